@@ -11,6 +11,8 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <stdlib.h>
+#include <string.h>
 #include "esp_jpg_decode.h"
 
 #include "esp_system.h"
@@ -38,6 +40,8 @@
 static const char* TAG = "esp_jpg_decode";
 #endif
 
+#define JPG_WORK_SIZE 3100
+
 typedef struct {
         jpg_scale_t scale;
         jpg_reader_cb reader;
@@ -93,9 +97,14 @@ static unsigned int _jpg_read(JDEC *decoder, uint8_t *buf, unsigned int len)
 
 esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg)
 {
-    static uint8_t work[3100];
     JDEC decoder;
     esp_jpg_decoder_t jpeg;
+    // Per call, so that concurrent decodes do not share it
+    uint8_t *work = (uint8_t *)malloc(JPG_WORK_SIZE);
+    if (!work) {
+        ESP_LOGE(TAG, "JPG work area malloc failed");
+        return ESP_ERR_NO_MEM;
+    }
 
     jpeg.len = len;
     jpeg.reader = reader;
@@ -104,9 +113,10 @@ esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jp
     jpeg.scale = scale;
     jpeg.index = 0;
 
-    JRESULT jres = jd_prepare(&decoder, _jpg_read, work, 3100, &jpeg);
+    JRESULT jres = jd_prepare(&decoder, _jpg_read, work, JPG_WORK_SIZE, &jpeg);
     if(jres != JDR_OK){
         ESP_LOGE(TAG, "JPG Header Parse Failed! %s", jd_errors[jres]);
+        free(work);
         return ESP_FAIL;
     }
 
@@ -119,6 +129,7 @@ esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jp
     jres = jd_decomp(&decoder, _jpg_write, (uint8_t)jpeg.scale);
     //output end
     writer(arg, output_width, output_height, output_width, output_height, NULL);
+    free(work);
 
     if (jres != JDR_OK) {
         ESP_LOGE(TAG, "JPG Decompression Failed! %s", jd_errors[jres]);
@@ -132,3 +143,207 @@ esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jp
     return ESP_OK;
 }
 
+
+// Decoder context: the tjpgd work area and the MCU row buffer live here instead of in statics
+struct jpg_decoder_s {
+    uint8_t work[JPG_WORK_SIZE];
+    uint8_t *rows;          // one MCU row of the ROI, BGR
+    size_t rows_size;
+
+    // Per decode
+    const uint8_t *src;
+    size_t len;
+    size_t index;
+    uint16_t width;         // scaled image size
+    uint16_t height;
+    jpg_rect_t roi;
+    jpg_rows_cb rows_cb;
+    void *arg;
+    uint8_t *out;           // caller buffer, NULL when streaming rows
+    size_t stride;
+    bool done;
+};
+
+jpg_decoder_t *jpg_decoder_create(void)
+{
+    jpg_decoder_t *ctx = (jpg_decoder_t *)malloc(sizeof(jpg_decoder_t));
+    if (!ctx) {
+        ESP_LOGE(TAG, "JPG decoder malloc failed");
+        return NULL;
+    }
+    ctx->rows = NULL;
+    ctx->rows_size = 0;
+    return ctx;
+}
+
+void jpg_decoder_destroy(jpg_decoder_t *ctx)
+{
+    if (!ctx) {
+        return;
+    }
+    free(ctx->rows);
+    free(ctx);
+}
+
+static unsigned int _ctx_read(JDEC *decoder, uint8_t *buf, unsigned int len)
+{
+    jpg_decoder_t *ctx = (jpg_decoder_t *)decoder->device;
+    if (len > ctx->len - ctx->index) {
+        len = ctx->len - ctx->index;
+    }
+    if (buf) {
+        memcpy(buf, ctx->src + ctx->index, len);
+    }
+    ctx->index += len;
+    return len;
+}
+
+// Copies the part of an output block that falls inside the ROI, swapping RGB to BGR
+static void _ctx_copy(jpg_decoder_t *ctx, const uint8_t *data, const JRECT *rect, uint8_t *dst, size_t stride, uint16_t dst_top)
+{
+    uint16_t bw = rect->right + 1 - rect->left;
+    uint16_t x0 = rect->left > ctx->roi.x ? rect->left : ctx->roi.x;
+    uint16_t x1 = rect->right + 1 < ctx->roi.x + ctx->roi.w ? rect->right + 1 : ctx->roi.x + ctx->roi.w;
+    uint16_t y0 = rect->top > ctx->roi.y ? rect->top : ctx->roi.y;
+    uint16_t y1 = rect->bottom + 1 < ctx->roi.y + ctx->roi.h ? rect->bottom + 1 : ctx->roi.y + ctx->roi.h;
+
+    for (uint16_t y = y0; y < y1; y++) {
+        const uint8_t *s = data + ((y - rect->top) * bw + (x0 - rect->left)) * 3;
+        uint8_t *d = dst + (y - dst_top) * stride + (x0 - ctx->roi.x) * 3;
+        for (uint16_t x = x0; x < x1; x++, s += 3, d += 3) {
+            d[0] = s[2];
+            d[1] = s[1];
+            d[2] = s[0];
+        }
+    }
+}
+
+static unsigned int _ctx_write(JDEC *decoder, void *bitmap, JRECT *rect)
+{
+    jpg_decoder_t *ctx = (jpg_decoder_t *)decoder->device;
+    const jpg_rect_t *roi = &ctx->roi;
+    bool row_end = rect->right + 1 >= ctx->width;
+
+    if (rect->top >= roi->y + roi->h) {
+        // Past the ROI, nothing left to decode
+        ctx->done = true;
+        return 0;
+    }
+    if (rect->bottom < roi->y) {
+        return 1;
+    }
+
+    if (rect->right >= roi->x && rect->left < roi->x + roi->w) {
+        if (ctx->out) {
+            _ctx_copy(ctx, (const uint8_t *)bitmap, rect, ctx->out, ctx->stride, roi->y);
+        } else {
+            _ctx_copy(ctx, (const uint8_t *)bitmap, rect, ctx->rows, roi->w * 3, rect->top);
+        }
+    }
+
+    if (!row_end) {
+        return 1;
+    }
+    uint16_t y0 = rect->top > roi->y ? rect->top : roi->y;
+    uint16_t y1 = rect->bottom + 1 < roi->y + roi->h ? rect->bottom + 1 : roi->y + roi->h;
+    if (ctx->rows_cb && !ctx->rows_cb(ctx->arg, y0 - roi->y, y1 - y0, ctx->rows + (y0 - rect->top) * roi->w * 3, roi->w * 3)) {
+        return 0;
+    }
+    if (y1 == roi->y + roi->h) {
+        ctx->done = true;
+        return 0;
+    }
+    return 1;
+}
+
+static esp_err_t _ctx_prepare(jpg_decoder_t *ctx, JDEC *decoder, const uint8_t *src, size_t len, jpg_scale_t scale)
+{
+    ctx->src = src;
+    ctx->len = len;
+    ctx->index = 0;
+    ctx->done = false;
+
+    JRESULT jres = jd_prepare(decoder, _ctx_read, ctx->work, JPG_WORK_SIZE, ctx);
+    if (jres != JDR_OK) {
+        ESP_LOGE(TAG, "JPG Header Parse Failed! %s", jd_errors[jres]);
+        return ESP_FAIL;
+    }
+    ctx->width = decoder->width / (1 << (uint8_t)scale);
+    ctx->height = decoder->height / (1 << (uint8_t)scale);
+    return ESP_OK;
+}
+
+esp_err_t jpg_decoder_get_size(jpg_decoder_t *ctx, const uint8_t *src, size_t len, jpg_scale_t scale, uint16_t *width, uint16_t *height)
+{
+    JDEC decoder;
+    esp_err_t err = _ctx_prepare(ctx, &decoder, src, len, scale);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *width = ctx->width;
+    *height = ctx->height;
+    return ESP_OK;
+}
+
+static esp_err_t _ctx_decode(jpg_decoder_t *ctx, const uint8_t *src, size_t len, jpg_scale_t scale, const jpg_rect_t *roi)
+{
+    JDEC decoder;
+    esp_err_t err = _ctx_prepare(ctx, &decoder, src, len, scale);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (roi) {
+        if (!roi->w || !roi->h || roi->x + roi->w > ctx->width || roi->y + roi->h > ctx->height) {
+            ESP_LOGE(TAG, "ROI %ux%u at %u,%u outside of %ux%u", roi->w, roi->h, roi->x, roi->y, ctx->width, ctx->height);
+            return ESP_ERR_INVALID_ARG;
+        }
+        ctx->roi = *roi;
+    } else {
+        ctx->roi.x = 0;
+        ctx->roi.y = 0;
+        ctx->roi.w = ctx->width;
+        ctx->roi.h = ctx->height;
+    }
+
+    if (!ctx->out) {
+        // One MCU row of the ROI, kept across calls while it is big enough
+        uint16_t mcu_h = (decoder.msy * 8) >> (uint8_t)scale;
+        size_t rows_size = (size_t)ctx->roi.w * 3 * (mcu_h ? mcu_h : 1);
+        if (rows_size > ctx->rows_size) {
+            free(ctx->rows);
+            ctx->rows_size = 0;
+            ctx->rows = (uint8_t *)malloc(rows_size);
+            if (!ctx->rows) {
+                ESP_LOGE(TAG, "JPG row buffer malloc failed");
+                return ESP_ERR_NO_MEM;
+            }
+            ctx->rows_size = rows_size;
+        }
+    }
+
+    JRESULT jres = jd_decomp(&decoder, _ctx_write, (uint8_t)scale);
+    if (jres != JDR_OK && !(jres == JDR_INTR && ctx->done)) {
+        ESP_LOGE(TAG, "JPG Decompression Failed! %s", jd_errors[jres]);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t jpg_decoder_rows(jpg_decoder_t *ctx, const uint8_t *src, size_t len, jpg_scale_t scale, const jpg_rect_t *roi, jpg_rows_cb cb, void *arg)
+{
+    ctx->rows_cb = cb;
+    ctx->arg = arg;
+    ctx->out = NULL;
+    ctx->stride = 0;
+    return _ctx_decode(ctx, src, len, scale, roi);
+}
+
+esp_err_t jpg_decoder_to_buf(jpg_decoder_t *ctx, const uint8_t *src, size_t len, jpg_scale_t scale, const jpg_rect_t *roi, uint8_t *out, size_t stride)
+{
+    ctx->rows_cb = NULL;
+    ctx->arg = NULL;
+    ctx->out = out;
+    ctx->stride = stride;
+    return _ctx_decode(ctx, src, len, scale, roi);
+}
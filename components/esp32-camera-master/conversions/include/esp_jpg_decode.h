@@ -36,6 +36,88 @@ typedef bool (* jpg_writer_cb)(void * arg, uint16_t x, uint16_t y, uint16_t w, u
 
 esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg);
 
+/**
+ * @brief Region of the decoded image, in output (scaled) pixels
+ */
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+} jpg_rect_t;
+
+/**
+ * @brief Opaque JPEG decoder context, owns the decoder work area and row buffer
+ *
+ * One context decodes one image at a time, give each task its own.
+ */
+typedef struct jpg_decoder_s jpg_decoder_t;
+
+/**
+ * @brief Called with consecutive rows of the decoded region, one MCU row (8 or 16 lines, fewer
+ * when scaled or clipped) at a time
+ *
+ * @param arg       Pointer passed to jpg_decoder_rows()
+ * @param y         First row, relative to the top of the region
+ * @param h         Number of rows
+ * @param data      Pixels in the PIXFORMAT_RGB888 layout of this component (B, G, R), valid during the call only
+ * @param stride    Bytes between rows, region width * 3
+ *
+ * @return true to continue, false to abort the decode
+ */
+typedef bool (* jpg_rows_cb)(void * arg, uint16_t y, uint16_t h, const uint8_t *data, size_t stride);
+
+/**
+ * @brief Allocate a decoder context
+ *
+ * @return the context or NULL when out of memory
+ */
+jpg_decoder_t *jpg_decoder_create(void);
+
+/**
+ * @brief Free a decoder context
+ */
+void jpg_decoder_destroy(jpg_decoder_t *ctx);
+
+/**
+ * @brief Read the output size of a JPEG without decoding it
+ */
+esp_err_t jpg_decoder_get_size(jpg_decoder_t *ctx, const uint8_t *src, size_t len, jpg_scale_t scale, uint16_t *width, uint16_t *height);
+
+/**
+ * @brief Decode a JPEG, or a region of it, streaming MCU rows to a callback
+ *
+ * Only one MCU row of the region is buffered. Decoding stops after the last row of the
+ * region: the entropy-coded data above it still has to be parsed, the rest of the image
+ * is not touched.
+ *
+ * @param ctx       Context returned by jpg_decoder_create()
+ * @param src       JPEG data
+ * @param len       Length of the JPEG data
+ * @param scale     Output scale
+ * @param roi       Region to decode, in scaled pixels, NULL for the whole image
+ * @param cb        Row callback
+ * @param arg       Pointer passed to the callback
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a region outside of the image
+ */
+esp_err_t jpg_decoder_rows(jpg_decoder_t *ctx, const uint8_t *src, size_t len, jpg_scale_t scale, const jpg_rect_t *roi, jpg_rows_cb cb, void *arg);
+
+/**
+ * @brief Decode a JPEG, or a region of it, into a caller provided buffer
+ *
+ * @param ctx       Context returned by jpg_decoder_create()
+ * @param src       JPEG data
+ * @param len       Length of the JPEG data
+ * @param scale     Output scale
+ * @param roi       Region to decode, in scaled pixels, NULL for the whole image
+ * @param out       Output in the PIXFORMAT_RGB888 layout of this component (B, G, R), region size
+ * @param stride    Bytes between output rows, at least region width * 3
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a region outside of the image
+ */
+esp_err_t jpg_decoder_to_buf(jpg_decoder_t *ctx, const uint8_t *src, size_t len, jpg_scale_t scale, const jpg_rect_t *roi, uint8_t *out, size_t stride);
+
 #ifdef __cplusplus
 }
 #endif
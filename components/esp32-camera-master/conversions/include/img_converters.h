@@ -26,6 +26,83 @@ extern "C" {
 
 typedef size_t (* jpg_out_cb)(void * arg, size_t index, const void* data, size_t len);
 
+/**
+ * @brief Opaque persistent JPEG encoder context
+ */
+typedef struct jpg_encoder_s jpg_encoder_t;
+
+/**
+ * @brief One contiguous piece of a chunked JPEG
+ */
+typedef struct {
+    const uint8_t * buf;    /*!< Chunk data */
+    size_t len;             /*!< Length of the chunk in bytes */
+} jpg_chunk_t;
+
+/**
+ * @brief Opaque JPEG image held in fixed-size chunks (CONFIG_CAMERA_JPEG_CHUNK_SIZE)
+ */
+typedef struct jpg_chunked_s jpg_chunked_t;
+
+/**
+ * @brief Chroma subsampling of the software JPEG encoder
+ */
+typedef enum {
+    JPG_SUBSAMPLING_420,    /*!< H2V2, 16x16 MCU, smallest output (default) */
+    JPG_SUBSAMPLING_422,    /*!< H2V1, 16x8 MCU, matches YUV422 sources: no vertical chroma averaging, 8 buffered rows */
+    JPG_SUBSAMPLING_444,    /*!< H1V1, 8x8 MCU, full chroma resolution */
+    JPG_SUBSAMPLING_GRAY,   /*!< Luminance only */
+} jpg_subsampling_t;
+
+/**
+ * @brief Forward DCT of the software JPEG encoder
+ */
+typedef enum {
+    JPG_DCT_DEFAULT,        /*!< As selected by CONFIG_CAMERA_JPEG_DCT */
+    JPG_DCT_ISLOW,          /*!< Accurate integer DCT */
+    JPG_DCT_IFAST,          /*!< Fast fixed-point AAN DCT */
+} jpg_dct_t;
+
+/**
+ * @brief Software JPEG encoder options
+ */
+typedef struct {
+    uint8_t quality;                /*!< JPEG quality, 1-100 */
+    jpg_subsampling_t subsampling;  /*!< Ignored for GRAYSCALE sources, those are always luminance only */
+    jpg_dct_t dct;
+    uint16_t restart_interval;      /*!< MCUs between RSTn markers, 0 disables them */
+    bool optimize_huffman;          /*!< Two-pass encode with per-image Huffman tables, see fmt2jpg_optimized() */
+} jpg_encode_options_t;
+
+#define JPG_ENCODE_OPTIONS_DEFAULT(q) {   \
+        .quality = (q),                     \
+        .subsampling = JPG_SUBSAMPLING_420, \
+        .dct = JPG_DCT_DEFAULT,             \
+        .restart_interval = 0,              \
+        .optimize_huffman = false,          \
+    }
+
+/**
+ * @brief Quality setting a rate controller drives
+ */
+typedef enum {
+    JPG_RATE_CTRL_ENCODER,  /*!< Software encoder quality, 1-100, higher is better */
+    JPG_RATE_CTRL_SENSOR,   /*!< Sensor JPEG quality (sensor_t::set_quality), 0-63, lower is better */
+} jpg_rate_ctrl_mode_t;
+
+/**
+ * @brief Frame to frame JPEG rate controller state
+ */
+typedef struct {
+    jpg_rate_ctrl_mode_t mode;
+    size_t target_size;     /*!< Byte budget per frame, 0 disables the controller */
+    int best_quality;       /*!< Quality is kept between these two, set by jpg_rate_ctrl_init() */
+    int worst_quality;
+    int quality;            /*!< Quality to use for the next frame */
+    float scale;            /*!< Linear quantization scale behind quality */
+    int64_t changed_us;     /*!< When quality last changed, see jpg_rate_ctrl_update_frame() */
+} jpg_rate_ctrl_t;
+
 /**
  * @brief Convert image buffer to JPEG
  *
@@ -54,6 +131,99 @@ bool fmt2jpg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, p
  */
 bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg);
 
+/**
+ * @brief Convert image buffer to JPEG with encoder options
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param opts      Encoder options, start from JPG_ENCODE_OPTIONS_DEFAULT()
+ * @param cp        Callback to be called to write the bytes of the output JPEG
+ * @param arg       Pointer to be passed to the callback
+ *
+ * @return true on success
+ */
+bool fmt2jpg_cb_opts(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_options_t *opts, jpg_out_cb cb, void * arg);
+
+/**
+ * @brief Convert camera frame buffer to JPEG with encoder options
+ *
+ * @param fb        Source camera frame buffer
+ * @param opts      Encoder options, start from JPG_ENCODE_OPTIONS_DEFAULT()
+ * @param cp        Callback to be called to write the bytes of the output JPEG
+ * @param arg       Pointer to be passed to the callback
+ *
+ * @return true on success
+ */
+bool frame2jpg_cb_opts(camera_fb_t * fb, const jpg_encode_options_t *opts, jpg_out_cb cb, void * arg);
+
+/**
+ * @brief Create a persistent JPEG encoder context
+ *
+ * The context keeps its line buffers and quantization tables between frames
+ * and only reallocates or recomputes them when the frame size, format or
+ * quality changes. A context must not be used by two tasks at once.
+ *
+ * @return the context or NULL if out of memory
+ */
+jpg_encoder_t *jpg_encoder_create(void);
+
+/**
+ * @brief Free a JPEG encoder context and its buffers
+ *
+ * @param ctx       Context returned by jpg_encoder_create(), may be NULL
+ */
+void jpg_encoder_destroy(jpg_encoder_t *ctx);
+
+/**
+ * @brief Convert image buffer to JPEG using a persistent encoder context
+ *
+ * @param ctx       Context returned by jpg_encoder_create()
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param quality   JPEG quality of the resulting image
+ * @param cp        Callback to be called to write the bytes of the output JPEG
+ * @param arg       Pointer to be passed to the callback
+ *
+ * @return true on success
+ */
+bool fmt2jpg_ctx_cb(jpg_encoder_t *ctx, uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_out_cb cb, void * arg);
+
+/**
+ * @brief Convert camera frame buffer to JPEG using a persistent encoder context
+ *
+ * @param ctx       Context returned by jpg_encoder_create()
+ * @param fb        Source camera frame buffer
+ * @param quality   JPEG quality of the resulting image
+ * @param cp        Callback to be called to write the bytes of the output JPEG
+ * @param arg       Pointer to be passed to the callback
+ *
+ * @return true on success
+ */
+bool frame2jpg_ctx_cb(jpg_encoder_t *ctx, camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg);
+
+/**
+ * @brief Convert image buffer to JPEG using a persistent encoder context and encoder options
+ *
+ * @param ctx       Context returned by jpg_encoder_create()
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param opts      Encoder options, start from JPG_ENCODE_OPTIONS_DEFAULT()
+ * @param cp        Callback to be called to write the bytes of the output JPEG
+ * @param arg       Pointer to be passed to the callback
+ *
+ * @return true on success
+ */
+bool fmt2jpg_ctx_cb_opts(jpg_encoder_t *ctx, uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_options_t *opts, jpg_out_cb cb, void * arg);
+
 /**
  * @brief Convert image buffer to JPEG buffer
  *
@@ -83,6 +253,224 @@ bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixf
  */
 bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len);
 
+/**
+ * @brief Convert image buffer to JPEG buffer with per-image optimized Huffman tables
+ *
+ * Two-pass encode for snapshots: the quantized coefficients of the whole image are kept
+ * (in PSRAM when available, 128 bytes per 8x8 block) while symbol statistics are gathered,
+ * then coded with Huffman tables built for this image. Output is typically 5-15% smaller
+ * than fmt2jpg() at the same quality and decodes to the same pixels. Nothing is written
+ * before the last scanline is encoded, so streaming should keep using the one-pass calls.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it.
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool fmt2jpg_optimized(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert camera frame buffer to JPEG buffer with per-image optimized Huffman tables
+ *
+ * @param fb        Source camera frame buffer
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Pointer to be populated with the address of the resulting buffer
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool frame2jpg_optimized(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert image buffer to JPEG buffer with encoder options
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param opts      Encoder options, start from JPG_ENCODE_OPTIONS_DEFAULT()
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it.
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool fmt2jpg_opts(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_options_t *opts, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert camera frame buffer to JPEG buffer with encoder options
+ *
+ * @param fb        Source camera frame buffer
+ * @param opts      Encoder options, start from JPG_ENCODE_OPTIONS_DEFAULT()
+ * @param out       Pointer to be populated with the address of the resulting buffer
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool frame2jpg_opts(camera_fb_t * fb, const jpg_encode_options_t *opts, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert image buffer to a chunked JPEG
+ *
+ * The output grows in fixed-size blocks taken from a pool instead of a
+ * buffer allocated up front. Encoding fails once the output grows past
+ * CONFIG_CAMERA_JPEG_MAX_SIZE.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Pointer to be populated with the resulting image.
+ *                  You MUST release it with jpg_chunked_free() once you are done with it.
+ *
+ * @return true on success
+ */
+bool fmt2jpg_chunked(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_chunked_t ** out);
+
+/**
+ * @brief Convert camera frame buffer to a chunked JPEG
+ *
+ * @param fb        Source camera frame buffer
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Pointer to be populated with the resulting image
+ *
+ * @return true on success
+ */
+bool frame2jpg_chunked(camera_fb_t * fb, uint8_t quality, jpg_chunked_t ** out);
+
+/**
+ * @brief Initialize a JPEG rate controller
+ *
+ * The controller adjusts the quantization scale from frame to frame so that
+ * frame sizes settle around target_size. Quality is kept within 95-10 for the
+ * encoder and 4-63 for the sensor, adjust best_quality and worst_quality and
+ * call jpg_rate_ctrl_set_quality() to change that.
+ *
+ * @param rc            Controller state
+ * @param mode          Whether the quality is for the software encoder or the sensor
+ * @param target_size   Byte budget per frame, see jpg_rate_ctrl_target_size()
+ * @param quality       Quality of the first frame
+ */
+void jpg_rate_ctrl_init(jpg_rate_ctrl_t *rc, jpg_rate_ctrl_mode_t mode, size_t target_size, int quality);
+
+/**
+ * @brief Restart a JPEG rate controller from the given quality
+ */
+void jpg_rate_ctrl_set_quality(jpg_rate_ctrl_t *rc, int quality);
+
+/**
+ * @brief Byte budget per frame for a bitrate in bits per second at a frame rate
+ */
+size_t jpg_rate_ctrl_target_size(uint32_t bitrate, uint32_t fps);
+
+/**
+ * @brief Feed the size of the last frame to a JPEG rate controller
+ *
+ * @param rc            Controller state
+ * @param frame_size    Size in bytes of the frame encoded with rc->quality
+ *
+ * @return the quality to use for the next frame
+ */
+int jpg_rate_ctrl_update(jpg_rate_ctrl_t *rc, size_t frame_size);
+
+/**
+ * @brief Feed the size of a frame the sensor compressed to a JPEG rate controller
+ *
+ * A quality change only reaches frames that start after the register write, while
+ * up to fb_count frames captured before it are still queued. Those are skipped here,
+ * feeding them back would correct the same error again on every one of them and
+ * overshoot. Times are those of esp_timer_get_time(), like camera_fb_t::timestamp.
+ *
+ * @param rc            Controller state
+ * @param frame_size    Size in bytes of the frame
+ * @param frame_us      Start of the frame (VSYNC)
+ * @param now_us        Current time, recorded if the quality changes
+ *
+ * @return the quality to set on the sensor
+ */
+int jpg_rate_ctrl_update_frame(jpg_rate_ctrl_t *rc, size_t frame_size, int64_t frame_us, int64_t now_us);
+
+/**
+ * @brief Convert camera frame buffer to JPEG buffer at the quality picked by a rate controller
+ *
+ * Encodes with rc->quality, then feeds the resulting size back to the controller.
+ *
+ * @param fb        Source camera frame buffer
+ * @param rc        Rate controller initialized with JPG_RATE_CTRL_ENCODER
+ * @param out       Pointer to be populated with the address of the resulting buffer
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool frame2jpg_rate_ctrl(camera_fb_t * fb, jpg_rate_ctrl_t * rc, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Scatter-gather view of a chunked JPEG
+ *
+ * @param jpg       Chunked JPEG
+ * @param count     Pointer to be populated with the number of chunks
+ *
+ * @return the chunks, in stream order. Valid until jpg_chunked_free()
+ */
+const jpg_chunk_t * jpg_chunked_view(const jpg_chunked_t * jpg, size_t * count);
+
+/**
+ * @brief Total length in bytes of a chunked JPEG
+ */
+size_t jpg_chunked_len(const jpg_chunked_t * jpg);
+
+/**
+ * @brief Release a chunked JPEG, its chunks go back to the pool
+ *
+ * @param jpg       Chunked JPEG, may be NULL
+ */
+void jpg_chunked_free(jpg_chunked_t * jpg);
+
+/**
+ * @brief Convert image buffer to JPEG buffer using both cores
+ *
+ * The frame is split into two horizontal stripes of whole MCU rows, one restart
+ * interval each. The bottom stripe is encoded by a task on the other core while
+ * the calling task encodes the top one, and both are joined with an RST0 marker
+ * into a single baseline JPEG. Falls back to fmt2jpg() on single core builds and
+ * for frames of a single MCU row.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the source image
+ * @param height    Height in pixels of the source image
+ * @param format    Format of the source image
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it.
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool fmt2jpg_parallel(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert camera frame buffer to JPEG buffer using both cores
+ *
+ * @param fb        Source camera frame buffer
+ * @param quality   JPEG quality of the resulting image
+ * @param out       Pointer to be populated with the address of the resulting buffer
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool frame2jpg_parallel(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len);
+
 /**
  * @brief Convert image buffer to BMP buffer
  *
@@ -0,0 +1,126 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stddef.h>
+#include <math.h>
+#include "img_converters.h"
+
+// Frame size falls off slower than the quantization scale grows (roughly scale^-0.6),
+// so correct by a bit more than the size ratio: a scene change settles in one or two frames
+#define JPG_RATE_CTRL_GAIN      1.6f
+#define JPG_RATE_CTRL_DEADBAND  0.05f
+#define JPG_RATE_CTRL_MAX_STEP  4.0f
+
+// The controller works on a linear quantization scale. For the software encoder that is
+// the IJG scale percentage quality maps to, the sensor quality register already is one.
+static float quality_to_scale(jpg_rate_ctrl_mode_t mode, int quality)
+{
+    if (mode == JPG_RATE_CTRL_SENSOR) {
+        return quality;
+    }
+    if (quality < 50) {
+        return 5000.0f / quality;
+    }
+    return 200.0f - quality * 2;
+}
+
+static int scale_to_quality(jpg_rate_ctrl_mode_t mode, float scale)
+{
+    if (mode == JPG_RATE_CTRL_SENSOR) {
+        return lroundf(scale);
+    }
+    if (scale >= 100.0f) {
+        return lroundf(5000.0f / scale);
+    }
+    return lroundf((200.0f - scale) / 2);
+}
+
+void jpg_rate_ctrl_init(jpg_rate_ctrl_t *rc, jpg_rate_ctrl_mode_t mode, size_t target_size, int quality)
+{
+    rc->mode = mode;
+    rc->target_size = target_size;
+    rc->changed_us = 0;
+    if (mode == JPG_RATE_CTRL_SENSOR) {
+        rc->best_quality = 4;
+        rc->worst_quality = 63;
+    } else {
+        rc->best_quality = 95;
+        rc->worst_quality = 10;
+    }
+    jpg_rate_ctrl_set_quality(rc, quality);
+}
+
+void jpg_rate_ctrl_set_quality(jpg_rate_ctrl_t *rc, int quality)
+{
+    float min_scale = quality_to_scale(rc->mode, rc->best_quality);
+    float max_scale = quality_to_scale(rc->mode, rc->worst_quality);
+    rc->scale = quality_to_scale(rc->mode, quality);
+    if (rc->scale < min_scale) {
+        rc->scale = min_scale;
+    } else if (rc->scale > max_scale) {
+        rc->scale = max_scale;
+    }
+    rc->quality = scale_to_quality(rc->mode, rc->scale);
+}
+
+size_t jpg_rate_ctrl_target_size(uint32_t bitrate, uint32_t fps)
+{
+    if (!fps) {
+        return 0;
+    }
+    return bitrate / 8 / fps;
+}
+
+int jpg_rate_ctrl_update(jpg_rate_ctrl_t *rc, size_t frame_size)
+{
+    if (!rc->target_size || !frame_size) {
+        return rc->quality;
+    }
+
+    float ratio = (float)frame_size / rc->target_size;
+    if (fabsf(ratio - 1.0f) < JPG_RATE_CTRL_DEADBAND) {
+        return rc->quality;
+    }
+    if (ratio > JPG_RATE_CTRL_MAX_STEP) {
+        ratio = JPG_RATE_CTRL_MAX_STEP;
+    } else if (ratio < 1.0f / JPG_RATE_CTRL_MAX_STEP) {
+        ratio = 1.0f / JPG_RATE_CTRL_MAX_STEP;
+    }
+
+    float min_scale = quality_to_scale(rc->mode, rc->best_quality);
+    float max_scale = quality_to_scale(rc->mode, rc->worst_quality);
+    // The sensor scale starts at 0, keep it off zero so it can still move up
+    if (min_scale < 1.0f) {
+        min_scale = 1.0f;
+    }
+    rc->scale *= powf(ratio, JPG_RATE_CTRL_GAIN);
+    if (rc->scale < min_scale) {
+        rc->scale = min_scale;
+    } else if (rc->scale > max_scale) {
+        rc->scale = max_scale;
+    }
+    rc->quality = scale_to_quality(rc->mode, rc->scale);
+    return rc->quality;
+}
+
+int jpg_rate_ctrl_update_frame(jpg_rate_ctrl_t *rc, size_t frame_size, int64_t frame_us, int64_t now_us)
+{
+    if (frame_us <= rc->changed_us) {
+        return rc->quality;
+    }
+    int quality = rc->quality;
+    if (jpg_rate_ctrl_update(rc, frame_size) != quality) {
+        rc->changed_us = now_us;
+    }
+    return rc->quality;
+}
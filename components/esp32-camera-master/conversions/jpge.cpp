@@ -36,10 +36,20 @@ namespace jpge {
         return NULL;
 #endif
     }
+    // Large buffers that are only streamed through, PSRAM first
+    static inline void *jpge_malloc_psram(size_t nSize) {
+#if (CONFIG_SPIRAM_SUPPORT && (CONFIG_SPIRAM_USE_CAPS_ALLOC || CONFIG_SPIRAM_USE_MALLOC))
+        void * b = heap_caps_malloc(nSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if(b){
+            return b;
+        }
+#endif
+        return malloc(nSize);
+    }
     static inline void jpge_free(void *p) { free(p); }
 
     // Various JPEG enums and tables.
-    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_APP0 = 0xE0 };
+    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_RST0 = 0xD0, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_DRI = 0xDD, M_APP0 = 0xE0 };
     enum { DC_LUM_CODES = 12, AC_LUM_CODES = 256, DC_CHROMA_CODES = 12, AC_CHROMA_CODES = 256, MAX_HUFF_SYMBOLS = 257, MAX_HUFF_CODESIZE = 32 };
 
     static const uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
@@ -70,10 +80,14 @@ namespace jpge {
 
     const int YR = 19595, YG = 38470, YB = 7471, CB_R = -11059, CB_G = -21709, CB_B = 32768, CR_R = 32768, CR_G = -27439, CR_B = -5329;
 
-    static int32 m_last_quality = 0;
-    static int32 m_quantization_tables[2][64];
+    // Sensor YUV422 is BT.601 limited range, JFIF expects full range YCbCr
+    static bool m_yuv_lut_initialized = false;
+    static uint8 m_yuv_y_lut[256];
+    static uint8 m_yuv_c_lut[256];
 
     static bool m_huff_initialized = false;
+    static uint8 m_huff_size_scratch[257];
+    static uint m_huff_code_scratch[257];
     static uint m_huff_codes[4][256];
     static uint8 m_huff_code_sizes[4][256];
     static uint8 m_huff_bits[4][17];
@@ -111,6 +125,33 @@ namespace jpge {
         }
     }
 
+    static void init_yuv_luts() {
+        for (int i = 0; i < 256; i++) {
+            m_yuv_y_lut[i] = clamp(((i - 16) * 255 + 109) / 219);
+            m_yuv_c_lut[i] = clamp(128 + ((i - 128) * 255 + ((i < 128) ? -112 : 112)) / 224);
+        }
+    }
+
+    static void YUYV_to_YCC(uint8* pDst, const uint8* pSrc, int num_pixels) {
+        uint8 v = 128;
+        for ( ; num_pixels > 1; pDst += 6, pSrc += 4, num_pixels -= 2) {
+            const uint8 u = m_yuv_c_lut[pSrc[1]];
+            v = m_yuv_c_lut[pSrc[3]];
+            pDst[0] = m_yuv_y_lut[pSrc[0]]; pDst[1] = u; pDst[2] = v;
+            pDst[3] = m_yuv_y_lut[pSrc[2]]; pDst[4] = u; pDst[5] = v;
+        }
+        // An odd last pixel ends the scanline after its Y and U, it takes the V of the pair before
+        if (num_pixels) {
+            pDst[0] = m_yuv_y_lut[pSrc[0]]; pDst[1] = m_yuv_c_lut[pSrc[1]]; pDst[2] = v;
+        }
+    }
+
+    static void YUYV_to_Y(uint8* pDst, const uint8* pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst++, pSrc += 2, num_pixels--) {
+            pDst[0] = m_yuv_y_lut[pSrc[0]];
+        }
+    }
+
     // Forward DCT - DCT derived from jfdctint.
     enum { CONST_BITS = 13, ROW_BITS = 2 };
 #define DCT_DESCALE(x, n) (((x) + (((int32)1) << ((n) - 1))) >> (n))
@@ -147,12 +188,71 @@ namespace jpge {
         }
     }
 
+    // Forward DCT - AAN DCT derived from jfdctfst.
+    // Each 1D pass transforms the 8 columns of the block side by side, so the inner loop is
+    // plain element-wise int32 arithmetic over contiguous lanes that the compiler can
+    // vectorize (SSE2/AVX2 on a host build, straight-line code on Xtensa).
+    // The result is left transposed and scaled up by 8 * aan(u) * aan(v), both of which are
+    // folded into the reciprocal quantization table (see compute_quant_recip_table()).
+    enum { FAST_CONST_BITS = 8, RECIP_BITS = 16, AAN_SCALE_BITS = 14 };
+#define FAST_MUL(var, c) (((var) * (c)) >> FAST_CONST_BITS)
+    static const int32 FIX_0_382683433 = 98, FIX_0_541196100 = 139, FIX_0_707106781 = 181, FIX_1_306562965 = 334;
+
+    // aan(u) * aan(v) scaled by 2^14, aan(0) = 1, aan(k) = cos(k*PI/16) * sqrt(2)
+    static const int16 s_aan_scales[64] = {
+        16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+        22725, 31521, 29692, 26722, 22725, 17855, 12299,  6270,
+        21407, 29692, 27969, 25172, 21407, 16819, 11585,  5906,
+        19266, 26722, 25172, 22654, 19266, 15137, 10426,  5315,
+        16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+        12873, 17855, 16819, 15137, 12873, 10114,  6967,  3552,
+         8867, 12299, 11585, 10426,  8867,  6967,  4799,  2446,
+         4520,  6270,  5906,  5315,  4520,  3552,  2446,  1247
+    };
+
+    static void DCT1D_fast_columns(int32 *p) {
+        for (int i = 0; i < 8; i++) {
+            int32 t0 = p[0*8+i] + p[7*8+i], t7 = p[0*8+i] - p[7*8+i];
+            int32 t1 = p[1*8+i] + p[6*8+i], t6 = p[1*8+i] - p[6*8+i];
+            int32 t2 = p[2*8+i] + p[5*8+i], t5 = p[2*8+i] - p[5*8+i];
+            int32 t3 = p[3*8+i] + p[4*8+i], t4 = p[3*8+i] - p[4*8+i];
+
+            // even part
+            int32 t10 = t0 + t3, t13 = t0 - t3, t11 = t1 + t2, t12 = t1 - t2;
+            int32 z1 = FAST_MUL(t12 + t13, FIX_0_707106781);
+            p[0*8+i] = t10 + t11; p[4*8+i] = t10 - t11;
+            p[2*8+i] = t13 + z1;  p[6*8+i] = t13 - z1;
+
+            // odd part
+            t10 = t4 + t5; t11 = t5 + t6; t12 = t6 + t7;
+            int32 z5 = FAST_MUL(t10 - t12, FIX_0_382683433);
+            int32 z2 = FAST_MUL(t10, FIX_0_541196100) + z5;
+            int32 z4 = FAST_MUL(t12, FIX_1_306562965) + z5;
+            int32 z3 = FAST_MUL(t11, FIX_0_707106781);
+            int32 z11 = t7 + z3, z13 = t7 - z3;
+            p[5*8+i] = z13 + z2; p[3*8+i] = z13 - z2;
+            p[1*8+i] = z11 + z4; p[7*8+i] = z11 - z4;
+        }
+    }
+
+    static inline void transpose_8_8(int32 *p) {
+        for (int r = 0; r < 8; r++) {
+            for (int c = r + 1; c < 8; c++) {
+                int32 t = p[r*8+c]; p[r*8+c] = p[c*8+r]; p[c*8+r] = t;
+            }
+        }
+    }
+
+    static void DCT2D_fast(int32 *p) {
+        DCT1D_fast_columns(p);
+        transpose_8_8(p);
+        DCT1D_fast_columns(p);
+    }
+
     // Compute the actual canonical Huffman codes/code sizes given the JPEG huff bits and val arrays.
-    static void compute_huffman_table(uint *codes, uint8 *code_sizes, uint8 *bits, uint8 *val)
+    static void compute_huffman_table(uint *codes, uint8 *code_sizes, uint8 *bits, uint8 *val, uint8 *huff_size, uint *huff_code)
     {
         int i, l, last_p, si;
-        static uint8 huff_size[257];
-        static uint huff_code[257];
         uint code;
 
         int p = 0;
@@ -183,6 +283,119 @@ namespace jpge {
         }
     }
 
+    // Huffman code optimization, from the original jpge.
+    struct sym_freq { uint m_key, m_sym_index; };
+
+    // Two-pass state, allocated only when m_two_pass_flag is set so it stays off the stack.
+    struct jpeg_encoder::huff_opt_t {
+        uint32 count[4][256];
+        uint codes[4][256];
+        uint8 code_sizes[4][256];
+        uint8 bits[4][17];
+        uint8 val[4][256];
+        sym_freq syms0[MAX_HUFF_SYMBOLS];
+        sym_freq syms1[MAX_HUFF_SYMBOLS];
+        uint32 hist[256 * 4];
+        uint8 huff_size[257];
+        uint huff_code[257];
+    };
+
+    // Radix sorts sym_freq[] array by 32-bit key m_key. Returns ptr to sorted values.
+    static inline sym_freq* radix_sort_syms(uint num_syms, sym_freq* pSyms0, sym_freq* pSyms1, uint32 *hist)
+    {
+        const uint cMaxPasses = 4;
+        memset(hist, 0, sizeof(hist[0]) * 256 * cMaxPasses);
+        for (uint i = 0; i < num_syms; i++) {
+            uint freq = pSyms0[i].m_key;
+            hist[freq & 0xFF]++;
+            hist[256 + ((freq >> 8) & 0xFF)]++;
+            hist[256*2 + ((freq >> 16) & 0xFF)]++;
+            hist[256*3 + ((freq >> 24) & 0xFF)]++;
+        }
+        sym_freq* pCur_syms = pSyms0, *pNew_syms = pSyms1;
+        uint total_passes = cMaxPasses;
+        while ((total_passes > 1) && (num_syms == hist[(total_passes - 1) * 256])) {
+            total_passes--;
+        }
+        for (uint pass_shift = 0, pass = 0; pass < total_passes; pass++, pass_shift += 8) {
+            const uint32* pHist = &hist[pass << 8];
+            uint offsets[256], cur_ofs = 0;
+            for (uint i = 0; i < 256; i++) {
+                offsets[i] = cur_ofs;
+                cur_ofs += pHist[i];
+            }
+            for (uint i = 0; i < num_syms; i++) {
+                pNew_syms[offsets[(pCur_syms[i].m_key >> pass_shift) & 0xFF]++] = pCur_syms[i];
+            }
+            sym_freq* t = pCur_syms; pCur_syms = pNew_syms; pNew_syms = t;
+        }
+        return pCur_syms;
+    }
+
+    // calculate_minimum_redundancy() originally written by: Alistair Moffat, alistair@cs.mu.oz.au, Jyrki Katajainen, jyrki@diku.dk, November 1996.
+    static void calculate_minimum_redundancy(sym_freq *A, int n)
+    {
+        int root, leaf, next, avbl, used, dpth;
+        if (n == 0) {
+            return;
+        } else if (n == 1) {
+            A[0].m_key = 1;
+            return;
+        }
+        A[0].m_key += A[1].m_key; root = 0; leaf = 2;
+        for (next = 1; next < n - 1; next++) {
+            if (leaf >= n || A[root].m_key < A[leaf].m_key) {
+                A[next].m_key = A[root].m_key; A[root++].m_key = next;
+            } else {
+                A[next].m_key = A[leaf++].m_key;
+            }
+            if (leaf >= n || (root < next && A[root].m_key < A[leaf].m_key)) {
+                A[next].m_key += A[root].m_key; A[root++].m_key = next;
+            } else {
+                A[next].m_key += A[leaf++].m_key;
+            }
+        }
+        A[n - 2].m_key = 0;
+        for (next = n - 3; next >= 0; next--) {
+            A[next].m_key = A[A[next].m_key].m_key + 1;
+        }
+        avbl = 1; used = dpth = 0; root = n - 2; next = n - 1;
+        while (avbl > 0) {
+            while (root >= 0 && (int)A[root].m_key == dpth) {
+                used++; root--;
+            }
+            while (avbl > used) {
+                A[next--].m_key = dpth; avbl--;
+            }
+            avbl = 2 * used; dpth++; used = 0;
+        }
+    }
+
+    // Limits canonical Huffman code table's max code size to max_code_size.
+    static void huffman_enforce_max_code_size(int *pNum_codes, int code_list_len, int max_code_size)
+    {
+        if (code_list_len <= 1) {
+            return;
+        }
+        for (int i = max_code_size + 1; i <= MAX_HUFF_CODESIZE; i++) {
+            pNum_codes[max_code_size] += pNum_codes[i];
+        }
+        uint32 total = 0;
+        for (int i = max_code_size; i > 0; i--) {
+            total += (((uint32)pNum_codes[i]) << (max_code_size - i));
+        }
+        while (total != (1UL << max_code_size)) {
+            pNum_codes[max_code_size]--;
+            for (int i = max_code_size - 1; i > 0; i--) {
+                if (pNum_codes[i]) {
+                    pNum_codes[i]--; pNum_codes[i + 1] += 2;
+                    break;
+                }
+            }
+            total--;
+        }
+    }
+
     void jpeg_encoder::flush_output_buffer()
     {
         if (m_out_buf_left != JPGE_OUT_BUF_SIZE) {
@@ -215,6 +428,14 @@ namespace jpge {
         }
     }
 
+    // Pad the last partial byte with 1 bits
+    void jpeg_encoder::flush_bits()
+    {
+        put_bits(0x7F, 7);
+        m_bit_buffer = 0;
+        m_bits_in = 0;
+    }
+
     void jpeg_encoder::emit_word(uint i)
     {
         emit_byte(uint8(i >> 8)); emit_byte(uint8(i & 0xFF));
@@ -294,11 +515,11 @@ namespace jpge {
     // Emit all Huffman tables.
     void jpeg_encoder::emit_dhts()
     {
-        emit_dht(m_huff_bits[0+0], m_huff_val[0+0], 0, false);
-        emit_dht(m_huff_bits[2+0], m_huff_val[2+0], 0, true);
+        emit_dht(m_pHuff_bits[0+0], m_pHuff_val[0+0], 0, false);
+        emit_dht(m_pHuff_bits[2+0], m_pHuff_val[2+0], 0, true);
         if (m_num_components == 3) {
-            emit_dht(m_huff_bits[0+1], m_huff_val[0+1], 1, false);
-            emit_dht(m_huff_bits[2+1], m_huff_val[2+1], 1, true);
+            emit_dht(m_pHuff_bits[0+1], m_pHuff_val[0+1], 1, false);
+            emit_dht(m_pHuff_bits[2+1], m_pHuff_val[2+1], 1, true);
         }
     }
 
@@ -321,6 +542,38 @@ namespace jpge {
         emit_byte(0);
     }
 
+    // Emit restart interval
+    void jpeg_encoder::emit_dri()
+    {
+        emit_marker(M_DRI);
+        emit_word(4);
+        emit_word(m_params.m_restart_interval);
+    }
+
+    void jpeg_encoder::emit_restart()
+    {
+        flush_bits();
+        emit_marker(M_RST0 + (m_restart_num & 7));
+        m_restart_num++;
+        memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+    }
+
+    // Called before coding each MCU
+    inline void jpeg_encoder::next_mcu()
+    {
+        if (m_params.m_restart_interval) {
+            if (!m_restart_mcus_left) {
+                if (m_pass_num == 1) {
+                    memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+                } else {
+                    emit_restart();
+                }
+                m_restart_mcus_left = m_params.m_restart_interval;
+            }
+            m_restart_mcus_left--;
+        }
+    }
+
     void jpeg_encoder::load_block_8_8_grey(int x)
     {
         uint8 *pSrc;
@@ -406,6 +659,118 @@ namespace jpge {
         }
     }
 
+    void jpeg_encoder::load_quantized_coefficients_fast(int component_num)
+    {
+        const uint32 *r = m_quantization_recip[component_num > 0];
+        int16 q[64];
+        // branchless round-half-up of |x| * (1 / divisor), kept element-wise so it vectorizes
+        for (int i = 0; i < 64; i++)
+        {
+            int32 j = m_sample_array[i];
+            int32 sign = j >> 31;
+            uint32 a = static_cast<uint32>((j ^ sign) - sign);
+            int32 v = static_cast<int32>((a * r[i] + (1U << (RECIP_BITS - 1))) >> RECIP_BITS);
+            q[i] = static_cast<int16>((v ^ sign) - sign);
+        }
+        // m_sample_array is transposed, so zig-zag through the transposed order
+        for (int i = 0; i < 64; i++)
+        {
+            const uint8 z = s_zag[i];
+            m_coefficient_array[i] = q[((z & 7) << 3) | (z >> 3)];
+        }
+    }
+
+    void jpeg_encoder::code_coefficients_pass_one(int component_num)
+    {
+        int i, run_len, nbits, temp1;
+        int16 *src = m_coefficient_array;
+        uint32 *dc_count = m_pHuff_opt->count[0 + (component_num > 0)];
+        uint32 *ac_count = m_pHuff_opt->count[2 + (component_num > 0)];
+
+        temp1 = src[0] - m_last_dc_val[component_num];
+        m_last_dc_val[component_num] = src[0];
+        if (temp1 < 0) {
+            temp1 = -temp1;
+        }
+
+        nbits = 0;
+        while (temp1) {
+            nbits++; temp1 >>= 1;
+        }
+
+        dc_count[nbits]++;
+        for (run_len = 0, i = 1; i < 64; i++) {
+            if ((temp1 = m_coefficient_array[i]) == 0) {
+                run_len++;
+            } else {
+                while (run_len >= 16) {
+                    ac_count[0xF0]++;
+                    run_len -= 16;
+                }
+                if (temp1 < 0) {
+                    temp1 = -temp1;
+                }
+                nbits = 1;
+                while (temp1 >>= 1) {
+                    nbits++;
+                }
+                ac_count[(run_len << 4) + nbits]++;
+                run_len = 0;
+            }
+        }
+        if (run_len) {
+            ac_count[0]++;
+        }
+    }
+
+    // Generates an optimized Huffman table.
+    void jpeg_encoder::optimize_huffman_table(int table_num, int table_len)
+    {
+        huff_opt_t *opt = m_pHuff_opt;
+        opt->syms0[0].m_key = 1; opt->syms0[0].m_sym_index = 0;  // dummy symbol, assures that no valid code contains all 1's
+        int num_used_syms = 1;
+        const uint32 *pSym_count = &opt->count[table_num][0];
+        for (int i = 0; i < table_len; i++) {
+            if (pSym_count[i]) {
+                opt->syms0[num_used_syms].m_key = pSym_count[i];
+                opt->syms0[num_used_syms++].m_sym_index = i + 1;
+            }
+        }
+        sym_freq* pSyms = radix_sort_syms(num_used_syms, opt->syms0, opt->syms1, opt->hist);
+        calculate_minimum_redundancy(pSyms, num_used_syms);
+
+        // Count the # of symbols of each code size.
+        int num_codes[1 + MAX_HUFF_CODESIZE];
+        memset(num_codes, 0, sizeof(num_codes));
+        for (int i = 0; i < num_used_syms; i++) {
+            num_codes[pSyms[i].m_key]++;
+        }
+
+        const uint JPGE_CODE_SIZE_LIMIT = 16; // the maximum possible size of a JPEG Huffman code (valid range is [9,16] - 9 vs. 8 because of the dummy symbol)
+        huffman_enforce_max_code_size(num_codes, num_used_syms, JPGE_CODE_SIZE_LIMIT);
+
+        // Compute bits array, which contains the # of symbols per code size.
+        memset(opt->bits[table_num], 0, sizeof(opt->bits[table_num]));
+        for (int i = 1; i <= (int)JPGE_CODE_SIZE_LIMIT; i++) {
+            opt->bits[table_num][i] = static_cast<uint8>(num_codes[i]);
+        }
+
+        // Remove the dummy symbol added above, which must be in largest bucket.
+        for (int i = JPGE_CODE_SIZE_LIMIT; i >= 1; i--) {
+            if (opt->bits[table_num][i]) {
+                opt->bits[table_num][i]--;
+                break;
+            }
+        }
+
+        // Compute the val array, which contains the symbol indices sorted by code size (smallest to largest).
+        for (int i = num_used_syms - 1; i >= 1; i--) {
+            opt->val[table_num][num_used_syms - 1 - i] = static_cast<uint8>(pSyms[i].m_sym_index - 1);
+        }
+
+        compute_huffman_table(opt->codes[table_num], opt->code_sizes[table_num], opt->bits[table_num], opt->val[table_num], opt->huff_size, opt->huff_code);
+    }
+
     void jpeg_encoder::code_coefficients_pass_two(int component_num)
     {
         int i, j, run_len, nbits, temp1, temp2;
@@ -415,13 +780,13 @@ namespace jpge {
 
         if (component_num == 0)
         {
-            codes[0] = m_huff_codes[0 + 0]; codes[1] = m_huff_codes[2 + 0];
-            code_sizes[0] = m_huff_code_sizes[0 + 0]; code_sizes[1] = m_huff_code_sizes[2 + 0];
+            codes[0] = m_pHuff_codes[0 + 0]; codes[1] = m_pHuff_codes[2 + 0];
+            code_sizes[0] = m_pHuff_code_sizes[0 + 0]; code_sizes[1] = m_pHuff_code_sizes[2 + 0];
         }
         else
         {
-            codes[0] = m_huff_codes[0 + 1]; codes[1] = m_huff_codes[2 + 1];
-            code_sizes[0] = m_huff_code_sizes[0 + 1]; code_sizes[1] = m_huff_code_sizes[2 + 1];
+            codes[0] = m_pHuff_codes[0 + 1]; codes[1] = m_pHuff_codes[2 + 1];
+            code_sizes[0] = m_pHuff_code_sizes[0 + 1]; code_sizes[1] = m_pHuff_code_sizes[2 + 1];
         }
 
         temp1 = temp2 = pSrc[0] - m_last_dc_val[component_num];
@@ -472,9 +837,20 @@ namespace jpge {
 
     void jpeg_encoder::code_block(int component_num)
     {
-        DCT2D(m_sample_array);
-        load_quantized_coefficients(component_num);
-        code_coefficients_pass_two(component_num);
+        if (m_params.m_dct_method == DCT_IFAST) {
+            DCT2D_fast(m_sample_array);
+            load_quantized_coefficients_fast(component_num);
+        } else {
+            DCT2D(m_sample_array);
+            load_quantized_coefficients(component_num);
+        }
+        if (m_pass_num == 1) {
+            memcpy(m_pCoefs_end, m_coefficient_array, sizeof(m_coefficient_array));
+            m_pCoefs_end += 64;
+            code_coefficients_pass_one(component_num);
+        } else {
+            code_coefficients_pass_two(component_num);
+        }
     }
 
     void jpeg_encoder::process_mcu_row()
@@ -483,6 +859,7 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                next_mcu();
                 load_block_8_8_grey(i); code_block(0);
             }
         }
@@ -490,6 +867,7 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                next_mcu();
                 load_block_8_8(i, 0, 0); code_block(0); load_block_8_8(i, 0, 1); code_block(1); load_block_8_8(i, 0, 2); code_block(2);
             }
         }
@@ -497,6 +875,7 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                next_mcu();
                 load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
                 load_block_16_8_8(i, 1); code_block(1); load_block_16_8_8(i, 2); code_block(2);
             }
@@ -505,6 +884,7 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                next_mcu();
                 load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
                 load_block_8_8(i * 2 + 0, 1, 0); code_block(0); load_block_8_8(i * 2 + 1, 1, 0); code_block(0);
                 load_block_16_8(i, 1); code_block(1); load_block_16_8(i, 2); code_block(2);
@@ -521,11 +901,15 @@ namespace jpge {
         if (m_num_components == 1) {
             if (m_image_bpp == 3)
                 RGB_to_Y(pDst, Psrc, m_image_x);
+            else if (m_image_bpp == 2)
+                YUYV_to_Y(pDst, Psrc, m_image_x);
             else
                 memcpy(pDst, Psrc, m_image_x);
         } else {
             if (m_image_bpp == 3)
                 RGB_to_YCC(pDst, Psrc, m_image_x);
+            else if (m_image_bpp == 2)
+                YUYV_to_YCC(pDst, Psrc, m_image_x);
             else
                 Y_to_YCC(pDst, Psrc, m_image_x);
         }
@@ -565,6 +949,18 @@ namespace jpge {
         }
     }
 
+    // Reciprocal quantization table for the AAN DCT, stored in the transposed natural order
+    // DCT2D_fast() leaves its output in. Each entry is 2^RECIP_BITS / (q * 8 * aan(u) * aan(v)).
+    void jpeg_encoder::compute_quant_recip_table(uint32 *pDst, const int32 *pSrc)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            const uint8 z = s_zag[i];
+            const uint32 d = static_cast<uint32>(pSrc[i]) * static_cast<uint32>(s_aan_scales[z]);
+            pDst[((z & 7) << 3) | (z >> 3)] = ((1U << (RECIP_BITS + AAN_SCALE_BITS - 3)) + (d >> 1)) / d;
+        }
+    }
+
     // Higher-level methods.
     bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, int src_channels)
     {
@@ -612,31 +1008,53 @@ namespace jpge {
         m_image_bpl_mcu  = m_image_x_mcu * m_num_components;
         m_mcus_per_row   = m_image_x_mcu / m_mcu_x;
 
-        if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) {
-            return false;
+        // The MCU line buffer is kept across init() calls for the same geometry
+        if (m_part != PART_HEADERS) {
+            uint mcu_lines_size = m_image_bpl_mcu * m_mcu_y;
+            if (m_mcu_lines[0] && (m_mcu_lines_size != mcu_lines_size)) {
+                jpge_free(m_mcu_lines[0]);
+                m_mcu_lines[0] = NULL;
+            }
+            if (!m_mcu_lines[0]) {
+                if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(mcu_lines_size))) == NULL) {
+                    m_mcu_lines_size = 0;
+                    return false;
+                }
+                m_mcu_lines_size = mcu_lines_size;
+            }
+            for (int i = 1; i < m_mcu_y; i++)
+                m_mcu_lines[i] = m_mcu_lines[i-1] + m_image_bpl_mcu;
         }
-        for (int i = 1; i < m_mcu_y; i++)
-            m_mcu_lines[i] = m_mcu_lines[i-1] + m_image_bpl_mcu;
 
         if(m_last_quality != m_params.m_quality){
             m_last_quality = m_params.m_quality;
             compute_quant_table(m_quantization_tables[0], s_std_lum_quant);
             compute_quant_table(m_quantization_tables[1], s_std_croma_quant);
+            compute_quant_recip_table(m_quantization_recip[0], m_quantization_tables[0]);
+            compute_quant_recip_table(m_quantization_recip[1], m_quantization_tables[1]);
         }
 
-        if(!m_huff_initialized){
-            m_huff_initialized = true;
+        if((m_image_bpp == 2) && !m_yuv_lut_initialized){
+            m_yuv_lut_initialized = true;
+            init_yuv_luts();
+        }
 
+        if(!m_huff_initialized){
             memcpy(m_huff_bits[0+0], s_dc_lum_bits, 17);    memcpy(m_huff_val[0+0], s_dc_lum_val, DC_LUM_CODES);
             memcpy(m_huff_bits[2+0], s_ac_lum_bits, 17);    memcpy(m_huff_val[2+0], s_ac_lum_val, AC_LUM_CODES);
             memcpy(m_huff_bits[0+1], s_dc_chroma_bits, 17); memcpy(m_huff_val[0+1], s_dc_chroma_val, DC_CHROMA_CODES);
             memcpy(m_huff_bits[2+1], s_ac_chroma_bits, 17); memcpy(m_huff_val[2+1], s_ac_chroma_val, AC_CHROMA_CODES);
 
-            compute_huffman_table(&m_huff_codes[0+0][0], &m_huff_code_sizes[0+0][0], m_huff_bits[0+0], m_huff_val[0+0]);
-            compute_huffman_table(&m_huff_codes[2+0][0], &m_huff_code_sizes[2+0][0], m_huff_bits[2+0], m_huff_val[2+0]);
-            compute_huffman_table(&m_huff_codes[0+1][0], &m_huff_code_sizes[0+1][0], m_huff_bits[0+1], m_huff_val[0+1]);
-            compute_huffman_table(&m_huff_codes[2+1][0], &m_huff_code_sizes[2+1][0], m_huff_bits[2+1], m_huff_val[2+1]);
+            compute_huffman_table(&m_huff_codes[0+0][0], &m_huff_code_sizes[0+0][0], m_huff_bits[0+0], m_huff_val[0+0], m_huff_size_scratch, m_huff_code_scratch);
+            compute_huffman_table(&m_huff_codes[2+0][0], &m_huff_code_sizes[2+0][0], m_huff_bits[2+0], m_huff_val[2+0], m_huff_size_scratch, m_huff_code_scratch);
+            compute_huffman_table(&m_huff_codes[0+1][0], &m_huff_code_sizes[0+1][0], m_huff_bits[0+1], m_huff_val[0+1], m_huff_size_scratch, m_huff_code_scratch);
+            compute_huffman_table(&m_huff_codes[2+1][0], &m_huff_code_sizes[2+1][0], m_huff_bits[2+1], m_huff_val[2+1], m_huff_size_scratch, m_huff_code_scratch);
+            m_huff_initialized = true;
         }
+        m_pHuff_codes = m_huff_codes;
+        m_pHuff_code_sizes = m_huff_code_sizes;
+        m_pHuff_bits = m_huff_bits;
+        m_pHuff_val = m_huff_val;
 
         m_out_buf_left = JPGE_OUT_BUF_SIZE;
         m_pOut_buf = m_out_buf;
@@ -644,17 +1062,92 @@ namespace jpge {
         m_bits_in = 0;
         m_mcu_y_ofs = 0;
         m_pass_num = 2;
+        m_restart_mcus_left = m_params.m_restart_interval;
+        m_restart_num = 0;
         memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
 
-        // Emit all markers at beginning of image file.
+        if (m_part == PART_STRIPE) {
+            return true;
+        }
+
+        // The headers of a two-pass image carry its own Huffman tables, they wait for the first pass
+        if (m_params.m_two_pass_flag) {
+            if (!open_two_pass()) {
+                return false;
+            }
+            m_pass_num = 1;
+            return true;
+        }
+
+        emit_headers();
+
+        if (m_part == PART_HEADERS) {
+            flush_output_buffer();
+        }
+
+        return m_all_stream_writes_succeeded;
+    }
+
+    // Emit all markers at beginning of image file.
+    void jpeg_encoder::emit_headers()
+    {
         emit_marker(M_SOI);
         emit_jfif_app0();
         emit_dqt();
         emit_sof();
         emit_dhts();
+        if (m_params.m_restart_interval) {
+            emit_dri();
+        }
         emit_sos();
+    }
 
-        return m_all_stream_writes_succeeded;
+    bool jpeg_encoder::open_two_pass()
+    {
+        int blocks_per_mcu = (m_num_components == 1) ? 1 : (m_comp_h_samp[0] * m_comp_v_samp[0] + 2);
+        uint coefs_size = m_mcus_per_row * (m_image_y_mcu / m_mcu_y) * blocks_per_mcu * 64 * sizeof(int16);
+
+        m_pHuff_opt = static_cast<huff_opt_t*>(jpge_malloc(sizeof(huff_opt_t)));
+        m_pCoefs = static_cast<int16*>(jpge_malloc_psram(coefs_size));
+        if (!m_pHuff_opt || !m_pCoefs) {
+            close_two_pass();
+            return false;
+        }
+        m_pCoefs_end = m_pCoefs;
+        memset(m_pHuff_opt->count, 0, sizeof(m_pHuff_opt->count));
+        return true;
+    }
+
+    void jpeg_encoder::close_two_pass()
+    {
+        jpge_free(m_pHuff_opt);
+        jpge_free(m_pCoefs);
+        m_pHuff_opt = NULL;
+        m_pCoefs = NULL;
+        m_pCoefs_end = NULL;
+    }
+
+    // Second pass: code the kept coefficients with the per-image tables, in the same MCU order
+    void jpeg_encoder::emit_optimized_scan()
+    {
+        static const uint8 s_mcu_components[4][6] = { { 0 }, { 0, 1, 2 }, { 0, 0, 1, 2 }, { 0, 0, 0, 0, 1, 2 } };
+        const uint8 *components = s_mcu_components[m_params.m_subsampling];
+        int blocks_per_mcu = (m_num_components == 1) ? 1 : (m_comp_h_samp[0] * m_comp_v_samp[0] + 2);
+        const int16 *pCoefs = m_pCoefs;
+        const int16 *pEnd = m_pCoefs_end;
+
+        m_pass_num = 2;
+        m_restart_mcus_left = m_params.m_restart_interval;
+        m_restart_num = 0;
+        memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+
+        while (pCoefs < pEnd) {
+            next_mcu();
+            for (int i = 0; i < blocks_per_mcu; i++, pCoefs += 64) {
+                memcpy(m_coefficient_array, pCoefs, sizeof(m_coefficient_array));
+                code_coefficients_pass_two(components[i]);
+            }
+        }
     }
 
     bool jpeg_encoder::process_end_of_image()
@@ -668,8 +1161,26 @@ namespace jpge {
             process_mcu_row();
         }
 
-        put_bits(0x7F, 7);
-        emit_marker(M_EOI);
+        if (m_pass_num == 1) {
+            optimize_huffman_table(0+0, DC_LUM_CODES);
+            optimize_huffman_table(2+0, AC_LUM_CODES);
+            if (m_num_components > 1) {
+                optimize_huffman_table(0+1, DC_CHROMA_CODES);
+                optimize_huffman_table(2+1, AC_CHROMA_CODES);
+            }
+            m_pHuff_codes = m_pHuff_opt->codes;
+            m_pHuff_code_sizes = m_pHuff_opt->code_sizes;
+            m_pHuff_bits = m_pHuff_opt->bits;
+            m_pHuff_val = m_pHuff_opt->val;
+            emit_headers();
+            emit_optimized_scan();
+            close_two_pass();
+        }
+
+        flush_bits();
+        if (m_part != PART_STRIPE) {
+            emit_marker(M_EOI);
+        }
         flush_output_buffer();
         m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(NULL, 0);
         m_pass_num++; // purposely bump up m_pass_num, for debugging
@@ -678,13 +1189,19 @@ namespace jpge {
 
     void jpeg_encoder::clear()
     {
+        m_pHuff_opt = NULL;
+        m_pCoefs = NULL;
+        m_pCoefs_end = NULL;
         m_mcu_lines[0] = NULL;
+        m_mcu_lines_size = 0;
         m_pass_num = 0;
         m_all_stream_writes_succeeded = true;
+        m_part = PART_IMAGE;
     }
 
     jpeg_encoder::jpeg_encoder()
     {
+        m_last_quality = 0;
         clear();
     }
 
@@ -693,17 +1210,47 @@ namespace jpge {
         deinit();
     }
 
-    bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    bool jpeg_encoder::open_part(output_stream *pStream, int width, int height, int src_channels, const params &comp_params, stream_part_t part)
     {
-        deinit();
-        if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
+        m_pass_num = 0;
+        m_all_stream_writes_succeeded = true;
+        close_two_pass();
+        if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels < 1) || (src_channels > 4)) || (!comp_params.check())) return false;
         m_pStream = pStream;
         m_params = comp_params;
-        return jpg_open(width, height, src_channels);
+        m_part = part;
+        if (m_part != PART_IMAGE) {
+            m_params.m_two_pass_flag = false;
+        }
+        if (!jpg_open(width, height, src_channels)) {
+            return false;
+        }
+        if (m_part == PART_HEADERS) {
+            m_pass_num = 0;
+        }
+        return m_all_stream_writes_succeeded;
+    }
+
+    bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    {
+        return open_part(pStream, width, height, src_channels, comp_params, PART_IMAGE);
+    }
+
+    bool jpeg_encoder::init_headers(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    {
+        return open_part(pStream, width, height, src_channels, comp_params, PART_HEADERS);
+    }
+
+    bool jpeg_encoder::init_stripe(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    {
+        params stripe_params = comp_params;
+        stripe_params.m_restart_interval = 0;
+        return open_part(pStream, width, height, src_channels, stripe_params, PART_STRIPE);
     }
 
     void jpeg_encoder::deinit()
     {
+        close_two_pass();
         jpge_free(m_mcu_lines[0]);
         clear();
     }
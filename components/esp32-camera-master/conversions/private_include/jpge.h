@@ -16,9 +16,16 @@ namespace jpge
     // JPEG chroma subsampling factors. Y_ONLY (grayscale images) and H2V2 (color images) are the most common.
     enum subsampling_t { Y_ONLY = 0, H1V1 = 1, H2V1 = 2, H2V2 = 3 };
 
+    // Forward DCT + quantization back-end.
+    // DCT_ISLOW: accurate integer DCT (jfdctint) followed by a per-coefficient division.
+    // DCT_IFAST: fixed-point AAN DCT (jfdctfst) with the AAN output scaling folded into
+    //            reciprocal-multiply quantization. Both passes run across 8 lanes at once
+    //            so the compiler can vectorize them.
+    enum dct_method_t { DCT_ISLOW = 0, DCT_IFAST = 1 };
+
     // JPEG compression parameters structure.
     struct params {
-            inline params() : m_quality(85), m_subsampling(H2V2) { }
+            inline params() : m_quality(85), m_subsampling(H2V2), m_dct_method(DCT_ISLOW), m_restart_interval(0), m_two_pass_flag(false) { }
 
             inline bool check() const {
                 if ((m_quality < 1) || (m_quality > 100)) {
@@ -27,6 +34,9 @@ namespace jpge
                 if ((uint)m_subsampling > (uint)H2V2) {
                     return false;
                 }
+                if ((uint)m_dct_method > (uint)DCT_IFAST) {
+                    return false;
+                }
                 return true;
             }
 
@@ -39,6 +49,18 @@ namespace jpge
             // 2 = H2V1 subsampling (YCbCr 2x1x1, 4 blocks per MCU)
             // 3 = H2V2 subsampling (YCbCr 4x1x1, 6 blocks per MCU-- very common)
             subsampling_t m_subsampling;
+
+            // DCT/quantization back-end, see dct_method_t.
+            dct_method_t m_dct_method;
+
+            // Number of MCUs between RSTn markers, 0 disables restart markers.
+            uint16 m_restart_interval;
+
+            // Optimized Huffman tables: the quantized coefficients of the whole image are kept (in PSRAM when
+            // available) while symbol statistics are gathered, then coded with per-image tables once the last
+            // scanline is in. Costs 128 bytes per 8x8 block, the bitstream is typically 5-15% smaller.
+            // Ignored by init_headers()/init_stripe().
+            bool m_two_pass_flag;
     };
     
     // Output stream abstract class - used by the jpeg_encoder class to write to the output stream.
@@ -56,16 +78,18 @@ namespace jpge
             jpeg_encoder();
             ~jpeg_encoder();
 
-            // Initializes the compressor.
+            // Initializes the compressor. May be called again to encode the next image: the MCU line buffer
+            // is kept while the geometry doesn't change and the quantization tables while the quality doesn't.
             // pStream: The stream object to use for writing compressed data.
             // params - Compression parameters structure, defined above.
             // width, height  - Image dimensions.
-            // channels - May be 1, or 3. 1 indicates grayscale, 3 indicates RGB source data.
+            // channels - May be 1, 2 or 3. 1 indicates grayscale, 2 indicates packed YUYV (YUV422) source data
+            //            that is fed straight into the YCbCr MCU buffers, 3 indicates RGB source data.
             // Returns false on out of memory or if a stream write fails.
             bool init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params());
 
             // Call this method with each source scanline.
-            // width * src_channels bytes per scanline is expected (RGB or Y format).
+            // width * src_channels bytes per scanline is expected (RGB, YUYV or Y format).
             // You must call with NULL after all scanlines are processed to finish compression.
             // Returns false on out of memory or if a stream write fails.
             bool process_scanline(const void* pScanline);
@@ -73,12 +97,25 @@ namespace jpge
             // Deinitializes the compressor, freeing any allocated memory. May be called at any time.
             void deinit();
 
+            // Stripe-parallel encoding. The image is cut into horizontal stripes of whole MCU rows, one
+            // restart interval (comp_params.m_restart_interval) each.
+            // init_headers() writes the markers of the full image from SOI up to SOS, including DRI,
+            // and flushes them to pStream. No scanlines are accepted afterwards.
+            // init_stripe() sets up an encoder for one stripe: width x height is the stripe, and only
+            // its byte-padded entropy-coded data is written, without any markers. The caller joins
+            // the stripes with RSTn markers and terminates the stream with EOI.
+            // Call init_headers() first: it also sets up the Huffman tables the stripe encoders share.
+            bool init_headers(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params());
+            bool init_stripe(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params());
+
         private:
             jpeg_encoder(const jpeg_encoder &);
             jpeg_encoder &operator =(const jpeg_encoder &);
 
             typedef int32 sample_array_t;
             enum { JPGE_OUT_BUF_SIZE = 512 };
+            enum stream_part_t { PART_IMAGE = 0, PART_HEADERS = 1, PART_STRIPE = 2 };
+            struct huff_opt_t;
 
             output_stream *m_pStream;
             params m_params;
@@ -90,10 +127,24 @@ namespace jpge
             int m_mcus_per_row;
             int m_mcu_x, m_mcu_y;
             uint8 *m_mcu_lines[16];
+            uint m_mcu_lines_size;
             uint8 m_mcu_y_ofs;
             sample_array_t m_sample_array[64];
             int16 m_coefficient_array[64];
 
+            // Huffman tables in use: the shared standard ones, or the per-image ones in m_pHuff_opt
+            uint (*m_pHuff_codes)[256];
+            uint8 (*m_pHuff_code_sizes)[256];
+            uint8 (*m_pHuff_bits)[17];
+            uint8 (*m_pHuff_val)[256];
+            huff_opt_t *m_pHuff_opt;
+            int16 *m_pCoefs;
+            int16 *m_pCoefs_end;
+
+            int32 m_last_quality;
+            int32 m_quantization_tables[2][64];
+            uint32 m_quantization_recip[2][64];
+
             int m_last_dc_val[3];
             uint8 m_out_buf[JPGE_OUT_BUF_SIZE];
             uint8 *m_pOut_buf;
@@ -102,11 +153,16 @@ namespace jpge
             uint m_bits_in;
             uint8 m_pass_num;
             bool m_all_stream_writes_succeeded;
+            stream_part_t m_part;
+            uint m_restart_mcus_left;
+            uint8 m_restart_num;
 
             bool jpg_open(int p_x_res, int p_y_res, int src_channels);
+            bool open_part(output_stream *pStream, int width, int height, int src_channels, const params &comp_params, stream_part_t part);
 
             void flush_output_buffer();
             void put_bits(uint bits, uint len);
+            void flush_bits();
 
             void emit_byte(uint8 i);
             void emit_word(uint i);
@@ -118,16 +174,27 @@ namespace jpge
             void emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag);
             void emit_dhts();
             void emit_sos();
+            void emit_dri();
+            void emit_restart();
+            void next_mcu();
 
             void compute_quant_table(int32 *dst, const int16 *src);
+            void compute_quant_recip_table(uint32 *dst, const int32 *src);
             void load_quantized_coefficients(int component_num);
+            void load_quantized_coefficients_fast(int component_num);
 
             void load_block_8_8_grey(int x);
             void load_block_8_8(int x, int y, int c);
             void load_block_16_8(int x, int c);
             void load_block_16_8_8(int x, int c);
 
+            void code_coefficients_pass_one(int component_num);
             void code_coefficients_pass_two(int component_num);
+            void optimize_huffman_table(int table_num, int table_len);
+            bool open_two_pass();
+            void close_two_pass();
+            void emit_headers();
+            void emit_optimized_scan();
             void code_block(int component_num);
 
             void process_mcu_row();
@@ -18,10 +18,24 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 void yuv2rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *r, uint8_t *g, uint8_t *b);
 
+/*
+ * Bulk YUYV (YUV422) conversion of pix_count pixels, a trailing odd pixel is ignored.
+ * Same results as yuv2rgb() per pixel, but chroma is looked up once per macropixel
+ * and eight pixels are converted per iteration. Gray is a strided copy of the Y bytes.
+ *
+ * yuv422_to_rgb888: B, G, R bytes per pixel, the PIXFORMAT_RGB888 layout of this component
+ * yuv422_to_rgb565: PIXFORMAT_RGB565, high byte first
+ * yuv422_to_gray:   the Y bytes
+ */
+void yuv422_to_rgb888(const uint8_t *src, uint8_t *dst, size_t pix_count);
+void yuv422_to_rgb565(const uint8_t *src, uint8_t *dst, size_t pix_count);
+void yuv422_to_gray(const uint8_t *src, uint8_t *dst, size_t pix_count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,13 +13,16 @@
 // limitations under the License.
 #include <stddef.h>
 #include <string.h>
+#include <new>
 #include "esp_attr.h"
 #include "soc/efuse_reg.h"
 #include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_camera.h"
 #include "img_converters.h"
 #include "jpge.h"
-#include "yuv.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -46,9 +49,7 @@ static void *_malloc(size_t size)
 static IRAM_ATTR void convert_line_format(uint8_t * src, pixformat_t format, uint8_t * dst, size_t width, size_t in_channels, size_t line)
 {
     int i=0, o=0, l=0;
-    if(format == PIXFORMAT_GRAYSCALE) {
-        memcpy(dst, src + line * width, width);
-    } else if(format == PIXFORMAT_RGB888) {
+    if(format == PIXFORMAT_RGB888) {
         l = width * 3;
         src += l * line;
         for(i=0; i<l; i+=3) {
@@ -64,81 +65,149 @@ static IRAM_ATTR void convert_line_format(uint8_t * src, pixformat_t format, uin
             dst[o++] = (src[i] & 0x07) << 5 | (src[i+1] & 0xE0) >> 3;
             dst[o++] = (src[i+1] & 0x1F) << 3;
         }
-    } else if(format == PIXFORMAT_YUV422) {
-        uint8_t y0, y1, u, v;
-        uint8_t r, g, b;
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=4) {
-            y0 = src[i];
-            u = src[i+1];
-            y1 = src[i+2];
-            v = src[i+3];
-
-            yuv2rgb(y0, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-
-            yuv2rgb(y1, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
-        }
     }
 }
 
-bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::output_stream *dst_stream)
+// Encoder setup for a source format. GRAYSCALE and YUV422 scanlines are fed to the encoder as they are
+static void jpg_setup(pixformat_t format, const jpg_encode_options_t *opts, jpge::params &comp_params, int &num_channels, bool &native)
 {
-    int num_channels = 3;
-    jpge::subsampling_t subsampling = jpge::H2V2;
+    static const jpge::subsampling_t subsampling[] = { jpge::H2V2, jpge::H2V1, jpge::H1V1, jpge::Y_ONLY };
+
+    num_channels = 3;
+    native = false;
+    comp_params = jpge::params();
+    comp_params.m_subsampling = jpge::H2V2;
+    if((unsigned)opts->subsampling < sizeof(subsampling) / sizeof(subsampling[0])) {
+        comp_params.m_subsampling = subsampling[opts->subsampling];
+    }
 
     if(format == PIXFORMAT_GRAYSCALE) {
         num_channels = 1;
-        subsampling = jpge::Y_ONLY;
+        comp_params.m_subsampling = jpge::Y_ONLY;
+        native = true;
+    } else if(format == PIXFORMAT_YUV422) {
+        num_channels = 2;
+        native = true;
     }
 
+    uint8_t quality = opts->quality;
     if(!quality) {
         quality = 1;
     } else if(quality > 100) {
         quality = 100;
     }
-
-    jpge::params comp_params = jpge::params();
-    comp_params.m_subsampling = subsampling;
     comp_params.m_quality = quality;
-
-    jpge::jpeg_encoder dst_image;
-
-    if (!dst_image.init(dst_stream, width, height, num_channels, comp_params)) {
-        ESP_LOGE(TAG, "JPG encoder init failed");
-        return false;
+#if CONFIG_CAMERA_JPEG_DCT_IFAST
+    comp_params.m_dct_method = jpge::DCT_IFAST;
+#endif
+    if(opts->dct == JPG_DCT_ISLOW) {
+        comp_params.m_dct_method = jpge::DCT_ISLOW;
+    } else if(opts->dct == JPG_DCT_IFAST) {
+        comp_params.m_dct_method = jpge::DCT_IFAST;
     }
+    comp_params.m_restart_interval = opts->restart_interval;
+    comp_params.m_two_pass_flag = opts->optimize_huffman;
+}
 
-    uint8_t* line = (uint8_t*)_malloc(width * num_channels);
-    if(!line) {
-        ESP_LOGE(TAG, "Scan line malloc failed");
-        return false;
+static size_t jpg_src_line_len(pixformat_t format, uint16_t width)
+{
+    if(format == PIXFORMAT_GRAYSCALE) {
+        return width;
+    } else if(format == PIXFORMAT_RGB888) {
+        return width * 3;
     }
+    return width * 2;
+}
 
-    for (int i = 0; i < height; i++) {
-        convert_line_format(src, format, line, width, num_channels, i);
-        if (!dst_image.process_scanline(line)) {
-            ESP_LOGE(TAG, "JPG process line %u failed", i);
-            free(line);
-            return false;
+// line is a scratch scanline for formats that need converting, one is allocated when NULL
+static bool encode_lines(jpge::jpeg_encoder &dst_image, uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, int num_channels, bool native, uint8_t *line)
+{
+    if (native) {
+        size_t line_len = width * num_channels;
+        for (int i = 0; i < height; i++) {
+            if (!dst_image.process_scanline(src + line_len * i)) {
+                ESP_LOGE(TAG, "JPG process line %u failed", i);
+                return false;
+            }
+        }
+    } else {
+        uint8_t* line_buf = line;
+        if(!line_buf) {
+            line_buf = (uint8_t*)_malloc(width * num_channels);
+            if(!line_buf) {
+                ESP_LOGE(TAG, "Scan line malloc failed");
+                return false;
+            }
+        }
+
+        for (int i = 0; i < height; i++) {
+            convert_line_format(src, format, line_buf, width, num_channels, i);
+            if (!dst_image.process_scanline(line_buf)) {
+                ESP_LOGE(TAG, "JPG process line %u failed", i);
+                if(!line) {
+                    free(line_buf);
+                }
+                return false;
+            }
+        }
+        if(!line) {
+            free(line_buf);
         }
     }
-    free(line);
 
     if (!dst_image.process_scanline(NULL)) {
         ESP_LOGE(TAG, "JPG image finish failed");
         return false;
     }
-    dst_image.deinit();
     return true;
 }
 
+// The encoder object is over 2 KB with its quantization tables, it lives on the heap and not
+// on the stack of the task that converts
+static jpge::jpeg_encoder *jpg_encoder_new()
+{
+    void *mem = _malloc(sizeof(jpge::jpeg_encoder));
+    if(!mem) {
+        ESP_LOGE(TAG, "JPG encoder malloc failed");
+        return NULL;
+    }
+    return new (mem) jpge::jpeg_encoder;
+}
+
+static void jpg_encoder_delete(jpge::jpeg_encoder *encoder)
+{
+    encoder->~jpeg_encoder();
+    free(encoder);
+}
+
+static bool convert_image_opts(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_options_t *opts, jpge::output_stream *dst_stream)
+{
+    int num_channels;
+    bool native;
+    jpge::params comp_params;
+    jpg_setup(format, opts, comp_params, num_channels, native);
+
+    jpge::jpeg_encoder *dst_image = jpg_encoder_new();
+    if (!dst_image) {
+        return false;
+    }
+
+    bool ok = dst_image->init(dst_stream, width, height, num_channels, comp_params);
+    if (!ok) {
+        ESP_LOGE(TAG, "JPG encoder init failed");
+    } else {
+        ok = encode_lines(*dst_image, src, width, height, format, num_channels, native, NULL);
+    }
+    jpg_encoder_delete(dst_image);
+    return ok;
+}
+
+bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::output_stream *dst_stream)
+{
+    jpg_encode_options_t opts = JPG_ENCODE_OPTIONS_DEFAULT(quality);
+    return convert_image_opts(src, width, height, format, &opts, dst_stream);
+}
+
 class callback_stream : public jpge::output_stream {
 protected:
     jpg_out_cb ocb;
@@ -153,7 +222,7 @@ public:
         index += ocb(oarg, index, data, len);
         return true;
     }
-    virtual size_t get_size() const
+    virtual jpge::uint get_size() const
     {
         return index;
     }
@@ -170,17 +239,216 @@ bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg)
     return fmt2jpg_cb(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, cb, arg);
 }
 
+bool fmt2jpg_cb_opts(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_options_t *opts, jpg_out_cb cb, void * arg)
+{
+    callback_stream dst_stream(cb, arg);
+    return convert_image_opts(src, width, height, format, opts, &dst_stream);
+}
+
+bool frame2jpg_cb_opts(camera_fb_t * fb, const jpg_encode_options_t *opts, jpg_out_cb cb, void * arg)
+{
+    return fmt2jpg_cb_opts(fb->buf, fb->len, fb->width, fb->height, fb->format, opts, cb, arg);
+}
+
+// Persistent encoder: the jpeg_encoder keeps its MCU line buffer and quantization
+// tables across frames, the scanline buffer is kept here
+struct jpg_encoder_s {
+    jpge::jpeg_encoder encoder;
+    uint8_t *line;
+    size_t line_len;
+};
+
+jpg_encoder_t *jpg_encoder_create(void)
+{
+    void *mem = _malloc(sizeof(jpg_encoder_t));
+    if(!mem) {
+        ESP_LOGE(TAG, "JPG encoder malloc failed");
+        return NULL;
+    }
+    jpg_encoder_t *ctx = new (mem) jpg_encoder_t;
+    ctx->line = NULL;
+    ctx->line_len = 0;
+    return ctx;
+}
+
+void jpg_encoder_destroy(jpg_encoder_t *ctx)
+{
+    if(!ctx) {
+        return;
+    }
+    free(ctx->line);
+    ctx->~jpg_encoder_t();
+    free(ctx);
+}
+
+bool fmt2jpg_ctx_cb_opts(jpg_encoder_t *ctx, uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_options_t *opts, jpg_out_cb cb, void * arg)
+{
+    int num_channels;
+    bool native;
+    jpge::params comp_params;
+    jpg_setup(format, opts, comp_params, num_channels, native);
+
+    if(!native && ctx->line_len != (size_t)width * num_channels) {
+        free(ctx->line);
+        ctx->line_len = 0;
+        ctx->line = (uint8_t*)_malloc(width * num_channels);
+        if(!ctx->line) {
+            ESP_LOGE(TAG, "Scan line malloc failed");
+            return false;
+        }
+        ctx->line_len = width * num_channels;
+    }
+
+    callback_stream dst_stream(cb, arg);
+    if (!ctx->encoder.init(&dst_stream, width, height, num_channels, comp_params)) {
+        ESP_LOGE(TAG, "JPG encoder init failed");
+        return false;
+    }
+    return encode_lines(ctx->encoder, src, width, height, format, num_channels, native, ctx->line);
+}
+
+bool fmt2jpg_ctx_cb(jpg_encoder_t *ctx, uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_out_cb cb, void * arg)
+{
+    jpg_encode_options_t opts = JPG_ENCODE_OPTIONS_DEFAULT(quality);
+    return fmt2jpg_ctx_cb_opts(ctx, src, src_len, width, height, format, &opts, cb, arg);
+}
+
+bool frame2jpg_ctx_cb(jpg_encoder_t *ctx, camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg)
+{
+    return fmt2jpg_ctx_cb(ctx, fb->buf, fb->len, fb->width, fb->height, fb->format, quality, cb, arg);
+}
+
+
+
+// Output chunks are fixed-size blocks. Released blocks are kept on a free list, linked
+// through their first word, so steady-state encoding does not go back to the heap.
+#define JPG_CHUNKS_MAX ((CONFIG_CAMERA_JPEG_MAX_SIZE + CONFIG_CAMERA_JPEG_CHUNK_SIZE - 1) / CONFIG_CAMERA_JPEG_CHUNK_SIZE)
+
+struct jpg_chunked_s {
+    size_t len;
+    size_t count;
+    jpg_chunk_t chunks[JPG_CHUNKS_MAX];
+};
+
+static portMUX_TYPE jpg_chunk_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static void *jpg_chunk_pool = NULL;
+static size_t jpg_chunk_pool_count = 0;
+
+static uint8_t *jpg_chunk_alloc(void)
+{
+    void *block = NULL;
+    portENTER_CRITICAL(&jpg_chunk_pool_lock);
+    if (jpg_chunk_pool) {
+        block = jpg_chunk_pool;
+        jpg_chunk_pool = *(void **)block;
+        jpg_chunk_pool_count--;
+    }
+    portEXIT_CRITICAL(&jpg_chunk_pool_lock);
+    if (!block) {
+        block = _malloc(CONFIG_CAMERA_JPEG_CHUNK_SIZE);
+    }
+    return (uint8_t *)block;
+}
+
+static void jpg_chunk_release(uint8_t *block)
+{
+    bool pooled = false;
+    portENTER_CRITICAL(&jpg_chunk_pool_lock);
+    if (jpg_chunk_pool_count < CONFIG_CAMERA_JPEG_CHUNK_POOL_SIZE) {
+        *(void **)block = jpg_chunk_pool;
+        jpg_chunk_pool = block;
+        jpg_chunk_pool_count++;
+        pooled = true;
+    }
+    portEXIT_CRITICAL(&jpg_chunk_pool_lock);
+    if (!pooled) {
+        free(block);
+    }
+}
+
+static jpg_chunked_t *jpg_chunked_new(void)
+{
+    jpg_chunked_t *jpg = (jpg_chunked_t *)_malloc(sizeof(jpg_chunked_t));
+    if (!jpg) {
+        ESP_LOGE(TAG, "JPG chunk list malloc failed");
+        return NULL;
+    }
+    jpg->len = 0;
+    jpg->count = 0;
+    return jpg;
+}
+
+static bool jpg_chunked_append(jpg_chunked_t *jpg, const void *data, size_t len)
+{
+    const uint8_t *src = (const uint8_t *)data;
+    if (jpg->len + len > CONFIG_CAMERA_JPEG_MAX_SIZE) {
+        ESP_LOGE(TAG, "JPG output overflow: more than %u bytes", CONFIG_CAMERA_JPEG_MAX_SIZE);
+        return false;
+    }
+    while (len) {
+        jpg_chunk_t *chunk = jpg->count ? &jpg->chunks[jpg->count - 1] : NULL;
+        if (!chunk || chunk->len == CONFIG_CAMERA_JPEG_CHUNK_SIZE) {
+            chunk = &jpg->chunks[jpg->count];
+            chunk->buf = jpg_chunk_alloc();
+            if (!chunk->buf) {
+                ESP_LOGE(TAG, "JPG chunk malloc failed");
+                return false;
+            }
+            chunk->len = 0;
+            jpg->count++;
+        }
+        size_t n = CONFIG_CAMERA_JPEG_CHUNK_SIZE - chunk->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy((uint8_t *)chunk->buf + chunk->len, src, n);
+        chunk->len += n;
+        jpg->len += n;
+        src += n;
+        len -= n;
+    }
+    return true;
+}
+
+static uint8_t *jpg_chunked_copy(const jpg_chunked_t *jpg, uint8_t *dst)
+{
+    for (size_t i = 0; i < jpg->count; i++) {
+        memcpy(dst, jpg->chunks[i].buf, jpg->chunks[i].len);
+        dst += jpg->chunks[i].len;
+    }
+    return dst;
+}
+
+const jpg_chunk_t *jpg_chunked_view(const jpg_chunked_t *jpg, size_t *count)
+{
+    *count = jpg->count;
+    return jpg->chunks;
+}
 
+size_t jpg_chunked_len(const jpg_chunked_t *jpg)
+{
+    return jpg->len;
+}
 
-class memory_stream : public jpge::output_stream {
+void jpg_chunked_free(jpg_chunked_t *jpg)
+{
+    if (!jpg) {
+        return;
+    }
+    for (size_t i = 0; i < jpg->count; i++) {
+        jpg_chunk_release((uint8_t *)jpg->chunks[i].buf);
+    }
+    free(jpg);
+}
+
+class chunked_stream : public jpge::output_stream {
 protected:
-    uint8_t *out_buf;
-    size_t max_len, index;
+    jpg_chunked_t *jpg;
 
 public:
-    memory_stream(void *pBuf, uint buf_size) : out_buf(static_cast<uint8_t*>(pBuf)), max_len(buf_size), index(0) { }
+    chunked_stream(jpg_chunked_t *out) : jpg(out) { }
 
-    virtual ~memory_stream() { }
+    virtual ~chunked_stream() { }
 
     virtual bool put_buf(const void* pBuf, int len)
     {
@@ -188,48 +456,260 @@ public:
             //end of image
             return true;
         }
-        if ((size_t)len > (max_len - index)) {
-            //ESP_LOGW(TAG, "JPG output overflow: %d bytes (%d,%d,%d)", len - (max_len - index), len, index, max_len);
-            len = max_len - index;
-        }
-        if (len) {
-            memcpy(out_buf + index, pBuf, len);
-            index += len;
-        }
-        return true;
+        return jpg_chunked_append(jpg, pBuf, len);
     }
 
-    virtual size_t get_size() const
+    virtual jpge::uint get_size() const
     {
-        return index;
+        return jpg->len;
     }
 };
 
-bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+static bool encode_chunked(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_options_t *opts, jpg_chunked_t ** out)
 {
-    //todo: allocate proper buffer for holding JPEG data
-    //this should be enough for CIF frame size
-    int jpg_buf_len = 128*1024;
-
+    jpg_chunked_t *jpg = jpg_chunked_new();
+    if (!jpg) {
+        return false;
+    }
+    chunked_stream dst_stream(jpg);
 
-    uint8_t * jpg_buf = (uint8_t *)_malloc(jpg_buf_len);
-    if(jpg_buf == NULL) {
-        ESP_LOGE(TAG, "JPG buffer malloc failed");
+    if(!convert_image_opts(src, width, height, format, opts, &dst_stream)) {
+        jpg_chunked_free(jpg);
         return false;
     }
-    memory_stream dst_stream(jpg_buf, jpg_buf_len);
 
-    if(!convert_image(src, width, height, format, quality, &dst_stream)) {
-        free(jpg_buf);
+    *out = jpg;
+    return true;
+}
+
+// Flattens the chunked output into one exactly sized buffer and frees it
+static bool jpg_chunked_flatten(jpg_chunked_t *jpg, uint8_t ** out, size_t * out_len)
+{
+    uint8_t * jpg_buf = (uint8_t *)_malloc(jpg->len);
+    if(jpg_buf == NULL) {
+        ESP_LOGE(TAG, "JPG buffer malloc failed");
+        jpg_chunked_free(jpg);
         return false;
     }
+    jpg_chunked_copy(jpg, jpg_buf);
 
     *out = jpg_buf;
-    *out_len = dst_stream.get_size();
+    *out_len = jpg->len;
+    jpg_chunked_free(jpg);
     return true;
 }
 
+bool fmt2jpg_chunked(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_chunked_t ** out)
+{
+    jpg_encode_options_t opts = JPG_ENCODE_OPTIONS_DEFAULT(quality);
+    return encode_chunked(src, width, height, format, &opts, out);
+}
+
+bool frame2jpg_chunked(camera_fb_t * fb, uint8_t quality, jpg_chunked_t ** out)
+{
+    return fmt2jpg_chunked(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out);
+}
+
+bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    jpg_chunked_t *jpg = NULL;
+    if(!fmt2jpg_chunked(src, src_len, width, height, format, quality, &jpg)) {
+        return false;
+    }
+    return jpg_chunked_flatten(jpg, out, out_len);
+}
+
 bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len)
 {
     return fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
 }
+
+bool fmt2jpg_opts(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_options_t *opts, uint8_t ** out, size_t * out_len)
+{
+    jpg_chunked_t *jpg = NULL;
+    if(!encode_chunked(src, width, height, format, opts, &jpg)) {
+        return false;
+    }
+    return jpg_chunked_flatten(jpg, out, out_len);
+}
+
+bool frame2jpg_opts(camera_fb_t * fb, const jpg_encode_options_t *opts, uint8_t ** out, size_t * out_len)
+{
+    return fmt2jpg_opts(fb->buf, fb->len, fb->width, fb->height, fb->format, opts, out, out_len);
+}
+
+bool fmt2jpg_optimized(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    jpg_encode_options_t opts = JPG_ENCODE_OPTIONS_DEFAULT(quality);
+    opts.optimize_huffman = true;
+    return fmt2jpg_opts(src, src_len, width, height, format, &opts, out, out_len);
+}
+
+bool frame2jpg_optimized(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    return fmt2jpg_optimized(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
+}
+
+bool frame2jpg_rate_ctrl(camera_fb_t * fb, jpg_rate_ctrl_t * rc, uint8_t ** out, size_t * out_len)
+{
+    if(!fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, rc->quality, out, out_len)) {
+        return false;
+    }
+    jpg_rate_ctrl_update(rc, *out_len);
+    return true;
+}
+
+#if !CONFIG_FREERTOS_UNICORE
+
+#define JPG_STRIPE_TASK_STACK 4096
+
+typedef struct {
+    uint8_t *src;
+    uint16_t width;
+    uint16_t height;
+    pixformat_t format;
+    int num_channels;
+    bool native;
+    jpge::params params;
+    jpge::output_stream *stream;
+    SemaphoreHandle_t done;
+    bool ok;
+} jpg_stripe_t;
+
+static bool encode_stripe(jpg_stripe_t *stripe)
+{
+    jpge::jpeg_encoder *dst_image = jpg_encoder_new();
+    if(!dst_image) {
+        return false;
+    }
+    bool ok = dst_image->init_stripe(stripe->stream, stripe->width, stripe->height, stripe->num_channels, stripe->params);
+    if (!ok) {
+        ESP_LOGE(TAG, "JPG stripe init failed");
+    } else {
+        ok = encode_lines(*dst_image, stripe->src, stripe->width, stripe->height, stripe->format, stripe->num_channels, stripe->native, NULL);
+    }
+    jpg_encoder_delete(dst_image);
+    return ok;
+}
+
+static void jpg_stripe_task(void *arg)
+{
+    jpg_stripe_t *stripe = (jpg_stripe_t *)arg;
+    stripe->ok = encode_stripe(stripe);
+    xSemaphoreGive(stripe->done);
+    vTaskDelete(NULL);
+}
+
+bool fmt2jpg_parallel(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    int num_channels;
+    bool native;
+    jpge::params comp_params;
+    jpg_encode_options_t opts = JPG_ENCODE_OPTIONS_DEFAULT(quality);
+    jpg_setup(format, &opts, comp_params, num_channels, native);
+
+    // Two stripes of whole MCU rows, the top one gets the odd row
+    int mcu_h = (comp_params.m_subsampling == jpge::H2V2) ? 16 : 8;
+    int mcu_w = (comp_params.m_subsampling == jpge::H2V2 || comp_params.m_subsampling == jpge::H2V1) ? 16 : 8;
+    int mcu_rows = (height + mcu_h - 1) / mcu_h;
+    int mcus_per_row = (width + mcu_w - 1) / mcu_w;
+    if (mcu_rows < 2 || (mcu_rows + 1) / 2 * mcus_per_row > 0xFFFF) {
+        return fmt2jpg(src, src_len, width, height, format, quality, out, out_len);
+    }
+    uint16_t top_height = (mcu_rows + 1) / 2 * mcu_h;
+    comp_params.m_restart_interval = (mcu_rows + 1) / 2 * mcus_per_row;
+
+    jpg_chunked_t *top_jpg = jpg_chunked_new();
+    jpg_chunked_t *bottom_jpg = jpg_chunked_new();
+    if (!top_jpg || !bottom_jpg) {
+        jpg_chunked_free(top_jpg);
+        jpg_chunked_free(bottom_jpg);
+        return false;
+    }
+    chunked_stream top_stream(top_jpg);
+    chunked_stream bottom_stream(bottom_jpg);
+    bool ok = false;
+    uint8_t *jpg_buf = NULL;
+    uint8_t *p = NULL;
+    size_t jpg_len = 0;
+
+    // Headers go first, they also set up the Huffman tables both stripe encoders share
+    jpge::jpeg_encoder *headers = jpg_encoder_new();
+    if (!headers) {
+        goto out;
+    }
+    ok = headers->init_headers(&top_stream, width, height, num_channels, comp_params);
+    jpg_encoder_delete(headers);
+    if (!ok) {
+        ESP_LOGE(TAG, "JPG encoder init failed");
+        goto out;
+    }
+    ok = false;
+
+    {
+        jpg_stripe_t top = {
+            src, width, top_height, format, num_channels, native, comp_params, &top_stream, NULL, false
+        };
+        jpg_stripe_t bottom = {
+            src + jpg_src_line_len(format, width) * top_height, width, (uint16_t)(height - top_height), format, num_channels, native, comp_params, &bottom_stream, NULL, false
+        };
+
+        bottom.done = xSemaphoreCreateBinary();
+        if (!bottom.done) {
+            ESP_LOGE(TAG, "JPG stripe semaphore create failed");
+            goto out;
+        }
+        if (xTaskCreatePinnedToCore(jpg_stripe_task, "jpg_stripe", JPG_STRIPE_TASK_STACK, &bottom, uxTaskPriorityGet(NULL), NULL, xPortGetCoreID() ? 0 : 1) != pdPASS) {
+            ESP_LOGE(TAG, "JPG stripe task create failed");
+            vSemaphoreDelete(bottom.done);
+            goto out;
+        }
+        top.ok = encode_stripe(&top);
+        xSemaphoreTake(bottom.done, portMAX_DELAY);
+        vSemaphoreDelete(bottom.done);
+        if (!top.ok || !bottom.ok) {
+            goto out;
+        }
+    }
+
+    // Join the stripes with RST0 and terminate with EOI
+    jpg_len = top_jpg->len + 2 + bottom_jpg->len + 2;
+    if (jpg_len > CONFIG_CAMERA_JPEG_MAX_SIZE) {
+        ESP_LOGE(TAG, "JPG output overflow: %u bytes", (unsigned)jpg_len);
+        goto out;
+    }
+    jpg_buf = (uint8_t *)_malloc(jpg_len);
+    if(jpg_buf == NULL) {
+        ESP_LOGE(TAG, "JPG buffer malloc failed");
+        goto out;
+    }
+    p = jpg_chunked_copy(top_jpg, jpg_buf);
+    *p++ = 0xFF;
+    *p++ = 0xD0;
+    p = jpg_chunked_copy(bottom_jpg, p);
+    *p++ = 0xFF;
+    *p++ = 0xD9;
+
+    *out = jpg_buf;
+    *out_len = jpg_len;
+    ok = true;
+
+out:
+    jpg_chunked_free(top_jpg);
+    jpg_chunked_free(bottom_jpg);
+    return ok;
+}
+
+#else
+
+bool fmt2jpg_parallel(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    return fmt2jpg(src, src_len, width, height, format, quality, out, out_len);
+}
+
+#endif
+
+bool frame2jpg_parallel(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    return fmt2jpg_parallel(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
+}
@@ -11,6 +11,7 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <string.h>
 #include "yuv.h"
 #include "esp_attr.h"
 
@@ -296,3 +297,86 @@ void IRAM_ATTR yuv2rgb(uint8_t y, uint8_t u, uint8_t v, uint8_t *r, uint8_t *g,
     *g = YUYV_CONSTRAIN(gi);
     *b = YUYV_CONSTRAIN(bi);
 }
+
+// Saturate to 0..255 without branching on the common in-range case
+#define YUYV_SAT(v) (((v) & ~0xFF) ? (uint8_t)(~(v) >> 31) : (uint8_t)(v))
+
+// One YUYV macropixel: chroma terms are looked up once for both pixels
+#define YUYV_PIXELS_BGR(dst, y0, u, v, y1) do {                         \
+        const int rv = yuv_table[v].vVr;                                \
+        const int gv = yuv_table[u].vUg + yuv_table[v].vVg;             \
+        const int bv = yuv_table[u].vUb;                                \
+        const int l0 = yuv_table[y0].vY, l1 = yuv_table[y1].vY;         \
+        (dst)[0] = YUYV_SAT(l0 + bv);                                   \
+        (dst)[1] = YUYV_SAT(l0 + gv);                                   \
+        (dst)[2] = YUYV_SAT(l0 + rv);                                   \
+        (dst)[3] = YUYV_SAT(l1 + bv);                                   \
+        (dst)[4] = YUYV_SAT(l1 + gv);                                   \
+        (dst)[5] = YUYV_SAT(l1 + rv);                                   \
+    } while (0)
+
+#define YUYV_PIXELS_565(dst, y0, u, v, y1) do {                         \
+        uint8_t bgr[6];                                                 \
+        YUYV_PIXELS_BGR(bgr, y0, u, v, y1);                             \
+        (dst)[0] = (bgr[2] & 0xF8) | (bgr[1] >> 5);                     \
+        (dst)[1] = ((bgr[1] & 0x1C) << 3) | (bgr[0] >> 3);              \
+        (dst)[2] = (bgr[5] & 0xF8) | (bgr[4] >> 5);                     \
+        (dst)[3] = ((bgr[4] & 0x1C) << 3) | (bgr[3] >> 3);              \
+    } while (0)
+
+// Macropixels are read a word at a time, little endian: Y0 | U << 8 | Y1 << 16 | V << 24
+static inline uint32_t yuyv_load(const uint8_t *src)
+{
+    uint32_t w;
+    memcpy(&w, src, sizeof(w));
+    return w;
+}
+
+#define YUYV_Y0(w) ((w) & 0xFF)
+#define YUYV_U(w)  (((w) >> 8) & 0xFF)
+#define YUYV_Y1(w) (((w) >> 16) & 0xFF)
+#define YUYV_V(w)  ((w) >> 24)
+
+void yuv422_to_rgb888(const uint8_t *src, uint8_t *dst, size_t pix_count)
+{
+    size_t n = pix_count / 2;
+    size_t i = 0;
+
+    // 8 pixels per iteration
+    for (; i + 4 <= n; i += 4, src += 16, dst += 24) {
+        uint32_t w0 = yuyv_load(src), w1 = yuyv_load(src + 4), w2 = yuyv_load(src + 8), w3 = yuyv_load(src + 12);
+        YUYV_PIXELS_BGR(dst, YUYV_Y0(w0), YUYV_U(w0), YUYV_V(w0), YUYV_Y1(w0));
+        YUYV_PIXELS_BGR(dst + 6, YUYV_Y0(w1), YUYV_U(w1), YUYV_V(w1), YUYV_Y1(w1));
+        YUYV_PIXELS_BGR(dst + 12, YUYV_Y0(w2), YUYV_U(w2), YUYV_V(w2), YUYV_Y1(w2));
+        YUYV_PIXELS_BGR(dst + 18, YUYV_Y0(w3), YUYV_U(w3), YUYV_V(w3), YUYV_Y1(w3));
+    }
+    for (; i < n; i++, src += 4, dst += 6) {
+        YUYV_PIXELS_BGR(dst, src[0], src[1], src[3], src[2]);
+    }
+}
+
+void yuv422_to_rgb565(const uint8_t *src, uint8_t *dst, size_t pix_count)
+{
+    size_t n = pix_count / 2;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4, src += 16, dst += 16) {
+        uint32_t w0 = yuyv_load(src), w1 = yuyv_load(src + 4), w2 = yuyv_load(src + 8), w3 = yuyv_load(src + 12);
+        YUYV_PIXELS_565(dst, YUYV_Y0(w0), YUYV_U(w0), YUYV_V(w0), YUYV_Y1(w0));
+        YUYV_PIXELS_565(dst + 4, YUYV_Y0(w1), YUYV_U(w1), YUYV_V(w1), YUYV_Y1(w1));
+        YUYV_PIXELS_565(dst + 8, YUYV_Y0(w2), YUYV_U(w2), YUYV_V(w2), YUYV_Y1(w2));
+        YUYV_PIXELS_565(dst + 12, YUYV_Y0(w3), YUYV_U(w3), YUYV_V(w3), YUYV_Y1(w3));
+    }
+    for (; i < n; i++, src += 4, dst += 4) {
+        YUYV_PIXELS_565(dst, src[0], src[1], src[3], src[2]);
+    }
+}
+
+void yuv422_to_gray(const uint8_t *src, uint8_t *dst, size_t pix_count)
+{
+    // A plain strided copy of the luma bytes, packing them into words by hand was slower
+    for (size_t i = 0; i + 1 < pix_count; i += 2, src += 4, dst += 2) {
+        dst[0] = src[0];
+        dst[1] = src[2];
+    }
+}
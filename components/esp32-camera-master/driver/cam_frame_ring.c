@@ -0,0 +1,114 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include "cam_frame_ring.h"
+
+static bool slot_cas(cam_slot_t *slot, unsigned from, unsigned to)
+{
+    return atomic_compare_exchange_strong_explicit(&slot->state, &from, to, memory_order_acq_rel, memory_order_relaxed);
+}
+
+bool cam_frame_ring_init(cam_frame_ring_t *ring, size_t count, bool latest)
+{
+    ring->slots = (cam_slot_t *)calloc(count, sizeof(cam_slot_t));
+    if (!ring->slots) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        atomic_init(&ring->slots[i].state, CAM_SLOT_FREE);
+        atomic_init(&ring->slots[i].seq, 0);
+    }
+    ring->count = count;
+    ring->latest = latest;
+    ring->seq = 0;
+    return true;
+}
+
+void cam_frame_ring_deinit(cam_frame_ring_t *ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+    ring->count = 0;
+}
+
+int cam_frame_ring_acquire(cam_frame_ring_t *ring)
+{
+    for (size_t i = 0; i < ring->count; i++) {
+        if (slot_cas(&ring->slots[i], CAM_SLOT_FREE, CAM_SLOT_FILLING)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+size_t cam_frame_ring_publish(cam_frame_ring_t *ring, int slot)
+{
+    uint32_t seq = ++ring->seq;
+    size_t recycled = 0;
+    atomic_store_explicit(&ring->slots[slot].seq, seq, memory_order_relaxed);
+    atomic_store_explicit(&ring->slots[slot].state, CAM_SLOT_READY, memory_order_release);
+    if (ring->latest) {
+        // Only the producer makes slots READY, so every other READY slot is older
+        for (size_t i = 0; i < ring->count; i++) {
+            if (i != (size_t)slot && slot_cas(&ring->slots[i], CAM_SLOT_READY, CAM_SLOT_FREE)) {
+                recycled++;
+            }
+        }
+    }
+    return recycled;
+}
+
+int cam_frame_ring_take(cam_frame_ring_t *ring)
+{
+    while (1) {
+        int oldest = -1;
+        uint32_t oldest_seq = 0;
+        for (size_t i = 0; i < ring->count; i++) {
+            if (atomic_load_explicit(&ring->slots[i].state, memory_order_acquire) != CAM_SLOT_READY) {
+                continue;
+            }
+            uint32_t seq = atomic_load_explicit(&ring->slots[i].seq, memory_order_relaxed);
+            // Wrap-safe comparison of publish numbers
+            if (oldest < 0 || (int32_t)(seq - oldest_seq) < 0) {
+                oldest = i;
+                oldest_seq = seq;
+            }
+        }
+        if (oldest < 0) {
+            return -1;
+        }
+        if (slot_cas(&ring->slots[oldest], CAM_SLOT_READY, CAM_SLOT_HELD)) {
+            return oldest;
+        }
+        // Another consumer took it, or the producer recycled it: scan again
+    }
+}
+
+bool cam_frame_ring_release(cam_frame_ring_t *ring, int slot)
+{
+    if (slot < 0 || (size_t)slot >= ring->count) {
+        return false;
+    }
+    return slot_cas(&ring->slots[slot], CAM_SLOT_HELD, CAM_SLOT_FREE);
+}
+
+void cam_frame_ring_release_all(cam_frame_ring_t *ring)
+{
+    for (size_t i = 0; i < ring->count; i++) {
+        if (!slot_cas(&ring->slots[i], CAM_SLOT_HELD, CAM_SLOT_FREE)) {
+            slot_cas(&ring->slots[i], CAM_SLOT_READY, CAM_SLOT_FREE);
+        }
+    }
+}
@@ -14,10 +14,12 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdalign.h>
 #include "esp_heap_caps.h"
 #include "ll_cam.h"
 #include "cam_hal.h"
+#include "cam_jpeg_markers.h"
 
 #if (ESP_IDF_VERSION_MAJOR == 3) && (ESP_IDF_VERSION_MINOR == 3)
 #include "rom/ets_sys.h"
@@ -39,63 +41,78 @@
 #define CAM_TASK_STACK             (2*1024)
 #endif
 
+// A frame size switch waits for the frame in flight, the slowest sizes run at a few fps
+#define CAM_MODE_HOLD_TIMEOUT      (1000 / portTICK_PERIOD_MS)
+
 static const char *TAG = "cam_hal";
 static cam_obj_t *cam_obj = NULL;
 
-static const uint32_t JPEG_SOI_MARKER = 0xFFD8FF;  // written in little-endian for esp32
-static const uint16_t JPEG_EOI_MARKER = 0xD9FF;  // written in little-endian for esp32
-
-static int cam_verify_jpeg_soi(const uint8_t *inbuf, uint32_t length)
+// Called at VSYNC: whether the scheduler lets a new frame start
+static bool cam_capture_due(void)
 {
-    for (uint32_t i = 0; i < length; i++) {
-        if (memcmp(&inbuf[i], &JPEG_SOI_MARKER, 3) == 0) {
-            //ESP_LOGW(TAG, "SOI: %d", (int) i);
-            return i;
+    switch (cam_obj->capture_mode) {
+        case CAMERA_CAPTURE_ON_DEMAND:
+            // Requests are only counted off once their frame is published
+            return atomic_load(&cam_obj->capture_requests) != 0;
+        case CAMERA_CAPTURE_RATE: {
+            int64_t interval = cam_obj->capture_interval_us;
+            int64_t now = cam_obj->vsync_us;
+            // VSYNC jitter must not push a frame that is due anyway to the next one
+            if (now < cam_obj->next_capture_us - interval / 8) {
+                return false;
+            }
+            // Frames only start at VSYNC, advancing by the interval keeps the average rate
+            cam_obj->next_capture_us += interval;
+            if (cam_obj->next_capture_us <= now) {
+                cam_obj->next_capture_us = now + interval;
+            }
+            return true;
         }
+        default:
+            return true;
     }
-    ESP_LOGW(TAG, "NO-SOI");
-    return -1;
 }
 
-static int cam_verify_jpeg_eoi(const uint8_t *inbuf, uint32_t length)
+static void cam_capture_done(void)
 {
-    int offset = -1;
-    uint8_t *dptr = (uint8_t *)inbuf + length - 2;
-    while (dptr > inbuf) {
-        if (memcmp(dptr, &JPEG_EOI_MARKER, 2) == 0) {
-            offset = dptr - inbuf;
-            //ESP_LOGW(TAG, "EOI: %d", length - (offset + 2));
-            return offset;
-        }
-        dptr--;
+    unsigned n = atomic_load(&cam_obj->capture_requests);
+    while (n && !atomic_compare_exchange_weak(&cam_obj->capture_requests, &n, n - 1)) {
     }
-    return -1;
 }
 
-static bool cam_get_next_frame(int * frame_pos)
+static bool cam_start_frame(int * frame_pos)
 {
-    if(!cam_obj->frames[*frame_pos].en){
-        for (int x = 0; x < cam_obj->frame_cnt; x++) {
-            if (cam_obj->frames[x].en) {
-                *frame_pos = x;
-                return true;
-            }
+    if (atomic_load(&cam_obj->mode_hold)) {
+        // The frame in flight is published, the DMA layout may change until the hold is released
+        if (!cam_obj->mode_held) {
+            cam_obj->mode_held = true;
+            xSemaphoreGive(cam_obj->mode_idle);
         }
-    } else {
-        return true;
+        return false;
     }
-    return false;
-}
-
-static bool cam_start_frame(int * frame_pos)
-{
-    if (cam_get_next_frame(frame_pos)) {
+    // A frame that was dropped is still FILLING and gets reused, it was already scheduled
+    if (*frame_pos < 0) {
+        if (!cam_capture_due()) {
+            // The DMA stays stopped until the next frame is due
+            return false;
+        }
+        *frame_pos = cam_frame_ring_acquire(&cam_obj->ring);
+        if (*frame_pos < 0) {
+            // Every buffer is queued or held by the application, this frame is lost
+            cam_obj->stats.queue_drops++;
+        }
+    }
+    if (*frame_pos >= 0) {
         if(ll_cam_start(cam_obj, *frame_pos)){
             // Vsync the frame manually
             ll_cam_do_vsync(cam_obj);
-            uint64_t us = (uint64_t)esp_timer_get_time();
+            // The frame starts at the VSYNC being handled, not when the task got to it
+            uint64_t us = (uint64_t)cam_obj->vsync_us;
             cam_obj->frames[*frame_pos].fb.timestamp.tv_sec = us / 1000000UL;
             cam_obj->frames[*frame_pos].fb.timestamp.tv_usec = us % 1000000UL;
+            cam_obj->frames[*frame_pos].fb.seq = cam_obj->vsync_cnt;
+            cam_obj->frames[*frame_pos].fb.width = cam_obj->width;
+            cam_obj->frames[*frame_pos].fb.height = cam_obj->height;
             return true;
         }
     }
@@ -104,6 +121,10 @@ static bool cam_start_frame(int * frame_pos)
 
 void IRAM_ATTR ll_cam_send_event(cam_obj_t *cam, cam_event_t cam_event, BaseType_t * HPTaskAwoken)
 {
+    if (cam_event == CAM_VSYNC_EVENT) {
+        cam->vsync_us = esp_timer_get_time();
+        cam->vsync_cnt++;
+    }
     if (xQueueSendFromISR(cam->event_queue, (void *)&cam_event, HPTaskAwoken) != pdTRUE) {
         ll_cam_stop(cam);
         cam->state = CAM_STATE_IDLE;
@@ -111,11 +132,21 @@ void IRAM_ATTR ll_cam_send_event(cam_obj_t *cam, cam_event_t cam_event, BaseType
     }
 }
 
+static void cam_count_frame(void)
+{
+    int64_t us = esp_timer_get_time();
+    if (!cam_obj->stats.frames) {
+        cam_obj->first_frame_us = us;
+    }
+    cam_obj->last_frame_us = us;
+    cam_obj->stats.frames++;
+}
+
 //Copy fram from DMA dma_buffer to fram dma_buffer
 static void cam_task(void *arg)
 {
     int cnt = 0;
-    int frame_pos = 0;
+    int frame_pos = -1;
     cam_obj->state = CAM_STATE_IDLE;
     cam_event_t cam_event = 0;
 
@@ -146,6 +177,7 @@ static void cam_task(void *arg)
                     if(!cam_obj->psram_mode){
                         if (cam_obj->fb_size < (frame_buffer_event->len + pixels_per_dma)) {
                             ESP_LOGW(TAG, "FB-OVF");
+                            cam_obj->stats.fb_overflow++;
                             ll_cam_stop(cam_obj);
                             DBG_PIN_SET(0);
                             continue;
@@ -156,7 +188,8 @@ static void cam_task(void *arg)
                             cam_obj->dma_half_buffer_size);
                     }
                     //Check for JPEG SOI in the first buffer. stop if not found
-                    if (cam_obj->jpeg_mode && cnt == 0 && cam_verify_jpeg_soi(frame_buffer_event->buf, frame_buffer_event->len) != 0) {
+                    if (cam_obj->jpeg_mode && cnt == 0 && cam_find_jpeg_soi(frame_buffer_event->buf, frame_buffer_event->len) != 0) {
+                        cam_obj->stats.no_soi++;
                         ll_cam_stop(cam_obj);
                         cam_obj->state = CAM_STATE_IDLE;
                     }
@@ -171,6 +204,7 @@ static void cam_task(void *arg)
                             if (!cam_obj->psram_mode) {
                                 if (cam_obj->fb_size < (frame_buffer_event->len + pixels_per_dma)) {
                                     ESP_LOGW(TAG, "FB-OVF");
+                                    cam_obj->stats.fb_overflow++;
                                     cnt--;
                                 } else {
                                     frame_buffer_event->len += ll_cam_memcpy(cam_obj,
@@ -182,7 +216,7 @@ static void cam_task(void *arg)
                             cnt++;
                         }
 
-                        cam_obj->frames[frame_pos].en = 0;
+                        bool drop = false;
 
                         if (cam_obj->psram_mode) {
                             if (cam_obj->jpeg_mode) {
@@ -190,29 +224,32 @@ static void cam_task(void *arg)
                             } else {
                                 frame_buffer_event->len = cam_obj->recv_size;
                             }
-                        } else if (!cam_obj->jpeg_mode) {
+                        }
+                        if (cam_obj->jpeg_mode) {
+                            // The EOI is in the last two DMA transfers, unless the frame is broken
+                            int offset_e = cam_find_jpeg_frame_eoi(frame_buffer_event->buf, frame_buffer_event->len, 2 * cam_obj->dma_half_buffer_size);
+                            if (offset_e >= 0) {
+                                // Data after the end marker is discarded
+                                frame_buffer_event->len = offset_e + CAM_JPEG_EOI_LEN;
+                            } else {
+                                ESP_LOGW(TAG, "NO-EOI");
+                                cam_obj->stats.no_eoi++;
+                                drop = true;
+                            }
+                        } else if (!cam_obj->psram_mode) {
                             if (frame_buffer_event->len != cam_obj->fb_size) {
-                                cam_obj->frames[frame_pos].en = 1;
+                                drop = true;
+                                cam_obj->stats.fb_size_err++;
                                 ESP_LOGE(TAG, "FB-SIZE: %u != %u", frame_buffer_event->len, (unsigned) cam_obj->fb_size);
                             }
                         }
-                        //send frame
-                        if(!cam_obj->frames[frame_pos].en && xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
-                            //pop frame buffer from the queue
-                            camera_fb_t * fb2 = NULL;
-                            if(xQueueReceive(cam_obj->frame_buffer_queue, &fb2, 0) == pdTRUE) {
-                                //push the new frame to the end of the queue
-                                if (xQueueSend(cam_obj->frame_buffer_queue, (void *)&frame_buffer_event, 0) != pdTRUE) {
-                                    cam_obj->frames[frame_pos].en = 1;
-                                    ESP_LOGE(TAG, "FBQ-SND");
-                                }
-                                //free the popped buffer
-                                cam_give(fb2);
-                            } else {
-                                //queue is full and we could not pop a frame from it
-                                cam_obj->frames[frame_pos].en = 1;
-                                ESP_LOGE(TAG, "FBQ-RCV");
-                            }
+                        //send frame, a dropped one is refilled with the next
+                        if (!drop) {
+                            cam_count_frame();
+                            cam_capture_done();
+                            cam_obj->stats.queue_drops += cam_frame_ring_publish(&cam_obj->ring, frame_pos);
+                            xSemaphoreGive(cam_obj->frame_ready);
+                            frame_pos = -1;
                         }
                     }
 
@@ -249,6 +286,17 @@ static lldesc_t * allocate_dma_descriptors(uint32_t count, uint16_t size, uint8_
     return dma;
 }
 
+static void cam_free_modes(cam_mode_t *modes, size_t count)
+{
+    if (!modes) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        free(modes[i].dma);
+    }
+    free(modes);
+}
+
 static esp_err_t cam_dma_config(const camera_config_t *config)
 {
     bool ret = ll_cam_dma_sizes(cam_obj);
@@ -277,9 +325,10 @@ static esp_err_t cam_dma_config(const camera_config_t *config)
             fb_size = cam_obj->recv_size;
         }
     }
+    cam_obj->fb_alloc_size = fb_size;
 
     /* Allocate memory for frame buffer */
-    size_t alloc_size = fb_size * sizeof(uint8_t) + dma_align;
+    size_t alloc_size = fb_size * sizeof(uint8_t) + dma_align + CAMERA_FB_HEADROOM;
     uint32_t _caps = MALLOC_CAP_8BIT;
     if (CAMERA_FB_IN_DRAM == config->fb_location) {
         _caps |= MALLOC_CAP_INTERNAL;
@@ -289,7 +338,6 @@ static esp_err_t cam_dma_config(const camera_config_t *config)
     for (int x = 0; x < cam_obj->frame_cnt; x++) {
         cam_obj->frames[x].dma = NULL;
         cam_obj->frames[x].fb_offset = 0;
-        cam_obj->frames[x].en = 0;
         ESP_LOGI(TAG, "Allocating %d Byte frame buffer in %s", alloc_size, _caps & MALLOC_CAP_SPIRAM ? "PSRAM" : "OnBoard RAM");
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
         // In IDF v4.2 and earlier, memory returned by heap_caps_aligned_alloc must be freed using heap_caps_aligned_free.
@@ -299,27 +347,39 @@ static esp_err_t cam_dma_config(const camera_config_t *config)
         cam_obj->frames[x].fb.buf = (uint8_t *)heap_caps_malloc(alloc_size, _caps);
 #endif
         CAM_CHECK(cam_obj->frames[x].fb.buf != NULL, "frame buffer malloc failed", ESP_FAIL);
+        cam_obj->frames[x].fb_offset = CAMERA_FB_HEADROOM;
+        cam_obj->frames[x].fb.buf += CAMERA_FB_HEADROOM;
         if (cam_obj->psram_mode) {
-            //align PSRAM buffer. TODO: save the offset so proper address can be freed later
-            cam_obj->frames[x].fb_offset = dma_align - ((uint32_t)cam_obj->frames[x].fb.buf & (dma_align - 1));
-            cam_obj->frames[x].fb.buf += cam_obj->frames[x].fb_offset;
+            //align PSRAM buffer past the headroom
+            size_t align_offset = dma_align - ((uint32_t)cam_obj->frames[x].fb.buf & (dma_align - 1));
+            cam_obj->frames[x].fb_offset += align_offset;
+            cam_obj->frames[x].fb.buf += align_offset;
             ESP_LOGI(TAG, "Frame[%d]: Offset: %u, Addr: 0x%08X", x, cam_obj->frames[x].fb_offset, (unsigned) cam_obj->frames[x].fb.buf);
             cam_obj->frames[x].dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->frames[x].fb.buf);
             CAM_CHECK(cam_obj->frames[x].dma != NULL, "frame dma malloc failed", ESP_FAIL);
         }
-        cam_obj->frames[x].en = 1;
     }
 
     if (!cam_obj->psram_mode) {
-        cam_obj->dma_buffer = (uint8_t *)heap_caps_malloc(cam_obj->dma_buffer_size * sizeof(uint8_t), MALLOC_CAP_DMA);
+        // RGB layouts of any frame size stay within CONFIG_CAMERA_DMA_BUFFER_SIZE_MAX,
+        // sized for that the buffer serves every size cam_prepare_modes() accepts
+        cam_obj->dma_buffer_alloc = cam_obj->dma_buffer_size;
+        if (!cam_obj->jpeg_mode) {
+            uint32_t dma_buffer_max = 2 * (CONFIG_CAMERA_DMA_BUFFER_SIZE_MAX / 2 / cam_obj->dma_bytes_per_item) * cam_obj->dma_bytes_per_item;
+            if (cam_obj->dma_buffer_alloc < dma_buffer_max) {
+                cam_obj->dma_buffer_alloc = dma_buffer_max;
+            }
+        }
+        cam_obj->dma_buffer = (uint8_t *)heap_caps_malloc(cam_obj->dma_buffer_alloc * sizeof(uint8_t), MALLOC_CAP_DMA);
         if(NULL == cam_obj->dma_buffer) {
             ESP_LOGE(TAG,"%s(%d): DMA buffer %d Byte malloc failed, the current largest free block:%d Byte", __FUNCTION__, __LINE__,
-                     (int) cam_obj->dma_buffer_size, (int) heap_caps_get_largest_free_block(MALLOC_CAP_DMA));
+                     (int) cam_obj->dma_buffer_alloc, (int) heap_caps_get_largest_free_block(MALLOC_CAP_DMA));
             return ESP_FAIL;
         }
 
         cam_obj->dma = allocate_dma_descriptors(cam_obj->dma_node_cnt, cam_obj->dma_node_buffer_size, cam_obj->dma_buffer);
         CAM_CHECK(cam_obj->dma != NULL, "dma malloc failed", ESP_FAIL);
+        cam_obj->dma_base = cam_obj->dma;
     }
 
     return ESP_OK;
@@ -356,6 +416,25 @@ err:
     return ESP_FAIL;
 }
 
+static void cam_set_frame_size(cam_obj_t *cam, framesize_t frame_size)
+{
+    cam->frame_size = frame_size;
+    cam->width = resolution[frame_size].width;
+    cam->height = resolution[frame_size].height;
+
+    if(cam->jpeg_mode){
+#ifdef CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_AUTO
+        cam->recv_size = cam->width * cam->height / 5;
+#else
+        cam->recv_size = CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE;
+#endif
+        cam->fb_size = cam->recv_size;
+    } else {
+        cam->recv_size = cam->width * cam->height * cam->in_bytes_per_pixel;
+        cam->fb_size = cam->width * cam->height * cam->fb_bytes_per_pixel;
+    }
+}
+
 esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint16_t sensor_pid)
 {
     CAM_CHECK(NULL != config, "config pointer is invalid", ESP_ERR_INVALID_ARG);
@@ -370,37 +449,27 @@ esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint
     cam_obj->psram_mode = (config->xclk_freq_hz == 16000000);
 #endif
     cam_obj->frame_cnt = config->fb_count;
-    cam_obj->width = resolution[frame_size].width;
-    cam_obj->height = resolution[frame_size].height;
-
-    if(cam_obj->jpeg_mode){
-#ifdef CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_AUTO
-        cam_obj->recv_size = cam_obj->width * cam_obj->height / 5;
-#else
-        cam_obj->recv_size = CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE;
-#endif
-        cam_obj->fb_size = cam_obj->recv_size;
-    } else {
-        cam_obj->recv_size = cam_obj->width * cam_obj->height * cam_obj->in_bytes_per_pixel;
-        cam_obj->fb_size = cam_obj->width * cam_obj->height * cam_obj->fb_bytes_per_pixel;
-    }
+    cam_set_frame_size(cam_obj, frame_size);
 
     ret = cam_dma_config(config);
     CAM_CHECK_GOTO(ret == ESP_OK, "cam_dma_config failed", err);
 
+    cam_obj->mode_idle = xSemaphoreCreateBinary();
+    CAM_CHECK_GOTO(cam_obj->mode_idle != NULL, "mode_idle create failed", err);
+
     size_t queue_size = cam_obj->dma_half_buffer_cnt - 1;
     if (queue_size == 0) {
         queue_size = 1;
     }
     cam_obj->event_queue = xQueueCreate(queue_size, sizeof(cam_event_t));
     CAM_CHECK_GOTO(cam_obj->event_queue != NULL, "event_queue create failed", err);
+    cam_obj->event_queue_len = queue_size;
 
-    size_t frame_buffer_queue_len = cam_obj->frame_cnt;
-    if (config->grab_mode == CAMERA_GRAB_LATEST && cam_obj->frame_cnt > 1) {
-        frame_buffer_queue_len = cam_obj->frame_cnt - 1;
-    }
-    cam_obj->frame_buffer_queue = xQueueCreate(frame_buffer_queue_len, sizeof(camera_fb_t*));
-    CAM_CHECK_GOTO(cam_obj->frame_buffer_queue != NULL, "frame_buffer_queue create failed", err);
+    // With a single frame buffer there is nothing to recycle, the frame is refilled once it is returned
+    bool latest = config->grab_mode == CAMERA_GRAB_LATEST && cam_obj->frame_cnt > 1;
+    CAM_CHECK_GOTO(cam_frame_ring_init(&cam_obj->ring, cam_obj->frame_cnt, latest), "frame ring create failed", err);
+    cam_obj->frame_ready = xSemaphoreCreateCounting(cam_obj->frame_cnt, 0);
+    CAM_CHECK_GOTO(cam_obj->frame_ready != NULL, "frame_ready create failed", err);
 
     ret = ll_cam_init_isr(cam_obj);
     CAM_CHECK_GOTO(ret == ESP_OK, "cam intr alloc failed", err);
@@ -435,14 +504,19 @@ esp_err_t cam_deinit(void)
     if (cam_obj->event_queue) {
         vQueueDelete(cam_obj->event_queue);
     }
-    if (cam_obj->frame_buffer_queue) {
-        vQueueDelete(cam_obj->frame_buffer_queue);
+    if (cam_obj->frame_ready) {
+        vSemaphoreDelete(cam_obj->frame_ready);
     }
+    if (cam_obj->mode_idle) {
+        vSemaphoreDelete(cam_obj->mode_idle);
+    }
+    cam_frame_ring_deinit(&cam_obj->ring);
 
     ll_cam_deinit(cam_obj);
 
-    if (cam_obj->dma) {
-        free(cam_obj->dma);
+    cam_free_modes(cam_obj->modes, cam_obj->mode_cnt);
+    if (cam_obj->dma_base) {
+        free(cam_obj->dma_base);
     }
     if (cam_obj->dma_buffer) {
         free(cam_obj->dma_buffer);
@@ -473,44 +547,54 @@ void cam_start(void)
     ll_cam_vsync_intr_enable(cam_obj, true);
 }
 
+// The semaphore only wakes consumers up, the ring decides who gets a frame
+static camera_fb_t *cam_take_ready(TickType_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    while (1) {
+        int slot = cam_frame_ring_take(&cam_obj->ring);
+        if (slot >= 0) {
+            return &cam_obj->frames[slot].fb;
+        }
+        // Nothing ready and nothing being captured: this call is the request
+        if (cam_obj->capture_mode == CAMERA_CAPTURE_ON_DEMAND && !atomic_load(&cam_obj->capture_requests)) {
+            cam_request_capture(1);
+        }
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) {
+            return NULL;
+        }
+        xSemaphoreTake(cam_obj->frame_ready, (timeout == portMAX_DELAY) ? portMAX_DELAY : timeout - elapsed);
+    }
+}
+
 camera_fb_t *cam_take(TickType_t timeout)
 {
     camera_fb_t *dma_buffer = NULL;
-    TickType_t start = xTaskGetTickCount();
-    xQueueReceive(cam_obj->frame_buffer_queue, (void *)&dma_buffer, timeout);
 #if CONFIG_IDF_TARGET_ESP32S3
     // Currently (22.01.2024) there is a bug in ESP-IDF v5.2, that causes
     // GDMA to fall into a strange state if it is running while WiFi STA is connecting.
     // This code tries to reset GDMA if frame is not received, to try and help with
-    // this case. It is possible to have some side effects too, though none come to mind
+    // this case. It is possible to have some side effects too, though none come to mind.
+    // The wait is split around the reset, so the call as a whole stays within the timeout
+    TickType_t first_wait = (timeout == portMAX_DELAY) ? timeout : timeout / 2;
+    dma_buffer = cam_take_ready(first_wait);
     if (!dma_buffer) {
         ll_cam_dma_reset(cam_obj);
-        xQueueReceive(cam_obj->frame_buffer_queue, (void *)&dma_buffer, timeout);
+        dma_buffer = cam_take_ready(timeout - first_wait);
     }
+#else
+    dma_buffer = cam_take_ready(timeout);
 #endif
     if (dma_buffer) {
-        if(cam_obj->jpeg_mode){
-            // find the end marker for JPEG. Data after that can be discarded
-            int offset_e = cam_verify_jpeg_eoi(dma_buffer->buf, dma_buffer->len);
-            if (offset_e >= 0) {
-                // adjust buffer length
-                dma_buffer->len = offset_e + sizeof(JPEG_EOI_MARKER);
-                return dma_buffer;
-            } else {
-                ESP_LOGW(TAG, "NO-EOI");
-                cam_give(dma_buffer);
-                TickType_t ticks_spent = xTaskGetTickCount() - start;
-                if (ticks_spent >= timeout) {
-                    return NULL; /* We are out of time */
-                }
-                return cam_take(timeout - ticks_spent);//recurse!!!!
-            }
-        } else if(cam_obj->psram_mode && cam_obj->in_bytes_per_pixel != cam_obj->fb_bytes_per_pixel){
+        // JPEG frames are queued already trimmed to their EOI by cam_task
+        if(!cam_obj->jpeg_mode && cam_obj->psram_mode && cam_obj->in_bytes_per_pixel != cam_obj->fb_bytes_per_pixel){
             //currently this is used only for YUV to GRAYSCALE
             dma_buffer->len = ll_cam_memcpy(cam_obj, dma_buffer->buf, dma_buffer->buf, dma_buffer->len);
         }
         return dma_buffer;
     } else {
+        cam_obj->stats.take_timeouts++;
         ESP_LOGW(TAG, "Failed to get the frame on time!");
 // #if CONFIG_IDF_TARGET_ESP32S3
 //         ll_cam_dma_print_state(cam_obj);
@@ -519,18 +603,205 @@ camera_fb_t *cam_take(TickType_t timeout)
     return NULL;
 }
 
+void cam_set_capture_mode(camera_capture_mode_t mode, uint32_t fps)
+{
+    atomic_store(&cam_obj->capture_requests, 0);
+    cam_obj->capture_interval_us = fps ? 1000000 / fps : 0;
+    cam_obj->next_capture_us = 0;
+    cam_obj->capture_mode = mode;
+}
+
+camera_capture_mode_t cam_get_capture_mode(void)
+{
+    return cam_obj->capture_mode;
+}
+
+void cam_request_capture(size_t count)
+{
+    atomic_fetch_add(&cam_obj->capture_requests, count);
+}
+
 void cam_give(camera_fb_t *dma_buffer)
 {
-    for (int x = 0; x < cam_obj->frame_cnt; x++) {
-        if (&cam_obj->frames[x].fb == dma_buffer) {
-            cam_obj->frames[x].en = 1;
-            break;
-        }
+    cam_frame_t *frame = (cam_frame_t *)((uint8_t *)dma_buffer - offsetof(cam_frame_t, fb));
+    if (!cam_frame_ring_release(&cam_obj->ring, frame - cam_obj->frames)) {
+        ESP_LOGW(TAG, "Returned frame is not held");
     }
 }
 
 void cam_give_all(void) {
-    for (int x = 0; x < cam_obj->frame_cnt; x++) {
-        cam_obj->frames[x].en = 1;
+    cam_frame_ring_release_all(&cam_obj->ring);
+}
+
+void cam_get_stats(camera_stats_t *stats)
+{
+    *stats = cam_obj->stats;
+    stats->frame_interval_us = 0;
+    if (stats->frames > 1) {
+        stats->frame_interval_us = (cam_obj->last_frame_us - cam_obj->first_frame_us) / (stats->frames - 1);
+    }
+}
+
+void cam_reset_stats(void)
+{
+    memset(&cam_obj->stats, 0, sizeof(cam_obj->stats));
+}
+
+static int cam_find_mode(const cam_mode_t *modes, size_t count, framesize_t frame_size)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (modes[i].frame_size == frame_size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void cam_apply_mode(const cam_mode_t *mode)
+{
+    cam_obj->frame_size = mode->frame_size;
+    cam_obj->width = mode->width;
+    cam_obj->height = mode->height;
+    cam_obj->recv_size = mode->recv_size;
+    cam_obj->fb_size = mode->fb_size;
+    cam_obj->dma_buffer_size = mode->dma_buffer_size;
+    cam_obj->dma_half_buffer_size = mode->dma_half_buffer_size;
+    cam_obj->dma_half_buffer_cnt = mode->dma_half_buffer_cnt;
+    cam_obj->dma_node_buffer_size = mode->dma_node_buffer_size;
+    cam_obj->dma_node_cnt = mode->dma_node_cnt;
+    cam_obj->frame_copy_cnt = mode->frame_copy_cnt;
+    cam_obj->dma = mode->dma;
+}
+
+// Returns once cam_task sits between two frames and starts no new one
+static esp_err_t cam_hold(void)
+{
+    xSemaphoreTake(cam_obj->mode_idle, 0);
+    cam_obj->mode_held = false;
+    atomic_store(&cam_obj->mode_hold, true);
+    if (xSemaphoreTake(cam_obj->mode_idle, CAM_MODE_HOLD_TIMEOUT) != pdTRUE) {
+        atomic_store(&cam_obj->mode_hold, false);
+        ESP_LOGW(TAG, "No VSYNC, the DMA layout was not changed");
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+static void cam_release(void)
+{
+    atomic_store(&cam_obj->mode_hold, false);
+}
+
+// Layout of one frame size, computed on a copy of cam_obj the way cam_config() does it
+static esp_err_t cam_build_mode(cam_obj_t *scratch, framesize_t frame_size, cam_mode_t *mode)
+{
+    memcpy(scratch, cam_obj, sizeof(cam_obj_t));
+    cam_set_frame_size(scratch, frame_size);
+    if (scratch->jpeg_mode) {
+        // Every JPEG frame gets the whole buffer, the size estimate only has to fit in it
+        if (scratch->fb_size > cam_obj->fb_alloc_size) {
+            ESP_LOGE(TAG, "%ux%u JPEG frames need %u bytes, the frame buffers have %u",
+                     scratch->width, scratch->height, (unsigned) scratch->fb_size, (unsigned) cam_obj->fb_alloc_size);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        scratch->recv_size = cam_obj->fb_alloc_size;
+        scratch->fb_size = cam_obj->fb_alloc_size;
+    }
+    if (!ll_cam_dma_sizes(scratch)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (scratch->fb_size > cam_obj->fb_alloc_size || scratch->dma_buffer_size > cam_obj->dma_buffer_alloc) {
+        ESP_LOGE(TAG, "%ux%u does not fit the buffers allocated at init", scratch->width, scratch->height);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // The ISR queues an event per half buffer, more than the queue holds ends in EV-OVF
+    if (scratch->dma_half_buffer_cnt > cam_obj->event_queue_len + 1) {
+        ESP_LOGE(TAG, "%ux%u needs %u DMA half buffers, the event queue was sized for %u",
+                 scratch->width, scratch->height, (unsigned) scratch->dma_half_buffer_cnt,
+                 (unsigned) cam_obj->event_queue_len + 1);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    mode->frame_size = frame_size;
+    mode->width = scratch->width;
+    mode->height = scratch->height;
+    mode->recv_size = scratch->recv_size;
+    mode->fb_size = scratch->fb_size;
+    mode->dma_buffer_size = scratch->dma_buffer_size;
+    mode->dma_half_buffer_size = scratch->dma_half_buffer_size;
+    mode->dma_half_buffer_cnt = scratch->dma_half_buffer_cnt;
+    mode->dma_node_buffer_size = scratch->dma_node_buffer_size;
+    mode->dma_node_cnt = scratch->dma_buffer_size / scratch->dma_node_buffer_size;
+    mode->frame_copy_cnt = scratch->recv_size / scratch->dma_half_buffer_size;
+    mode->dma = allocate_dma_descriptors(mode->dma_node_cnt, mode->dma_node_buffer_size, cam_obj->dma_buffer);
+    CAM_CHECK(mode->dma != NULL, "dma malloc failed", ESP_ERR_NO_MEM);
+    return ESP_OK;
+}
+
+esp_err_t cam_prepare_modes(const framesize_t *frame_sizes, size_t count)
+{
+    CAM_CHECK(!cam_obj->psram_mode, "frames are received straight into their buffers", ESP_ERR_NOT_SUPPORTED);
+
+    // The current size is always prepared, so that there is a way back
+    cam_mode_t *modes = (cam_mode_t *)calloc(count + 1, sizeof(cam_mode_t));
+    cam_obj_t *scratch = (cam_obj_t *)malloc(sizeof(cam_obj_t));
+    size_t mode_cnt = 0;
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    CAM_CHECK_GOTO(modes != NULL && scratch != NULL, "modes malloc failed", err);
+
+    for (size_t i = 0; i <= count; i++) {
+        framesize_t frame_size = i < count ? frame_sizes[i] : cam_obj->frame_size;
+        if (cam_find_mode(modes, mode_cnt, frame_size) >= 0) {
+            continue;
+        }
+        ret = cam_build_mode(scratch, frame_size, &modes[mode_cnt]);
+        if (ret != ESP_OK) {
+            goto err;
+        }
+        mode_cnt++;
+    }
+    free(scratch);
+    scratch = NULL;
+
+    // The chain of the current size is replaced by an identical one, between two frames
+    ret = cam_hold();
+    if (ret != ESP_OK) {
+        goto err;
+    }
+    cam_mode_t *old_modes = cam_obj->modes;
+    size_t old_cnt = cam_obj->mode_cnt;
+    cam_obj->modes = modes;
+    cam_obj->mode_cnt = mode_cnt;
+    cam_apply_mode(&modes[cam_find_mode(modes, mode_cnt, cam_obj->frame_size)]);
+    cam_release();
+    cam_free_modes(old_modes, old_cnt);
+
+    ESP_LOGI(TAG, "%u frame sizes prepared", (unsigned) mode_cnt);
+    return ESP_OK;
+
+err:
+    free(scratch);
+    cam_free_modes(modes, mode_cnt);
+    return ret;
+}
+
+esp_err_t cam_switch_begin(framesize_t frame_size)
+{
+    int mode = cam_find_mode(cam_obj->modes, cam_obj->mode_cnt, frame_size);
+    if (mode < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_err_t ret = cam_hold();
+    if (ret == ESP_OK) {
+        cam_obj->mode_next = mode;
+    }
+    return ret;
+}
+
+void cam_switch_end(bool apply)
+{
+    if (apply) {
+        cam_apply_mode(&cam_obj->modes[cam_obj->mode_next]);
     }
+    cam_release();
 }
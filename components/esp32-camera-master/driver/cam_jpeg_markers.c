@@ -0,0 +1,100 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "esp_log.h"
+#include "cam_jpeg_markers.h"
+
+static const char *TAG = "cam_hal";
+
+static const uint32_t JPEG_SOI_MARKER = 0xFFD8FF;  // written in little-endian for esp32
+
+// Top bit set in exactly the bytes of w that are 0xFF
+static inline uint32_t cam_ff_bytes(uint32_t w)
+{
+    uint32_t v = ~w;
+    return ~(((v & 0x7F7F7F7F) + 0x7F7F7F7F) | v | 0x7F7F7F7F);
+}
+
+// Index of the next 0xFF byte in [from, to), or to. Aligned words without one are skipped whole.
+static uint32_t cam_find_ff(const uint8_t *inbuf, uint32_t from, uint32_t to)
+{
+    uint32_t i = from;
+    while (i < to && ((uintptr_t)&inbuf[i] & 3)) {
+        if (inbuf[i] == 0xFF) {
+            return i;
+        }
+        i++;
+    }
+    while (i + 4 <= to) {
+        uint32_t m = cam_ff_bytes(*(const uint32_t *)&inbuf[i]);
+        if (m) {
+            return i + (__builtin_ctz(m) >> 3);
+        }
+        i += 4;
+    }
+    while (i < to && inbuf[i] != 0xFF) {
+        i++;
+    }
+    return i;
+}
+
+int cam_find_jpeg_soi(const uint8_t *inbuf, uint32_t length)
+{
+    for (uint32_t i = cam_find_ff(inbuf, 0, length); i + 3 <= length; i = cam_find_ff(inbuf, i + 1, length)) {
+        if (memcmp(&inbuf[i], &JPEG_SOI_MARKER, 3) == 0) {
+            return i;
+        }
+    }
+    ESP_LOGW(TAG, "NO-SOI");
+    return -1;
+}
+
+// Offset of the entropy-coded data: walks the marker segments from SOI to the end of SOS.
+// Tables in the headers may hold FF D9 byte pairs, the EOI search has to start past them.
+uint32_t cam_jpeg_header_len(const uint8_t *inbuf, uint32_t length)
+{
+    uint32_t i = 2;
+    while (i + 4 <= length && inbuf[i] == 0xFF) {
+        uint8_t marker = inbuf[i + 1];
+        uint32_t seg_len = (inbuf[i + 2] << 8) | inbuf[i + 3];
+        i += 2 + seg_len;
+        if (marker == 0xDA) {
+            return i <= length ? i : 0;
+        }
+    }
+    return 0;
+}
+
+int cam_find_jpeg_eoi(const uint8_t *inbuf, uint32_t start, uint32_t length)
+{
+    // FF D9 can not occur inside the entropy-coded data, so the first one is the end of the image
+    for (uint32_t i = cam_find_ff(inbuf, start, length); i + 2 <= length; i = cam_find_ff(inbuf, i + 1, length)) {
+        if (inbuf[i + 1] == 0xD9) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int cam_find_jpeg_frame_eoi(const uint8_t *inbuf, uint32_t length, uint32_t tail)
+{
+    uint32_t data_start = cam_jpeg_header_len(inbuf, length);
+    uint32_t seed = length > tail ? length - tail : 0;
+    int offset_e = cam_find_jpeg_eoi(inbuf, seed > data_start ? seed : data_start, length);
+    if (offset_e < 0 && seed > data_start) {
+        offset_e = cam_find_jpeg_eoi(inbuf, data_start, seed + 1);
+    }
+    return offset_e;
+}
@@ -20,6 +20,7 @@
 #include "freertos/task.h"
 #include "driver/gpio.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "sensor.h"
@@ -81,6 +82,7 @@ static const char *TAG = "camera";
 typedef struct {
     sensor_t sensor;
     camera_fb_t fb;
+    framesize_t framesize;      // size of the DMA layout, the sensor may have been set differently
 } camera_state_t;
 
 static const char *CAMERA_SENSOR_NVS_KEY = "sensor";
@@ -307,6 +309,7 @@ esp_err_t esp_camera_init(const camera_config_t *config)
 
     s_state->sensor.status.framesize = frame_size;
     s_state->sensor.pixformat = pix_format;
+    s_state->framesize = frame_size;
 
     ESP_LOGD(TAG, "Setting frame size to %dx%d", resolution[frame_size].width, resolution[frame_size].height);
     if (s_state->sensor.set_framesize(&s_state->sensor, frame_size) != 0) {
@@ -366,9 +369,19 @@ camera_fb_t *esp_camera_fb_get()
     camera_fb_t *fb = cam_take(FB_GET_TIMEOUT);
     //set the frame properties
     if (fb) {
-        fb->width = resolution[s_state->sensor.status.framesize].width;
-        fb->height = resolution[s_state->sensor.status.framesize].height;
+        // Frames carry the size they were captured at, a size set on the sensor directly is only known here
+        if (s_state->sensor.status.framesize != s_state->framesize) {
+            fb->width = resolution[s_state->sensor.status.framesize].width;
+            fb->height = resolution[s_state->sensor.status.framesize].height;
+        }
         fb->format = s_state->sensor.pixformat;
+        // Configured values only: reading the live exposure and gain back would cost an SCCB
+        // transaction per frame and a register layout per sensor
+        fb->aec_value_cfg = s_state->sensor.status.aec_value;
+        fb->agc_gain_cfg = s_state->sensor.status.agc_gain;
+        fb->aec = s_state->sensor.status.aec;
+        fb->agc = s_state->sensor.status.agc;
+        fb->latency_us = esp_timer_get_time() - ((int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec);
     }
     return fb;
 }
@@ -484,3 +497,93 @@ void esp_camera_return_all(void) {
     cam_give_all();
 }
 
+esp_err_t esp_camera_get_stats(camera_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    cam_get_stats(stats);
+    return ESP_OK;
+}
+
+void esp_camera_reset_stats(void)
+{
+    if (s_state == NULL) {
+        return;
+    }
+    cam_reset_stats();
+}
+
+esp_err_t esp_camera_set_capture_mode(camera_capture_mode_t mode, uint32_t fps)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (mode == CAMERA_CAPTURE_RATE && fps == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    cam_set_capture_mode(mode, fps);
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_capture(size_t count)
+{
+    if (s_state == NULL || cam_get_capture_mode() != CAMERA_CAPTURE_ON_DEMAND) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    cam_request_capture(count);
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_prepare_framesizes(const framesize_t *framesizes, size_t count)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (framesizes == NULL && count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    camera_sensor_info_t *info = esp_camera_sensor_get_info(&s_state->sensor.id);
+    for (size_t i = 0; i < count; i++) {
+        if (framesizes[i] >= FRAMESIZE_INVALID || (info && framesizes[i] > info->max_size)) {
+            ESP_LOGE(TAG, "Frame size %d is not supported by the sensor", framesizes[i]);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return cam_prepare_modes(framesizes, count);
+}
+
+esp_err_t esp_camera_set_framesize(framesize_t framesize)
+{
+    if (s_state == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sensor_t *s = &s_state->sensor;
+    if (framesize == s_state->framesize && framesize == s->status.framesize) {
+        return ESP_OK;
+    }
+    esp_err_t err = cam_switch_begin(framesize);
+    if (err == ESP_ERR_NOT_FOUND) {
+        ESP_LOGE(TAG, "Frame size %d was not prepared", framesize);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    // With the register cache only the registers that differ between the sizes are written
+    int64_t t = esp_timer_get_time();
+    if (s->set_framesize(s, framesize) != 0) {
+        ESP_LOGE(TAG, "Failed to set frame size");
+        s->set_framesize(s, s_state->framesize);
+        cam_switch_end(false);
+        return ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE;
+    }
+    s_state->framesize = framesize;
+    cam_switch_end(true);
+    ESP_LOGD(TAG, "Frame size %dx%d set in %u us", resolution[framesize].width, resolution[framesize].height,
+             (unsigned)(esp_timer_get_time() - t));
+    return ESP_OK;
+}
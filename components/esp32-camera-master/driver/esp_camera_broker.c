@@ -0,0 +1,312 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include "esp_camera_broker.h"
+#include "esp_log.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "cam_broker";
+
+#define BROKER_TASK_STACK   2560
+#define BROKER_MAX_SUBS     8
+// More than any sensible fb_count
+#define BROKER_MAX_FRAMES   16
+
+struct camera_broker_sub_s {
+    QueueHandle_t queue;
+    bool drop_oldest;
+    uint32_t dropped;
+    uint32_t fps;
+    int64_t next_us;        // capture time the next frame is due at
+};
+
+typedef struct {
+    camera_fb_t *fb;
+    uint32_t refs;
+} broker_frame_t;
+
+typedef struct {
+    SemaphoreHandle_t lock;     // guards subs and frames
+    SemaphoreHandle_t done;
+    TaskHandle_t task;
+    volatile bool running;
+    camera_broker_sub_t subs[BROKER_MAX_SUBS];
+    size_t sub_cnt;
+    broker_frame_t frames[BROKER_MAX_FRAMES];
+} broker_t;
+
+static broker_t *s_broker = NULL;
+
+static broker_frame_t *broker_frame_find(camera_fb_t *fb)
+{
+    for (int i = 0; i < BROKER_MAX_FRAMES; i++) {
+        if (s_broker->frames[i].fb == fb) {
+            return &s_broker->frames[i];
+        }
+    }
+    return NULL;
+}
+
+// Called with the lock held
+static void broker_frame_unref(camera_fb_t *fb)
+{
+    broker_frame_t *frame = broker_frame_find(fb);
+    if (!frame) {
+        ESP_LOGE(TAG, "Release of a frame not handed out by the broker");
+        return;
+    }
+    if (--frame->refs == 0) {
+        frame->fb = NULL;
+        esp_camera_fb_return(fb);
+    }
+}
+
+// Called with the lock held: the driver captures at the fastest rate a subscriber wants
+static void broker_schedule(void)
+{
+    uint32_t fps = 0;
+    for (size_t i = 0; i < s_broker->sub_cnt; i++) {
+        if (!s_broker->subs[i]->fps) {
+            esp_camera_set_capture_mode(CAMERA_CAPTURE_CONTINUOUS, 0);
+            return;
+        }
+        if (s_broker->subs[i]->fps > fps) {
+            fps = s_broker->subs[i]->fps;
+        }
+    }
+    if (fps) {
+        esp_camera_set_capture_mode(CAMERA_CAPTURE_RATE, fps);
+    } else {
+        esp_camera_set_capture_mode(CAMERA_CAPTURE_ON_DEMAND, 0);
+    }
+}
+
+// Same pacing as the driver: a little early is on time, the average rate is kept
+static bool broker_sub_due(camera_broker_sub_t sub, int64_t us)
+{
+    if (!sub->fps) {
+        return true;
+    }
+    int64_t interval = 1000000 / sub->fps;
+    if (us < sub->next_us - interval / 8) {
+        return false;
+    }
+    sub->next_us += interval;
+    if (sub->next_us <= us) {
+        sub->next_us = us + interval;
+    }
+    return true;
+}
+
+static void broker_publish(camera_fb_t *fb)
+{
+    int64_t us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    broker_frame_t *frame = broker_frame_find(NULL);
+    if (!frame) {
+        ESP_LOGE(TAG, "Too many frames held");
+        esp_camera_fb_return(fb);
+        return;
+    }
+    // The broker keeps a reference while handing the frame out
+    frame->fb = fb;
+    frame->refs = 1;
+    for (size_t i = 0; i < s_broker->sub_cnt; i++) {
+        camera_broker_sub_t sub = s_broker->subs[i];
+        if (!broker_sub_due(sub, us)) {
+            continue;
+        }
+        if (!uxQueueSpacesAvailable(sub->queue)) {
+            sub->dropped++;
+            if (!sub->drop_oldest) {
+                continue;
+            }
+            camera_fb_t *oldest = NULL;
+            if (xQueueReceive(sub->queue, &oldest, 0) == pdTRUE) {
+                broker_frame_unref(oldest);
+            }
+        }
+        // Subscribers only ever take from the queue, there is room now
+        frame->refs++;
+        xQueueSend(sub->queue, &fb, 0);
+    }
+    broker_frame_unref(fb);
+}
+
+static void broker_task(void *arg)
+{
+    while (s_broker->running) {
+        if (!s_broker->sub_cnt) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb) {
+            continue;
+        }
+        xSemaphoreTake(s_broker->lock, portMAX_DELAY);
+        broker_publish(fb);
+        xSemaphoreGive(s_broker->lock);
+    }
+    xSemaphoreGive(s_broker->done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_camera_broker_init(UBaseType_t priority, BaseType_t core_id)
+{
+    if (s_broker) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_broker = (broker_t *)calloc(1, sizeof(broker_t));
+    if (!s_broker) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_broker->lock = xSemaphoreCreateMutex();
+    s_broker->done = xSemaphoreCreateBinary();
+    s_broker->running = true;
+    if (!s_broker->lock || !s_broker->done
+            || esp_camera_set_capture_mode(CAMERA_CAPTURE_ON_DEMAND, 0) != ESP_OK
+            || xTaskCreatePinnedToCore(broker_task, "cam_broker", BROKER_TASK_STACK, NULL, priority, &s_broker->task, core_id) != pdPASS) {
+        ESP_LOGE(TAG, "Broker init failed");
+        if (s_broker->lock) {
+            vSemaphoreDelete(s_broker->lock);
+        }
+        if (s_broker->done) {
+            vSemaphoreDelete(s_broker->done);
+        }
+        free(s_broker);
+        s_broker = NULL;
+        esp_camera_set_capture_mode(CAMERA_CAPTURE_CONTINUOUS, 0);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_broker_deinit(void)
+{
+    if (!s_broker || s_broker->sub_cnt) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_broker->running = false;
+    xTaskNotifyGive(s_broker->task);
+    xSemaphoreTake(s_broker->done, portMAX_DELAY);
+    esp_camera_set_capture_mode(CAMERA_CAPTURE_CONTINUOUS, 0);
+    vSemaphoreDelete(s_broker->lock);
+    vSemaphoreDelete(s_broker->done);
+    free(s_broker);
+    s_broker = NULL;
+    return ESP_OK;
+}
+
+camera_broker_sub_t esp_camera_broker_subscribe(const camera_broker_sub_config_t *config)
+{
+    camera_broker_sub_config_t def = CAMERA_BROKER_SUB_CONFIG_DEFAULT();
+    if (!s_broker) {
+        return NULL;
+    }
+    if (!config) {
+        config = &def;
+    }
+    camera_broker_sub_t sub = (camera_broker_sub_t)calloc(1, sizeof(struct camera_broker_sub_s));
+    if (!sub) {
+        return NULL;
+    }
+    sub->drop_oldest = config->drop_oldest;
+    sub->fps = config->fps;
+    sub->queue = xQueueCreate(config->depth ? config->depth : 1, sizeof(camera_fb_t *));
+    if (!sub->queue) {
+        free(sub);
+        return NULL;
+    }
+
+    xSemaphoreTake(s_broker->lock, portMAX_DELAY);
+    if (s_broker->sub_cnt == BROKER_MAX_SUBS) {
+        xSemaphoreGive(s_broker->lock);
+        ESP_LOGE(TAG, "Too many subscribers");
+        vQueueDelete(sub->queue);
+        free(sub);
+        return NULL;
+    }
+    s_broker->subs[s_broker->sub_cnt++] = sub;
+    broker_schedule();
+    xSemaphoreGive(s_broker->lock);
+    xTaskNotifyGive(s_broker->task);
+    return sub;
+}
+
+esp_err_t esp_camera_broker_set_fps(camera_broker_sub_t sub, uint32_t fps)
+{
+    if (!sub) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_broker) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_broker->lock, portMAX_DELAY);
+    if (sub->fps != fps) {
+        // Paced from the next frame on, a slower rate does not wait out the old interval
+        sub->fps = fps;
+        sub->next_us = 0;
+        broker_schedule();
+    }
+    xSemaphoreGive(s_broker->lock);
+    return ESP_OK;
+}
+
+void esp_camera_broker_unsubscribe(camera_broker_sub_t sub)
+{
+    if (!s_broker || !sub) {
+        return;
+    }
+    xSemaphoreTake(s_broker->lock, portMAX_DELAY);
+    for (size_t i = 0; i < s_broker->sub_cnt; i++) {
+        if (s_broker->subs[i] == sub) {
+            s_broker->subs[i] = s_broker->subs[--s_broker->sub_cnt];
+            broker_schedule();
+            break;
+        }
+    }
+    camera_fb_t *fb = NULL;
+    while (xQueueReceive(sub->queue, &fb, 0) == pdTRUE) {
+        broker_frame_unref(fb);
+    }
+    xSemaphoreGive(s_broker->lock);
+    vQueueDelete(sub->queue);
+    free(sub);
+}
+
+camera_fb_t *esp_camera_broker_take(camera_broker_sub_t sub, TickType_t timeout)
+{
+    camera_fb_t *fb = NULL;
+    if (!sub || xQueueReceive(sub->queue, &fb, timeout) != pdTRUE) {
+        return NULL;
+    }
+    return fb;
+}
+
+void esp_camera_broker_release(camera_fb_t *fb)
+{
+    if (!s_broker || !fb) {
+        return;
+    }
+    xSemaphoreTake(s_broker->lock, portMAX_DELAY);
+    broker_frame_unref(fb);
+    xSemaphoreGive(s_broker->lock);
+}
+
+uint32_t esp_camera_broker_dropped(camera_broker_sub_t sub)
+{
+    return sub ? sub->dropped : 0;
+}
@@ -87,9 +87,20 @@ extern "C" {
  */
 typedef enum {
     CAMERA_GRAB_WHEN_EMPTY,         /*!< Fills buffers when they are empty. Less resources but first 'fb_count' frames might be old */
-    CAMERA_GRAB_LATEST              /*!< Except when 1 frame buffer is used, queue will always contain the last 'fb_count' frames */
+    CAMERA_GRAB_LATEST              /*!< Except when 1 frame buffer is used, esp_camera_fb_get() returns the most recent frame and older unclaimed frames are refilled */
 } camera_grab_mode_t;
 
+/**
+ * @brief When the driver starts capturing a frame
+ *
+ * Between frames the I2S/LCD_CAM DMA is stopped, the sensor keeps running but its data is not transferred.
+ */
+typedef enum {
+    CAMERA_CAPTURE_CONTINUOUS,      /*!< Every frame the sensor sends, while a frame buffer is free */
+    CAMERA_CAPTURE_RATE,            /*!< At most the requested frames per second */
+    CAMERA_CAPTURE_ON_DEMAND,       /*!< Only frames requested with esp_camera_capture(), or by esp_camera_fb_get() when no frame is ready */
+} camera_capture_mode_t;
+
 /**
  * @brief Camera frame buffer location
  */
@@ -157,6 +168,17 @@ typedef struct {
     int sccb_i2c_port;              /*!< If pin_sccb_sda is -1, use the already configured I2C bus by number */
 } camera_config_t;
 
+/**
+ * @brief Bytes reserved in front of camera_fb_t.buf, see CONFIG_CAMERA_FB_HEADROOM
+ *
+ * A frame shared through the frame broker has one headroom, only one consumer may write to it.
+ */
+#if CONFIG_CAMERA_FB_HEADROOM
+#define CAMERA_FB_HEADROOM  ((CONFIG_CAMERA_FB_HEADROOM + 15) & ~15)
+#else
+#define CAMERA_FB_HEADROOM  0
+#endif
+
 /**
  * @brief Data structure of camera frame buffer
  */
@@ -166,9 +188,29 @@ typedef struct {
     size_t width;               /*!< Width of the buffer in pixels */
     size_t height;              /*!< Height of the buffer in pixels */
     pixformat_t format;         /*!< Format of the pixel data */
-    struct timeval timestamp;   /*!< Timestamp since boot of the first DMA buffer of the frame */
+    struct timeval timestamp;   /*!< Timestamp since boot of the VSYNC that started the frame */
+    uint32_t seq;               /*!< VSYNC count at the start of the frame, gaps are frames that were not delivered */
+    uint32_t latency_us;        /*!< Time from VSYNC to the frame leaving esp_camera_fb_get() */
+    uint16_t aec_value_cfg;     /*!< Exposure last configured through the sensor API, not read back from the sensor. With aec on the sensor runs its own value */
+    uint8_t agc_gain_cfg;       /*!< Gain last configured through the sensor API, not read back from the sensor. With agc on the sensor runs its own value */
+    uint8_t aec;                /*!< Automatic exposure was configured on */
+    uint8_t agc;                /*!< Automatic gain was configured on */
 } camera_fb_t;
 
+/**
+ * @brief Frame acquisition counters, accumulated since init or the last esp_camera_reset_stats()
+ */
+typedef struct {
+    uint32_t frames;            /*!< Frames captured and queued to the application */
+    uint32_t no_soi;            /*!< JPEG frames dropped because they did not start with SOI */
+    uint32_t no_eoi;            /*!< JPEG frames dropped because no EOI was found */
+    uint32_t fb_overflow;       /*!< Frames that did not fit the frame buffer (FB-OVF) */
+    uint32_t fb_size_err;       /*!< RGB/YUV frames dropped because of a short or long read (FB-SIZE) */
+    uint32_t queue_drops;       /*!< Frames lost because no frame buffer was free, or replaced unread in CAMERA_GRAB_LATEST mode */
+    uint32_t take_timeouts;     /*!< esp_camera_fb_get() calls that returned no frame */
+    uint32_t frame_interval_us; /*!< Average time between captured frames, in microseconds */
+} camera_stats_t;
+
 #define ESP_ERR_CAMERA_BASE 0x20000
 #define ESP_ERR_CAMERA_NOT_DETECTED             (ESP_ERR_CAMERA_BASE + 1)
 #define ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE (ESP_ERR_CAMERA_BASE + 2)
@@ -242,6 +284,92 @@ esp_err_t esp_camera_load_from_nvs(const char *key);
  */
 void esp_camera_return_all(void);
 
+/**
+ * @brief Read the frame acquisition counters.
+ *
+ * @param stats Filled with the counters
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ */
+esp_err_t esp_camera_get_stats(camera_stats_t *stats);
+
+/**
+ * @brief Clear the frame acquisition counters.
+ */
+void esp_camera_reset_stats(void);
+
+/**
+ * @brief Set when frames are captured, see camera_capture_mode_t
+ *
+ * Frame starts are aligned to VSYNC, with CAMERA_CAPTURE_RATE the average rate
+ * is kept as long as the sensor runs faster than fps.
+ *
+ * @param mode  Capture mode
+ * @param fps   Frames per second for CAMERA_CAPTURE_RATE, ignored otherwise
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if fps is 0 in CAMERA_CAPTURE_RATE mode
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ */
+esp_err_t esp_camera_set_capture_mode(camera_capture_mode_t mode, uint32_t fps);
+
+/**
+ * @brief Request single frames in CAMERA_CAPTURE_ON_DEMAND mode
+ *
+ * The frames are captured at the next VSYNCs and returned by esp_camera_fb_get().
+ *
+ * @param count Number of frames
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized or is not in CAMERA_CAPTURE_ON_DEMAND mode
+ */
+esp_err_t esp_camera_capture(size_t count);
+
+/**
+ * @brief Prepare frame sizes for esp_camera_set_framesize()
+ *
+ * The DMA layout and descriptors of each size are computed once, so that a
+ * switch only reprograms the sensor. The current size is always prepared.
+ * Frames of every size must fit the frame buffers allocated by esp_camera_init(),
+ * initialize the camera with the largest size and switch down from there.
+ * Calling it again replaces the prepared sizes.
+ *
+ * @param framesizes Frame sizes to prepare
+ * @param count      Number of frame sizes
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if a size is not supported by the sensor
+ *      - ESP_ERR_INVALID_SIZE if a size does not fit the frame or DMA buffers
+ *      - ESP_ERR_NOT_SUPPORTED if frames are received straight into PSRAM (16 MHz XCLK on ESP32-S2/S3)
+ *      - ESP_ERR_NO_MEM if the DMA descriptors could not be allocated
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ */
+esp_err_t esp_camera_prepare_framesizes(const framesize_t *framesizes, size_t count);
+
+/**
+ * @brief Switch to a frame size prepared with esp_camera_prepare_framesizes()
+ *
+ * Waits for the frame being captured to complete, reprograms the sensor and
+ * resumes with the next VSYNC. Frames are stamped with the size they were
+ * captured at, frames queued before the switch keep the old size.
+ *
+ * @param framesize Frame size
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if the size was not prepared
+ *      - ESP_ERR_TIMEOUT if no frame completed, the size is unchanged
+ *      - ESP_ERR_CAMERA_FAILED_TO_SET_FRAME_SIZE if the sensor rejected the size
+ *      - ESP_ERR_INVALID_STATE if the driver hasn't been initialized yet
+ */
+esp_err_t esp_camera_set_framesize(framesize_t framesize);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,162 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/*
+ * Frame broker: shares every captured frame between several consumers.
+ *
+ * A broker task takes frames from the driver and hands the same camera_fb_t to each
+ * subscriber. Frames are reference counted, the driver gets a frame back once the last
+ * subscriber released it. Each subscriber has a small queue of frames it has not taken
+ * yet; when it is full the subscriber either drops its oldest queued frame or skips the
+ * new one, so a slow consumer can not stall the others.
+ *
+ * Frames a subscriber holds are not available to the driver: fb_count should be at least
+ * the sum of the subscriber queue depths plus one frame in use per subscriber.
+ *
+ * Subscribers can ask for a frame rate of their own. The broker sets the driver capture
+ * mode to the fastest rate asked for, and to CAMERA_CAPTURE_ON_DEMAND while nobody is
+ * subscribed, so that the DMA is not running for frames no one takes.
+ *
+ * Example:
+ *
+ *     camera_broker_sub_config_t config = CAMERA_BROKER_SUB_CONFIG_DEFAULT();
+ *     camera_broker_sub_t sub = esp_camera_broker_subscribe(&config);
+ *     camera_fb_t *fb = esp_camera_broker_take(sub, portMAX_DELAY);
+ *     if (fb) {
+ *         ...
+ *         esp_camera_broker_release(fb);
+ *     }
+ *     esp_camera_broker_unsubscribe(sub);
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "esp_camera.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Subscriber handle
+ */
+typedef struct camera_broker_sub_s *camera_broker_sub_t;
+
+/**
+ * @brief Subscriber configuration
+ */
+typedef struct {
+    size_t depth;       /*!< Frames queued for the subscriber before the drop policy applies, at least 1 */
+    bool drop_oldest;   /*!< When the queue is full: true drops the oldest queued frame, false skips the new frame */
+    uint32_t fps;       /*!< Frames per second the subscriber wants, 0 for every frame the sensor sends */
+} camera_broker_sub_config_t;
+
+#define CAMERA_BROKER_SUB_CONFIG_DEFAULT() { \
+    .depth = 1, \
+    .drop_oldest = true, \
+    .fps = 0, \
+}
+
+/**
+ * @brief Start the broker task
+ *
+ * The task only takes frames from the driver while there are subscribers.
+ * The driver has to be initialized, and no other code may call esp_camera_fb_get()
+ * or esp_camera_set_capture_mode() while the broker is running.
+ *
+ * @param priority  Priority of the broker task
+ * @param core_id   Core the task is pinned to, or tskNO_AFFINITY
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the broker is already running
+ *      - ESP_ERR_NO_MEM if the task could not be created
+ */
+esp_err_t esp_camera_broker_init(UBaseType_t priority, BaseType_t core_id);
+
+/**
+ * @brief Stop the broker task
+ *
+ * All subscribers have to be unsubscribed first. The driver is left in CAMERA_CAPTURE_CONTINUOUS mode.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if the broker is not running or still has subscribers
+ */
+esp_err_t esp_camera_broker_deinit(void);
+
+/**
+ * @brief Add a subscriber, it receives every frame captured from now on, or as many as its fps asks for
+ *
+ * @param config  Queue depth, drop policy and rate, NULL for CAMERA_BROKER_SUB_CONFIG_DEFAULT()
+ *
+ * @return subscriber handle or NULL if the broker is not running or out of memory
+ */
+camera_broker_sub_t esp_camera_broker_subscribe(const camera_broker_sub_config_t *config);
+
+/**
+ * @brief Change the frame rate a subscriber wants
+ *
+ * The driver capture rate follows, frames already queued for the subscriber stay queued.
+ *
+ * @param sub  Subscriber handle
+ * @param fps  Frames per second, 0 for every frame the sensor sends
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if sub is NULL
+ *      - ESP_ERR_INVALID_STATE if the broker is not running
+ */
+esp_err_t esp_camera_broker_set_fps(camera_broker_sub_t sub, uint32_t fps);
+
+/**
+ * @brief Remove a subscriber, frames still queued for it are released
+ *
+ * Frames the subscriber took have to be released by the caller.
+ *
+ * @param sub  Subscriber handle
+ */
+void esp_camera_broker_unsubscribe(camera_broker_sub_t sub);
+
+/**
+ * @brief Take the oldest frame queued for a subscriber
+ *
+ * @param sub      Subscriber handle
+ * @param timeout  Ticks to wait for a frame
+ *
+ * @return frame, to be given back with esp_camera_broker_release(), or NULL on timeout
+ */
+camera_fb_t *esp_camera_broker_take(camera_broker_sub_t sub, TickType_t timeout);
+
+/**
+ * @brief Release a frame taken with esp_camera_broker_take()
+ *
+ * The frame goes back to the driver when no other subscriber holds it.
+ *
+ * @param fb  Frame buffer
+ */
+void esp_camera_broker_release(camera_fb_t *fb);
+
+/**
+ * @brief Number of frames a subscriber lost to its drop policy
+ *
+ * @param sub  Subscriber handle
+ *
+ * @return dropped frames since the subscriber was added
+ */
+uint32_t esp_camera_broker_dropped(camera_broker_sub_t sub);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,105 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Frame slot ring shared by cam_task (the single producer) and any number of consumers.
+ *
+ * Every frame buffer has a slot whose state only moves through compare-and-swap:
+ *
+ *   FREE -> FILLING       producer, cam_frame_ring_acquire()
+ *   FILLING -> READY      producer, cam_frame_ring_publish()
+ *   READY -> HELD         consumer, cam_frame_ring_take()
+ *   HELD -> FREE          consumer, cam_frame_ring_release()
+ *   READY -> FREE         producer in latest mode, for frames superseded by a newer one
+ *
+ * The ring does not block: callers that want to wait pair it with a semaphore given on publish.
+ */
+
+typedef enum {
+    CAM_SLOT_FREE = 0,
+    CAM_SLOT_FILLING,
+    CAM_SLOT_READY,
+    CAM_SLOT_HELD,
+} cam_slot_state_t;
+
+typedef struct {
+    atomic_uint state;
+    atomic_uint seq;        // publish order, consumers take the oldest READY slot first
+} cam_slot_t;
+
+typedef struct {
+    cam_slot_t *slots;
+    size_t count;
+    bool latest;            // publishing a frame recycles the READY frames before it
+    uint32_t seq;           // producer only
+} cam_frame_ring_t;
+
+/**
+ * @brief Allocate the slots, all FREE
+ *
+ * @param latest  Latest frame wins: only the most recent published frame stays READY
+ *
+ * @return false when out of memory
+ */
+bool cam_frame_ring_init(cam_frame_ring_t *ring, size_t count, bool latest);
+
+void cam_frame_ring_deinit(cam_frame_ring_t *ring);
+
+/**
+ * @brief Producer: claim a FREE slot for the next frame
+ *
+ * @return slot index or -1 when every slot is READY, HELD or FILLING
+ */
+int cam_frame_ring_acquire(cam_frame_ring_t *ring);
+
+/**
+ * @brief Producer: make a FILLING slot READY
+ *
+ * @return number of READY frames recycled in latest mode
+ */
+size_t cam_frame_ring_publish(cam_frame_ring_t *ring, int slot);
+
+/**
+ * @brief Consumer: hold the oldest READY slot
+ *
+ * @return slot index or -1 when nothing is READY
+ */
+int cam_frame_ring_take(cam_frame_ring_t *ring);
+
+/**
+ * @brief Consumer: give a HELD slot back
+ *
+ * @return false if the slot was not HELD
+ */
+bool cam_frame_ring_release(cam_frame_ring_t *ring, int slot);
+
+/**
+ * @brief Give back every READY and HELD slot
+ */
+void cam_frame_ring_release_all(cam_frame_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,6 +15,7 @@
 #pragma once
 
 #include "esp_camera.h"
+#include "cam_jpeg_markers.h"
 
 
 #ifdef __cplusplus
@@ -57,6 +58,47 @@ void cam_give(camera_fb_t *dma_buffer);
 
 void cam_give_all(void);
 
+void cam_get_stats(camera_stats_t *stats);
+
+void cam_reset_stats(void);
+
+void cam_set_capture_mode(camera_capture_mode_t mode, uint32_t fps);
+
+camera_capture_mode_t cam_get_capture_mode(void);
+
+void cam_request_capture(size_t count);
+
+/**
+ * @brief Compute the DMA layout and descriptor chain of each frame size, and of the current one
+ *
+ * Replaces the sizes prepared before. Takes effect between two frames.
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_ERR_NOT_SUPPORTED Frames are received straight into the frame buffers (PSRAM DMA)
+ *     - ESP_ERR_INVALID_SIZE A size does not fit the buffers or the event queue allocated by cam_config()
+ *     - ESP_ERR_NO_MEM No memory for the descriptors
+ *     - ESP_ERR_TIMEOUT No VSYNC came to take the new chains in
+ */
+esp_err_t cam_prepare_modes(const framesize_t *frame_sizes, size_t count);
+
+/**
+ * @brief Wait until the frame in flight is published and keep the next one from starting
+ *
+ * The sensor is reconfigured between cam_switch_begin() and cam_switch_end().
+ *
+ * @return
+ *     - ESP_OK Capture is held
+ *     - ESP_ERR_NOT_FOUND The size was not prepared
+ *     - ESP_ERR_TIMEOUT No VSYNC, capture is not held
+ */
+esp_err_t cam_switch_begin(framesize_t frame_size);
+
+/**
+ * @brief Resume capture, with the layout passed to cam_switch_begin() if apply is set
+ */
+void cam_switch_end(bool apply);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,61 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * JPEG marker search over the frames cam_task receives. No hardware access, the host tests
+ * run these on frame dumps.
+ */
+
+#define CAM_JPEG_EOI_LEN 2
+
+/**
+ * @brief Find the JPEG SOI marker (FF D8 FF), scanning a word at a time
+ *
+ * @return offset of the marker or -1
+ */
+int cam_find_jpeg_soi(const uint8_t *inbuf, uint32_t length);
+
+/**
+ * @brief Length of the JPEG headers, from SOI up to and including the SOS segment
+ *
+ * @return offset of the entropy-coded data or 0 when the headers are incomplete
+ */
+uint32_t cam_jpeg_header_len(const uint8_t *inbuf, uint32_t length);
+
+/**
+ * @brief Find the first JPEG EOI marker (FF D9) in [start, length), scanning a word at a time
+ *
+ * @return offset of the marker or -1
+ */
+int cam_find_jpeg_eoi(const uint8_t *inbuf, uint32_t start, uint32_t length);
+
+/**
+ * @brief Find the end of the frame in a received buffer: the EOI search starts 'tail' bytes
+ *        before the end and only goes over the rest of the entropy-coded data when that misses
+ *
+ * @return offset of the marker or -1
+ */
+int cam_find_jpeg_frame_eoi(const uint8_t *inbuf, uint32_t length, uint32_t tail);
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,6 +9,31 @@
 #ifndef __SCCB_H__
 #define __SCCB_H__
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sccb_cache.h"
+
+#define SCCB_BATCH_MAX_WRITES   32
+#define SCCB_BATCH_BUF_SIZE     128
+
+/*
+ * Register writes queued up and sent with one I2C command link, instead of one
+ * i2c_master_cmd_begin() per register. Each queued write is a complete SCCB write
+ * (START, address, register, value, STOP). On sensors that increment the register
+ * address themselves, writes to consecutive registers are merged into one write.
+ * The batch is flushed when full; SCCB_Batch_Flush() sends the rest.
+ */
+typedef struct {
+    uint8_t slv_addr;
+    uint8_t reg_len;                            // 1 or 2 byte register addresses
+    bool sequential;                            // merge writes to consecutive registers
+    uint16_t next_reg;
+    size_t count;                               // queued writes
+    size_t len;                                 // bytes used in buf
+    uint8_t write_len[SCCB_BATCH_MAX_WRITES];   // register address and data bytes of each write
+    uint8_t buf[SCCB_BATCH_BUF_SIZE];
+} sccb_batch_t;
+
 int SCCB_Init(int pin_sda, int pin_scl);
 int SCCB_Use_Port(int sccb_i2c_port);
 int SCCB_Deinit(void);
@@ -19,4 +44,10 @@ uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg);
 int SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data);
 uint16_t SCCB_Read_Addr16_Val16(uint8_t slv_addr, uint16_t reg);
 int SCCB_Write_Addr16_Val16(uint8_t slv_addr, uint16_t reg, uint16_t data);
+void SCCB_Batch_Init(sccb_batch_t *batch, uint8_t slv_addr, uint8_t reg_len, bool sequential);
+int SCCB_Batch_Write(sccb_batch_t *batch, uint16_t reg, uint8_t data);
+int SCCB_Batch_Flush(sccb_batch_t *batch);
+int SCCB_Cache_Enable(uint8_t slv_addr, int bank_reg, const sccb_cache_range_t *volatile_regs, size_t volatile_count);
+void SCCB_Cache_Disable(void);
+void SCCB_Cache_Invalidate(uint8_t slv_addr);
 #endif // __SCCB_H__
@@ -0,0 +1,109 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Shadow copy of the sensor registers, for sccb.c.
+ *
+ * Every value written to or read from the sensor is remembered, so reads of
+ * known registers and writes that change nothing need no I2C transfer.
+ * Registers the sensor changes on its own (AEC/AGC results, self-clearing
+ * reset bits, group launch triggers) are declared volatile and never cached.
+ *
+ * Sensors with 8-bit addresses that page their registers through a bank
+ * register (OV2640 0xFF) cache by bank. Until a write to the bank register has
+ * been seen the bank is unknown and nothing is cached.
+ *
+ * Registers are keyed by address; with a bank register the key is (bank << 8) | reg.
+ */
+
+#define SCCB_CACHE_NO_BANK      -1
+#define SCCB_CACHE_KEY(bank, reg)   ((uint16_t)(((bank) << 8) | (reg)))
+
+typedef struct {
+    uint16_t first;
+    uint16_t last;
+} sccb_cache_range_t;
+
+typedef enum {
+    SCCB_CACHE_EMPTY = 0,
+    SCCB_CACHE_VALID,
+    SCCB_CACHE_STALE,       // key stays in place so that lookups keep probing past it
+} sccb_cache_state_t;
+
+typedef struct {
+    uint16_t key;
+    uint8_t value;
+    uint8_t state;
+} sccb_cache_entry_t;
+
+typedef struct {
+    uint8_t slv_addr;
+    int bank_reg;                               // SCCB_CACHE_NO_BANK or the bank select register
+    int bank;                                   // current bank, -1 while unknown
+    sccb_cache_entry_t *entries;
+    size_t size;                                // power of two
+    size_t used;                                // entries not EMPTY
+    const sccb_cache_range_t *volatile_regs;
+    size_t volatile_count;
+} sccb_cache_t;
+
+/**
+ * @brief Allocate an empty cache
+ *
+ * @param size           Registers the cache can hold, rounded up to a power of two
+ * @param bank_reg       Bank select register or SCCB_CACHE_NO_BANK
+ * @param volatile_regs  Key ranges that are never cached, must stay valid while the cache is used
+ *
+ * @return false when out of memory
+ */
+bool sccb_cache_init(sccb_cache_t *cache, uint8_t slv_addr, size_t size, int bank_reg,
+                     const sccb_cache_range_t *volatile_regs, size_t volatile_count);
+
+void sccb_cache_deinit(sccb_cache_t *cache);
+
+/**
+ * @brief Forget every register and the bank, after a sensor reset or a failed transfer
+ */
+void sccb_cache_invalidate(sccb_cache_t *cache);
+
+/**
+ * @brief Current value of a register
+ *
+ * @return false if the register is volatile, not cached or its bank is unknown
+ */
+bool sccb_cache_lookup(const sccb_cache_t *cache, uint16_t reg, uint8_t *value);
+
+/**
+ * @brief Remember a value read from or written to the sensor
+ */
+void sccb_cache_store(sccb_cache_t *cache, uint16_t reg, uint8_t value);
+
+/**
+ * @brief Forget one register, after a failed write
+ */
+void sccb_cache_forget(sccb_cache_t *cache, uint16_t reg);
+
+#ifdef __cplusplus
+}
+#endif
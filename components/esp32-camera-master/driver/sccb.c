@@ -46,6 +46,39 @@ const int SCCB_I2C_PORT_DEFAULT = 0;
 static int sccb_i2c_port;
 static bool sccb_owns_i2c_port;
 
+#if CONFIG_SCCB_REG_CACHE
+// One camera per driver, so one cache: the one of the attached sensor
+static sccb_cache_t sccb_cache;
+#endif
+
+static bool cache_read(uint8_t slv_addr, uint16_t reg, uint8_t *value)
+{
+#if CONFIG_SCCB_REG_CACHE
+    if (sccb_cache.entries && sccb_cache.slv_addr == slv_addr) {
+        return sccb_cache_lookup(&sccb_cache, reg, value);
+    }
+#endif
+    return false;
+}
+
+static void cache_store(uint8_t slv_addr, uint16_t reg, uint8_t value)
+{
+#if CONFIG_SCCB_REG_CACHE
+    if (sccb_cache.entries && sccb_cache.slv_addr == slv_addr) {
+        sccb_cache_store(&sccb_cache, reg, value);
+    }
+#endif
+}
+
+static void cache_forget(uint8_t slv_addr, uint16_t reg)
+{
+#if CONFIG_SCCB_REG_CACHE
+    if (sccb_cache.entries && sccb_cache.slv_addr == slv_addr) {
+        sccb_cache_forget(&sccb_cache, reg);
+    }
+#endif
+}
+
 int SCCB_Init(int pin_sda, int pin_scl)
 {
     ESP_LOGI(TAG, "pin_sda %d pin_scl %d", pin_sda, pin_scl);
@@ -85,6 +118,7 @@ int SCCB_Use_Port(int i2c_num) { // sccb use an already initialized I2C port
 
 int SCCB_Deinit(void)
 {
+    SCCB_Cache_Disable();
     if (!sccb_owns_i2c_port) {
         return ESP_OK;
     }
@@ -118,6 +152,9 @@ uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg)
 {
     uint8_t data=0;
     esp_err_t ret = ESP_FAIL;
+    if (cache_read(slv_addr, reg, &data)) {
+        return data;
+    }
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, ( slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
@@ -135,6 +172,8 @@ uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg)
     i2c_cmd_link_delete(cmd);
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "SCCB_Read Failed addr:0x%02x, reg:0x%02x, data:0x%02x, ret:%d", slv_addr, reg, data, ret);
+    } else {
+        cache_store(slv_addr, reg, data);
     }
     return data;
 }
@@ -142,6 +181,10 @@ uint8_t SCCB_Read(uint8_t slv_addr, uint8_t reg)
 int SCCB_Write(uint8_t slv_addr, uint8_t reg, uint8_t data)
 {
     esp_err_t ret = ESP_FAIL;
+    uint8_t cached;
+    if (cache_read(slv_addr, reg, &cached) && cached == data) {
+        return 0;
+    }
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, ( slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
@@ -152,6 +195,9 @@ int SCCB_Write(uint8_t slv_addr, uint8_t reg, uint8_t data)
     i2c_cmd_link_delete(cmd);
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "SCCB_Write Failed addr:0x%02x, reg:0x%02x, data:0x%02x, ret:%d", slv_addr, reg, data, ret);
+        cache_forget(slv_addr, reg);
+    } else {
+        cache_store(slv_addr, reg, data);
     }
     return ret == ESP_OK ? 0 : -1;
 }
@@ -160,6 +206,9 @@ uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg)
 {
     uint8_t data=0;
     esp_err_t ret = ESP_FAIL;
+    if (cache_read(slv_addr, reg, &data)) {
+        return data;
+    }
     uint16_t reg_htons = LITTLETOBIG(reg);
     uint8_t *reg_u8 = (uint8_t *)&reg_htons;
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
@@ -180,6 +229,8 @@ uint8_t SCCB_Read16(uint8_t slv_addr, uint16_t reg)
     i2c_cmd_link_delete(cmd);
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "W [%04x]=%02x fail\n", reg, data);
+    } else {
+        cache_store(slv_addr, reg, data);
     }
     return data;
 }
@@ -188,6 +239,10 @@ int SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data)
 {
     static uint16_t i = 0;
     esp_err_t ret = ESP_FAIL;
+    uint8_t cached;
+    if (cache_read(slv_addr, reg, &cached) && cached == data) {
+        return 0;
+    }
     uint16_t reg_htons = LITTLETOBIG(reg);
     uint8_t *reg_u8 = (uint8_t *)&reg_htons;
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
@@ -201,6 +256,9 @@ int SCCB_Write16(uint8_t slv_addr, uint16_t reg, uint8_t data)
     i2c_cmd_link_delete(cmd);
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "W [%04x]=%02x %d fail\n", reg, data, i++);
+        cache_forget(slv_addr, reg);
+    } else {
+        cache_store(slv_addr, reg, data);
     }
     return ret == ESP_OK ? 0 : -1;
 }
@@ -255,6 +313,111 @@ int SCCB_Write_Addr16_Val16(uint8_t slv_addr, uint16_t reg, uint16_t data)
     i2c_cmd_link_delete(cmd);
     if(ret != ESP_OK) {
         ESP_LOGE(TAG, "W [%04x]=%04x fail\n", reg, data);
+        cache_forget(slv_addr, reg);
+        cache_forget(slv_addr, reg + 1);
+    } else {
+        cache_store(slv_addr, reg, data >> 8);
+        cache_store(slv_addr, reg + 1, data & 0xFF);
+    }
+    return ret == ESP_OK ? 0 : -1;
+}
+
+void SCCB_Batch_Init(sccb_batch_t *batch, uint8_t slv_addr, uint8_t reg_len, bool sequential)
+{
+    batch->slv_addr = slv_addr;
+    batch->reg_len = reg_len;
+#if CONFIG_SCCB_SEQUENTIAL_WRITE
+    batch->sequential = sequential;
+#else
+    batch->sequential = false;
+#endif
+    batch->next_reg = 0;
+    batch->count = 0;
+    batch->len = 0;
+}
+
+int SCCB_Batch_Write(sccb_batch_t *batch, uint16_t reg, uint8_t data)
+{
+    uint8_t cached;
+    if (cache_read(batch->slv_addr, reg, &cached) && cached == data) {
+        return 0;
+    }
+    // Cached now, so that later writes of the batch see it; a failed flush drops the cache
+    cache_store(batch->slv_addr, reg, data);
+    // The sensor stores the next data byte of a write to the following register
+    if (batch->sequential && batch->count && reg == batch->next_reg
+            && batch->len < SCCB_BATCH_BUF_SIZE && batch->write_len[batch->count - 1] < UINT8_MAX) {
+        batch->buf[batch->len++] = data;
+        batch->write_len[batch->count - 1]++;
+        batch->next_reg++;
+        return 0;
     }
+    if (batch->count == SCCB_BATCH_MAX_WRITES || batch->len + batch->reg_len + 1 > SCCB_BATCH_BUF_SIZE) {
+        int ret = SCCB_Batch_Flush(batch);
+        if (ret) {
+            return ret;
+        }
+    }
+    if (batch->reg_len == 2) {
+        batch->buf[batch->len++] = reg >> 8;
+    }
+    batch->buf[batch->len++] = reg & 0xFF;
+    batch->buf[batch->len++] = data;
+    batch->write_len[batch->count++] = batch->reg_len + 1;
+    batch->next_reg = reg + 1;
+    return 0;
+}
+
+int SCCB_Batch_Flush(sccb_batch_t *batch)
+{
+    if (!batch->count) {
+        return 0;
+    }
+    esp_err_t ret = ESP_FAIL;
+    size_t offset = 0;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    for (size_t i = 0; i < batch->count; i++) {
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, ( batch->slv_addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
+        i2c_master_write(cmd, &batch->buf[offset], batch->write_len[i], ACK_CHECK_EN);
+        i2c_master_stop(cmd);
+        offset += batch->write_len[i];
+    }
+    ret = i2c_master_cmd_begin(sccb_i2c_port, cmd, 1000 / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+    if(ret != ESP_OK) {
+        ESP_LOGE(TAG, "SCCB_Batch_Flush Failed addr:0x%02x, %u writes, ret:%d", batch->slv_addr, (unsigned)batch->count, ret);
+        SCCB_Cache_Invalidate(batch->slv_addr);
+    }
+    batch->count = 0;
+    batch->len = 0;
     return ret == ESP_OK ? 0 : -1;
 }
+
+int SCCB_Cache_Enable(uint8_t slv_addr, int bank_reg, const sccb_cache_range_t *volatile_regs, size_t volatile_count)
+{
+#if CONFIG_SCCB_REG_CACHE
+    SCCB_Cache_Disable();
+    if (!sccb_cache_init(&sccb_cache, slv_addr, CONFIG_SCCB_REG_CACHE_SIZE, bank_reg, volatile_regs, volatile_count)) {
+        ESP_LOGW(TAG, "No memory for the register cache");
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    return ESP_OK;
+}
+
+void SCCB_Cache_Disable(void)
+{
+#if CONFIG_SCCB_REG_CACHE
+    sccb_cache_deinit(&sccb_cache);
+#endif
+}
+
+void SCCB_Cache_Invalidate(uint8_t slv_addr)
+{
+#if CONFIG_SCCB_REG_CACHE
+    if (sccb_cache.entries && sccb_cache.slv_addr == slv_addr) {
+        sccb_cache_invalidate(&sccb_cache);
+    }
+#endif
+}
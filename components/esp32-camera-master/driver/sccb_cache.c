@@ -0,0 +1,158 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include "sccb_cache.h"
+
+bool sccb_cache_init(sccb_cache_t *cache, uint8_t slv_addr, size_t size, int bank_reg,
+                     const sccb_cache_range_t *volatile_regs, size_t volatile_count)
+{
+    size_t pow2 = 16;
+    while (pow2 < size) {
+        pow2 <<= 1;
+    }
+    cache->entries = (sccb_cache_entry_t *)calloc(pow2, sizeof(sccb_cache_entry_t));
+    if (!cache->entries) {
+        return false;
+    }
+    cache->slv_addr = slv_addr;
+    cache->bank_reg = bank_reg;
+    cache->bank = -1;
+    cache->size = pow2;
+    cache->used = 0;
+    cache->volatile_regs = volatile_regs;
+    cache->volatile_count = volatile_count;
+    return true;
+}
+
+void sccb_cache_deinit(sccb_cache_t *cache)
+{
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->size = 0;
+    cache->used = 0;
+}
+
+void sccb_cache_invalidate(sccb_cache_t *cache)
+{
+    memset(cache->entries, 0, cache->size * sizeof(sccb_cache_entry_t));
+    cache->used = 0;
+    cache->bank = -1;
+}
+
+// Key of a register in the current bank, -1 if it can not be cached
+static int cache_key(const sccb_cache_t *cache, uint16_t reg)
+{
+    int key = reg;
+    if (cache->bank_reg != SCCB_CACHE_NO_BANK) {
+        if (cache->bank < 0) {
+            return -1;
+        }
+        key = SCCB_CACHE_KEY(cache->bank, reg & 0xFF);
+    }
+    for (size_t i = 0; i < cache->volatile_count; i++) {
+        if (key >= cache->volatile_regs[i].first && key <= cache->volatile_regs[i].last) {
+            return -1;
+        }
+    }
+    return key;
+}
+
+// Entry holding the key, or the empty one where it would go, NULL when full
+static sccb_cache_entry_t *cache_find(const sccb_cache_t *cache, uint16_t key)
+{
+    size_t mask = cache->size - 1;
+    size_t i = ((key * 2654435761u) >> 16) & mask;
+    for (size_t n = 0; n < cache->size; n++, i = (i + 1) & mask) {
+        sccb_cache_entry_t *e = &cache->entries[i];
+        if (e->state == SCCB_CACHE_EMPTY || e->key == key) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+bool sccb_cache_lookup(const sccb_cache_t *cache, uint16_t reg, uint8_t *value)
+{
+    if (!cache->entries) {
+        return false;
+    }
+    if (cache->bank_reg != SCCB_CACHE_NO_BANK && reg == cache->bank_reg) {
+        if (cache->bank < 0) {
+            return false;
+        }
+        *value = cache->bank;
+        return true;
+    }
+    int key = cache_key(cache, reg);
+    if (key < 0) {
+        return false;
+    }
+    sccb_cache_entry_t *e = cache_find(cache, key);
+    if (!e || e->state != SCCB_CACHE_VALID) {
+        return false;
+    }
+    *value = e->value;
+    return true;
+}
+
+void sccb_cache_store(sccb_cache_t *cache, uint16_t reg, uint8_t value)
+{
+    if (!cache->entries) {
+        return;
+    }
+    if (cache->bank_reg != SCCB_CACHE_NO_BANK && reg == cache->bank_reg) {
+        cache->bank = value;
+        return;
+    }
+    int key = cache_key(cache, reg);
+    if (key < 0) {
+        return;
+    }
+    sccb_cache_entry_t *e = cache_find(cache, key);
+    if (!e) {
+        return;
+    }
+    if (e->state == SCCB_CACHE_EMPTY) {
+        // Keep a quarter free so that probing stays short, registers past that are not cached
+        if (cache->used >= cache->size - cache->size / 4) {
+            return;
+        }
+        cache->used++;
+        e->key = key;
+    }
+    e->value = value;
+    e->state = SCCB_CACHE_VALID;
+}
+
+void sccb_cache_forget(sccb_cache_t *cache, uint16_t reg)
+{
+    if (!cache->entries) {
+        return;
+    }
+    if (cache->bank_reg != SCCB_CACHE_NO_BANK && reg == cache->bank_reg) {
+        // Later keys can not be computed, start over
+        sccb_cache_invalidate(cache);
+        return;
+    }
+    int key = cache_key(cache, reg);
+    if (key < 0) {
+        return;
+    }
+    sccb_cache_entry_t *e = cache_find(cache, key);
+    if (e && e->state == SCCB_CACHE_VALID) {
+        e->state = SCCB_CACHE_STALE;
+    }
+}
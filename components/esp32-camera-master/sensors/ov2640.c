@@ -25,6 +25,17 @@ static const char* TAG = "ov2640";
 #endif
 
 static volatile ov2640_bank_t reg_bank = BANK_MAX;
+
+// Updated by the sensor itself: AGC gain, AEC exposure, self-clearing resets
+static const sccb_cache_range_t volatile_regs[] = {
+    {SCCB_CACHE_KEY(BANK_SENSOR, GAIN), SCCB_CACHE_KEY(BANK_SENSOR, GAIN)},
+    {SCCB_CACHE_KEY(BANK_SENSOR, REG04), SCCB_CACHE_KEY(BANK_SENSOR, REG04)},
+    {SCCB_CACHE_KEY(BANK_SENSOR, AEC), SCCB_CACHE_KEY(BANK_SENSOR, AEC)},
+    {SCCB_CACHE_KEY(BANK_SENSOR, COM7), SCCB_CACHE_KEY(BANK_SENSOR, COM7)},
+    {SCCB_CACHE_KEY(BANK_SENSOR, REG45), SCCB_CACHE_KEY(BANK_SENSOR, REG45)},
+    {SCCB_CACHE_KEY(BANK_DSP, RESET), SCCB_CACHE_KEY(BANK_DSP, RESET)},
+};
+
 static int set_bank(sensor_t *sensor, ov2640_bank_t bank)
 {
     int res = 0;
@@ -35,14 +46,30 @@ static int set_bank(sensor_t *sensor, ov2640_bank_t bank)
     return res;
 }
 
-static int write_regs(sensor_t *sensor, const uint8_t (*regs)[2])
+static int batch_reg(sccb_batch_t *batch, ov2640_bank_t bank, uint8_t reg, uint8_t value)
+{
+    int res = 0;
+    if (bank != reg_bank) {
+        reg_bank = bank;
+        res = SCCB_Batch_Write(batch, BANK_SEL, bank);
+    }
+    if (!res) {
+        res = SCCB_Batch_Write(batch, reg, value);
+    }
+    return res;
+}
+
+static int batch_regs(sccb_batch_t *batch, const uint8_t (*regs)[2])
 {
     int i=0, res = 0;
     while (regs[i][0]) {
         if (regs[i][0] == BANK_SEL) {
-            res = set_bank(sensor, regs[i][1]);
+            if (regs[i][1] != reg_bank) {
+                reg_bank = regs[i][1];
+                res = SCCB_Batch_Write(batch, BANK_SEL, regs[i][1]);
+            }
         } else {
-            res = SCCB_Write(sensor->slv_addr, regs[i][0], regs[i][1]);
+            res = SCCB_Batch_Write(batch, regs[i][0], regs[i][1]);
         }
         if (res) {
             return res;
@@ -52,6 +79,29 @@ static int write_regs(sensor_t *sensor, const uint8_t (*regs)[2])
     return res;
 }
 
+static int batch_flush(sccb_batch_t *batch)
+{
+    int res = SCCB_Batch_Flush(batch);
+    if (res) {
+        // Not known which writes made it, the bank register included
+        reg_bank = BANK_MAX;
+    }
+    return res;
+}
+
+static int write_regs(sensor_t *sensor, const uint8_t (*regs)[2])
+{
+    sccb_batch_t batch;
+    SCCB_Batch_Init(&batch, sensor->slv_addr, 1, false);
+    int res = batch_regs(&batch, regs);
+    if (!res) {
+        res = batch_flush(&batch);
+    } else {
+        reg_bank = BANK_MAX;
+    }
+    return res;
+}
+
 static int write_reg(sensor_t *sensor, ov2640_bank_t bank, uint8_t reg, uint8_t value)
 {
     int ret = set_bank(sensor, bank);
@@ -103,6 +153,7 @@ static int reset(sensor_t *sensor)
     int ret = 0;
     WRITE_REG_OR_RETURN(BANK_SENSOR, COM7, COM7_SRST);
     vTaskDelay(10 / portTICK_PERIOD_MS);
+    SCCB_Cache_Invalidate(sensor->slv_addr);
     WRITE_REGS_OR_RETURN(ov2640_settings_cif);
     return ret;
 }
@@ -194,12 +245,23 @@ static int set_window(sensor_t *sensor, ov2640_sensor_mode_t mode, int offset_x,
         regs = ov2640_settings_to_uxga;
     }
 
-    WRITE_REG_OR_RETURN(BANK_DSP, R_BYPASS, R_BYPASS_DSP_BYPAS);
-    WRITE_REGS_OR_RETURN(regs);
-    WRITE_REGS_OR_RETURN(win_regs);
-    WRITE_REG_OR_RETURN(BANK_SENSOR, CLKRC, c.clk);
-    WRITE_REG_OR_RETURN(BANK_DSP, R_DVP_SP, c.pclk);
-    WRITE_REG_OR_RETURN(BANK_DSP, R_BYPASS, R_BYPASS_DSP_EN);
+    // The whole mode switch goes out in as few I2C transactions as possible
+    sccb_batch_t batch;
+    SCCB_Batch_Init(&batch, sensor->slv_addr, 1, false);
+    ret = batch_reg(&batch, BANK_DSP, R_BYPASS, R_BYPASS_DSP_BYPAS)
+        || batch_regs(&batch, regs)
+        || batch_regs(&batch, win_regs)
+        || batch_reg(&batch, BANK_SENSOR, CLKRC, c.clk)
+        || batch_reg(&batch, BANK_DSP, R_DVP_SP, c.pclk)
+        || batch_reg(&batch, BANK_DSP, R_BYPASS, R_BYPASS_DSP_EN);
+    if (ret) {
+        reg_bank = BANK_MAX;
+        return ret;
+    }
+    ret = batch_flush(&batch);
+    if (ret) {
+        return ret;
+    }
 
     vTaskDelay(10 / portTICK_PERIOD_MS);
     //required when changing resolution
@@ -607,6 +669,8 @@ int ov2640_init(sensor_t *sensor)
     sensor->set_res_raw = set_res_raw;
     sensor->set_pll = _set_pll;
     sensor->set_xclk = set_xclk;
+
+    SCCB_Cache_Enable(sensor->slv_addr, BANK_SEL, volatile_regs, sizeof(volatile_regs) / sizeof(volatile_regs[0]));
     ESP_LOGD(TAG, "OV2640 Attached");
     return 0;
 }
@@ -26,6 +26,15 @@ static const char *TAG = "ov5640";
 
 //#define REG_DEBUG_ON
 
+// Updated by the sensor itself, or where writing the same value again triggers something
+static const sccb_cache_range_t volatile_regs[] = {
+    {SYSTEM_CTROL0, SYSTEM_CTROL0},     // software reset, power down
+    {0x3212, 0x3212},                   // group hold / launch
+    {0x3400, 0x3405},                   // AWB gains
+    {0x3500, 0x3502},                   // AEC exposure
+    {0x350A, 0x350B},                   // AGC gain
+};
+
 static int read_reg(uint8_t slv_addr, const uint16_t reg){
     int ret = SCCB_Read16(slv_addr, reg);
 #ifdef REG_DEBUG_ON
@@ -142,9 +151,31 @@ static int set_reg_bits(uint8_t slv_addr, uint16_t reg, uint8_t offset, uint8_t
     return ret;
 }
 
+// OV5640 increments the register address within a write, runs of registers go out as one write
+static void batch_init(sccb_batch_t *batch, uint8_t slv_addr)
+{
+    SCCB_Batch_Init(batch, slv_addr, 2, true);
+}
+
 static int write_regs(uint8_t slv_addr, const uint16_t (*regs)[2])
 {
     int i = 0, ret = 0;
+#ifndef REG_DEBUG_ON
+    sccb_batch_t batch;
+    batch_init(&batch, slv_addr);
+    while (!ret && regs[i][0] != REGLIST_TAIL) {
+        if (regs[i][0] == REG_DLY) {
+            ret = SCCB_Batch_Flush(&batch);
+            vTaskDelay(regs[i][1] / portTICK_PERIOD_MS);
+        } else {
+            ret = SCCB_Batch_Write(&batch, regs[i][0], regs[i][1]);
+        }
+        i++;
+    }
+    if (!ret) {
+        ret = SCCB_Batch_Flush(&batch);
+    }
+#else
     while (!ret && regs[i][0] != REGLIST_TAIL) {
         if (regs[i][0] == REG_DLY) {
             vTaskDelay(regs[i][1] / portTICK_PERIOD_MS);
@@ -153,6 +184,7 @@ static int write_regs(uint8_t slv_addr, const uint16_t (*regs)[2])
         }
         i++;
     }
+#endif
     return ret;
 }
 
@@ -164,9 +196,10 @@ static int write_reg16(uint8_t slv_addr, const uint16_t reg, uint16_t value)
     return 0;
 }
 
-static int write_addr_reg(uint8_t slv_addr, const uint16_t reg, uint16_t x_value, uint16_t y_value)
+static int write_addr_reg(sccb_batch_t *batch, const uint16_t reg, uint16_t x_value, uint16_t y_value)
 {
-    if (write_reg16(slv_addr, reg, x_value) || write_reg16(slv_addr, reg + 2, y_value)) {
+    if (SCCB_Batch_Write(batch, reg, x_value >> 8) || SCCB_Batch_Write(batch, reg + 1, x_value)
+            || SCCB_Batch_Write(batch, reg + 2, y_value >> 8) || SCCB_Batch_Write(batch, reg + 3, y_value)) {
         return -1;
     }
     return 0;
@@ -214,30 +247,35 @@ static int set_pll(sensor_t *sensor, bool bypass, uint8_t multiplier, uint8_t sy
 
     calc_sysclk(sensor->xclk_freq_hz, bypass, multiplier, sys_div, pre_div, root_2x, pclk_root_div, pclk_manual, pclk_div);
 
-    ret = write_reg(sensor->slv_addr, 0x3039, bypass?0x80:0x00);
+    sccb_batch_t batch;
+    batch_init(&batch, sensor->slv_addr);
+    ret = SCCB_Batch_Write(&batch, 0x3039, bypass?0x80:0x00);
+    if (ret == 0) {
+        ret = SCCB_Batch_Write(&batch, 0x3034, 0x1A);//10bit mode
+    }
     if (ret == 0) {
-        ret = write_reg(sensor->slv_addr, 0x3034, 0x1A);//10bit mode
+        ret = SCCB_Batch_Write(&batch, 0x3035, 0x01 | ((sys_div & 0x0f) << 4));
     }
     if (ret == 0) {
-        ret = write_reg(sensor->slv_addr, 0x3035, 0x01 | ((sys_div & 0x0f) << 4));
+        ret = SCCB_Batch_Write(&batch, 0x3036, multiplier & 0xff);
     }
     if (ret == 0) {
-        ret = write_reg(sensor->slv_addr, 0x3036, multiplier & 0xff);
+        ret = SCCB_Batch_Write(&batch, 0x3037, (pre_div & 0xf) | (root_2x?0x10:0x00));
     }
     if (ret == 0) {
-        ret = write_reg(sensor->slv_addr, 0x3037, (pre_div & 0xf) | (root_2x?0x10:0x00));
+        ret = SCCB_Batch_Write(&batch, 0x3108, (pclk_root_div & 0x3) << 4 | 0x06);
     }
     if (ret == 0) {
-        ret = write_reg(sensor->slv_addr, 0x3108, (pclk_root_div & 0x3) << 4 | 0x06);
+        ret = SCCB_Batch_Write(&batch, 0x3824, pclk_div & 0x1f);
     }
     if (ret == 0) {
-        ret = write_reg(sensor->slv_addr, 0x3824, pclk_div & 0x1f);
+        ret = SCCB_Batch_Write(&batch, 0x460C, pclk_manual?0x22:0x20);
     }
     if (ret == 0) {
-        ret = write_reg(sensor->slv_addr, 0x460C, pclk_manual?0x22:0x20);
+        ret = SCCB_Batch_Write(&batch, 0x3103, 0x13);// system clock from pll, bit[1]
     }
     if (ret == 0) {
-        ret = write_reg(sensor->slv_addr, 0x3103, 0x13);// system clock from pll, bit[1]
+        ret = SCCB_Batch_Flush(&batch);
     }
     if(ret){
         ESP_LOGE(TAG, "set_sensor_pll FAILED!");
@@ -259,6 +297,7 @@ static int reset(sensor_t *sensor)
         return ret;
     }
     vTaskDelay(100 / portTICK_PERIOD_MS);
+    SCCB_Cache_Invalidate(sensor->slv_addr);
     ret = write_regs(sensor->slv_addr, sensor_default_regs);
     if (ret == 0) {
         ESP_LOGD(TAG, "Camera defaults loaded");
@@ -397,28 +436,35 @@ static int set_framesize(sensor_t *sensor, framesize_t framesize)
     sensor->status.scale = !((w == settings.max_width && h == settings.max_height)
         || (w == (settings.max_width / 2) && h == (settings.max_height / 2)));
 
-    ret  = write_addr_reg(sensor->slv_addr, X_ADDR_ST_H, settings.start_x, settings.start_y)
-        || write_addr_reg(sensor->slv_addr, X_ADDR_END_H, settings.end_x, settings.end_y)
-        || write_addr_reg(sensor->slv_addr, X_OUTPUT_SIZE_H, w, h);
+    // The window registers 0x3800-0x3813 are contiguous, they go out as a single write
+    sccb_batch_t batch;
+    batch_init(&batch, sensor->slv_addr);
+    ret  = write_addr_reg(&batch, X_ADDR_ST_H, settings.start_x, settings.start_y)
+        || write_addr_reg(&batch, X_ADDR_END_H, settings.end_x, settings.end_y)
+        || write_addr_reg(&batch, X_OUTPUT_SIZE_H, w, h);
 
     if (ret) {
         goto fail;
     }
 
     if (!sensor->status.binning) {
-        ret  = write_addr_reg(sensor->slv_addr, X_TOTAL_SIZE_H, settings.total_x, settings.total_y)
-            || write_addr_reg(sensor->slv_addr, X_OFFSET_H, settings.offset_x, settings.offset_y);
+        ret  = write_addr_reg(&batch, X_TOTAL_SIZE_H, settings.total_x, settings.total_y)
+            || write_addr_reg(&batch, X_OFFSET_H, settings.offset_x, settings.offset_y);
     } else {
         if (w > 920) {
-            ret = write_addr_reg(sensor->slv_addr, X_TOTAL_SIZE_H, settings.total_x - 200, settings.total_y / 2);
+            ret = write_addr_reg(&batch, X_TOTAL_SIZE_H, settings.total_x - 200, settings.total_y / 2);
         } else {
-            ret = write_addr_reg(sensor->slv_addr, X_TOTAL_SIZE_H, 2060, settings.total_y / 2);
+            ret = write_addr_reg(&batch, X_TOTAL_SIZE_H, 2060, settings.total_y / 2);
         }
         if (ret == 0) {
-            ret = write_addr_reg(sensor->slv_addr, X_OFFSET_H, settings.offset_x / 2, settings.offset_y / 2);
+            ret = write_addr_reg(&batch, X_OFFSET_H, settings.offset_x / 2, settings.offset_y / 2);
         }
     }
 
+    if (ret == 0) {
+        ret = SCCB_Batch_Flush(&batch);
+    }
+
     if (ret == 0) {
         ret = write_reg_bits(sensor->slv_addr, ISP_CONTROL_01, 0x20, sensor->status.scale);
     }
@@ -1014,11 +1060,14 @@ static int set_reg(sensor_t *sensor, int reg, int mask, int value)
 static int set_res_raw(sensor_t *sensor, int startX, int startY, int endX, int endY, int offsetX, int offsetY, int totalX, int totalY, int outputX, int outputY, bool scale, bool binning)
 {
     int ret = 0;
-    ret  = write_addr_reg(sensor->slv_addr, X_ADDR_ST_H, startX, startY)
-        || write_addr_reg(sensor->slv_addr, X_ADDR_END_H, endX, endY)
-        || write_addr_reg(sensor->slv_addr, X_OFFSET_H, offsetX, offsetY)
-        || write_addr_reg(sensor->slv_addr, X_TOTAL_SIZE_H, totalX, totalY)
-        || write_addr_reg(sensor->slv_addr, X_OUTPUT_SIZE_H, outputX, outputY)
+    sccb_batch_t batch;
+    batch_init(&batch, sensor->slv_addr);
+    ret  = write_addr_reg(&batch, X_ADDR_ST_H, startX, startY)
+        || write_addr_reg(&batch, X_ADDR_END_H, endX, endY)
+        || write_addr_reg(&batch, X_OFFSET_H, offsetX, offsetY)
+        || write_addr_reg(&batch, X_TOTAL_SIZE_H, totalX, totalY)
+        || write_addr_reg(&batch, X_OUTPUT_SIZE_H, outputX, outputY)
+        || SCCB_Batch_Flush(&batch)
         || write_reg_bits(sensor->slv_addr, ISP_CONTROL_01, 0x20, scale);
     if(!ret){
         sensor->status.scale = scale;
@@ -1126,5 +1175,7 @@ int ov5640_init(sensor_t *sensor)
     sensor->set_res_raw = set_res_raw;
     sensor->set_pll = _set_pll;
     sensor->set_xclk = set_xclk;
+
+    SCCB_Cache_Enable(sensor->slv_addr, SCCB_CACHE_NO_BANK, volatile_regs, sizeof(volatile_regs) / sizeof(volatile_regs[0]));
     return 0;
 }
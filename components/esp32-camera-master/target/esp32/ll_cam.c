@@ -31,6 +31,7 @@ static inline int gpio_ll_get_level(gpio_dev_t *hw, int gpio_num)
 }
 #endif
 #include "ll_cam.h"
+#include "ll_cam_dma_filter.h"
 #include "xclk.h"
 #include "cam_hal.h"
 
@@ -97,110 +98,45 @@ static size_t ll_cam_bytes_per_sample(i2s_sampling_mode_t mode)
     }
 }
 
+// The frame buffer offset advances in whole DMA transfers, so the word kernels are the common case
 static size_t IRAM_ATTR ll_cam_dma_filter_jpeg(uint8_t* dst, const uint8_t* src, size_t len)
 {
-    const dma_elem_t* dma_el = (const dma_elem_t*)src;
-    size_t elements = len / sizeof(dma_elem_t);
-    size_t end = elements / 4;
-    // manually unrolling 4 iterations of the loop here
-    for (size_t i = 0; i < end; ++i) {
-        dst[0] = dma_el[0].sample1;
-        dst[1] = dma_el[1].sample1;
-        dst[2] = dma_el[2].sample1;
-        dst[3] = dma_el[3].sample1;
-        dma_el += 4;
-        dst += 4;
+    if (ll_cam_filter_aligned(dst, src)) {
+        return ll_cam_filter_s1_words(dst, src, len);
     }
-    return elements;
+    return ll_cam_filter_s1_bytes(dst, src, len);
 }
 
 static size_t IRAM_ATTR ll_cam_dma_filter_grayscale(uint8_t* dst, const uint8_t* src, size_t len)
 {
-    const dma_elem_t* dma_el = (const dma_elem_t*)src;
-    size_t elements = len / sizeof(dma_elem_t);
-    size_t end = elements / 4;
-    for (size_t i = 0; i < end; ++i) {
-        // manually unrolling 4 iterations of the loop here
-        dst[0] = dma_el[0].sample1;
-        dst[1] = dma_el[1].sample1;
-        dst[2] = dma_el[2].sample1;
-        dst[3] = dma_el[3].sample1;
-        dma_el += 4;
-        dst += 4;
+    if (ll_cam_filter_aligned(dst, src)) {
+        return ll_cam_filter_s1_words(dst, src, len);
     }
-    return elements;
+    return ll_cam_filter_s1_bytes(dst, src, len);
 }
 
 static size_t IRAM_ATTR ll_cam_dma_filter_grayscale_highspeed(uint8_t* dst, const uint8_t* src, size_t len)
 {
-    const dma_elem_t* dma_el = (const dma_elem_t*)src;
-    size_t elements = len / sizeof(dma_elem_t);
-    size_t end = elements / 8;
-    for (size_t i = 0; i < end; ++i) {
-        // manually unrolling 4 iterations of the loop here
-        dst[0] = dma_el[0].sample1;
-        dst[1] = dma_el[2].sample1;
-        dst[2] = dma_el[4].sample1;
-        dst[3] = dma_el[6].sample1;
-        dma_el += 8;
-        dst += 4;
+    if (ll_cam_filter_aligned(dst, src)) {
+        return ll_cam_filter_s1_half_words(dst, src, len);
     }
-    // the final sample of a line in SM_0A0B_0B0C sampling mode needs special handling
-    if ((elements & 0x7) != 0) {
-        dst[0] = dma_el[0].sample1;
-        dst[1] = dma_el[2].sample1;
-        elements += 1;
-    }
-    return elements / 2;
+    return ll_cam_filter_s1_half_bytes(dst, src, len);
 }
 
 static size_t IRAM_ATTR ll_cam_dma_filter_yuyv(uint8_t* dst, const uint8_t* src, size_t len)
 {
-    const dma_elem_t* dma_el = (const dma_elem_t*)src;
-    size_t elements = len / sizeof(dma_elem_t);
-    size_t end = elements / 4;
-    for (size_t i = 0; i < end; ++i) {
-        dst[0] = dma_el[0].sample1;//y0
-        dst[1] = dma_el[0].sample2;//u
-        dst[2] = dma_el[1].sample1;//y1
-        dst[3] = dma_el[1].sample2;//v
-
-        dst[4] = dma_el[2].sample1;//y0
-        dst[5] = dma_el[2].sample2;//u
-        dst[6] = dma_el[3].sample1;//y1
-        dst[7] = dma_el[3].sample2;//v
-        dma_el += 4;
-        dst += 8;
+    if (ll_cam_filter_aligned(dst, src)) {
+        return ll_cam_filter_s12_words(dst, src, len);
     }
-    return elements * 2;
+    return ll_cam_filter_s12_bytes(dst, src, len);
 }
 
 static size_t IRAM_ATTR ll_cam_dma_filter_yuyv_highspeed(uint8_t* dst, const uint8_t* src, size_t len)
 {
-    const dma_elem_t* dma_el = (const dma_elem_t*)src;
-    size_t elements = len / sizeof(dma_elem_t);
-    size_t end = elements / 8;
-    for (size_t i = 0; i < end; ++i) {
-        dst[0] = dma_el[0].sample1;//y0
-        dst[1] = dma_el[1].sample1;//u
-        dst[2] = dma_el[2].sample1;//y1
-        dst[3] = dma_el[3].sample1;//v
-
-        dst[4] = dma_el[4].sample1;//y0
-        dst[5] = dma_el[5].sample1;//u
-        dst[6] = dma_el[6].sample1;//y1
-        dst[7] = dma_el[7].sample1;//v
-        dma_el += 8;
-        dst += 8;
-    }
-    if ((elements & 0x7) != 0) {
-        dst[0] = dma_el[0].sample1;//y0
-        dst[1] = dma_el[1].sample1;//u
-        dst[2] = dma_el[2].sample1;//y1
-        dst[3] = dma_el[2].sample2;//v
-        elements += 4;
+    if (ll_cam_filter_aligned(dst, src)) {
+        return ll_cam_filter_yuyv_hs_words(dst, src, len);
     }
-    return elements;
+    return ll_cam_filter_yuyv_hs_bytes(dst, src, len);
 }
 
 static void IRAM_ATTR ll_cam_vsync_isr(void *arg)
@@ -18,6 +18,7 @@
 #include "soc/i2s_struct.h"
 #include "hal/gpio_ll.h"
 #include "ll_cam.h"
+#include "ll_cam_dma_filter.h"
 #include "xclk.h"
 #include "cam_hal.h"
 
@@ -371,16 +372,10 @@ size_t IRAM_ATTR ll_cam_memcpy(cam_obj_t *cam, uint8_t *out, const uint8_t *in,
 {
     // YUV to Grayscale
     if (cam->in_bytes_per_pixel == 2 && cam->fb_bytes_per_pixel == 1) {
-        size_t end = len / 8;
-        for (size_t i = 0; i < end; ++i) {
-            out[0] = in[0];
-            out[1] = in[2];
-            out[2] = in[4];
-            out[3] = in[6];
-            out += 4;
-            in += 8;
+        if (ll_cam_filter_aligned(out, in)) {
+            return ll_cam_filter_yuyv_y_words(out, in, len);
         }
-        return len / 2;
+        return ll_cam_filter_yuyv_y_bytes(out, in, len);
     }
 
     // just memcpy
@@ -30,6 +30,7 @@
 #endif
 #include "esp_log.h"
 #include "esp_camera.h"
+#include "cam_frame_ring.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
@@ -87,12 +88,27 @@ typedef enum {
 
 typedef struct {
     camera_fb_t fb;
-    uint8_t en;
     //for RGB/YUV modes
     lldesc_t *dma;
     size_t fb_offset;
 } cam_frame_t;
 
+//DMA layout of one prepared frame size, see cam_prepare_modes()
+typedef struct {
+    framesize_t frame_size;
+    uint16_t width;
+    uint16_t height;
+    uint32_t recv_size;
+    uint32_t fb_size;
+    uint32_t dma_buffer_size;
+    uint32_t dma_half_buffer_size;
+    uint32_t dma_half_buffer_cnt;
+    uint32_t dma_node_buffer_size;
+    uint32_t dma_node_cnt;
+    uint32_t frame_copy_cnt;
+    lldesc_t *dma;
+} cam_mode_t;
+
 typedef struct {
     uint32_t dma_bytes_per_item;
     uint32_t dma_buffer_size;
@@ -105,11 +121,15 @@ typedef struct {
     //for JPEG mode
     lldesc_t *dma;
     uint8_t  *dma_buffer;
+    lldesc_t *dma_base;         //chain allocated by cam_dma_config, dma may point to a mode's chain instead
+    uint32_t dma_buffer_alloc;  //bytes allocated for dma_buffer, at least dma_buffer_size
 
     cam_frame_t *frames;
+    cam_frame_ring_t ring;
 
     QueueHandle_t event_queue;
-    QueueHandle_t frame_buffer_queue;
+    uint32_t event_queue_len;   //events the queue holds, sized for the DMA layout at init
+    SemaphoreHandle_t frame_ready;
     TaskHandle_t task_handle;
     intr_handle_t cam_intr_handle;
 
@@ -139,8 +159,33 @@ typedef struct {
     uint8_t fb_bytes_per_pixel;
 #endif
     uint32_t fb_size;
+    uint32_t fb_alloc_size;     //bytes allocated per frame buffer at init
+    framesize_t frame_size;
 
     cam_state_t state;
+
+    //frame size switching, see cam_prepare_modes()
+    cam_mode_t *modes;
+    size_t mode_cnt;
+    size_t mode_next;
+    atomic_bool mode_hold;      //set by the switching task, cam_task starts no frame while it is set
+    bool mode_held;             //cam_task has seen mode_hold and given mode_idle
+    SemaphoreHandle_t mode_idle;
+
+    //capture scheduler, see camera_capture_mode_t
+    volatile camera_capture_mode_t capture_mode;
+    volatile uint32_t capture_interval_us;
+    int64_t next_capture_us;
+    atomic_uint capture_requests;
+
+    //written by ll_cam_send_event in the VSYNC ISR
+    volatile int64_t vsync_us;
+    volatile uint32_t vsync_cnt;
+
+    //frame acquisition counters, written by cam_task
+    camera_stats_t stats;
+    int64_t first_frame_us;
+    int64_t last_frame_us;
 } cam_obj_t;
 
 
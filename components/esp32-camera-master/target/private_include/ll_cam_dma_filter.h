@@ -0,0 +1,237 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+/*
+ * Sample extraction kernels that turn DMA buffers into frame buffer bytes.
+ *
+ * The ESP32 I2S FIFO delivers every sample in a 32-bit element, little-endian:
+ * sample2 in bits 0-7 and sample1 in bits 16-23. The *_bytes kernels pick the
+ * samples out one byte at a time and work on any alignment. The *_words kernels
+ * load whole elements and assemble every four output bytes into one 32-bit store,
+ * which matters most when the frame buffer is in PSRAM. They need src and dst
+ * aligned to 4 bytes and produce exactly the same bytes.
+ *
+ * The kernels are always inlined, so they end up in IRAM with the filter calling them.
+ * Plain C so that test/host can check them against each other.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LL_CAM_FILTER_INLINE static inline __attribute__((always_inline))
+
+#define LL_CAM_S1(w)  (((w) >> 16) & 0xff)
+#define LL_CAM_S2(w)  ((w) & 0xff)
+
+// sample1 of elements w0..w3 as one little-endian word
+#define LL_CAM_PACK_S1(w0, w1, w2, w3) \
+    (LL_CAM_S1(w0) | (((w1) >> 8) & 0xff00) | ((w2) & 0xff0000) | (((w3) << 8) & 0xff000000))
+
+// sample1, sample2 of w0 then of w1 as one little-endian word
+#define LL_CAM_PACK_S12(w0, w1) \
+    (LL_CAM_S1(w0) | (LL_CAM_S2(w0) << 8) | ((w1) & 0xff0000) | (LL_CAM_S2(w1) << 24))
+
+LL_CAM_FILTER_INLINE bool ll_cam_filter_aligned(const void *dst, const void *src)
+{
+    return (((uintptr_t)dst | (uintptr_t)src) & 3) == 0;
+}
+
+// One byte per element: sample1. JPEG and the Y8 of grayscale in SM_0A0B_0C0D.
+LL_CAM_FILTER_INLINE size_t ll_cam_filter_s1_bytes(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    size_t elements = len / sizeof(uint32_t);
+    size_t end = elements / 4;
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = LL_CAM_S1(el[0]);
+        dst[1] = LL_CAM_S1(el[1]);
+        dst[2] = LL_CAM_S1(el[2]);
+        dst[3] = LL_CAM_S1(el[3]);
+        el += 4;
+        dst += 4;
+    }
+    return elements;
+}
+
+LL_CAM_FILTER_INLINE size_t ll_cam_filter_s1_words(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    uint32_t *out = (uint32_t *)dst;
+    size_t elements = len / sizeof(uint32_t);
+    size_t end = elements / 4;
+    for (size_t i = 0; i < end; ++i) {
+        out[i] = LL_CAM_PACK_S1(el[0], el[1], el[2], el[3]);
+        el += 4;
+    }
+    return elements;
+}
+
+// sample1 of every other element: Y of YU/YV in SM_0A00_0B00, with the odd last sample of a line
+LL_CAM_FILTER_INLINE size_t ll_cam_filter_s1_half_bytes(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    size_t elements = len / sizeof(uint32_t);
+    size_t end = elements / 8;
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = LL_CAM_S1(el[0]);
+        dst[1] = LL_CAM_S1(el[2]);
+        dst[2] = LL_CAM_S1(el[4]);
+        dst[3] = LL_CAM_S1(el[6]);
+        el += 8;
+        dst += 4;
+    }
+    // the final sample of a line in SM_0A0B_0B0C sampling mode needs special handling
+    if ((elements & 0x7) != 0) {
+        dst[0] = LL_CAM_S1(el[0]);
+        dst[1] = LL_CAM_S1(el[2]);
+        elements += 1;
+    }
+    return elements / 2;
+}
+
+LL_CAM_FILTER_INLINE size_t ll_cam_filter_s1_half_words(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    uint32_t *out = (uint32_t *)dst;
+    size_t elements = len / sizeof(uint32_t);
+    size_t end = elements / 8;
+    for (size_t i = 0; i < end; ++i) {
+        out[i] = LL_CAM_PACK_S1(el[0], el[2], el[4], el[6]);
+        el += 8;
+    }
+    if ((elements & 0x7) != 0) {
+        dst += end * 4;
+        dst[0] = LL_CAM_S1(el[0]);
+        dst[1] = LL_CAM_S1(el[2]);
+        elements += 1;
+    }
+    return elements / 2;
+}
+
+// Two bytes per element: sample1, sample2. YU/YV in SM_0A0B_0C0D.
+LL_CAM_FILTER_INLINE size_t ll_cam_filter_s12_bytes(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    size_t elements = len / sizeof(uint32_t);
+    size_t end = elements / 4;
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = LL_CAM_S1(el[0]);//y0
+        dst[1] = LL_CAM_S2(el[0]);//u
+        dst[2] = LL_CAM_S1(el[1]);//y1
+        dst[3] = LL_CAM_S2(el[1]);//v
+
+        dst[4] = LL_CAM_S1(el[2]);//y0
+        dst[5] = LL_CAM_S2(el[2]);//u
+        dst[6] = LL_CAM_S1(el[3]);//y1
+        dst[7] = LL_CAM_S2(el[3]);//v
+        el += 4;
+        dst += 8;
+    }
+    return elements * 2;
+}
+
+LL_CAM_FILTER_INLINE size_t ll_cam_filter_s12_words(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    uint32_t *out = (uint32_t *)dst;
+    size_t elements = len / sizeof(uint32_t);
+    size_t end = elements / 4;
+    for (size_t i = 0; i < end; ++i) {
+        out[0] = LL_CAM_PACK_S12(el[0], el[1]);
+        out[1] = LL_CAM_PACK_S12(el[2], el[3]);
+        el += 4;
+        out += 2;
+    }
+    return elements * 2;
+}
+
+// sample1 of every element, YU/YV in SM_0A00_0B00 and SM_0A0B_0B0C, with the last pixel of a line
+LL_CAM_FILTER_INLINE size_t ll_cam_filter_yuyv_hs_bytes(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    size_t elements = len / sizeof(uint32_t);
+    size_t end = elements / 8;
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = LL_CAM_S1(el[0]);//y0
+        dst[1] = LL_CAM_S1(el[1]);//u
+        dst[2] = LL_CAM_S1(el[2]);//y1
+        dst[3] = LL_CAM_S1(el[3]);//v
+
+        dst[4] = LL_CAM_S1(el[4]);//y0
+        dst[5] = LL_CAM_S1(el[5]);//u
+        dst[6] = LL_CAM_S1(el[6]);//y1
+        dst[7] = LL_CAM_S1(el[7]);//v
+        el += 8;
+        dst += 8;
+    }
+    if ((elements & 0x7) != 0) {
+        dst[0] = LL_CAM_S1(el[0]);//y0
+        dst[1] = LL_CAM_S1(el[1]);//u
+        dst[2] = LL_CAM_S1(el[2]);//y1
+        dst[3] = LL_CAM_S2(el[2]);//v
+        elements += 4;
+    }
+    return elements;
+}
+
+LL_CAM_FILTER_INLINE size_t ll_cam_filter_yuyv_hs_words(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    const uint32_t *el = (const uint32_t *)src;
+    uint32_t *out = (uint32_t *)dst;
+    size_t elements = len / sizeof(uint32_t);
+    size_t end = elements / 8;
+    for (size_t i = 0; i < end; ++i) {
+        out[0] = LL_CAM_PACK_S1(el[0], el[1], el[2], el[3]);
+        out[1] = LL_CAM_PACK_S1(el[4], el[5], el[6], el[7]);
+        el += 8;
+        out += 2;
+    }
+    if ((elements & 0x7) != 0) {
+        out[0] = LL_CAM_S1(el[0]) | (LL_CAM_S1(el[1]) << 8) | (el[2] & 0xff0000) | (LL_CAM_S2(el[2]) << 24);
+        elements += 4;
+    }
+    return elements;
+}
+
+// Y out of YUYV bytes, the YUV to grayscale copy of the ESP32-S2/S3 LCD_CAM path
+LL_CAM_FILTER_INLINE size_t ll_cam_filter_yuyv_y_bytes(uint8_t *out, const uint8_t *in, size_t len)
+{
+    size_t end = len / 8;
+    for (size_t i = 0; i < end; ++i) {
+        out[0] = in[0];
+        out[1] = in[2];
+        out[2] = in[4];
+        out[3] = in[6];
+        out += 4;
+        in += 8;
+    }
+    return len / 2;
+}
+
+LL_CAM_FILTER_INLINE size_t ll_cam_filter_yuyv_y_words(uint8_t *out, const uint8_t *in, size_t len)
+{
+    const uint32_t *src = (const uint32_t *)in;
+    uint32_t *dst = (uint32_t *)out;
+    size_t end = len / 8;
+    for (size_t i = 0; i < end; ++i) {
+        uint32_t a = src[0];
+        uint32_t b = src[1];
+        dst[i] = (a & 0xff) | ((a >> 8) & 0xff00) | ((b & 0xff) << 16) | ((b << 8) & 0xff000000);
+        src += 2;
+    }
+    return len / 2;
+}
@@ -0,0 +1,229 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "ov2640.h"
+#include "ov5640.h"
+#include "driver/i2c.h"
+#include "freertos/task.h"
+#include "xclk.h"
+#include "fake_i2c.h"
+
+#define MAX_OPS                 1024
+
+typedef enum { OP_START, OP_STOP, OP_WRITE, OP_READ } op_type_t;
+
+typedef struct {
+    op_type_t type;
+    const uint8_t *data;    // OP_WRITE, points into the command link or the caller's buffer
+    size_t len;
+    uint8_t byte;           // OP_WRITE of a single byte
+    uint8_t *out;           // OP_READ
+} op_t;
+
+typedef struct {
+    op_t ops[MAX_OPS];
+    size_t count;
+} link_t;
+
+fake_i2c_device_t fake_ov2640 = { .addr = OV2640_SCCB_ADDR, .reg_len = 1, .bank_reg = 0xFF };
+fake_i2c_device_t fake_ov5640 = { .addr = OV5640_SCCB_ADDR, .reg_len = 2, .bank_reg = -1 };
+fake_i2c_stats_t fake_i2c_stats;
+fake_i2c_write_t fake_i2c_log[FAKE_I2C_MAX_LOG];
+size_t fake_i2c_log_len;
+
+static fake_i2c_device_t *find_device(uint8_t addr)
+{
+    if (addr == fake_ov2640.addr) {
+        return &fake_ov2640;
+    }
+    if (addr == fake_ov5640.addr) {
+        return &fake_ov5640;
+    }
+    return NULL;
+}
+
+uint8_t *fake_i2c_reg(fake_i2c_device_t *dev, uint8_t bank, uint16_t reg)
+{
+    if (dev->bank_reg >= 0 && reg != dev->bank_reg) {
+        return &dev->regs[(bank << 8) | (reg & 0xFF)];
+    }
+    return &dev->regs[reg];
+}
+
+static uint8_t *current_reg(fake_i2c_device_t *dev)
+{
+    return fake_i2c_reg(dev, dev->bank, dev->ptr);
+}
+
+double fake_i2c_bits_us(unsigned bits)
+{
+    return bits * 1e6 / CONFIG_SCCB_CLK_FREQ;
+}
+
+void fake_i2c_reset_stats(void)
+{
+    memset(&fake_i2c_stats, 0, sizeof(fake_i2c_stats));
+    fake_i2c_log_len = 0;
+}
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *conf) { return ESP_OK; }
+esp_err_t i2c_driver_install(i2c_port_t port, int mode, size_t rx_buf, size_t tx_buf, int flags) { return ESP_OK; }
+esp_err_t i2c_driver_delete(i2c_port_t port) { return ESP_OK; }
+esp_err_t xclk_timer_conf(int ledc_timer, int xclk_freq_hz) { return ESP_OK; }
+
+void vTaskDelay(TickType_t ticks)
+{
+    fake_i2c_stats.delay_ms += ticks * portTICK_PERIOD_MS;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return calloc(1, sizeof(link_t));
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd)
+{
+    free(cmd);
+}
+
+static op_t *add_op(i2c_cmd_handle_t cmd, op_type_t type)
+{
+    link_t *link = (link_t *)cmd;
+    if (link->count == MAX_OPS) {
+        fprintf(stderr, "command link too long\n");
+        exit(1);
+    }
+    op_t *op = &link->ops[link->count++];
+    memset(op, 0, sizeof(*op));
+    op->type = type;
+    return op;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd)
+{
+    add_op(cmd, OP_START);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd)
+{
+    add_op(cmd, OP_STOP);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en)
+{
+    op_t *op = add_op(cmd, OP_WRITE);
+    op->byte = data;
+    op->data = NULL;
+    op->len = 1;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *data, size_t data_len, bool ack_en)
+{
+    op_t *op = add_op(cmd, OP_WRITE);
+    op->data = data;
+    op->len = data_len;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t *data, int ack)
+{
+    op_t *op = add_op(cmd, OP_READ);
+    op->out = data;
+    op->len = 1;
+    return ESP_OK;
+}
+
+// Plays a command link on the simulated sensors, the way an SCCB slave sees it
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait)
+{
+    link_t *link = (link_t *)cmd;
+    fake_i2c_device_t *dev = NULL;
+    bool reading = false, addressed = false;
+    size_t reg_bytes = 0;
+    unsigned bits = 0, data_bytes = 0;
+    bool has_read = false;
+
+    for (size_t i = 0; i < link->count; i++) {
+        op_t *op = &link->ops[i];
+        switch (op->type) {
+        case OP_START:
+            addressed = false;
+            reg_bytes = 0;
+            fake_i2c_stats.transactions++;
+            bits += 1;
+            break;
+        case OP_STOP:
+            bits += 1;
+            break;
+        case OP_WRITE:
+            for (size_t n = 0; n < op->len; n++) {
+                uint8_t b = op->data ? op->data[n] : op->byte;
+                bits += 9;
+                fake_i2c_stats.bytes++;
+                if (!addressed) {
+                    dev = find_device(b >> 1);
+                    if (!dev) {
+                        return ESP_FAIL;
+                    }
+                    reading = b & 1;
+                    addressed = true;
+                } else if (reg_bytes < dev->reg_len) {
+                    dev->ptr = (reg_bytes ? dev->ptr << 8 : 0) | b;
+                    reg_bytes++;
+                } else {
+                    // Data bytes go to consecutive registers
+                    if (dev->bank_reg >= 0 && dev->ptr == dev->bank_reg) {
+                        dev->bank = b;
+                    }
+                    *current_reg(dev) = b;
+                    if (fake_i2c_log_len < FAKE_I2C_MAX_LOG) {
+                        fake_i2c_log[fake_i2c_log_len].reg = dev->ptr;
+                        fake_i2c_log[fake_i2c_log_len].val = b;
+                        fake_i2c_log_len++;
+                    }
+                    fake_i2c_stats.reg_writes++;
+                    data_bytes++;
+                    dev->ptr++;
+                }
+            }
+            break;
+        case OP_READ:
+            if (!dev || !reading) {
+                return ESP_FAIL;
+            }
+            *op->out = *current_reg(dev);
+            dev->ptr++;
+            bits += 9;
+            fake_i2c_stats.bytes++;
+            has_read = true;
+            break;
+        }
+    }
+    double us = FAKE_I2C_CMD_US + fake_i2c_bits_us(bits);
+    fake_i2c_stats.cmd_begins++;
+    fake_i2c_stats.bus_us += us;
+    if (has_read || (dev && !data_bytes && reg_bytes == dev->reg_len)) {
+        // The read itself, or the write that only sets the register pointer for it
+        fake_i2c_stats.reads++;
+        fake_i2c_stats.read_us += us;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,69 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Fake I2C master for running sccb.c and the sensor drivers on the host.
+//
+// i2c_master_cmd_begin() plays the command link on simulated OV2640 (8-bit registers,
+// banked through 0xFF) and OV5640 (16-bit registers) register files, logs the register
+// writes and estimates the time the link takes on the bus.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Per i2c_master_cmd_begin(): command link allocation, driver locking, interrupt and task
+// wake-up. An assumption for an ESP32 at 240 MHz, printed with the results.
+#define FAKE_I2C_CMD_US         100
+#define FAKE_I2C_MAX_LOG        4096
+
+typedef struct {
+    uint8_t addr;
+    uint8_t reg_len;
+    int bank_reg;                   // -1 without banks
+    uint8_t bank;
+    uint16_t ptr;
+    uint8_t regs[65536];            // (bank << 8) | reg with banks
+} fake_i2c_device_t;
+
+typedef struct {
+    uint16_t reg;
+    uint8_t val;
+} fake_i2c_write_t;
+
+typedef struct {
+    unsigned cmd_begins;
+    unsigned transactions;
+    unsigned bytes;
+    unsigned reg_writes;
+    unsigned reads;                 // command links of register reads, pointer write included
+    double bus_us;                  // with FAKE_I2C_CMD_US per command link
+    double read_us;
+    double delay_ms;                // vTaskDelay() calls of the drivers
+} fake_i2c_stats_t;
+
+extern fake_i2c_device_t fake_ov2640;
+extern fake_i2c_device_t fake_ov5640;
+extern fake_i2c_stats_t fake_i2c_stats;
+extern fake_i2c_write_t fake_i2c_log[FAKE_I2C_MAX_LOG];
+extern size_t fake_i2c_log_len;
+
+// Clears the statistics and the write log, not the registers
+void fake_i2c_reset_stats(void);
+
+double fake_i2c_bits_us(unsigned bits);
+
+// Register as the sensor holds it, bank is ignored for sensors without banks
+uint8_t *fake_i2c_reg(fake_i2c_device_t *dev, uint8_t bank, uint16_t reg);
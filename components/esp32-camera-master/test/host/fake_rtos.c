@@ -0,0 +1,132 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The part of FreeRTOS and esp_timer the conversions use, on POSIX threads. A task is a
+// detached thread, so the stripe encoder of fmt2jpg_parallel() really runs concurrently
+// with its caller and ThreadSanitizer sees both sides.
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+typedef struct {
+    void (*fn)(void *);
+    void *arg;
+} task_start_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+} binary_sem_t;
+
+static void *task_thread(void *arg)
+{
+    task_start_t start = *(task_start_t *)arg;
+    free(arg);
+    start.fn(start.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id)
+{
+    (void)name; (void)stack_depth; (void)priority; (void)core_id;
+    pthread_t thread;
+    task_start_t *start = malloc(sizeof(task_start_t));
+    if (!start) {
+        return pdFALSE;
+    }
+    start->fn = fn;
+    start->arg = arg;
+    if (pthread_create(&thread, NULL, task_thread, start)) {
+        free(start);
+        return pdFALSE;
+    }
+    pthread_detach(thread);
+    if (handle) {
+        *handle = NULL;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (!task) {
+        pthread_exit(NULL);
+    }
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    (void)task;
+    return 5;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    return 1;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    binary_sem_t *sem = calloc(1, sizeof(binary_sem_t));
+    if (sem) {
+        pthread_mutex_init(&sem->lock, NULL);
+        pthread_cond_init(&sem->cond, NULL);
+    }
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks)
+{
+    binary_sem_t *sem = handle;
+    pthread_mutex_lock(&sem->lock);
+    while (!sem->count && ticks) {
+        pthread_cond_wait(&sem->cond, &sem->lock);
+    }
+    BaseType_t taken = sem->count ? pdTRUE : pdFALSE;
+    sem->count = 0;
+    pthread_mutex_unlock(&sem->lock);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle)
+{
+    binary_sem_t *sem = handle;
+    pthread_mutex_lock(&sem->lock);
+    sem->count = 1;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->lock);
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t handle)
+{
+    binary_sem_t *sem = handle;
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->lock);
+    free(sem);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
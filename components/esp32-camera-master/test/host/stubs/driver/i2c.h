@@ -0,0 +1,39 @@
+// Fake I2C master, implemented by the host test that links the SCCB driver
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef int i2c_port_t;
+typedef void *i2c_cmd_handle_t;
+
+#define I2C_NUM_MAX         2
+#define I2C_MASTER_WRITE    0
+#define I2C_MASTER_READ     1
+#define I2C_MODE_MASTER     1
+#define GPIO_PULLUP_ENABLE  1
+
+typedef struct {
+    int mode;
+    int sda_io_num;
+    int sda_pullup_en;
+    int scl_io_num;
+    int scl_pullup_en;
+    struct {
+        uint32_t clk_speed;
+    } master;
+} i2c_config_t;
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *conf);
+esp_err_t i2c_driver_install(i2c_port_t port, int mode, size_t rx_buf, size_t tx_buf, int flags);
+esp_err_t i2c_driver_delete(i2c_port_t port);
+i2c_cmd_handle_t i2c_cmd_link_create(void);
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en);
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *data, size_t data_len, bool ack_en);
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t *data, int ack);
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait);
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+#include <pthread.h>
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+#define portTICK_PERIOD_MS  1
+#define portTICK_RATE_MS    portTICK_PERIOD_MS
+#define portMAX_DELAY       UINT32_MAX
+#define pdFALSE             0
+#define pdTRUE              1
+#define pdPASS              pdTRUE
+#define configMAX_PRIORITIES 25
+// Critical sections are a plain mutex on the host
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)  pthread_mutex_unlock(mux)
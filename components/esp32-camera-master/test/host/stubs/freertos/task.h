@@ -0,0 +1,15 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+void vTaskDelay(TickType_t ticks);
+// Tasks run as detached threads, see fake_rtos.c
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id);
+void vTaskDelete(TaskHandle_t task);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+BaseType_t xPortGetCoreID(void);
+#ifdef __cplusplus
+}
+#endif
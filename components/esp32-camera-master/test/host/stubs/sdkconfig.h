@@ -0,0 +1,10 @@
+// Host build of the SCCB, sensor and conversion code, see test_sccb_batch.c and test_jpeg_dct.cpp
+#pragma once
+#define CONFIG_SCCB_CLK_FREQ 100000
+#define CONFIG_SCCB_SEQUENTIAL_WRITE 1
+#define CONFIG_SCCB_REG_CACHE 1
+#define CONFIG_SCCB_REG_CACHE_SIZE 512
+#define CONFIG_SCCB_HARDWARE_I2C_PORT1 1
+#define CONFIG_CAMERA_JPEG_CHUNK_SIZE 4096
+#define CONFIG_CAMERA_JPEG_CHUNK_POOL_SIZE 16
+#define CONFIG_CAMERA_JPEG_MAX_SIZE 262144
@@ -0,0 +1,3 @@
+#pragma once
+#include "esp_err.h"
+esp_err_t xclk_timer_conf(int ledc_timer, int xclk_freq_hz);
@@ -0,0 +1,186 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// JPEG marker scan of cam_task on frame dumps: run as
+//     test_cam_jpeg_eoi [frame.jpg ...]
+// Without arguments the frames are encoded from the test scene at QVGA, VGA and SVGA.
+//
+// Each frame is put in a buffer the way it sits in a PSRAM frame buffer: whole DMA
+// half-buffers, one more than the frame needs, with a tail of zeros or of an older frame's
+// data that holds a stale FF D9. The SOI, the end of the headers and the EOI that cam_task
+// picks are checked against the frame, and three scans are timed per half-buffer size:
+// the backwards byte compare the driver used before, the forward word scan from the end of
+// the headers and the seeded scan cam_task does.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "img_converters.h"
+#include "cam_jpeg_markers.h"
+#include "test_image.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); return 1; } } while (0)
+
+#define SCAN_TIMES      200
+#define JPG_QUALITY     12
+
+static const uint32_t dma_half_sizes[] = { 1024, 4096, 16384 };
+
+// The driver's scan before the word search: memcmp backwards from the end of the buffer
+static int eoi_backwards(const uint8_t *inbuf, uint32_t length)
+{
+    static const uint16_t JPEG_EOI_MARKER = 0xD9FF;
+    const uint8_t *dptr = inbuf + length - 2;
+    while (dptr > inbuf) {
+        if (memcmp(dptr, &JPEG_EOI_MARKER, 2) == 0) {
+            return dptr - inbuf;
+        }
+        dptr--;
+    }
+    return -1;
+}
+
+// The last FF D9 of the frame itself
+static int eoi_of_frame(const uint8_t *jpg, size_t len)
+{
+    for (size_t i = len - 2; i > 0; i--) {
+        if (jpg[i] == 0xFF && jpg[i + 1] == 0xD9) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static double scan_us(int64_t t)
+{
+    return (esp_timer_get_time() - t) / (double)SCAN_TIMES;
+}
+
+static int test_frame(const char *name, const uint8_t *jpg, size_t jpg_len)
+{
+    int true_eoi = eoi_of_frame(jpg, jpg_len);
+    CHECK(true_eoi > 0);
+
+    for (size_t h = 0; h < sizeof(dma_half_sizes) / sizeof(dma_half_sizes[0]); h++) {
+        uint32_t half = dma_half_sizes[h];
+        uint32_t fb_len = (jpg_len / half + 2) * half;
+        // Word aligned like the frame buffers, the scan reads aligned words
+        uint8_t *fb = (uint8_t *)malloc(fb_len);
+        CHECK(fb);
+
+        for (int stale = 0; stale < 2; stale++) {
+            memset(fb, 0, fb_len);
+            if (stale) {
+                for (uint32_t i = jpg_len; i < fb_len; i++) {
+                    fb[i] = rand();
+                }
+                fb[fb_len - 100] = 0xFF;
+                fb[fb_len - 99] = 0xD9;
+            }
+            memcpy(fb, jpg, jpg_len);
+
+            CHECK(cam_find_jpeg_soi(fb, fb_len) == 0);
+            uint32_t data_start = cam_jpeg_header_len(fb, fb_len);
+            CHECK(data_start > 0 && data_start < (uint32_t)true_eoi);
+            CHECK(cam_find_jpeg_eoi(fb, data_start, fb_len) == true_eoi);
+            CHECK(cam_find_jpeg_frame_eoi(fb, fb_len, 2 * half) == true_eoi);
+            // A tail that misses the marker (a broken frame), the fallback over the rest finds it
+            CHECK(stale || cam_find_jpeg_frame_eoi(fb, fb_len, fb_len - true_eoi - 1) == true_eoi);
+            int backwards = eoi_backwards(fb, fb_len);
+            CHECK(stale || backwards == true_eoi);
+
+            volatile int sink = 0;
+            int64_t t = esp_timer_get_time();
+            for (int i = 0; i < SCAN_TIMES; i++) {
+                sink += eoi_backwards(fb, fb_len);
+            }
+            double t_backwards = scan_us(t);
+
+            t = esp_timer_get_time();
+            for (int i = 0; i < SCAN_TIMES; i++) {
+                sink += cam_find_jpeg_eoi(fb, cam_jpeg_header_len(fb, fb_len), fb_len);
+            }
+            double t_forward = scan_us(t);
+
+            t = esp_timer_get_time();
+            for (int i = 0; i < SCAN_TIMES; i++) {
+                sink += cam_find_jpeg_frame_eoi(fb, fb_len, 2 * half);
+            }
+            double t_seeded = scan_us(t);
+            (void)sink;
+
+            printf("%-16s %7u %6u %-5s %8.2f %s %8.2f %8.2f\n", name, (unsigned)jpg_len, (unsigned)half,
+                   stale ? "stale" : "zero", t_backwards, backwards == true_eoi ? " " : "!", t_forward, t_seeded);
+        }
+        free(fb);
+    }
+    return 0;
+}
+
+static int test_dump(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    CHECK(f);
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    CHECK(len > 4);
+    uint8_t *jpg = (uint8_t *)malloc(len);
+    CHECK(jpg);
+    CHECK(fread(jpg, 1, len, f) == (size_t)len);
+    fclose(f);
+
+    const char *name = strrchr(path, '/');
+    int fail = test_frame(name ? name + 1 : path, jpg, len);
+    free(jpg);
+    return fail;
+}
+
+static int test_scene(const char *name, int width, int height)
+{
+    size_t rgb_len = width * height * 3;
+    uint8_t *rgb = (uint8_t *)malloc(rgb_len);
+    CHECK(rgb);
+    test_image_rgb888(rgb, width, height, 0);
+
+    uint8_t *jpg = NULL;
+    size_t jpg_len = 0;
+    CHECK(fmt2jpg(rgb, rgb_len, width, height, PIXFORMAT_RGB888, JPG_QUALITY, &jpg, &jpg_len));
+    free(rgb);
+
+    int fail = test_frame(name, jpg, jpg_len);
+    free(jpg);
+    return fail;
+}
+
+int main(int argc, char **argv)
+{
+    int fail = 0;
+
+    printf("JPEG marker scan, us per frame ('!' the backwards scan took a stale marker)\n");
+    printf("%-16s %7s %6s %-5s %8s   %8s %8s\n", "frame", "bytes", "half", "tail", "backward", "forward", "seeded");
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            fail |= test_dump(argv[i]);
+        }
+    } else {
+        fail |= test_scene("scene QVGA", 320, 240);
+        fail |= test_scene("scene VGA", 640, 480);
+        fail |= test_scene("scene SVGA", 800, 600);
+    }
+
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
@@ -0,0 +1,175 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <jpeglib.h>
+#include "test_image.h"
+
+static uint8_t clamp(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+void test_image_rgb888(uint8_t *rgb, int width, int height, int frame)
+{
+    // The scene pans right by one MCU per frame, the noisy band gets busier over the
+    // first half of a 64 frame cycle and calmer over the second, and every 48 frames
+    // the checkerboard switches between 32 and 16 pixel squares like a scene cut
+    int pan = frame * 16;
+    int phase = frame & 63;
+    int amp = 4 + (phase < 32 ? phase : 64 - phase);
+    int square = ((frame / 48) & 1) ? 16 : 32;
+    uint32_t seed = 1 + frame;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sx = x + pan;
+            seed = seed * 1103515245 + 12345;
+            int noise = (y > height / 3 && y < 2 * height / 3) ? (int)((seed >> 16) % (2 * amp + 1)) - amp : 0;
+            uint8_t *p = rgb + ((size_t)y * width + x) * 3;
+            p[0] = clamp((sx % width) * 255 / width + noise);
+            p[1] = clamp(y * 255 / height + noise);
+            p[2] = ((sx / square + y / square) & 1) ? 200 : 40;
+        }
+    }
+}
+
+static void rgb_to_studio_yuv(const uint8_t *p, int *y, int *u, int *v)
+{
+    *y = 16 + (p[0] * 16829 + p[1] * 33039 + p[2] * 6416 + 32768) / 65536;
+    *u = 128 + (-p[0] * 9714 - p[1] * 19070 + p[2] * 28784) / 65536;
+    *v = 128 + (p[0] * 28784 - p[1] * 24103 - p[2] * 4681) / 65536;
+}
+
+void test_image_yuyv(uint8_t *yuyv, int width, int height, int frame)
+{
+    uint8_t *scene = malloc((size_t)width * height * 3);
+    test_image_rgb888(scene, width, height, frame);
+    for (int y = 0; y < height; y++) {
+        const uint8_t *src = scene + (size_t)y * width * 3;
+        uint8_t *dst = yuyv + (size_t)y * width * 2;
+        for (int x = 0; x < width; x += 2) {
+            int y0, u0, v0, y1 = 0, u1, v1;
+            rgb_to_studio_yuv(src + x * 3, &y0, &u0, &v0);
+            u1 = u0;
+            v1 = v0;
+            if (x + 1 < width) {
+                rgb_to_studio_yuv(src + x * 3 + 3, &y1, &u1, &v1);
+            }
+            dst[x * 2] = y0;
+            dst[x * 2 + 1] = (u0 + u1 + 1) / 2;
+            if (x + 1 < width) {
+                dst[x * 2 + 2] = y1;
+                dst[x * 2 + 3] = (v0 + v1 + 1) / 2;
+            }
+        }
+    }
+    free(scene);
+}
+
+uint8_t *test_image_guarded_alloc(size_t len)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t pages = (len + page - 1) / page + 1;
+    uint8_t *map = mmap(NULL, pages * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    mprotect(map + (pages - 1) * page, page, PROT_NONE);
+    return map + (pages - 1) * page - len;
+}
+
+void test_image_guarded_free(uint8_t *buf, size_t len)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t pages = (len + page - 1) / page + 1;
+    munmap(buf + len - (pages - 1) * page, pages * page);
+}
+
+typedef struct {
+    struct jpeg_error_mgr mgr;
+    jmp_buf jump;
+} decode_error_t;
+
+static void decode_error_exit(j_common_ptr cinfo)
+{
+    decode_error_t *err = (decode_error_t *)cinfo->err;
+    char msg[JMSG_LENGTH_MAX];
+    err->mgr.format_message(cinfo, msg);
+    fprintf(stderr, "libjpeg: %s\n", msg);
+    longjmp(err->jump, 1);
+}
+
+uint8_t *test_image_decode(const uint8_t *jpg, size_t len, int *width, int *height, int *components)
+{
+    struct jpeg_decompress_struct cinfo;
+    decode_error_t err;
+    uint8_t *volatile out = NULL;
+
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = decode_error_exit;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        free(out);
+        return NULL;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpg, len);
+    jpeg_read_header(&cinfo, TRUE);
+    // Plain upsampling and the accurate IDCT, so the numbers only move with the encoder
+    cinfo.dct_method = JDCT_ISLOW;
+    cinfo.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&cinfo);
+
+    size_t stride = (size_t)cinfo.output_width * cinfo.output_components;
+    out = malloc(stride * cinfo.output_height);
+    if (!out) {
+        jpeg_destroy_decompress(&cinfo);
+        return NULL;
+    }
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = out + stride * cinfo.output_scanline;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    // Corrupt entropy data is only a warning to libjpeg, it fills in the rest
+    long warnings = cinfo.err->num_warnings;
+    *width = cinfo.output_width;
+    *height = cinfo.output_height;
+    *components = cinfo.output_components;
+    jpeg_destroy_decompress(&cinfo);
+    if (warnings) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+double test_image_psnr(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    double se = 0;
+    for (size_t i = 0; i < len; i++) {
+        int d = (int)a[i] - (int)b[i];
+        se += d * d;
+    }
+    if (se == 0) {
+        return 99.0;
+    }
+    return 10.0 * log10(255.0 * 255.0 * len / se);
+}
@@ -0,0 +1,52 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// Source images and JPEG checks for the conversion benchmarks.
+//
+// The scenes are synthetic: gradients, hard edges and a noisy band, the mix a camera
+// frame gives the encoder. Frames of one scene pan and change the amount of detail, so a
+// sequence of them also works as a recording for the rate control replay. The output is
+// decoded with the system libjpeg, an independent check of the bitstream.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Frame number 'frame' of the test scene as RGB888
+void test_image_rgb888(uint8_t *rgb, int width, int height, int frame);
+
+// The same frame as YUYV (YUV422) in the BT.601 studio range the sensors put out.
+// Chroma is the average of each pixel pair, an odd last pixel is Y and U only.
+void test_image_yuyv(uint8_t *yuyv, int width, int height, int frame);
+
+// len bytes that end right before an inaccessible page, so reading past the end of a
+// source image faults. Free with test_image_guarded_free().
+uint8_t *test_image_guarded_alloc(size_t len);
+void test_image_guarded_free(uint8_t *buf, size_t len);
+
+// Decodes a JPEG to RGB888 (or Y for grayscale). Returns a malloc'd buffer, NULL if libjpeg
+// rejects the stream.
+uint8_t *test_image_decode(const uint8_t *jpg, size_t len, int *width, int *height, int *components);
+
+// PSNR in dB over len bytes, 99 for identical buffers
+double test_image_psnr(const uint8_t *a, const uint8_t *b, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
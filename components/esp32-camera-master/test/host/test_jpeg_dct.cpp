@@ -0,0 +1,142 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// DCT back-ends of jpge: the DCT_ISLOW and DCT_IFAST kernels on their own and inside a
+// full VGA encode, in 8x8 blocks per second. jpge.cpp is included rather than linked to
+// reach the kernels, which are file local. The IFAST output must stay within a small
+// PSNR margin of ISLOW at every quality, decoded with libjpeg.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "test_image.h"
+#include "../../conversions/jpge.cpp"
+#include "test_jpge.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); return 1; } } while (0)
+
+#define IMG_W           640
+#define IMG_H           480
+#define JPG_BUF_LEN     (512 * 1024)
+#define KERNEL_BLOCKS   2000000
+#define ENCODE_TIMES    10
+
+// IFAST may lose this much against ISLOW, and ISLOW must reach MIN_PSNR at quality 80
+#define MAX_PSNR_LOSS   0.5
+#define MIN_PSNR        32.0
+
+static size_t encode(const uint8_t *rgb, int quality, jpge::dct_method_t dct, uint8_t *out)
+{
+    jpge::params params;
+    params.m_quality = quality;
+    params.m_dct_method = dct;
+    return jpge_encode(rgb, IMG_W, IMG_H, 3, params, out, JPG_BUF_LEN);
+}
+
+static const char *simd_name(void)
+{
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#elif defined(__ARM_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+static double kernel_blocks_per_s(void (*dct)(jpge::int32 *))
+{
+    jpge::int32 src[64], blk[64];
+    uint32_t seed = 1;
+    for (int i = 0; i < 64; i++) {
+        seed = seed * 1103515245 + 12345;
+        src[i] = (int)((seed >> 16) & 0xff) - 128;
+    }
+    jpge::int32 sink = 0;
+    int64_t t = esp_timer_get_time();
+    for (int b = 0; b < KERNEL_BLOCKS; b++) {
+        memcpy(blk, src, sizeof(blk));
+        blk[b & 63] ^= b & 1;
+        dct(blk);
+        sink += blk[b & 63];
+    }
+    t = esp_timer_get_time() - t;
+    if (sink == 0x7fffffff) {
+        printf("\n");
+    }
+    return KERNEL_BLOCKS * 1e6 / t;
+}
+
+static int test_kernels(void)
+{
+    double islow = kernel_blocks_per_s(jpge::DCT2D);
+    double ifast = kernel_blocks_per_s(jpge::DCT2D_fast);
+    printf("DCT kernel (%s): ISLOW %.0f blocks/s, IFAST %.0f blocks/s (x%.2f)\n",
+           simd_name(), islow, ifast, ifast / islow);
+    return 0;
+}
+
+static int test_encode(void)
+{
+    static const jpge::dct_method_t methods[2] = {jpge::DCT_ISLOW, jpge::DCT_IFAST};
+    static const char *names[2] = {"ISLOW", "IFAST"};
+    static const int qualities[] = {50, 80, 95};
+    const int blocks = (IMG_W / 16) * (IMG_H / 16) * 6;
+
+    uint8_t *rgb = (uint8_t *)malloc(IMG_W * IMG_H * 3);
+    uint8_t *jpg = (uint8_t *)malloc(JPG_BUF_LEN);
+    CHECK(rgb && jpg);
+    test_image_rgb888(rgb, IMG_W, IMG_H, 16);
+
+    for (size_t q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++) {
+        double psnr[2];
+        for (int m = 0; m < 2; m++) {
+            size_t len = 0;
+            int64_t t = esp_timer_get_time();
+            for (int i = 0; i < ENCODE_TIMES; i++) {
+                len = encode(rgb, qualities[q], methods[m], jpg);
+                CHECK(len);
+            }
+            t = esp_timer_get_time() - t;
+
+            int w, h, c;
+            uint8_t *dec = test_image_decode(jpg, len, &w, &h, &c);
+            CHECK(dec);
+            CHECK(w == IMG_W && h == IMG_H && c == 3);
+            psnr[m] = test_image_psnr(rgb, dec, IMG_W * IMG_H * 3);
+            free(dec);
+            printf("VGA q=%d %s: %zu bytes, %.2f ms, %.0f blocks/s, PSNR %.2f dB\n", qualities[q], names[m], len,
+                   t / 1000.0 / ENCODE_TIMES, (double)blocks * ENCODE_TIMES * 1e6 / t, psnr[m]);
+        }
+        CHECK(psnr[1] >= psnr[0] - MAX_PSNR_LOSS);
+        if (qualities[q] == 80) {
+            CHECK(psnr[0] >= MIN_PSNR);
+        }
+    }
+    free(jpg);
+    free(rgb);
+    return 0;
+}
+
+int main(void)
+{
+    int fail = 0;
+    fail |= test_kernels();
+    fail |= test_encode();
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
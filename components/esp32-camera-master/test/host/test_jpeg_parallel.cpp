@@ -0,0 +1,169 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// fmt2jpg_parallel() on the pthread executor of fake_rtos.c: the bottom stripe is encoded
+// on its own thread while the caller encodes the top one. Restart markers only reset the
+// DC predictors, so the stitched stream must decode with libjpeg to exactly the pixels of
+// the fmt2jpg() output. Serial and parallel encode times are printed. With two or more CPUs
+// online the frames of VGA and up have to encode at least MIN_SPEEDUP times faster in
+// parallel, on a single CPU the scaling is not measured.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "img_converters.h"
+#include "test_image.h"
+
+#define MIN_SPEEDUP     1.3
+// Smaller frames are dominated by the stripe task start
+#define SPEEDUP_PIXELS  (640 * 480)
+
+static long cpus;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); return 1; } } while (0)
+
+#define ENCODE_TIMES    5
+
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+    pixformat_t format;
+} parallel_case_t;
+
+// Source image of the case from the RGB scene
+static uint8_t *make_source(const parallel_case_t *c, size_t *len)
+{
+    size_t pixels = (size_t)c->width * c->height;
+    uint8_t *rgb = (uint8_t *)malloc(pixels * 3);
+    uint8_t *src = (uint8_t *)malloc(pixels * 3);
+    if (!rgb || !src) {
+        free(rgb);
+        free(src);
+        return NULL;
+    }
+    test_image_rgb888(rgb, c->width, c->height, 16);
+    switch (c->format) {
+    case PIXFORMAT_YUV422:
+        test_image_yuyv(src, c->width, c->height, 16);
+        *len = pixels * 2;
+        break;
+    case PIXFORMAT_RGB565:
+        for (size_t i = 0; i < pixels; i++) {
+            const uint8_t *p = rgb + i * 3;
+            src[i * 2] = (p[0] & 0xF8) | (p[1] >> 5);
+            src[i * 2 + 1] = ((p[1] & 0x1C) << 3) | (p[2] >> 3);
+        }
+        *len = pixels * 2;
+        break;
+    case PIXFORMAT_GRAYSCALE:
+        for (size_t i = 0; i < pixels; i++) {
+            src[i] = (rgb[i * 3] * 77 + rgb[i * 3 + 1] * 150 + rgb[i * 3 + 2] * 29) >> 8;
+        }
+        *len = pixels;
+        break;
+    default:
+        memcpy(src, rgb, pixels * 3);
+        *len = pixels * 3;
+        break;
+    }
+    free(rgb);
+    return src;
+}
+
+static int count_restart_markers(const uint8_t *jpg, size_t len)
+{
+    int count = 0;
+    for (size_t i = 0; i + 1 < len; i++) {
+        if (jpg[i] == 0xFF && jpg[i + 1] >= 0xD0 && jpg[i + 1] <= 0xD7) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int run_case(const parallel_case_t *c)
+{
+    size_t src_len = 0;
+    uint8_t *src = make_source(c, &src_len);
+    CHECK(src);
+
+    uint8_t *jpg[2] = {NULL, NULL};
+    size_t len[2] = {0, 0};
+    int64_t t_us[2];
+    for (int parallel = 0; parallel < 2; parallel++) {
+        int64_t t = esp_timer_get_time();
+        for (int i = 0; i < ENCODE_TIMES; i++) {
+            free(jpg[parallel]);
+            jpg[parallel] = NULL;
+            bool ok = parallel ? fmt2jpg_parallel(src, src_len, c->width, c->height, c->format, 80, &jpg[parallel], &len[parallel])
+                               : fmt2jpg(src, src_len, c->width, c->height, c->format, 80, &jpg[parallel], &len[parallel]);
+            CHECK(ok);
+        }
+        t_us[parallel] = (esp_timer_get_time() - t) / ENCODE_TIMES;
+    }
+
+    int w[2], h[2], comps[2];
+    uint8_t *dec[2];
+    for (int i = 0; i < 2; i++) {
+        dec[i] = test_image_decode(jpg[i], len[i], &w[i], &h[i], &comps[i]);
+        CHECK(dec[i]);
+        CHECK(w[i] == c->width && h[i] == c->height);
+    }
+    CHECK(comps[0] == comps[1]);
+    CHECK(memcmp(dec[0], dec[1], (size_t)w[0] * h[0] * comps[0]) == 0);
+
+    // Images of a single MCU row fall back to the serial encoder
+    int restarts = count_restart_markers(jpg[1], len[1]);
+    double speedup = (double)t_us[0] / t_us[1];
+    printf("%-10s %4dx%-4d serial %6.2f ms %6zu bytes, parallel %6.2f ms %6zu bytes, %d RST, x%.2f\n",
+           c->name, c->width, c->height, t_us[0] / 1000.0, len[0], t_us[1] / 1000.0, len[1], restarts, speedup);
+    CHECK(restarts == (c->height > 16 ? 1 : 0));
+    if (cpus >= 2 && c->width * c->height >= SPEEDUP_PIXELS) {
+        CHECK(speedup >= MIN_SPEEDUP);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        free(dec[i]);
+        free(jpg[i]);
+    }
+    free(src);
+    return 0;
+}
+
+int main(void)
+{
+    static const parallel_case_t cases[] = {
+        {"RGB888", 640, 480, PIXFORMAT_RGB888},
+        {"YUV422", 800, 600, PIXFORMAT_YUV422},
+        {"RGB565", 321, 241, PIXFORMAT_RGB565},
+        {"GRAYSCALE", 1600, 1200, PIXFORMAT_GRAYSCALE},
+        {"RGB888", 100, 16, PIXFORMAT_RGB888},
+    };
+    int fail = 0;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus >= 2) {
+        printf("%ld CPUs online, speedup checked from %d pixels\n", cpus, SPEEDUP_PIXELS);
+    } else {
+        printf("%ld CPU online, scaling not measured, both stripes share it\n", cpus);
+    }
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        fail |= run_case(&cases[i]);
+    }
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
@@ -0,0 +1,203 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replay of a frame sequence through the JPEG rate controller, reporting frame size
+// spread and PSNR (libjpeg decode against the source) for:
+//  - a fixed encoder quality, for reference
+//  - frame2jpg_rate_ctrl() on the software encoder
+//  - the sensor quality loop, modelled as a sensor whose JPEG engine uses the quality
+//    register at the start of each frame while FB_COUNT frames wait in the queue. Fed
+//    with jpg_rate_ctrl_update() on every dequeued frame and with
+//    jpg_rate_ctrl_update_frame(), which skips the frames queued before a change.
+//
+// Run without arguments it replays the panning test scene at QVGA. A recording of raw
+// RGB888 frames is replayed with: test_jpeg_rate_ctrl frames.rgb <width> <height>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "img_converters.h"
+#include "test_image.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); return 1; } } while (0)
+
+#define SCENE_W         320
+#define SCENE_H         240
+#define SCENE_FRAMES    128
+#define FB_COUNT        5
+#define FRAME_US        40000
+#define SETTLE_FRAMES   8       // left out of the statistics
+#define TARGET_QUALITY  60      // the budget is what the first frame takes at this quality
+#define SENSOR_QUALITY  12
+
+typedef enum { MODE_FIXED, MODE_ENCODER, MODE_SENSOR_EVERY_FRAME, MODE_SENSOR_SETTLED, MODE_MAX } replay_mode_t;
+
+static const char *mode_names[MODE_MAX] = {
+    "fixed quality", "encoder rate ctrl", "sensor, every frame", "sensor, settled",
+};
+
+typedef struct {
+    double mean;
+    double cv;          // standard deviation over mean
+    int over;           // frames more than 25% over budget
+    int changes;        // quality changes
+    double psnr;
+} replay_stats_t;
+
+// Stand-in for the sensor JPEG engine: the quality register scales the quantization
+// tables linearly, 8 IJG scale percent per step puts the default of 12 near quality 50
+static int sensor_to_encoder_quality(int sensor_quality)
+{
+    int scale = sensor_quality * 8;
+    if (scale < 1) {
+        scale = 1;
+    }
+    int quality = scale >= 100 ? 5000 / scale : (200 - scale) / 2;
+    return quality < 1 ? 1 : (quality > 100 ? 100 : quality);
+}
+
+static int encode(uint8_t *rgb, int w, int h, int quality, uint8_t **jpg, size_t *len)
+{
+    return fmt2jpg(rgb, (size_t)w * h * 3, w, h, PIXFORMAT_RGB888, quality, jpg, len) ? 0 : 1;
+}
+
+static int replay(replay_mode_t mode, uint8_t *frames, int count, int w, int h, size_t target, replay_stats_t *st)
+{
+    size_t frame_len = (size_t)w * h * 3;
+    jpg_rate_ctrl_t rc;
+    double sum = 0, sum2 = 0, psnr = 0;
+    int n = 0, quality = 0;
+    // Sensor register writes, frame i reads the last one made before it started
+    int64_t write_us[SCENE_FRAMES * 4];
+    int write_quality[SCENE_FRAMES * 4];
+    int writes = 0;
+
+    memset(st, 0, sizeof(*st));
+    if (mode == MODE_ENCODER) {
+        jpg_rate_ctrl_init(&rc, JPG_RATE_CTRL_ENCODER, target, 80);
+    } else {
+        jpg_rate_ctrl_init(&rc, JPG_RATE_CTRL_SENSOR, target, SENSOR_QUALITY);
+    }
+    write_us[writes] = 0;
+    write_quality[writes++] = rc.quality;
+
+    for (int i = 0; i < count; i++) {
+        uint8_t *rgb = frames + frame_len * i;
+        uint8_t *jpg = NULL;
+        size_t len = 0;
+        int64_t start_us = (int64_t)(i + 1) * FRAME_US;
+        int prev_quality = quality;
+
+        if (mode == MODE_FIXED) {
+            quality = 80;
+            CHECK(!encode(rgb, w, h, quality, &jpg, &len));
+        } else if (mode == MODE_ENCODER) {
+            camera_fb_t fb = { .buf = rgb, .len = frame_len, .width = w, .height = h, .format = PIXFORMAT_RGB888 };
+            quality = rc.quality;
+            CHECK(frame2jpg_rate_ctrl(&fb, &rc, &jpg, &len));
+        } else {
+            int k = writes - 1;
+            while (write_us[k] >= start_us) {
+                k--;
+            }
+            quality = write_quality[k];
+            CHECK(!encode(rgb, w, h, sensor_to_encoder_quality(quality), &jpg, &len));
+            // Dequeued FB_COUNT frames later, the register write lands right away
+            int64_t now_us = start_us + FB_COUNT * FRAME_US + FRAME_US / 2;
+            int next = mode == MODE_SENSOR_SETTLED ? jpg_rate_ctrl_update_frame(&rc, len, start_us, now_us)
+                                                   : jpg_rate_ctrl_update(&rc, len);
+            if (next != write_quality[writes - 1] && writes < SCENE_FRAMES * 4) {
+                write_us[writes] = now_us;
+                write_quality[writes++] = next;
+            }
+        }
+
+        if (i >= SETTLE_FRAMES) {
+            int dw, dh, dc;
+            uint8_t *dec = test_image_decode(jpg, len, &dw, &dh, &dc);
+            CHECK(dec && dw == w && dh == h && dc == 3);
+            // PIXFORMAT_RGB888 is stored B, G, R
+            for (size_t p = 0; p < frame_len; p += 3) {
+                uint8_t r = dec[p];
+                dec[p] = dec[p + 2];
+                dec[p + 2] = r;
+            }
+            psnr += test_image_psnr(rgb, dec, frame_len);
+            free(dec);
+            sum += len;
+            sum2 += (double)len * len;
+            st->over += len > target + target / 4;
+            st->changes += quality != prev_quality;
+            n++;
+        }
+        free(jpg);
+    }
+    st->mean = sum / n;
+    st->cv = sqrt(sum2 / n - st->mean * st->mean) / st->mean;
+    st->psnr = psnr / n;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int w = SCENE_W, h = SCENE_H, count = SCENE_FRAMES;
+    uint8_t *frames;
+    int fail = 0;
+
+    if (argc == 4) {
+        w = atoi(argv[2]);
+        h = atoi(argv[3]);
+        FILE *f = fopen(argv[1], "rb");
+        CHECK(f && w > 0 && h > 0);
+        size_t frame_len = (size_t)w * h * 3;
+        frames = malloc(frame_len * SCENE_FRAMES);
+        CHECK(frames);
+        count = fread(frames, frame_len, SCENE_FRAMES, f);
+        fclose(f);
+        CHECK(count > SETTLE_FRAMES);
+    } else {
+        frames = malloc((size_t)w * h * 3 * count);
+        CHECK(frames);
+        for (int i = 0; i < count; i++) {
+            test_image_rgb888(frames + (size_t)w * h * 3 * i, w, h, i);
+        }
+    }
+
+    uint8_t *jpg;
+    size_t target;
+    CHECK(!encode(frames, w, h, TARGET_QUALITY, &jpg, &target));
+    free(jpg);
+    printf("%d frames of %dx%d, budget %zu bytes, %d frames queued in the sensor model\n", count, w, h, target, FB_COUNT);
+
+    replay_stats_t st[MODE_MAX];
+    for (int m = 0; m < MODE_MAX; m++) {
+        fail |= replay(m, frames, count, w, h, target, &st[m]);
+        printf("%-20s mean %6.0f bytes (%+5.1f%%), stddev %5.1f%%, %3d over budget, %3d quality changes, PSNR %.2f dB\n",
+               mode_names[m], st[m].mean, 100.0 * (st[m].mean - target) / target, 100.0 * st[m].cv,
+               st[m].over, st[m].changes, st[m].psnr);
+    }
+    free(frames);
+
+    // The controllers must hold the budget closer than a fixed quality does, and the
+    // settled sensor loop must not swing more than the one fed every frame
+    CHECK(st[MODE_ENCODER].cv < st[MODE_FIXED].cv);
+    CHECK(fabs(st[MODE_ENCODER].mean - target) < target * 0.15);
+    CHECK(fabs(st[MODE_SENSOR_SETTLED].mean - target) < target * 0.15);
+    CHECK(st[MODE_SENSOR_SETTLED].cv <= st[MODE_SENSOR_EVERY_FRAME].cv);
+    CHECK(st[MODE_SENSOR_SETTLED].over <= st[MODE_SENSOR_EVERY_FRAME].over);
+
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
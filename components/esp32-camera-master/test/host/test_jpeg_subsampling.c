@@ -0,0 +1,157 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Heap and time per jpg_subsampling_t: fmt2jpg_cb_opts() of VGA and SVGA YUV422 and
+// RGB888 frames in every subsampling mode. The output goes to a callback that only
+// counts it, so the heap peak is the encoder's own: the jpeg_encoder object, the MCU line
+// buffer (16 or 8 rows of YCbCr) and the RGB scanline for sources that are converted.
+// malloc() and free() are wrapped at link time to track it. Output size and libjpeg PSNR
+// are printed for each mode.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "esp_timer.h"
+#include "img_converters.h"
+#include "test_image.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); return 1; } } while (0)
+
+#define ENCODE_TIMES    10
+#define JPG_BUF_LEN     (512 * 1024)
+
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+
+static size_t heap_used;
+static size_t heap_peak;
+
+void *__wrap_malloc(size_t size)
+{
+    void *p = __real_malloc(size);
+    if (p) {
+        heap_used += malloc_usable_size(p);
+        if (heap_used > heap_peak) {
+            heap_peak = heap_used;
+        }
+    }
+    return p;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr) {
+        heap_used -= malloc_usable_size(ptr);
+    }
+    __real_free(ptr);
+}
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+} jpg_buf_t;
+
+static size_t jpg_out(void *arg, size_t index, const void *data, size_t len)
+{
+    jpg_buf_t *jpg = arg;
+    if (data && jpg->buf && index + len <= JPG_BUF_LEN) {
+        memcpy(jpg->buf + index, data, len);
+    }
+    if (index + len > jpg->len) {
+        jpg->len = index + len;
+    }
+    return len;
+}
+
+static int run_size(const char *name, int w, int h, pixformat_t format)
+{
+    static const char *mode_names[] = {"4:2:0", "4:2:2", "4:4:4", "gray"};
+    static const int mcu_rows[] = {16, 8, 8, 8};
+    size_t pixels = (size_t)w * h;
+    uint8_t *rgb = malloc(pixels * 3);
+    uint8_t *src = malloc(pixels * 3);
+    uint8_t *out = malloc(JPG_BUF_LEN);
+    CHECK(rgb && src && out);
+    test_image_rgb888(rgb, w, h, 16);
+    size_t src_len;
+    if (format == PIXFORMAT_YUV422) {
+        test_image_yuyv(src, w, h, 16);
+        src_len = pixels * 2;
+    } else {
+        // PIXFORMAT_RGB888 is stored B, G, R
+        for (size_t i = 0; i < pixels; i++) {
+            src[i * 3] = rgb[i * 3 + 2];
+            src[i * 3 + 1] = rgb[i * 3 + 1];
+            src[i * 3 + 2] = rgb[i * 3];
+        }
+        src_len = pixels * 3;
+    }
+
+    size_t heap[JPG_SUBSAMPLING_GRAY + 1];
+    for (int mode = JPG_SUBSAMPLING_420; mode <= JPG_SUBSAMPLING_GRAY; mode++) {
+        jpg_encode_options_t opts = JPG_ENCODE_OPTIONS_DEFAULT(80);
+        opts.subsampling = mode;
+
+        // One encode to measure, the output is not stored
+        jpg_buf_t jpg = { NULL, 0 };
+        size_t base = heap_used;
+        heap_peak = heap_used;
+        CHECK(fmt2jpg_cb_opts(src, src_len, w, h, format, &opts, jpg_out, &jpg));
+        heap[mode] = heap_peak - base;
+
+        int64_t t = esp_timer_get_time();
+        for (int i = 0; i < ENCODE_TIMES; i++) {
+            jpg.buf = out;
+            jpg.len = 0;
+            CHECK(fmt2jpg_cb_opts(src, src_len, w, h, format, &opts, jpg_out, &jpg));
+        }
+        t = (esp_timer_get_time() - t) / ENCODE_TIMES;
+        CHECK(jpg.len <= JPG_BUF_LEN);
+
+        int dw, dh, dc;
+        uint8_t *dec = test_image_decode(out, jpg.len, &dw, &dh, &dc);
+        CHECK(dec && dw == w && dh == h);
+        CHECK(dc == (mode == JPG_SUBSAMPLING_GRAY ? 1 : 3));
+        double psnr = 0;
+        if (dc == 3) {
+            psnr = test_image_psnr(rgb, dec, pixels * 3);
+        }
+        free(dec);
+        printf("%-4s %-6s %-5s heap %6zu bytes, %2d rows buffered, %6.2f ms, %6zu bytes",
+               name, format == PIXFORMAT_YUV422 ? "YUV422" : "RGB888", mode_names[mode], heap[mode],
+               mcu_rows[mode], t / 1000.0, jpg.len);
+        if (dc == 3) {
+            printf(", PSNR %.2f dB", psnr);
+        }
+        printf("\n");
+    }
+    // Half the MCU rows buffered must show in the heap
+    CHECK(heap[JPG_SUBSAMPLING_422] < heap[JPG_SUBSAMPLING_420]);
+
+    free(out);
+    free(src);
+    free(rgb);
+    return 0;
+}
+
+int main(void)
+{
+    int fail = 0;
+    fail |= run_size("VGA", 640, 480, PIXFORMAT_YUV422);
+    fail |= run_size("VGA", 640, 480, PIXFORMAT_RGB888);
+    fail |= run_size("SVGA", 800, 600, PIXFORMAT_YUV422);
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
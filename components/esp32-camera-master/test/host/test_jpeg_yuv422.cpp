@@ -0,0 +1,142 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Native YUV422 ingest of jpge against the RGB round trip it replaced (every YUYV scanline
+// through yuv2rgb() into an RGB888 line, then back to YCbCr in the encoder), per frame at
+// VGA and SVGA. Both outputs are decoded with libjpeg and compared to the source scene.
+// Most of the PSNR gap is yuv2rgb() itself, its table applies the U weight of green to V
+// and the other way round.
+// The odd width case reads its source from a buffer that ends at an inaccessible page, a
+// read past the last scanline faults.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "yuv.h"
+#include "test_image.h"
+#include "test_jpge.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); return 1; } } while (0)
+
+#define JPG_BUF_LEN     (512 * 1024)
+#define ENCODE_TIMES    10
+
+// The native path does one colour conversion less, it may not come out worse than this
+#define MAX_PSNR_LOSS   0.2
+
+static size_t encode_via_rgb(const uint8_t *yuyv, int w, int h, const jpge::params &params, uint8_t *line, uint8_t *out)
+{
+    memory_stream stream(out, JPG_BUF_LEN);
+    jpge::jpeg_encoder encoder;
+    if (!encoder.init(&stream, w, h, 3, params)) {
+        return 0;
+    }
+    for (int y = 0; y < h; y++) {
+        const uint8_t *src = yuyv + (size_t)y * w * 2;
+        uint8_t *dst = line;
+        for (int x = 0; x < w * 2; x += 4, dst += 6) {
+            yuv2rgb(src[x], src[x + 1], src[x + 3], &dst[0], &dst[1], &dst[2]);
+            yuv2rgb(src[x + 2], src[x + 1], src[x + 3], &dst[3], &dst[4], &dst[5]);
+        }
+        if (!encoder.process_scanline(line)) {
+            return 0;
+        }
+    }
+    if (!encoder.process_scanline(NULL)) {
+        return 0;
+    }
+    return stream.get_size();
+}
+
+static int run_size(const char *name, int w, int h)
+{
+    jpge::params params;
+    params.m_quality = 80;
+    uint8_t *rgb = (uint8_t *)malloc((size_t)w * h * 3);
+    uint8_t *yuyv = (uint8_t *)malloc((size_t)w * h * 2);
+    uint8_t *line = (uint8_t *)malloc((size_t)w * 3);
+    uint8_t *jpg = (uint8_t *)malloc(JPG_BUF_LEN);
+    CHECK(rgb && yuyv && line && jpg);
+    test_image_rgb888(rgb, w, h, 16);
+    test_image_yuyv(yuyv, w, h, 16);
+
+    int64_t t_us[2];
+    double psnr[2];
+    size_t len[2];
+    for (int native = 0; native < 2; native++) {
+        int64_t t = esp_timer_get_time();
+        for (int i = 0; i < ENCODE_TIMES; i++) {
+            len[native] = native ? jpge_encode(yuyv, w, h, 2, params, jpg, JPG_BUF_LEN) : encode_via_rgb(yuyv, w, h, params, line, jpg);
+            CHECK(len[native]);
+        }
+        t_us[native] = (esp_timer_get_time() - t) / ENCODE_TIMES;
+
+        int dw, dh, dc;
+        uint8_t *dec = test_image_decode(jpg, len[native], &dw, &dh, &dc);
+        CHECK(dec);
+        CHECK(dw == w && dh == h && dc == 3);
+        psnr[native] = test_image_psnr(rgb, dec, (size_t)w * h * 3);
+        free(dec);
+    }
+    printf("%s YUV422: via RGB %.2f ms %zu bytes %.2f dB (+%d bytes line buffer), native %.2f ms %zu bytes %.2f dB, %.0f%% less time\n",
+           name, t_us[0] / 1000.0, len[0], psnr[0], w * 3, t_us[1] / 1000.0, len[1], psnr[1],
+           100.0 * (t_us[0] - t_us[1]) / t_us[0]);
+    CHECK(psnr[1] >= psnr[0] - MAX_PSNR_LOSS);
+
+    free(jpg);
+    free(line);
+    free(yuyv);
+    free(rgb);
+    return 0;
+}
+
+static int test_odd_width(void)
+{
+    static const int sizes[][2] = {{1, 9}, {3, 8}, {321, 241}};
+    jpge::params params;
+    uint8_t *jpg = (uint8_t *)malloc(JPG_BUF_LEN);
+    CHECK(jpg);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int w = sizes[i][0], h = sizes[i][1];
+        size_t src_len = (size_t)w * h * 2;
+        uint8_t *yuyv = test_image_guarded_alloc(src_len);
+        CHECK(yuyv);
+        test_image_yuyv(yuyv, w, h, 0);
+        for (int s = jpge::H1V1; s <= jpge::H2V2; s++) {
+            params.m_subsampling = (jpge::subsampling_t)s;
+            size_t len = jpge_encode(yuyv, w, h, 2, params, jpg, JPG_BUF_LEN);
+            CHECK(len);
+            int dw, dh, dc;
+            uint8_t *dec = test_image_decode(jpg, len, &dw, &dh, &dc);
+            CHECK(dec);
+            CHECK(dw == w && dh == h);
+            free(dec);
+        }
+        test_image_guarded_free(yuyv, src_len);
+    }
+    free(jpg);
+    printf("odd width YUV422       OK\n");
+    return 0;
+}
+
+int main(void)
+{
+    int fail = 0;
+    fail |= run_size("VGA", 640, 480);
+    fail |= run_size("SVGA", 800, 600);
+    fail |= test_odd_width();
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
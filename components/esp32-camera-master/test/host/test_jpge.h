@@ -0,0 +1,65 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// jpge::jpeg_encoder into a memory buffer, for the benchmarks that drive the encoder directly
+
+#include <stdint.h>
+#include <string.h>
+#include "jpge.h"
+
+class memory_stream : public jpge::output_stream {
+public:
+    uint8_t *buf;
+    size_t max_len, index;
+
+    memory_stream(uint8_t *b, size_t len) : buf(b), max_len(len), index(0) { }
+    virtual bool put_buf(const void *data, int len)
+    {
+        if (!data) {
+            return true;
+        }
+        if ((size_t)len > max_len - index) {
+            return false;
+        }
+        memcpy(buf + index, data, len);
+        index += len;
+        return true;
+    }
+    virtual jpge::uint get_size() const
+    {
+        return index;
+    }
+};
+
+// Encodes a whole image of width * channels bytes per scanline, returns the JPEG size or 0
+static inline size_t jpge_encode(const uint8_t *src, int width, int height, int channels, const jpge::params &params,
+                                 uint8_t *out, size_t out_len)
+{
+    memory_stream stream(out, out_len);
+    jpge::jpeg_encoder encoder;
+    if (!encoder.init(&stream, width, height, channels, params)) {
+        return 0;
+    }
+    for (int y = 0; y < height; y++) {
+        if (!encoder.process_scanline(src + (size_t)y * width * channels)) {
+            return 0;
+        }
+    }
+    if (!encoder.process_scanline(NULL)) {
+        return 0;
+    }
+    return stream.get_size();
+}
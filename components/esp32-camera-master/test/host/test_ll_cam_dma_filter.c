@@ -0,0 +1,257 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks the ll_cam DMA sample filters byte for byte against the per-element
+// filters they replaced, on synthetic I2S FIFO patterns of every sampling mode.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ll_cam_dma_filter.h"
+
+// Reference: the ESP32 filters as they were, reading samples through the element bitfields
+typedef union {
+    struct {
+        uint32_t sample2:8;
+        uint32_t unused2:8;
+        uint32_t sample1:8;
+        uint32_t unused1:8;
+    };
+    uint32_t val;
+} dma_elem_t;
+
+static size_t ref_filter_jpeg(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const dma_elem_t* dma_el = (const dma_elem_t*)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 4;
+    // manually unrolling 4 iterations of the loop here
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = dma_el[0].sample1;
+        dst[1] = dma_el[1].sample1;
+        dst[2] = dma_el[2].sample1;
+        dst[3] = dma_el[3].sample1;
+        dma_el += 4;
+        dst += 4;
+    }
+    return elements;
+}
+
+static size_t ref_filter_grayscale(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const dma_elem_t* dma_el = (const dma_elem_t*)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 4;
+    for (size_t i = 0; i < end; ++i) {
+        // manually unrolling 4 iterations of the loop here
+        dst[0] = dma_el[0].sample1;
+        dst[1] = dma_el[1].sample1;
+        dst[2] = dma_el[2].sample1;
+        dst[3] = dma_el[3].sample1;
+        dma_el += 4;
+        dst += 4;
+    }
+    return elements;
+}
+
+static size_t ref_filter_grayscale_highspeed(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const dma_elem_t* dma_el = (const dma_elem_t*)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 8;
+    for (size_t i = 0; i < end; ++i) {
+        // manually unrolling 4 iterations of the loop here
+        dst[0] = dma_el[0].sample1;
+        dst[1] = dma_el[2].sample1;
+        dst[2] = dma_el[4].sample1;
+        dst[3] = dma_el[6].sample1;
+        dma_el += 8;
+        dst += 4;
+    }
+    // the final sample of a line in SM_0A0B_0B0C sampling mode needs special handling
+    if ((elements & 0x7) != 0) {
+        dst[0] = dma_el[0].sample1;
+        dst[1] = dma_el[2].sample1;
+        elements += 1;
+    }
+    return elements / 2;
+}
+
+static size_t ref_filter_yuyv(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const dma_elem_t* dma_el = (const dma_elem_t*)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 4;
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = dma_el[0].sample1;//y0
+        dst[1] = dma_el[0].sample2;//u
+        dst[2] = dma_el[1].sample1;//y1
+        dst[3] = dma_el[1].sample2;//v
+
+        dst[4] = dma_el[2].sample1;//y0
+        dst[5] = dma_el[2].sample2;//u
+        dst[6] = dma_el[3].sample1;//y1
+        dst[7] = dma_el[3].sample2;//v
+        dma_el += 4;
+        dst += 8;
+    }
+    return elements * 2;
+}
+
+static size_t ref_filter_yuyv_highspeed(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    const dma_elem_t* dma_el = (const dma_elem_t*)src;
+    size_t elements = len / sizeof(dma_elem_t);
+    size_t end = elements / 8;
+    for (size_t i = 0; i < end; ++i) {
+        dst[0] = dma_el[0].sample1;//y0
+        dst[1] = dma_el[1].sample1;//u
+        dst[2] = dma_el[2].sample1;//y1
+        dst[3] = dma_el[3].sample1;//v
+
+        dst[4] = dma_el[4].sample1;//y0
+        dst[5] = dma_el[5].sample1;//u
+        dst[6] = dma_el[6].sample1;//y1
+        dst[7] = dma_el[7].sample1;//v
+        dma_el += 8;
+        dst += 8;
+    }
+    if ((elements & 0x7) != 0) {
+        dst[0] = dma_el[0].sample1;//y0
+        dst[1] = dma_el[1].sample1;//u
+        dst[2] = dma_el[2].sample1;//y1
+        dst[3] = dma_el[2].sample2;//v
+        elements += 4;
+    }
+    return elements;
+}
+
+// Reference: the ESP32-S2/S3 YUV to grayscale copy
+static size_t ref_filter_yuyv_y(uint8_t *out, const uint8_t *in, size_t len)
+{
+    size_t end = len / 8;
+    for (size_t i = 0; i < end; ++i) {
+        out[0] = in[0];
+        out[1] = in[2];
+        out[2] = in[4];
+        out[3] = in[6];
+        out += 4;
+        in += 8;
+    }
+    return len / 2;
+}
+
+typedef size_t (*filter_t)(uint8_t *dst, const uint8_t *src, size_t len);
+
+static size_t s1_bytes(uint8_t *d, const uint8_t *s, size_t l) { return ll_cam_filter_s1_bytes(d, s, l); }
+static size_t s1_words(uint8_t *d, const uint8_t *s, size_t l) { return ll_cam_filter_s1_words(d, s, l); }
+static size_t s1_half_bytes(uint8_t *d, const uint8_t *s, size_t l) { return ll_cam_filter_s1_half_bytes(d, s, l); }
+static size_t s1_half_words(uint8_t *d, const uint8_t *s, size_t l) { return ll_cam_filter_s1_half_words(d, s, l); }
+static size_t s12_bytes(uint8_t *d, const uint8_t *s, size_t l) { return ll_cam_filter_s12_bytes(d, s, l); }
+static size_t s12_words(uint8_t *d, const uint8_t *s, size_t l) { return ll_cam_filter_s12_words(d, s, l); }
+static size_t yuyv_hs_bytes(uint8_t *d, const uint8_t *s, size_t l) { return ll_cam_filter_yuyv_hs_bytes(d, s, l); }
+static size_t yuyv_hs_words(uint8_t *d, const uint8_t *s, size_t l) { return ll_cam_filter_yuyv_hs_words(d, s, l); }
+static size_t yuyv_y_bytes(uint8_t *d, const uint8_t *s, size_t l) { return ll_cam_filter_yuyv_y_bytes(d, s, l); }
+static size_t yuyv_y_words(uint8_t *d, const uint8_t *s, size_t l) { return ll_cam_filter_yuyv_y_words(d, s, l); }
+
+typedef struct {
+    const char *name;
+    filter_t ref;
+    filter_t bytes;
+    filter_t words;
+} filter_case_t;
+
+static const filter_case_t cases[] = {
+    { "jpeg",               ref_filter_jpeg,                s1_bytes,       s1_words },
+    { "grayscale",          ref_filter_grayscale,           s1_bytes,       s1_words },
+    { "grayscale_highspeed", ref_filter_grayscale_highspeed, s1_half_bytes,  s1_half_words },
+    { "yuyv",               ref_filter_yuyv,                s12_bytes,      s12_words },
+    { "yuyv_highspeed",     ref_filter_yuyv_highspeed,      yuyv_hs_bytes,  yuyv_hs_words },
+    { "yuyv_to_y",          ref_filter_yuyv_y,              yuyv_y_bytes,   yuyv_y_words },
+};
+
+#define MAX_LEN     4096
+#define GUARD       64
+#define OUT_SIZE    (2 * MAX_LEN + 2 * GUARD)
+
+typedef enum { PAT_RANDOM, PAT_0A00_0B00, PAT_0A0B_0B0C, PAT_0A0B_0C0D, PAT_COUNT } pattern_t;
+
+// FIFO content for a camera byte stream s1, s2, s3, ... in each sampling mode, garbage in the unused bytes
+static void fill_pattern(uint8_t *buf, size_t len, pattern_t pat)
+{
+    uint32_t *el = (uint32_t *)buf;
+    uint8_t s = rand();
+    for (size_t i = 0; i < len / 4; i++) {
+        uint32_t junk = rand() & 0xff00ff00;
+        switch (pat) {
+        case PAT_0A00_0B00:
+            el[i] = junk | ((uint32_t)s++ << 16);
+            break;
+        case PAT_0A0B_0B0C:
+            el[i] = junk | ((uint32_t)s << 16) | (uint8_t)(s + 1);
+            s++;
+            break;
+        case PAT_0A0B_0C0D:
+            el[i] = junk | ((uint32_t)s << 16) | (uint8_t)(s + 1);
+            s += 2;
+            break;
+        default:
+            el[i] = ((uint32_t)rand() << 16) ^ rand();
+            break;
+        }
+    }
+}
+
+static int check(const filter_case_t *c, filter_t f, const char *kind, const uint8_t *src, size_t len, size_t dst_ofs)
+{
+    static uint8_t want[OUT_SIZE], got[OUT_SIZE];
+    memset(want, 0xA5, sizeof(want));
+    memset(got, 0xA5, sizeof(got));
+    size_t rw = c->ref(want + GUARD + dst_ofs, src, len);
+    size_t rg = f(got + GUARD + dst_ofs, src, len);
+    if (rw != rg || memcmp(want, got, sizeof(want))) {
+        printf("%s %s: mismatch, len %u dst offset %u, returned %u expected %u\n",
+               c->name, kind, (unsigned)len, (unsigned)dst_ofs, (unsigned)rg, (unsigned)rw);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static uint32_t src_words[MAX_LEN / 4 + 16];
+    uint8_t *src = (uint8_t *)src_words;
+    int fail = 0;
+    srand(1);
+
+    for (size_t n = 0; n < sizeof(cases) / sizeof(cases[0]); n++) {
+        const filter_case_t *c = &cases[n];
+        int checks = 0;
+        for (int pat = 0; pat < PAT_COUNT; pat++) {
+            // Every length up to a few groups, then typical DMA transfer sizes, some with a line tail
+            for (size_t len = 0; len <= MAX_LEN; len += (len < 256) ? 4 : 252) {
+                fill_pattern(src, len + 32, pat);
+                for (size_t ofs = 0; ofs < 4; ofs++) {
+                    fail |= check(c, c->bytes, "bytes", src, len, ofs);
+                    checks++;
+                }
+                fail |= check(c, c->words, "words", src, len, 0);
+                checks++;
+            }
+        }
+        printf("%-20s %5d checks\n", c->name, checks);
+    }
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
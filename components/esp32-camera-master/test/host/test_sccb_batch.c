@@ -0,0 +1,134 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs sccb.c and the OV2640/OV5640 drivers against a fake I2C master.
+//
+// The fake decodes every command link into register writes of a simulated sensor, so
+// batched and single writes can be compared. Init and resolution switch are measured as sent now, and as they
+// were sent before batching: every register write in an i2c_master_cmd_begin() of its own.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "sccb.h"
+#include "sensor.h"
+#include "ov2640.h"
+#include "ov5640.h"
+#include "ov5640_settings.h"
+#include "fake_i2c.h"
+
+// Time of the same register writes with one transaction each, plus the unchanged reads
+static double single_write_us(const fake_i2c_stats_t *st, uint8_t reg_len)
+{
+    unsigned bits = 1 + 9 * (1 + reg_len + 1) + 1;
+    return st->read_us + st->reg_writes * (FAKE_I2C_CMD_US + fake_i2c_bits_us(bits));
+}
+
+static void print_row(const char *name, const fake_i2c_stats_t *st, uint8_t reg_len)
+{
+    double before = single_write_us(st, reg_len);
+    printf("%-22s %4u writes %3u read cmds  before: %4u cmd %7.1f ms  after: %4u cmd %4u xfers %7.1f ms  (%.1fx)  + %.0f ms delays\n",
+           name, st->reg_writes, st->reads, st->reg_writes + st->reads, before / 1000,
+           st->cmd_begins, st->transactions, st->bus_us / 1000, before / st->bus_us, st->delay_ms);
+}
+
+// Same registers and values, in the same order, as writing them one at a time
+static int check_table16(const char *name, const uint16_t (*regs)[2])
+{
+    static fake_i2c_write_t want[FAKE_I2C_MAX_LOG];
+    size_t n = 0;
+    fake_i2c_reset_stats();
+    for (size_t i = 0; regs[i][0] != REGLIST_TAIL; i++) {
+        if (regs[i][0] != REG_DLY) {
+            SCCB_Write16(OV5640_SCCB_ADDR, regs[i][0], regs[i][1]);
+        }
+    }
+    n = fake_i2c_log_len;
+    memcpy(want, fake_i2c_log, n * sizeof(fake_i2c_write_t));
+
+    fake_i2c_reset_stats();
+    sccb_batch_t batch;
+    SCCB_Batch_Init(&batch, OV5640_SCCB_ADDR, 2, true);
+    for (size_t i = 0; regs[i][0] != REGLIST_TAIL; i++) {
+        if (regs[i][0] != REG_DLY) {
+            SCCB_Batch_Write(&batch, regs[i][0], regs[i][1]);
+        }
+    }
+    SCCB_Batch_Flush(&batch);
+    if (fake_i2c_log_len != n || memcmp(want, fake_i2c_log, n * sizeof(fake_i2c_write_t))) {
+        printf("%s: batched writes differ\n", name);
+        return 1;
+    }
+    printf("%-22s %4u writes in %3u transactions, %3u command links: same as single writes\n",
+           name, (unsigned)n, fake_i2c_stats.transactions, fake_i2c_stats.cmd_begins);
+    return 0;
+}
+
+// What esp_camera_init() does with the sensor
+static int sensor_init(sensor_t *s, int (*init)(sensor_t *), framesize_t framesize)
+{
+    init(s);
+    // Batching only, every write goes out
+    SCCB_Cache_Disable();
+    s->xclk_freq_hz = 20000000;
+    s->status.framesize = framesize;
+    s->pixformat = PIXFORMAT_JPEG;
+    int ret = s->reset(s) || s->set_framesize(s, framesize);
+    s->set_pixformat(s, PIXFORMAT_JPEG);
+    if (s->id.PID == OV2640_PID) {
+        s->set_gainceiling(s, GAINCEILING_2X);
+        s->set_bpc(s, false);
+        s->set_wpc(s, true);
+        s->set_lenc(s, true);
+    }
+    s->set_quality(s, 12);
+    s->init_status(s);
+    return ret;
+}
+
+int main(void)
+{
+    int fail = 0;
+    sensor_t s;
+
+    SCCB_Init(-1, -1);
+    printf("SCCB at %u Hz, %u us per command link\n", CONFIG_SCCB_CLK_FREQ, FAKE_I2C_CMD_US);
+
+    fail |= check_table16("ov5640 default regs", sensor_default_regs);
+    fail |= check_table16("ov5640 fmt jpeg", sensor_fmt_jpeg);
+
+    memset(&s, 0, sizeof(s));
+    s.slv_addr = OV2640_SCCB_ADDR;
+    s.id.PID = OV2640_PID;
+    fake_i2c_reset_stats();
+    fail |= sensor_init(&s, ov2640_init, FRAMESIZE_VGA);
+    print_row("ov2640 init VGA", &fake_i2c_stats, 1);
+    fake_i2c_reset_stats();
+    fail |= s.set_framesize(&s, FRAMESIZE_UXGA);
+    print_row("ov2640 VGA to UXGA", &fake_i2c_stats, 1);
+
+    memset(&s, 0, sizeof(s));
+    s.slv_addr = OV5640_SCCB_ADDR;
+    s.id.PID = OV5640_PID;
+    fake_i2c_reset_stats();
+    fail |= sensor_init(&s, ov5640_init, FRAMESIZE_VGA);
+    print_row("ov5640 init VGA", &fake_i2c_stats, 2);
+    fake_i2c_reset_stats();
+    fail |= s.set_framesize(&s, FRAMESIZE_QSXGA);
+    print_row("ov5640 VGA to QSXGA", &fake_i2c_stats, 2);
+
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
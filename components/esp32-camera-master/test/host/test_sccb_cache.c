@@ -0,0 +1,196 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Register shadow cache: sccb_cache.c on its own, then the OV2640/OV5640 drivers on
+// the fake I2C master. The same tuning commands are run with and without the cache;
+// the sensor must end up with the same registers, with fewer SCCB transfers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "sccb.h"
+#include "sccb_cache.h"
+#include "sensor.h"
+#include "ov2640.h"
+#include "ov5640.h"
+#include "fake_i2c.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); return 1; } } while (0)
+
+static int test_cache(void)
+{
+    static const sccb_cache_range_t volatile_regs[] = {{0x3500, 0x3502}};
+    sccb_cache_t c;
+    uint8_t v = 0;
+
+    CHECK(sccb_cache_init(&c, 0x3C, 16, SCCB_CACHE_NO_BANK, volatile_regs, 1));
+    CHECK(!sccb_cache_lookup(&c, 0x3800, &v));
+    sccb_cache_store(&c, 0x3800, 0x12);
+    CHECK(sccb_cache_lookup(&c, 0x3800, &v) && v == 0x12);
+    sccb_cache_store(&c, 0x3800, 0x34);
+    CHECK(sccb_cache_lookup(&c, 0x3800, &v) && v == 0x34);
+
+    // Volatile registers are never cached
+    sccb_cache_store(&c, 0x3501, 0x56);
+    CHECK(!sccb_cache_lookup(&c, 0x3501, &v));
+
+    sccb_cache_forget(&c, 0x3800);
+    CHECK(!sccb_cache_lookup(&c, 0x3800, &v));
+    sccb_cache_store(&c, 0x3800, 0x78);
+    CHECK(sccb_cache_lookup(&c, 0x3800, &v) && v == 0x78);
+
+    // Three quarters of 16 entries, the rest goes to the sensor
+    for (uint16_t r = 0; r < 16; r++) {
+        sccb_cache_store(&c, 0x4000 + r, r);
+    }
+    CHECK(c.used == 12);
+    CHECK(sccb_cache_lookup(&c, 0x3800, &v) && v == 0x78);
+    CHECK(sccb_cache_lookup(&c, 0x400A, &v) && v == 0x0A);
+    CHECK(!sccb_cache_lookup(&c, 0x400B, &v));
+
+    sccb_cache_invalidate(&c);
+    CHECK(!sccb_cache_lookup(&c, 0x3800, &v));
+    sccb_cache_deinit(&c);
+
+    // Banked: nothing is cached until the bank is known
+    static const sccb_cache_range_t banked_volatile[] = {{SCCB_CACHE_KEY(1, 0x10), SCCB_CACHE_KEY(1, 0x10)}};
+    CHECK(sccb_cache_init(&c, 0x30, 64, 0xFF, banked_volatile, 1));
+    sccb_cache_store(&c, 0x10, 0x11);
+    CHECK(!sccb_cache_lookup(&c, 0x10, &v));
+    CHECK(!sccb_cache_lookup(&c, 0xFF, &v));
+    sccb_cache_store(&c, 0xFF, 0);
+    CHECK(sccb_cache_lookup(&c, 0xFF, &v) && v == 0);
+    sccb_cache_store(&c, 0x10, 0x22);
+    sccb_cache_store(&c, 0xFF, 1);
+    CHECK(!sccb_cache_lookup(&c, 0x10, &v));            // volatile in bank 1
+    sccb_cache_store(&c, 0x11, 0x33);
+    sccb_cache_store(&c, 0xFF, 0);
+    CHECK(sccb_cache_lookup(&c, 0x10, &v) && v == 0x22);
+    CHECK(!sccb_cache_lookup(&c, 0x11, &v));
+
+    // A failed bank write leaves the bank unknown
+    sccb_cache_forget(&c, 0xFF);
+    CHECK(!sccb_cache_lookup(&c, 0xFF, &v));
+    CHECK(!sccb_cache_lookup(&c, 0x10, &v));
+    sccb_cache_deinit(&c);
+    printf("sccb_cache             OK\n");
+    return 0;
+}
+
+static void sensor_init(sensor_t *s, uint8_t addr, uint16_t pid, int (*init)(sensor_t *), bool cache)
+{
+    memset(s, 0, sizeof(*s));
+    s->slv_addr = addr;
+    s->id.PID = pid;
+    init(s);
+    if (!cache) {
+        SCCB_Cache_Disable();
+    }
+    s->xclk_freq_hz = 20000000;
+    s->status.framesize = FRAMESIZE_VGA;
+    s->pixformat = PIXFORMAT_JPEG;
+    s->reset(s);
+    s->set_framesize(s, FRAMESIZE_VGA);
+    s->set_pixformat(s, PIXFORMAT_JPEG);
+    s->set_quality(s, 12);
+    s->init_status(s);
+}
+
+// Image tuning as a web UI sends it, including values that are already set
+static void tune(sensor_t *s, const int (*regs)[3])
+{
+    for (int round = 0; round < 2; round++) {
+        s->set_brightness(s, 1);
+        s->set_contrast(s, -1);
+        s->set_saturation(s, 2);
+        s->set_ae_level(s, 1);
+        s->set_whitebal(s, 1);
+        s->set_awb_gain(s, 1);
+        s->set_wb_mode(s, 2);
+        s->set_hmirror(s, 1);
+        s->set_vflip(s, 0);
+        s->set_quality(s, 10);
+        s->set_special_effect(s, 0);
+        for (int i = 0; regs[i][1]; i++) {
+            s->set_reg(s, regs[i][0], regs[i][1], regs[i][2]);
+            s->get_reg(s, regs[i][0], 0xFF);
+        }
+    }
+}
+
+static int run_sensor(const char *name, fake_i2c_device_t *dev, uint16_t pid, int (*init)(sensor_t *),
+                      const int (*regs)[3], uint16_t volatile_reg, uint8_t volatile_bank, uint16_t plain_reg)
+{
+    static uint8_t uncached_regs[65536];
+    sensor_t s;
+    fake_i2c_stats_t before, after;
+
+    memset(dev->regs, 0, sizeof(dev->regs));
+    sensor_init(&s, dev->addr, pid, init, false);
+    fake_i2c_reset_stats();
+    tune(&s, regs);
+    before = fake_i2c_stats;
+    memcpy(uncached_regs, dev->regs, sizeof(uncached_regs));
+
+    memset(dev->regs, 0, sizeof(dev->regs));
+    sensor_init(&s, dev->addr, pid, init, true);
+    fake_i2c_reset_stats();
+    tune(&s, regs);
+    after = fake_i2c_stats;
+    CHECK(memcmp(uncached_regs, dev->regs, sizeof(uncached_regs)) == 0);
+
+    printf("%-22s %4u -> %4u command links  %6.1f -> %6.1f ms\n", name,
+           before.cmd_begins, after.cmd_begins, before.bus_us / 1000, after.bus_us / 1000);
+    CHECK(after.cmd_begins < before.cmd_begins);
+
+    // Known registers are answered without a transfer, volatile ones always come from the sensor
+    int reg = s.get_reg(&s, plain_reg, 0xFF);
+    fake_i2c_reset_stats();
+    CHECK(s.get_reg(&s, plain_reg, 0xFF) == reg);
+    CHECK(fake_i2c_stats.cmd_begins == 0);
+    *fake_i2c_reg(dev, volatile_bank, volatile_reg & 0xFFFF) = 0x5A;
+    CHECK(s.get_reg(&s, volatile_reg, 0xFF) == 0x5A);
+    *fake_i2c_reg(dev, volatile_bank, volatile_reg & 0xFFFF) = 0xA5;
+    CHECK(s.get_reg(&s, volatile_reg, 0xFF) == 0xA5);
+    CHECK(fake_i2c_stats.cmd_begins > 0);
+    return 0;
+}
+
+int main(void)
+{
+    int fail = 0;
+    // {reg, mask, value}, OV2640 registers are (bank << 8) | reg with bank 1 the sensor bank
+    static const int ov2640_regs[][3] = {
+        {0x0111, 0x3F, 0x01},   // CLKRC
+        {0x0013, 0x20, 0x20},   // COM8 in DSP bank
+        {0x00C3, 0xFF, 0xED},   // CTRL1
+        {0, 0, 0},
+    };
+    static const int ov5640_regs[][3] = {
+        {0x5001, 0x80, 0x80},   // ISP control 01
+        {0x3A18, 0x03, 0x00},   // gain ceiling
+        {0x4407, 0x3F, 0x08},   // JPEG quality
+        {0, 0, 0},
+    };
+
+    SCCB_Init(-1, -1);
+    printf("SCCB at %u Hz, %u us per command link\n", CONFIG_SCCB_CLK_FREQ, FAKE_I2C_CMD_US);
+    fail |= test_cache();
+    fail |= run_sensor("ov2640 tuning", &fake_ov2640, OV2640_PID, ov2640_init, ov2640_regs, 0x0110, 1, 0x00C3);
+    fail |= run_sensor("ov5640 tuning", &fake_ov5640, OV5640_PID, ov5640_init, ov5640_regs, 0x3501, 0, 0x4407);
+    SCCB_Deinit();
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
@@ -0,0 +1,182 @@
+// Copyright 2010-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Bulk YUYV kernels of yuv.c against the per-pixel yuv2rgb() table implementation:
+// bit-exact over every Y/U/V triple, at every source alignment and for tails shorter
+// than one unrolled iteration, then timed on a VGA frame. Reference and kernel take turns,
+// in alternating order, over BENCH_ROUNDS rounds and the best round of each counts.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "yuv.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); return 1; } } while (0)
+
+#define BENCH_W         640
+#define BENCH_H         480
+#define BENCH_TIMES     20
+#define BENCH_ROUNDS    5
+
+typedef void (*yuv422_kernel_t)(const uint8_t *src, uint8_t *dst, size_t pix_count);
+
+typedef struct {
+    const char *name;
+    yuv422_kernel_t kernel;
+    int bpp;
+} kernel_t;
+
+// What the converters did before the kernels: two yuv2rgb() calls per macropixel, and
+// a byte at a time for gray
+static void ref_rgb888(const uint8_t *src, uint8_t *dst, size_t pix_count)
+{
+    for (size_t i = 0; i + 1 < pix_count; i += 2, src += 4, dst += 6) {
+        yuv2rgb(src[0], src[1], src[3], &dst[2], &dst[1], &dst[0]);
+        yuv2rgb(src[2], src[1], src[3], &dst[5], &dst[4], &dst[3]);
+    }
+}
+
+static void ref_rgb565(const uint8_t *src, uint8_t *dst, size_t pix_count)
+{
+    for (size_t i = 0; i < pix_count / 2 * 2; i++, dst += 2) {
+        const uint8_t *s = src + (i / 2) * 4;
+        uint8_t r, g, b;
+        yuv2rgb(s[(i & 1) * 2], s[1], s[3], &r, &g, &b);
+        dst[0] = (r & 0xF8) | (g >> 5);
+        dst[1] = ((g & 0x1C) << 3) | (b >> 3);
+    }
+}
+
+static void ref_gray(const uint8_t *src, uint8_t *dst, size_t pix_count)
+{
+    for (size_t i = 0; i + 1 < pix_count; i += 2, src += 4, dst += 2) {
+        dst[0] = src[0];
+        dst[1] = src[2];
+    }
+}
+
+static const kernel_t kernels[] = {
+    {"RGB888", yuv422_to_rgb888, 3},
+    {"RGB565", yuv422_to_rgb565, 2},
+    {"gray", yuv422_to_gray, 1},
+};
+static const yuv422_kernel_t refs[] = {ref_rgb888, ref_rgb565, ref_gray};
+
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+// All 2^24 Y/U/V triples, one U value per pass: Y0 and V run through every pair,
+// Y1 mirrors Y0 so both luma positions see every value too
+static int test_exhaustive(void)
+{
+    const size_t pixels = 256 * 256 * 2;
+    uint8_t *yuyv = malloc(pixels * 2);
+    uint8_t *ref = malloc(pixels * 3);
+    uint8_t *out = malloc(pixels * 3);
+    CHECK(yuyv && ref && out);
+
+    for (int u = 0; u < 256; u++) {
+        uint8_t *p = yuyv;
+        for (int v = 0; v < 256; v++) {
+            for (int y = 0; y < 256; y++, p += 4) {
+                p[0] = y;
+                p[1] = u;
+                p[2] = 255 - y;
+                p[3] = v;
+            }
+        }
+        for (size_t k = 0; k < KERNEL_COUNT; k++) {
+            refs[k](yuyv, ref, pixels);
+            kernels[k].kernel(yuyv, out, pixels);
+            CHECK(memcmp(ref, out, pixels * kernels[k].bpp) == 0);
+        }
+    }
+    free(out);
+    free(ref);
+    free(yuyv);
+    printf("exhaustive Y/U/V         OK\n");
+    return 0;
+}
+
+// Every source alignment and pixel count up to a few iterations, odd counts included.
+// Nothing past the last full macropixel may be written.
+static int test_edges(void)
+{
+    enum { MAX_PIXELS = 41, GUARD = 8 };
+    uint8_t src[MAX_PIXELS * 2 + 8];
+    uint8_t ref[MAX_PIXELS * 3 + GUARD], out[MAX_PIXELS * 3 + GUARD];
+    uint32_t seed = 7;
+    for (size_t i = 0; i < sizeof(src); i++) {
+        seed = seed * 1103515245 + 12345;
+        src[i] = seed >> 16;
+    }
+    for (size_t k = 0; k < KERNEL_COUNT; k++) {
+        for (int offset = 0; offset < 4; offset++) {
+            for (size_t n = 0; n <= MAX_PIXELS; n++) {
+                memset(ref, 0xA5, sizeof(ref));
+                memset(out, 0xA5, sizeof(out));
+                refs[k](src + offset, ref, n);
+                kernels[k].kernel(src + offset, out, n);
+                CHECK(memcmp(ref, out, sizeof(out)) == 0);
+            }
+        }
+    }
+    printf("alignment and tails      OK\n");
+    return 0;
+}
+
+static int bench(void)
+{
+    const size_t pixels = BENCH_W * BENCH_H;
+    uint8_t *yuyv = malloc(pixels * 2);
+    uint8_t *out = malloc(pixels * 3);
+    CHECK(yuyv && out);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < pixels * 2; i++) {
+        seed = seed * 1103515245 + 12345;
+        yuyv[i] = seed >> 16;
+    }
+    for (size_t k = 0; k < KERNEL_COUNT; k++) {
+        int64_t t_us[2] = { INT64_MAX, INT64_MAX };
+        for (int round = 0; round < BENCH_ROUNDS; round++) {
+            for (int turn = 0; turn < 2; turn++) {
+                int bulk = turn ^ (round & 1);
+                yuv422_kernel_t fn = bulk ? kernels[k].kernel : refs[k];
+                int64_t t = esp_timer_get_time();
+                for (int i = 0; i < BENCH_TIMES; i++) {
+                    fn(yuyv, out, pixels);
+                }
+                t = (esp_timer_get_time() - t) / BENCH_TIMES;
+                t_us[bulk] = t < t_us[bulk] ? t : t_us[bulk];
+            }
+        }
+        printf("VGA YUYV to %-6s  per pixel %6.3f ms, kernel %6.3f ms, %7.1f Mpixel/s, x%.2f\n",
+               kernels[k].name, t_us[0] / 1000.0, t_us[1] / 1000.0, (double)pixels / t_us[1],
+               (double)t_us[0] / t_us[1]);
+    }
+    free(out);
+    free(yuyv);
+    return 0;
+}
+
+int main(void)
+{
+    int fail = 0;
+    fail |= test_exhaustive();
+    fail |= test_edges();
+    fail |= bench();
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
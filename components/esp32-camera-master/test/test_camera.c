@@ -9,6 +9,8 @@
 #include "driver/i2c.h"
 
 #include "esp_camera.h"
+#include "esp_camera_broker.h"
+#include "cam_hal.h"
 
 #ifdef CONFIG_IDF_TARGET_ESP32
 #define BOARD_WROVER_KIT 1
@@ -343,6 +345,233 @@ TEST_CASE("Camera driver performance test", "[camera]")
     camera_performance_test(20 * 1000000, 16);
 }
 
+TEST_CASE("Camera driver frame statistics", "[camera]")
+{
+    camera_stats_t st;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_camera_get_stats(&st));
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, FRAMESIZE_QVGA, 2, SIOD_GPIO_NUM, -1));
+    vTaskDelay(500 / portTICK_RATE_MS);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_camera_get_stats(NULL));
+
+    // A consumer slower than the sensor, so that frames get dropped from the full queue
+    esp_camera_reset_stats();
+    for (size_t i = 0; i < 16; i++) {
+        camera_fb_t *pic = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(pic);
+        vTaskDelay(100 / portTICK_RATE_MS);
+        esp_camera_fb_return(pic);
+    }
+    TEST_ESP_OK(esp_camera_get_stats(&st));
+    TEST_ESP_OK(esp_camera_deinit());
+
+    printf("Stats Result\n");
+    printf("frames, NO-SOI, NO-EOI, FB-OVF, FB-SIZE, queue drops, timeouts, interval us\n");
+    printf("%6u, %6u, %6u, %6u, %7u, %11u, %8u, %11u\n",
+           (unsigned)st.frames, (unsigned)st.no_soi, (unsigned)st.no_eoi, (unsigned)st.fb_overflow,
+           (unsigned)st.fb_size_err, (unsigned)st.queue_drops, (unsigned)st.take_timeouts, (unsigned)st.frame_interval_us);
+    printf("----------------------------------------------------------------------------------------\n");
+
+    TEST_ASSERT_GREATER_OR_EQUAL(16, st.frames);
+    TEST_ASSERT_GREATER_THAN(0, st.queue_drops);
+    TEST_ASSERT_EQUAL(0, st.take_timeouts);
+    TEST_ASSERT_GREATER_THAN(0, st.frame_interval_us);
+}
+
+TEST_CASE("Camera driver frame metadata", "[camera]")
+{
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, FRAMESIZE_QVGA, 2, SIOD_GPIO_NUM, -1));
+    vTaskDelay(500 / portTICK_RATE_MS);
+
+    printf("Metadata Result\n");
+    printf("seq, timestamp us, latency us, aec, aec_value_cfg, agc, agc_gain_cfg\n");
+    uint32_t last_seq = 0;
+    int64_t last_us = 0;
+    for (size_t i = 0; i < 8; i++) {
+        camera_fb_t *pic = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(pic);
+        int64_t us = (int64_t)pic->timestamp.tv_sec * 1000000 + pic->timestamp.tv_usec;
+        printf("%3u, %12lld, %10u, %3u, %13u, %3u, %12u\n", (unsigned)pic->seq, us, (unsigned)pic->latency_us,
+               pic->aec, pic->aec_value_cfg, pic->agc, pic->agc_gain_cfg);
+        // Frames come in capture order, stamped at VSYNC before they were handed out
+        if (i) {
+            TEST_ASSERT_GREATER_THAN(last_seq, pic->seq);
+            TEST_ASSERT_GREATER_THAN(last_us, us);
+        }
+        TEST_ASSERT_LESS_THAN(1000000, pic->latency_us);
+        last_seq = pic->seq;
+        last_us = us;
+        esp_camera_fb_return(pic);
+    }
+    printf("----------------------------------------------------------------\n");
+    TEST_ESP_OK(esp_camera_deinit());
+}
+
+TEST_CASE("Camera driver capture scheduler", "[camera]")
+{
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_camera_set_capture_mode(CAMERA_CAPTURE_RATE, 5));
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, FRAMESIZE_QVGA, 2, SIOD_GPIO_NUM, -1));
+    vTaskDelay(500 / portTICK_RATE_MS);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_camera_set_capture_mode(CAMERA_CAPTURE_RATE, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_camera_capture(1));
+
+    // Capture rate: measured between VSYNC timestamps, frames queued before the switch are skipped
+    TEST_ESP_OK(esp_camera_set_capture_mode(CAMERA_CAPTURE_RATE, 5));
+    esp_camera_return_all();
+    camera_fb_t *pic = esp_camera_fb_get();
+    TEST_ASSERT_NOT_NULL(pic);
+    esp_camera_fb_return(pic);
+    int64_t first_us = 0, last_us = 0;
+    for (size_t i = 0; i < 11; i++) {
+        pic = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(pic);
+        last_us = (int64_t)pic->timestamp.tv_sec * 1000000 + pic->timestamp.tv_usec;
+        if (!i) {
+            first_us = last_us;
+        }
+        esp_camera_fb_return(pic);
+    }
+    float rate_fps = 10 * 1000000.0f / (last_us - first_us);
+
+    // On demand: nothing is captured while nobody asks
+    TEST_ESP_OK(esp_camera_set_capture_mode(CAMERA_CAPTURE_ON_DEMAND, 0));
+    esp_camera_return_all();
+    vTaskDelay(200 / portTICK_RATE_MS);
+    camera_stats_t st;
+    esp_camera_reset_stats();
+    vTaskDelay(500 / portTICK_RATE_MS);
+    TEST_ESP_OK(esp_camera_get_stats(&st));
+    uint32_t idle_frames = st.frames;
+
+    int64_t t = esp_timer_get_time();
+    pic = esp_camera_fb_get();
+    TEST_ASSERT_NOT_NULL(pic);
+    int64_t shot_us = (int64_t)pic->timestamp.tv_sec * 1000000 + pic->timestamp.tv_usec;
+    uint32_t shot_ms = (esp_timer_get_time() - t) / 1000;
+    esp_camera_fb_return(pic);
+
+    TEST_ESP_OK(esp_camera_capture(2));
+    for (size_t i = 0; i < 2; i++) {
+        pic = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(pic);
+        esp_camera_fb_return(pic);
+    }
+    TEST_ESP_OK(esp_camera_get_stats(&st));
+    TEST_ESP_OK(esp_camera_set_capture_mode(CAMERA_CAPTURE_CONTINUOUS, 0));
+    TEST_ESP_OK(esp_camera_deinit());
+
+    printf("Scheduler Result\n");
+    printf("rate fps (5 asked), idle frames, single shot ms, on demand frames\n");
+    printf("%17.2f, %11u, %14u, %16u\n", rate_fps, (unsigned)idle_frames, (unsigned)shot_ms, (unsigned)st.frames);
+    printf("-------------------------------------------------------------------\n");
+
+    TEST_ASSERT_FLOAT_WITHIN(0.5, 5, rate_fps);
+    TEST_ASSERT_EQUAL(0, idle_frames);
+    TEST_ASSERT_GREATER_THAN(t, shot_us);
+    TEST_ASSERT_EQUAL(3, st.frames);
+}
+
+TEST_CASE("Camera driver frame broker", "[camera]")
+{
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, FRAMESIZE_QVGA, 4, SIOD_GPIO_NUM, -1));
+    TEST_ESP_OK(esp_camera_broker_init(configMAX_PRIORITIES - 3, tskNO_AFFINITY));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_camera_broker_init(configMAX_PRIORITIES - 3, tskNO_AFFINITY));
+
+    camera_broker_sub_config_t config = CAMERA_BROKER_SUB_CONFIG_DEFAULT();
+    camera_broker_sub_t fast = esp_camera_broker_subscribe(&config);
+    camera_broker_sub_t slow = esp_camera_broker_subscribe(&config);
+    TEST_ASSERT_NOT_NULL(fast);
+    TEST_ASSERT_NOT_NULL(slow);
+
+    // Both subscribers hold the same frame at once
+    camera_fb_t *a = esp_camera_broker_take(fast, 4000 / portTICK_RATE_MS);
+    camera_fb_t *b = esp_camera_broker_take(slow, 4000 / portTICK_RATE_MS);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_EQUAL_PTR(a, b);
+    esp_camera_broker_release(a);
+    esp_camera_broker_release(b);
+
+    // A subscriber that never takes frames does not stall the other one
+    uint64_t t = esp_timer_get_time();
+    for (size_t i = 0; i < 16; i++) {
+        camera_fb_t *pic = esp_camera_broker_take(fast, 4000 / portTICK_RATE_MS);
+        TEST_ASSERT_NOT_NULL(pic);
+        esp_camera_broker_release(pic);
+    }
+    t = esp_timer_get_time() - t;
+    uint32_t dropped = esp_camera_broker_dropped(slow);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_camera_broker_deinit());
+    esp_camera_broker_unsubscribe(fast);
+    esp_camera_broker_unsubscribe(slow);
+    TEST_ESP_OK(esp_camera_broker_deinit());
+    TEST_ESP_OK(esp_camera_deinit());
+
+    printf("Broker Result\n");
+    printf("frames, fps, idle subscriber drops\n");
+    printf("%6u, %5.2f, %6u\n", 16, 16 * 1000000.0f / t, (unsigned)dropped);
+    printf("----------------------------------------------------------------------------------------\n");
+    TEST_ASSERT_GREATER_OR_EQUAL(15, dropped);
+}
+
+TEST_CASE("Camera driver frame size switch", "[camera]")
+{
+    const framesize_t prepared[] = {FRAMESIZE_VGA, FRAMESIZE_QVGA};
+    const framesize_t order[] = {FRAMESIZE_VGA, FRAMESIZE_QVGA, FRAMESIZE_HD, FRAMESIZE_QVGA, FRAMESIZE_VGA, FRAMESIZE_HD};
+    const size_t switches = sizeof(order) / sizeof(order[0]);
+    uint32_t switch_us[switches];
+    uint32_t lost[switches];
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_camera_set_framesize(FRAMESIZE_VGA));
+    // Buffers are sized for the largest frame, the other sizes switch down from it
+    TEST_ESP_OK(init_camera(20000000, PIXFORMAT_JPEG, FRAMESIZE_HD, 3, SIOD_GPIO_NUM, -1));
+    vTaskDelay(500 / portTICK_RATE_MS);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_camera_set_framesize(FRAMESIZE_VGA));
+    TEST_ESP_OK(esp_camera_prepare_framesizes(prepared, 2));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_camera_set_framesize(FRAMESIZE_SVGA));
+
+    for (size_t i = 0; i < switches; i++) {
+        // Drain the queue and keep up with the sensor, every VSYNC that produced no frame is a gap in seq
+        camera_fb_t *pic = NULL;
+        uint32_t last_seq = 0;
+        for (size_t j = 0; j < 4; j++) {
+            pic = esp_camera_fb_get();
+            TEST_ASSERT_NOT_NULL(pic);
+            last_seq = pic->seq;
+            esp_camera_fb_return(pic);
+        }
+
+        int64_t t = esp_timer_get_time();
+        TEST_ESP_OK(esp_camera_set_framesize(order[i]));
+        switch_us[i] = esp_timer_get_time() - t;
+
+        // The frame in flight at the switch is still published with the old size
+        while (1) {
+            pic = esp_camera_fb_get();
+            TEST_ASSERT_NOT_NULL(pic);
+            if (pic->width == resolution[order[i]].width) {
+                break;
+            }
+            last_seq = pic->seq;
+            esp_camera_fb_return(pic);
+        }
+        TEST_ASSERT_EQUAL(resolution[order[i]].height, pic->height);
+        lost[i] = pic->seq - last_seq - 1;
+        esp_camera_fb_return(pic);
+    }
+    TEST_ESP_OK(esp_camera_deinit());
+
+    printf("Frame size switch Result\n");
+    printf("to         , switch us, lost frames\n");
+    for (size_t i = 0; i < switches; i++) {
+        printf("%4u x %4u, %9u, %11u\n", resolution[order[i]].width, resolution[order[i]].height,
+               (unsigned)switch_us[i], (unsigned)lost[i]);
+    }
+    printf("-------------------------------------\n");
+    for (size_t i = 0; i < switches; i++) {
+        TEST_ASSERT_LESS_OR_EQUAL(1, lost[i]);
+    }
+}
+
 
 static void print_rgb565_img(uint8_t *img, int width, int height)
 {
@@ -533,3 +762,69 @@ TEST_CASE("Camera driver uses an i2c port initialized by other devices test", "[
     TEST_ESP_OK(esp_camera_deinit());
     TEST_ESP_OK(i2c_driver_delete(I2C_MASTER_NUM));
 }
+
+// Byte-wise backward scan the driver used before, as the reference
+static int test_jpeg_eoi_bytewise(const uint8_t *inbuf, uint32_t length)
+{
+    const uint8_t eoi[2] = {0xFF, 0xD9};
+    for (const uint8_t *dptr = inbuf + length - 2; dptr > inbuf; dptr--) {
+        if (memcmp(dptr, eoi, 2) == 0) {
+            return dptr - inbuf;
+        }
+    }
+    return -1;
+}
+
+TEST_CASE("Camera driver JPEG marker scan", "[camera]")
+{
+    extern const uint8_t img_start[] asm("_binary_test_outside_jpeg_start");
+    extern const uint8_t img_end[]   asm("_binary_test_outside_jpeg_end");
+    const uint32_t jpg_len = img_end - img_start;
+    const uint32_t dma_half = 16 * 1024;
+    const int times = 64;
+
+    // A frame as it sits in a PSRAM frame buffer: whole DMA transfers, the tail left over from older frames
+    uint32_t fb_len = (jpg_len / dma_half + 2) * dma_half;
+    uint8_t *fb = (uint8_t *)heap_caps_malloc(fb_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!fb) {
+        fb = (uint8_t *)malloc(fb_len);
+    }
+    TEST_ASSERT_NOT_NULL(fb);
+    memset(fb, 0, fb_len);
+    memcpy(fb, img_start, jpg_len);
+    int true_eoi = test_jpeg_eoi_bytewise(fb, jpg_len);
+
+    TEST_ASSERT_EQUAL(0, cam_find_jpeg_soi(fb, fb_len));
+    uint32_t data_start = cam_jpeg_header_len(fb, fb_len);
+    TEST_ASSERT_TRUE(data_start > 0 && data_start < jpg_len);
+    TEST_ASSERT_EQUAL(true_eoi, cam_find_jpeg_eoi(fb, data_start, fb_len));
+    TEST_ASSERT_EQUAL(true_eoi, cam_find_jpeg_eoi(fb, fb_len - 2 * dma_half, fb_len));
+    // Unaligned start and a marker split across the start of the range
+    TEST_ASSERT_EQUAL(true_eoi, cam_find_jpeg_eoi(fb, true_eoi - 5, fb_len));
+    TEST_ASSERT_EQUAL(-1, cam_find_jpeg_eoi(fb, true_eoi + 1, fb_len));
+
+    int64_t t = esp_timer_get_time();
+    for (int i = 0; i < times; i++) {
+        TEST_ASSERT_EQUAL(true_eoi, test_jpeg_eoi_bytewise(fb, fb_len));
+    }
+    float t_bytewise = (esp_timer_get_time() - t) / (float)times;
+
+    t = esp_timer_get_time();
+    for (int i = 0; i < times; i++) {
+        TEST_ASSERT_EQUAL(true_eoi, cam_find_jpeg_eoi(fb, fb_len - 2 * dma_half, fb_len));
+    }
+    float t_seeded = (esp_timer_get_time() - t) / (float)times;
+
+    // A stale marker from an older, longer frame is not taken for the end of this one
+    fb[fb_len - 100] = 0xFF;
+    fb[fb_len - 99] = 0xD9;
+    TEST_ASSERT_EQUAL(true_eoi, cam_find_jpeg_eoi(fb, fb_len - 2 * dma_half, fb_len));
+
+    printf("JPEG marker scan Result\n");
+    printf("scan      , time     \n");
+    printf("bytewise  , %6.1f us \n", t_bytewise);
+    printf("seeded    , %6.1f us \n", t_seeded);
+
+    free(fb);
+    TEST_ASSERT_TRUE(t_seeded < t_bytewise);
+}
@@ -0,0 +1,875 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "unity.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "esp_camera.h"
+#include "img_converters.h"
+#include "jpge.h"
+#include "yuv.h"
+
+static const char *TAG = "test conversions";
+
+#define TEST_IMG_W 320
+#define TEST_IMG_H 240
+#define TEST_JPG_BUF_LEN (64 * 1024)
+#define TEST_YUV_JPG_BUF_LEN (192 * 1024)
+
+class test_memory_stream : public jpge::output_stream {
+public:
+    uint8_t *buf;
+    size_t max_len, index;
+
+    test_memory_stream(uint8_t *b, size_t len) : buf(b), max_len(len), index(0) { }
+    virtual bool put_buf(const void *data, int len)
+    {
+        if (!data) {
+            return true;
+        }
+        if ((size_t)len > max_len - index) {
+            return false;
+        }
+        memcpy(buf + index, data, len);
+        index += len;
+        return true;
+    }
+    virtual jpge::uint get_size() const
+    {
+        return index;
+    }
+};
+
+static void *test_malloc(size_t size)
+{
+    void *p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p) {
+        p = malloc(size);
+    }
+    return p;
+}
+
+// Synthetic RGB888 scene: smooth gradients with a textured band and hard edges
+static void fill_test_rgb888(uint8_t *rgb, int w, int h)
+{
+    uint32_t seed = 1;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            seed = seed * 1103515245 + 12345;
+            int noise = (y > h / 3 && y < 2 * h / 3) ? (int)((seed >> 16) & 0x1f) - 16 : 0;
+            int r = (x * 255) / w + noise;
+            int g = (y * 255) / h + noise;
+            int b = ((x / 32 + y / 32) & 1) ? 200 : 40;
+            uint8_t *p = rgb + (y * w + x) * 3;
+            p[0] = r < 0 ? 0 : (r > 255 ? 255 : r);
+            p[1] = g < 0 ? 0 : (g > 255 ? 255 : g);
+            p[2] = b;
+        }
+    }
+}
+
+static size_t encode_rgb888(const uint8_t *rgb, int w, int h, const jpge::params &params, uint8_t *out, size_t out_len)
+{
+    test_memory_stream stream(out, out_len);
+    jpge::jpeg_encoder encoder;
+    if (!encoder.init(&stream, w, h, 3, params)) {
+        return 0;
+    }
+    for (int y = 0; y < h; y++) {
+        if (!encoder.process_scanline(rgb + y * w * 3)) {
+            return 0;
+        }
+    }
+    if (!encoder.process_scanline(NULL)) {
+        return 0;
+    }
+    return stream.get_size();
+}
+
+// Synthetic YUYV scene with the same structure as fill_test_rgb888()
+static void fill_test_yuyv(uint8_t *yuyv, int w, int h)
+{
+    uint32_t seed = 1;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x += 2) {
+            seed = seed * 1103515245 + 12345;
+            int noise = (y > h / 3 && y < 2 * h / 3) ? (int)((seed >> 16) & 0x1f) - 16 : 0;
+            uint8_t *p = yuyv + (y * w + x) * 2;
+            p[0] = 16 + (x * 219) / w + noise / 2;
+            p[1] = 128 + ((y * 96) / h) - 48;
+            p[2] = 16 + ((x + 1) * 219) / w - noise / 2;
+            p[3] = ((x / 32 + y / 32) & 1) ? 176 : 80;
+        }
+    }
+}
+
+// Encoder input as it was fed before the native YUYV path: YUYV -> RGB888 scanline -> YCbCr
+static size_t encode_yuyv_via_rgb(const uint8_t *yuyv, int w, int h, const jpge::params &params, uint8_t *line, uint8_t *out, size_t out_len)
+{
+    test_memory_stream stream(out, out_len);
+    jpge::jpeg_encoder encoder;
+    if (!encoder.init(&stream, w, h, 3, params)) {
+        return 0;
+    }
+    for (int y = 0; y < h; y++) {
+        const uint8_t *src = yuyv + y * w * 2;
+        uint8_t *dst = line;
+        for (int x = 0; x < w * 2; x += 4, dst += 6) {
+            yuv2rgb(src[x], src[x + 1], src[x + 3], &dst[0], &dst[1], &dst[2]);
+            yuv2rgb(src[x + 2], src[x + 1], src[x + 3], &dst[3], &dst[4], &dst[5]);
+        }
+        if (!encoder.process_scanline(line)) {
+            return 0;
+        }
+    }
+    if (!encoder.process_scanline(NULL)) {
+        return 0;
+    }
+    return stream.get_size();
+}
+
+static size_t encode_yuyv_native(const uint8_t *yuyv, int w, int h, const jpge::params &params, uint8_t *out, size_t out_len)
+{
+    test_memory_stream stream(out, out_len);
+    jpge::jpeg_encoder encoder;
+    if (!encoder.init(&stream, w, h, 2, params)) {
+        return 0;
+    }
+    for (int y = 0; y < h; y++) {
+        if (!encoder.process_scanline(yuyv + y * w * 2)) {
+            return 0;
+        }
+    }
+    if (!encoder.process_scanline(NULL)) {
+        return 0;
+    }
+    return stream.get_size();
+}
+
+// fmt2rgb888() hands back BGR, the source is RGB
+static float psnr_rgb888(const uint8_t *src_rgb, const uint8_t *dec_bgr, int pix_count)
+{
+    double se = 0;
+    for (int i = 0; i < pix_count; i++) {
+        for (int c = 0; c < 3; c++) {
+            int d = (int)src_rgb[i * 3 + c] - (int)dec_bgr[i * 3 + 2 - c];
+            se += d * d;
+        }
+    }
+    double mse = se / (pix_count * 3);
+    if (mse == 0) {
+        return 99.0f;
+    }
+    return (float)(10.0 * log10(255.0 * 255.0 / mse));
+}
+
+TEST_CASE("Conversions JPEG encoder DCT back-end benchmark", "[camera]")
+{
+    const int times = 8;
+    const int blocks = (TEST_IMG_W / 16) * (TEST_IMG_H / 16) * 6;
+    const jpge::dct_method_t methods[2] = {jpge::DCT_ISLOW, jpge::DCT_IFAST};
+    const char *names[2] = {"ISLOW", "IFAST"};
+    float blocks_per_s[2] = {0};
+    float psnr[2] = {0};
+    size_t sizes[2] = {0};
+
+    uint8_t *rgb = (uint8_t *)test_malloc(TEST_IMG_W * TEST_IMG_H * 3);
+    uint8_t *dec = (uint8_t *)test_malloc(TEST_IMG_W * TEST_IMG_H * 3);
+    uint8_t *jpg = (uint8_t *)test_malloc(TEST_JPG_BUF_LEN);
+    TEST_ASSERT_NOT_NULL(rgb);
+    TEST_ASSERT_NOT_NULL(dec);
+    TEST_ASSERT_NOT_NULL(jpg);
+    fill_test_rgb888(rgb, TEST_IMG_W, TEST_IMG_H);
+
+    for (int m = 0; m < 2; m++) {
+        jpge::params params;
+        params.m_quality = 80;
+        params.m_dct_method = methods[m];
+
+        uint64_t t = esp_timer_get_time();
+        for (int i = 0; i < times; i++) {
+            sizes[m] = encode_rgb888(rgb, TEST_IMG_W, TEST_IMG_H, params, jpg, TEST_JPG_BUF_LEN);
+            TEST_ASSERT_NOT_EQUAL(0, sizes[m]);
+        }
+        t = esp_timer_get_time() - t;
+        blocks_per_s[m] = (float)blocks * times * 1000000.0f / t;
+
+        TEST_ASSERT_TRUE(fmt2rgb888(jpg, sizes[m], PIXFORMAT_JPEG, dec));
+        psnr[m] = psnr_rgb888(rgb, dec, TEST_IMG_W * TEST_IMG_H);
+        ESP_LOGI(TAG, "%s: %u bytes", names[m], (unsigned)sizes[m]);
+    }
+
+    printf("DCT back-end Result\n");
+    printf("method , blocks/s , size  , PSNR \n");
+    for (int m = 0; m < 2; m++) {
+        printf("%s  , %8.0f , %5u , %5.2f dB \n", names[m], blocks_per_s[m], (unsigned)sizes[m], psnr[m]);
+    }
+
+    free(rgb);
+    free(dec);
+    free(jpg);
+
+    TEST_ASSERT_TRUE(psnr[1] > 30.0f);
+    TEST_ASSERT_TRUE(psnr[1] > psnr[0] - 0.5f);
+}
+
+TEST_CASE("Conversions YUV422 native JPEG ingest benchmark", "[camera]")
+{
+    const int times = 4;
+    const int widths[2] = {640, 800};
+    const int heights[2] = {480, 600};
+    float t_rgb[2] = {0}, t_native[2] = {0};
+
+    uint8_t *jpg = (uint8_t *)test_malloc(TEST_YUV_JPG_BUF_LEN);
+    TEST_ASSERT_NOT_NULL(jpg);
+
+    for (int s = 0; s < 2; s++) {
+        int w = widths[s];
+        int h = heights[s];
+        uint8_t *yuyv = (uint8_t *)test_malloc(w * h * 2);
+        uint8_t *line = (uint8_t *)test_malloc(w * 3);
+        TEST_ASSERT_NOT_NULL(yuyv);
+        TEST_ASSERT_NOT_NULL(line);
+        fill_test_yuyv(yuyv, w, h);
+
+        jpge::params params;
+        params.m_quality = 80;
+
+        uint64_t t = esp_timer_get_time();
+        for (int i = 0; i < times; i++) {
+            TEST_ASSERT_NOT_EQUAL(0, encode_yuyv_via_rgb(yuyv, w, h, params, line, jpg, TEST_YUV_JPG_BUF_LEN));
+        }
+        t_rgb[s] = (esp_timer_get_time() - t) / 1000.0f / times;
+
+        t = esp_timer_get_time();
+        for (int i = 0; i < times; i++) {
+            TEST_ASSERT_NOT_EQUAL(0, encode_yuyv_native(yuyv, w, h, params, jpg, TEST_YUV_JPG_BUF_LEN));
+        }
+        t_native[s] = (esp_timer_get_time() - t) / 1000.0f / times;
+
+        free(yuyv);
+        free(line);
+    }
+    free(jpg);
+
+    printf("YUV422 ingest Result\n");
+    printf("resolution  , via RGB888 , native   , saved \n");
+    for (int s = 0; s < 2; s++) {
+        printf("%4d x %4d , %7.2f ms , %6.2f ms , %5.2f ms \n", widths[s], heights[s],
+               t_rgb[s], t_native[s], t_rgb[s] - t_native[s]);
+    }
+
+    TEST_ASSERT_TRUE(t_native[0] < t_rgb[0]);
+}
+
+// Locate the first occurrence of a marker in the JPEG data
+static int find_marker(const uint8_t *jpg, size_t len, uint8_t marker)
+{
+    for (size_t i = 0; i + 1 < len; i++) {
+        if (jpg[i] == 0xFF && jpg[i + 1] == marker) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+TEST_CASE("Conversions JPEG parallel stripe encoder", "[camera]")
+{
+    const int times = 4;
+    const int w = 640, h = 480;
+    float t_serial = 0, t_parallel = 0;
+    uint8_t *serial_jpg = NULL, *parallel_jpg = NULL;
+    size_t serial_len = 0, parallel_len = 0;
+
+    uint8_t *rgb = (uint8_t *)test_malloc(w * h * 3);
+    uint8_t *dec_serial = (uint8_t *)test_malloc(w * h * 3);
+    uint8_t *dec_parallel = (uint8_t *)test_malloc(w * h * 3);
+    TEST_ASSERT_NOT_NULL(rgb);
+    TEST_ASSERT_NOT_NULL(dec_serial);
+    TEST_ASSERT_NOT_NULL(dec_parallel);
+    fill_test_rgb888(rgb, w, h);
+
+    uint64_t t = esp_timer_get_time();
+    for (int i = 0; i < times; i++) {
+        free(serial_jpg);
+        TEST_ASSERT_TRUE(fmt2jpg(rgb, w * h * 3, w, h, PIXFORMAT_RGB888, 80, &serial_jpg, &serial_len));
+    }
+    t_serial = (esp_timer_get_time() - t) / 1000.0f / times;
+
+    t = esp_timer_get_time();
+    for (int i = 0; i < times; i++) {
+        free(parallel_jpg);
+        TEST_ASSERT_TRUE(fmt2jpg_parallel(rgb, w * h * 3, w, h, PIXFORMAT_RGB888, 80, &parallel_jpg, &parallel_len));
+    }
+    t_parallel = (esp_timer_get_time() - t) / 1000.0f / times;
+
+    // One restart interval per stripe: DRI in the headers, a single RST0 between the stripes
+    int dri = find_marker(parallel_jpg, parallel_len, 0xDD);
+    int sos = find_marker(parallel_jpg, parallel_len, 0xDA);
+    int rst = find_marker(parallel_jpg, parallel_len, 0xD0);
+    TEST_ASSERT_TRUE(dri > 0 && dri < sos);
+    TEST_ASSERT_TRUE(rst > sos);
+    TEST_ASSERT_EQUAL(-1, find_marker(parallel_jpg + rst + 2, parallel_len - rst - 2, 0xD1));
+    TEST_ASSERT_EQUAL(0xFF, parallel_jpg[parallel_len - 2]);
+    TEST_ASSERT_EQUAL(0xD9, parallel_jpg[parallel_len - 1]);
+
+    // Restart markers only reset the DC predictors, the decoded pixels are the same
+    TEST_ASSERT_TRUE(fmt2rgb888(serial_jpg, serial_len, PIXFORMAT_JPEG, dec_serial));
+    TEST_ASSERT_TRUE(fmt2rgb888(parallel_jpg, parallel_len, PIXFORMAT_JPEG, dec_parallel));
+    TEST_ASSERT_EQUAL_MEMORY(dec_serial, dec_parallel, w * h * 3);
+
+    printf("Parallel JPEG Result\n");
+    printf("mode     , time     , size  \n");
+    printf("serial   , %5.2f ms , %5u \n", t_serial, (unsigned)serial_len);
+    printf("parallel , %5.2f ms , %5u \n", t_parallel, (unsigned)parallel_len);
+    printf("speedup  , %5.2fx \n", t_serial / t_parallel);
+
+    free(serial_jpg);
+    free(parallel_jpg);
+    free(rgb);
+    free(dec_serial);
+    free(dec_parallel);
+
+#if !CONFIG_FREERTOS_UNICORE
+    TEST_ASSERT_TRUE(t_parallel < t_serial);
+#endif
+}
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t max_len;
+} test_jpg_sink_t;
+
+static size_t test_jpg_sink(void *arg, size_t index, const void *data, size_t len)
+{
+    test_jpg_sink_t *sink = (test_jpg_sink_t *)arg;
+    if (!data || index + len > sink->max_len) {
+        return 0;
+    }
+    memcpy(sink->buf + index, data, len);
+    sink->len = index + len;
+    return len;
+}
+
+TEST_CASE("Conversions JPEG encoder context reuse", "[camera]")
+{
+    const int times = 16;
+    float t_oneshot = 0, t_ctx = 0;
+
+    uint8_t *rgb = (uint8_t *)test_malloc(TEST_IMG_W * TEST_IMG_H * 3);
+    uint8_t *oneshot_jpg = (uint8_t *)test_malloc(TEST_JPG_BUF_LEN);
+    uint8_t *ctx_jpg = (uint8_t *)test_malloc(TEST_JPG_BUF_LEN);
+    TEST_ASSERT_NOT_NULL(rgb);
+    TEST_ASSERT_NOT_NULL(oneshot_jpg);
+    TEST_ASSERT_NOT_NULL(ctx_jpg);
+    fill_test_rgb888(rgb, TEST_IMG_W, TEST_IMG_H);
+
+    test_jpg_sink_t oneshot = {oneshot_jpg, 0, TEST_JPG_BUF_LEN};
+    test_jpg_sink_t reused = {ctx_jpg, 0, TEST_JPG_BUF_LEN};
+
+    uint64_t t = esp_timer_get_time();
+    for (int i = 0; i < times; i++) {
+        TEST_ASSERT_TRUE(fmt2jpg_cb(rgb, TEST_IMG_W * TEST_IMG_H * 3, TEST_IMG_W, TEST_IMG_H, PIXFORMAT_RGB888, 80, test_jpg_sink, &oneshot));
+    }
+    t_oneshot = (esp_timer_get_time() - t) / 1000.0f / times;
+
+    jpg_encoder_t *ctx = jpg_encoder_create();
+    TEST_ASSERT_NOT_NULL(ctx);
+    // First frame sets up the buffers, the following ones must not touch the heap
+    TEST_ASSERT_TRUE(fmt2jpg_ctx_cb(ctx, rgb, TEST_IMG_W * TEST_IMG_H * 3, TEST_IMG_W, TEST_IMG_H, PIXFORMAT_RGB888, 80, test_jpg_sink, &reused));
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    t = esp_timer_get_time();
+    for (int i = 0; i < times; i++) {
+        TEST_ASSERT_TRUE(fmt2jpg_ctx_cb(ctx, rgb, TEST_IMG_W * TEST_IMG_H * 3, TEST_IMG_W, TEST_IMG_H, PIXFORMAT_RGB888, 80, test_jpg_sink, &reused));
+    }
+    t_ctx = (esp_timer_get_time() - t) / 1000.0f / times;
+    size_t free_after = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    TEST_ASSERT_EQUAL(oneshot.len, reused.len);
+    TEST_ASSERT_EQUAL_MEMORY(oneshot_jpg, ctx_jpg, oneshot.len);
+
+    // A size change reallocates, going back reuses again
+    TEST_ASSERT_TRUE(fmt2jpg_ctx_cb(ctx, rgb, TEST_IMG_W * TEST_IMG_H * 3 / 4, TEST_IMG_W / 2, TEST_IMG_H / 2, PIXFORMAT_RGB888, 60, test_jpg_sink, &reused));
+    TEST_ASSERT_TRUE(fmt2jpg_ctx_cb(ctx, rgb, TEST_IMG_W * TEST_IMG_H * 3, TEST_IMG_W, TEST_IMG_H, PIXFORMAT_RGB888, 80, test_jpg_sink, &reused));
+    TEST_ASSERT_EQUAL_MEMORY(oneshot_jpg, ctx_jpg, oneshot.len);
+    jpg_encoder_destroy(ctx);
+
+    printf("Encoder context Result\n");
+    printf("mode     , time     , heap delta \n");
+    printf("one-shot , %5.2f ms , \n", t_oneshot);
+    printf("context  , %5.2f ms , %d \n", t_ctx, (int)(free_before - free_after));
+
+    free(rgb);
+    free(oneshot_jpg);
+    free(ctx_jpg);
+
+    TEST_ASSERT_EQUAL(free_before, free_after);
+}
+
+TEST_CASE("Conversions JPEG chunked output", "[camera]")
+{
+    const int w = 800, h = 600;
+    uint8_t *rgb = (uint8_t *)test_malloc(w * h * 3);
+    TEST_ASSERT_NOT_NULL(rgb);
+    fill_test_rgb888(rgb, w, h);
+
+    jpg_chunked_t *jpg = NULL;
+    uint8_t *flat = NULL;
+    size_t flat_len = 0;
+    uint64_t t = esp_timer_get_time();
+    TEST_ASSERT_TRUE(fmt2jpg_chunked(rgb, w * h * 3, w, h, PIXFORMAT_RGB888, 95, &jpg));
+    float t_chunked = (esp_timer_get_time() - t) / 1000.0f;
+    TEST_ASSERT_TRUE(fmt2jpg(rgb, w * h * 3, w, h, PIXFORMAT_RGB888, 95, &flat, &flat_len));
+
+    // The view covers the whole stream, in order, and fmt2jpg() returns exactly that
+    size_t count = 0, offset = 0;
+    const jpg_chunk_t *chunks = jpg_chunked_view(jpg, &count);
+    TEST_ASSERT_TRUE(count > 1);
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_TRUE(chunks[i].len <= CONFIG_CAMERA_JPEG_CHUNK_SIZE);
+        TEST_ASSERT_EQUAL_MEMORY(flat + offset, chunks[i].buf, chunks[i].len);
+        offset += chunks[i].len;
+    }
+    TEST_ASSERT_EQUAL(flat_len, offset);
+    TEST_ASSERT_EQUAL(flat_len, jpg_chunked_len(jpg));
+
+    printf("Chunked JPEG Result\n");
+    printf("size   , chunks , time     \n");
+    printf("%6u , %6u , %5.2f ms \n", (unsigned)flat_len, (unsigned)count, t_chunked);
+
+    jpg_chunked_free(jpg);
+    free(flat);
+    free(rgb);
+}
+
+static float psnr_bytes(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    double se = 0;
+    for (size_t i = 0; i < len; i++) {
+        int d = (int)a[i] - (int)b[i];
+        se += d * d;
+    }
+    double mse = se / len;
+    if (mse == 0) {
+        return 99.0f;
+    }
+    return (float)(10.0 * log10(255.0 * 255.0 / mse));
+}
+
+static void size_stats(const size_t *sizes, int count, float *mean, float *stddev)
+{
+    double sum = 0, sum2 = 0;
+    for (int i = 0; i < count; i++) {
+        sum += sizes[i];
+        sum2 += (double)sizes[i] * sizes[i];
+    }
+    *mean = sum / count;
+    *stddev = sqrt(sum2 / count - (*mean) * (*mean));
+}
+
+TEST_CASE("Conversions JPEG rate control replay", "[camera]")
+{
+    extern const uint8_t img_inside_start[] asm("_binary_test_inside_jpeg_start");
+    extern const uint8_t img_inside_end[]   asm("_binary_test_inside_jpeg_end");
+    extern const uint8_t img_outside_start[] asm("_binary_test_outside_jpeg_start");
+    extern const uint8_t img_outside_end[]   asm("_binary_test_outside_jpeg_end");
+    const int w = 320, h = 240, outside_w = 480, outside_h = 320;
+    const int frames = 40;
+    const size_t target = 12 * 1024;
+    const int fixed_quality = 80;
+
+    uint8_t *inside = (uint8_t *)test_malloc(w * h * 3);
+    uint8_t *outside = (uint8_t *)test_malloc(outside_w * outside_h * 3);
+    uint8_t *frame = (uint8_t *)test_malloc(w * h * 3);
+    uint8_t *dec = (uint8_t *)test_malloc(w * h * 3);
+    TEST_ASSERT_NOT_NULL(inside);
+    TEST_ASSERT_NOT_NULL(outside);
+    TEST_ASSERT_NOT_NULL(frame);
+    TEST_ASSERT_NOT_NULL(dec);
+    TEST_ASSERT_TRUE(fmt2rgb888(img_inside_start, img_inside_end - img_inside_start, PIXFORMAT_JPEG, inside));
+    TEST_ASSERT_TRUE(fmt2rgb888(img_outside_start, img_outside_end - img_outside_start, PIXFORMAT_JPEG, outside));
+
+    size_t sizes[2][frames];
+    float psnr[2] = {0};
+    jpg_rate_ctrl_t rc;
+    jpg_rate_ctrl_init(&rc, JPG_RATE_CTRL_ENCODER, target, fixed_quality);
+
+    for (int m = 0; m < 2; m++) {
+        for (int i = 0; i < frames; i++) {
+            // Recorded scene: indoor shots cut to a slow pan across the outdoor one and back
+            if ((i / 10) & 1) {
+                int x = (i % 10) * 16;
+                for (int y = 0; y < h; y++) {
+                    memcpy(frame + y * w * 3, outside + ((y + 40) * outside_w + x) * 3, w * 3);
+                }
+            } else {
+                memcpy(frame, inside, w * h * 3);
+            }
+
+            camera_fb_t fb = {};
+            fb.buf = frame;
+            fb.len = w * h * 3;
+            fb.width = w;
+            fb.height = h;
+            fb.format = PIXFORMAT_RGB888;
+            uint8_t *jpg = NULL;
+            size_t jpg_len = 0;
+            if (m) {
+                TEST_ASSERT_TRUE(frame2jpg_rate_ctrl(&fb, &rc, &jpg, &jpg_len));
+            } else {
+                TEST_ASSERT_TRUE(frame2jpg(&fb, fixed_quality, &jpg, &jpg_len));
+            }
+            sizes[m][i] = jpg_len;
+            TEST_ASSERT_TRUE(fmt2rgb888(jpg, jpg_len, PIXFORMAT_JPEG, dec));
+            psnr[m] += psnr_bytes(frame, dec, w * h * 3) / frames;
+            free(jpg);
+        }
+    }
+
+    float mean[2], stddev[2];
+    printf("Rate control Result\n");
+    printf("mode    , mean  , stddev , PSNR \n");
+    for (int m = 0; m < 2; m++) {
+        size_stats(sizes[m], frames, &mean[m], &stddev[m]);
+        printf("%s , %5.0f , %6.0f , %5.2f dB \n", m ? "rate   " : "fixed  ", mean[m], stddev[m], psnr[m]);
+    }
+
+    free(inside);
+    free(outside);
+    free(frame);
+    free(dec);
+
+    TEST_ASSERT_TRUE(stddev[1] < stddev[0]);
+    TEST_ASSERT_TRUE(mean[1] > target * 0.85f && mean[1] < target * 1.15f);
+}
+
+TEST_CASE("Conversions JPEG optimized Huffman tables", "[camera]")
+{
+    const int w = 640, h = 480;
+    const pixformat_t formats[] = { PIXFORMAT_RGB888, PIXFORMAT_GRAYSCALE };
+    uint8_t *rgb = (uint8_t *)test_malloc(w * h * 3);
+    uint8_t *dec_std = (uint8_t *)test_malloc(w * h * 3);
+    uint8_t *dec_opt = (uint8_t *)test_malloc(w * h * 3);
+    TEST_ASSERT_NOT_NULL(rgb);
+    TEST_ASSERT_NOT_NULL(dec_std);
+    TEST_ASSERT_NOT_NULL(dec_opt);
+    fill_test_rgb888(rgb, w, h);
+
+    printf("Optimized Huffman Result\n");
+    printf("format , one-pass , two-pass , saved  , time     \n");
+    for (int f = 0; f < 2; f++) {
+        size_t src_len = w * h * (formats[f] == PIXFORMAT_GRAYSCALE ? 1 : 3);
+        uint8_t *std_jpg = NULL, *opt_jpg = NULL;
+        size_t std_len = 0, opt_len = 0;
+
+        TEST_ASSERT_TRUE(fmt2jpg(rgb, src_len, w, h, formats[f], 80, &std_jpg, &std_len));
+        size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        uint64_t t = esp_timer_get_time();
+        TEST_ASSERT_TRUE(fmt2jpg_optimized(rgb, src_len, w, h, formats[f], 80, &opt_jpg, &opt_len));
+        float t_opt = (esp_timer_get_time() - t) / 1000.0f;
+
+        // Same coefficients, only the entropy coding differs
+        TEST_ASSERT_TRUE(opt_len < std_len);
+        TEST_ASSERT_TRUE(fmt2rgb888(std_jpg, std_len, PIXFORMAT_JPEG, dec_std));
+        TEST_ASSERT_TRUE(fmt2rgb888(opt_jpg, opt_len, PIXFORMAT_JPEG, dec_opt));
+        TEST_ASSERT_EQUAL_MEMORY(dec_std, dec_opt, w * h * 3);
+
+        printf("%s , %8u , %8u , %5.1f%% , %5.2f ms \n", f ? "gray  " : "rgb888", (unsigned)std_len, (unsigned)opt_len,
+               100.0f * (std_len - opt_len) / std_len, t_opt);
+
+        // The coefficient store is released with the image
+        free(opt_jpg);
+        TEST_ASSERT_EQUAL(free_before, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+        free(std_jpg);
+    }
+
+    free(rgb);
+    free(dec_std);
+    free(dec_opt);
+}
+
+typedef struct {
+    test_jpg_sink_t sink;
+    size_t min_free;
+} test_heap_sink_t;
+
+// Sink that also tracks the lowest free heap seen while the encoder is running
+static size_t test_heap_sink(void *arg, size_t index, const void *data, size_t len)
+{
+    test_heap_sink_t *hs = (test_heap_sink_t *)arg;
+    size_t free_now = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    if (free_now < hs->min_free) {
+        hs->min_free = free_now;
+    }
+    return test_jpg_sink(&hs->sink, index, data, len);
+}
+
+TEST_CASE("Conversions JPEG subsampling options benchmark", "[camera]")
+{
+    const int times = 4;
+    const int w = 800, h = 600;
+    const jpg_subsampling_t modes[4] = { JPG_SUBSAMPLING_420, JPG_SUBSAMPLING_422, JPG_SUBSAMPLING_444, JPG_SUBSAMPLING_GRAY };
+    const char *names[4] = { "4:2:0", "4:2:2", "4:4:4", "gray " };
+    float t_mode[4] = {0};
+    size_t heap_mode[4] = {0}, size_mode[4] = {0};
+
+    uint8_t *yuyv = (uint8_t *)test_malloc(w * h * 2);
+    uint8_t *jpg = (uint8_t *)test_malloc(TEST_YUV_JPG_BUF_LEN);
+    TEST_ASSERT_NOT_NULL(yuyv);
+    TEST_ASSERT_NOT_NULL(jpg);
+    fill_test_yuyv(yuyv, w, h);
+
+    for (int m = 0; m < 4; m++) {
+        jpg_encode_options_t opts = JPG_ENCODE_OPTIONS_DEFAULT(80);
+        opts.subsampling = modes[m];
+        test_heap_sink_t hs = {{jpg, 0, TEST_YUV_JPG_BUF_LEN}, 0};
+
+        size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        hs.min_free = free_before;
+        uint64_t t = esp_timer_get_time();
+        for (int i = 0; i < times; i++) {
+            TEST_ASSERT_TRUE(fmt2jpg_cb_opts(yuyv, w * h * 2, w, h, PIXFORMAT_YUV422, &opts, test_heap_sink, &hs));
+        }
+        t_mode[m] = (esp_timer_get_time() - t) / 1000.0f / times;
+        heap_mode[m] = free_before - hs.min_free;
+        size_mode[m] = hs.sink.len;
+    }
+
+    // Restart interval goes all the way through: DRI in the headers, RSTn in the scan
+    jpg_encode_options_t opts = JPG_ENCODE_OPTIONS_DEFAULT(80);
+    opts.subsampling = JPG_SUBSAMPLING_422;
+    opts.restart_interval = 50;
+    test_heap_sink_t hs = {{jpg, 0, TEST_YUV_JPG_BUF_LEN}, SIZE_MAX};
+    TEST_ASSERT_TRUE(fmt2jpg_cb_opts(yuyv, w * h * 2, w, h, PIXFORMAT_YUV422, &opts, test_heap_sink, &hs));
+    int sos = find_marker(jpg, hs.sink.len, 0xDA);
+    TEST_ASSERT_TRUE(find_marker(jpg, hs.sink.len, 0xDD) > 0);
+    TEST_ASSERT_TRUE(find_marker(jpg, hs.sink.len, 0xD0) > sos);
+
+    printf("Subsampling options Result\n");
+    printf("mode  , time      , heap   , size   \n");
+    for (int m = 0; m < 4; m++) {
+        printf("%s , %6.2f ms , %6u , %6u \n", names[m], t_mode[m], (unsigned)heap_mode[m], (unsigned)size_mode[m]);
+    }
+
+    free(yuyv);
+    free(jpg);
+
+    // 8 buffered MCU rows instead of 16
+    TEST_ASSERT_TRUE(heap_mode[1] < heap_mode[0]);
+    TEST_ASSERT_TRUE(heap_mode[3] < heap_mode[1]);
+}
+
+TEST_CASE("Conversions YUV422 bulk kernels", "[camera]")
+{
+    const int times = 8;
+    const int w = 640, h = 480;
+    uint8_t *yuyv = (uint8_t *)test_malloc(w * h * 2);
+    uint8_t *ref = (uint8_t *)test_malloc(w * h * 3);
+    uint8_t *out = (uint8_t *)test_malloc(w * h * 3);
+    TEST_ASSERT_NOT_NULL(yuyv);
+    TEST_ASSERT_NOT_NULL(ref);
+    TEST_ASSERT_NOT_NULL(out);
+
+    // Every Y/U/V value in every byte position, then the regular test pattern
+    uint32_t seed = 1;
+    for (int i = 0; i < w * h * 2; i++) {
+        seed = seed * 1103515245 + 12345;
+        yuyv[i] = (i < 256 * 4) ? (uint8_t)(i / 4) : (uint8_t)(seed >> 16);
+    }
+
+    float t_ref[3] = {0}, t_bulk[3] = {0};
+    for (int k = 0; k < 3; k++) {
+        uint64_t t = esp_timer_get_time();
+        for (int n = 0; n < times; n++) {
+            for (int i = 0; i < w * h; i += 2) {
+                const uint8_t *s = yuyv + i * 2;
+                uint8_t r[2], g[2], b[2];
+                yuv2rgb(s[0], s[1], s[3], &r[0], &g[0], &b[0]);
+                yuv2rgb(s[2], s[1], s[3], &r[1], &g[1], &b[1]);
+                for (int p = 0; p < 2; p++) {
+                    if (k == 0) {
+                        uint8_t *d = ref + (i + p) * 3;
+                        d[0] = b[p];
+                        d[1] = g[p];
+                        d[2] = r[p];
+                    } else if (k == 1) {
+                        uint8_t *d = ref + (i + p) * 2;
+                        d[0] = (r[p] & 0xF8) | (g[p] >> 5);
+                        d[1] = ((g[p] & 0x1C) << 3) | (b[p] >> 3);
+                    } else {
+                        ref[i + p] = s[p * 2];
+                    }
+                }
+            }
+        }
+        t_ref[k] = (esp_timer_get_time() - t) / 1000.0f / times;
+
+        t = esp_timer_get_time();
+        for (int n = 0; n < times; n++) {
+            if (k == 0) {
+                yuv422_to_rgb888(yuyv, out, w * h);
+            } else if (k == 1) {
+                yuv422_to_rgb565(yuyv, out, w * h);
+            } else {
+                yuv422_to_gray(yuyv, out, w * h);
+            }
+        }
+        t_bulk[k] = (esp_timer_get_time() - t) / 1000.0f / times;
+
+        TEST_ASSERT_EQUAL_MEMORY(ref, out, w * h * (3 - k));
+    }
+
+    // Unaligned source and a tail shorter than one iteration
+    yuv422_to_rgb888(yuyv + 2, out, 14);
+    for (int i = 0; i < 14; i++) {
+        const uint8_t *s = yuyv + 2 + (i / 2) * 4;
+        uint8_t r, g, b;
+        yuv2rgb(s[(i & 1) * 2], s[1], s[3], &r, &g, &b);
+        TEST_ASSERT_EQUAL(b, out[i * 3 + 0]);
+        TEST_ASSERT_EQUAL(g, out[i * 3 + 1]);
+        TEST_ASSERT_EQUAL(r, out[i * 3 + 2]);
+    }
+
+    printf("YUV422 bulk kernels Result\n");
+    printf("output , yuv2rgb   , bulk      \n");
+    const char *names[3] = {"rgb888", "rgb565", "gray  "};
+    for (int k = 0; k < 3; k++) {
+        printf("%s , %6.2f ms , %6.2f ms \n", names[k], t_ref[k], t_bulk[k]);
+    }
+
+    free(yuyv);
+    free(ref);
+    free(out);
+
+    TEST_ASSERT_TRUE(t_bulk[0] < t_ref[0]);
+}
+
+typedef struct {
+    uint8_t *buf;
+    size_t stride;
+    uint16_t next_y;
+    bool in_order;
+} test_rows_sink_t;
+
+static bool test_rows_sink(void *arg, uint16_t y, uint16_t h, const uint8_t *data, size_t stride)
+{
+    test_rows_sink_t *sink = (test_rows_sink_t *)arg;
+    if (y != sink->next_y) {
+        sink->in_order = false;
+    }
+    for (int i = 0; i < h; i++) {
+        memcpy(sink->buf + (y + i) * sink->stride, data + i * stride, stride);
+    }
+    sink->next_y = y + h;
+    return true;
+}
+
+typedef struct {
+    const uint8_t *jpg;
+    size_t jpg_len;
+    const uint8_t *ref;
+    uint8_t *out;
+    size_t out_len;
+    int times;
+    bool ok;
+    SemaphoreHandle_t done;
+} test_decode_task_t;
+
+static void test_decode_task(void *arg)
+{
+    test_decode_task_t *t = (test_decode_task_t *)arg;
+    t->ok = true;
+    for (int i = 0; i < t->times && t->ok; i++) {
+        memset(t->out, 0, t->out_len);
+        t->ok = fmt2rgb888(t->jpg, t->jpg_len, PIXFORMAT_JPEG, t->out) && !memcmp(t->out, t->ref, t->out_len);
+    }
+    xSemaphoreGive(t->done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("Conversions JPEG decoder context and ROI", "[camera]")
+{
+    extern const uint8_t img_inside_start[] asm("_binary_test_inside_jpeg_start");
+    extern const uint8_t img_inside_end[]   asm("_binary_test_inside_jpeg_end");
+    extern const uint8_t img_outside_start[] asm("_binary_test_outside_jpeg_start");
+    extern const uint8_t img_outside_end[]   asm("_binary_test_outside_jpeg_end");
+    const int w = 480, h = 320;
+    const jpg_rect_t roi = {100, 60, 200, 120};
+    size_t outside_len = img_outside_end - img_outside_start;
+
+    uint8_t *full = (uint8_t *)test_malloc(w * h * 3);
+    uint8_t *crop = (uint8_t *)test_malloc(roi.w * roi.h * 3);
+    uint8_t *rows = (uint8_t *)test_malloc(roi.w * roi.h * 3);
+    TEST_ASSERT_NOT_NULL(full);
+    TEST_ASSERT_NOT_NULL(crop);
+    TEST_ASSERT_NOT_NULL(rows);
+    TEST_ASSERT_TRUE(fmt2rgb888(img_outside_start, outside_len, PIXFORMAT_JPEG, full));
+
+    jpg_decoder_t *ctx = jpg_decoder_create();
+    TEST_ASSERT_NOT_NULL(ctx);
+    uint16_t dw = 0, dh = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, jpg_decoder_get_size(ctx, img_outside_start, outside_len, JPG_SCALE_NONE, &dw, &dh));
+    TEST_ASSERT_EQUAL(w, dw);
+    TEST_ASSERT_EQUAL(h, dh);
+
+    uint64_t t = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, jpg_decoder_to_buf(ctx, img_outside_start, outside_len, JPG_SCALE_NONE, NULL, full, w * 3));
+    float t_full = (esp_timer_get_time() - t) / 1000.0f;
+
+    t = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, jpg_decoder_to_buf(ctx, img_outside_start, outside_len, JPG_SCALE_NONE, &roi, crop, roi.w * 3));
+    float t_roi = (esp_timer_get_time() - t) / 1000.0f;
+
+    test_rows_sink_t sink = {rows, (size_t)roi.w * 3, 0, true};
+    TEST_ASSERT_EQUAL(ESP_OK, jpg_decoder_rows(ctx, img_outside_start, outside_len, JPG_SCALE_NONE, &roi, test_rows_sink, &sink));
+    TEST_ASSERT_TRUE(sink.in_order);
+    TEST_ASSERT_EQUAL(roi.h, sink.next_y);
+
+    for (int y = 0; y < roi.h; y++) {
+        TEST_ASSERT_EQUAL_MEMORY(full + ((roi.y + y) * w + roi.x) * 3, crop + y * roi.w * 3, roi.w * 3);
+        TEST_ASSERT_EQUAL_MEMORY(full + ((roi.y + y) * w + roi.x) * 3, rows + y * roi.w * 3, roi.w * 3);
+    }
+
+    const jpg_rect_t outside_roi = {400, 0, 81, 1};
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jpg_decoder_to_buf(ctx, img_outside_start, outside_len, JPG_SCALE_NONE, &outside_roi, crop, roi.w * 3));
+    jpg_decoder_destroy(ctx);
+
+    // Two tasks decoding at once must not disturb each other
+    const int in_w = 320, in_h = 240;
+    uint8_t *in_ref = (uint8_t *)test_malloc(in_w * in_h * 3);
+    TEST_ASSERT_NOT_NULL(in_ref);
+    TEST_ASSERT_TRUE(fmt2rgb888(img_inside_start, img_inside_end - img_inside_start, PIXFORMAT_JPEG, in_ref));
+    test_decode_task_t tasks[2] = {
+        {img_inside_start, (size_t)(img_inside_end - img_inside_start), in_ref, (uint8_t *)test_malloc(in_w * in_h * 3), (size_t)in_w * in_h * 3, 8, false, xSemaphoreCreateBinary()},
+        {img_outside_start, outside_len, full, (uint8_t *)test_malloc(w * h * 3), (size_t)w * h * 3, 4, false, xSemaphoreCreateBinary()},
+    };
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_NOT_NULL(tasks[i].out);
+        TEST_ASSERT_NOT_NULL(tasks[i].done);
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(test_decode_task, "test_decode", 4096, &tasks[i], uxTaskPriorityGet(NULL), NULL, i % portNUM_PROCESSORS));
+    }
+    for (int i = 0; i < 2; i++) {
+        xSemaphoreTake(tasks[i].done, portMAX_DELAY);
+        vSemaphoreDelete(tasks[i].done);
+        free(tasks[i].out);
+        TEST_ASSERT_TRUE(tasks[i].ok);
+    }
+
+    printf("Decoder context Result\n");
+    printf("region  , time     \n");
+    printf("full    , %5.2f ms \n", t_full);
+    printf("roi     , %5.2f ms \n", t_roi);
+
+    free(full);
+    free(crop);
+    free(rows);
+    free(in_ref);
+
+    TEST_ASSERT_TRUE(t_roi < t_full);
+}
@@ -2,8 +2,16 @@
 
 #include "camera.h"
 #include "esp_camera.h"
+#include "esp_camera_broker.h"
+#include "img_converters.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "mqtt_client.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -11,6 +19,9 @@
 #include "settings.h"
 #include "status.h"
 #include "mqtt.h"
+#include "frame_chunk.h"
+#include "camera_motion.h"
+#include "stream_ctrl.h"
 
 
 static const char *TAG = "CAMERA_MODULE";
@@ -63,10 +74,114 @@ static camera_config_t camera_config = {
         .frame_size = FRAMESIZE_VGA,//QQVGA-QXGA Do not use sizes above QVGA when not JPEG
 
         .jpeg_quality = 12, //0-63 lower number means higher quality
-        .fb_count = 2, //if more than one, i2s runs in continuous mode. Use only with JPEG
+        .fb_count = 5, //if more than one, i2s runs in continuous mode. Use only with JPEG. MQTT and HTTP streams share frames through the broker: one queued and one in use for MQTT, one queued and two held for the HTTP viewers
         .grab_mode = CAMERA_GRAB_WHEN_EMPTY//CAMERA_GRAB_LATEST. Sets when buffers should be filled
 };
 
+// Frames are published in chunks of this size, see frame_chunk.h. Small publishes keep memory
+// bounded and let other messages through between them. Every chunk is copied behind its header
+// in chunk_buf: the header can not be written into the frame in front of the chunk, the frame
+// is shared with the HTTP stream. With 0 every frame is one message, a time_t capture timestamp
+// followed by the JPEG frame. Only then is CONFIG_CAMERA_FB_HEADROOM used: the timestamp is
+// written in front of the frame and both are sent in place, without a copy.
+#define CAMERA_MQTT_CHUNK_SIZE 4096
+// How long a stream waits for the next frame from the broker
+#define CAMERA_TAKE_TIMEOUT (4000 / portTICK_PERIOD_MS)
+// Frames between two publish statistics log lines
+#define CAMERA_STATS_INTERVAL 100
+
+// MQTT stream levels, best first, the stream moves between them to keep up with the link.
+// Frames per second are what the sensor is read out at unless the HTTP stream runs, the
+// budget is what the JPEG quality is steered towards. A different frame size applies to
+// the HTTP stream as well, sizes must not exceed camera_config.frame_size.
+static const stream_ctrl_level_t camera_levels[] = {
+  { FRAMESIZE_VGA,   5, 1024*32 },
+  { FRAMESIZE_VGA,   5, 1024*20 },
+  { FRAMESIZE_VGA,   3, 1024*16 },
+  { FRAMESIZE_CIF,   3, 1024*10 },
+  { FRAMESIZE_QVGA,  2, 1024*6 },
+  { FRAMESIZE_QVGA,  1, 1024*4 },
+  { FRAMESIZE_QQVGA, 1, 1024*2 },
+};
+#define CAMERA_LEVEL_COUNT (sizeof(camera_levels) / sizeof(camera_levels[0]))
+
+static const framesize_t camera_framesizes[] = { FRAMESIZE_VGA, FRAMESIZE_CIF, FRAMESIZE_QVGA, FRAMESIZE_QQVGA };
+static bool framesizes_prepared;
+
+typedef struct {
+  const char *topic;
+  mqtt_publish_stats_t *stats;
+} camera_chunk_ctx_t;
+
+// VSYNC of the frame on the esp_timer clock
+static int64_t camera_vsync_us(const camera_fb_t *fb) {
+  return (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+}
+
+// Wall clock time of the VSYNC that started the frame, in microseconds since the epoch
+static int64_t camera_capture_time_us(const camera_fb_t *fb) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  int64_t age_us = esp_timer_get_time() - camera_vsync_us(fb);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_usec - age_us;
+}
+
+static int camera_publish_chunk(const uint8_t *msg, size_t len, void *ctx) {
+  camera_chunk_ctx_t *chunk_ctx = ctx;
+  mqtt_segment_t segment = { msg, len };
+  return mqtt_publish_segments(chunk_ctx->topic, &segment, 1, 0, chunk_ctx->stats);
+}
+
+static void camera_publish_frame(const char *topic, camera_fb_t *fb, const uint8_t *jpg, size_t jpg_len,
+                                 int64_t capture_us, uint8_t *chunk_buf, mqtt_publish_stats_t *stats) {
+  static uint32_t frame_id;
+  if (CAMERA_MQTT_CHUNK_SIZE) {
+    camera_chunk_ctx_t ctx = { topic, stats };
+    if (frame_chunk_send(jpg, jpg_len, frame_id++, capture_us, CAMERA_MQTT_CHUNK_SIZE, chunk_buf,
+                         camera_publish_chunk, &ctx) < 0) {
+      ESP_LOGW(TAG, "Frame of %u bytes not sent completely", jpg_len);
+    }
+    return;
+  }
+
+  time_t ts = capture_us / 1000000;
+  mqtt_segment_t segments[2] = {
+    { &ts, sizeof(time_t) },
+    { jpg, jpg_len },
+  };
+  if (jpg == fb->buf && CAMERA_FB_HEADROOM >= sizeof(time_t)) {
+    // Only this task writes to the headroom, the other subscribers read from fb->buf on
+    memcpy(fb->buf - sizeof(time_t), &ts, sizeof(time_t));
+    segments[0].data = fb->buf - sizeof(time_t);
+  }
+  if (mqtt_publish_segments(topic, segments, 2, 0, stats) == -2) {
+    ESP_LOGW(TAG, "Frame of %u bytes dropped, over the broker's packet size limit", jpg_len);
+  }
+}
+
+static int8_t camera_wifi_rssi(void) {
+  wifi_ap_record_t ap;
+  return esp_wifi_sta_get_ap_info(&ap) == ESP_OK ? ap.rssi : 0;
+}
+
+static void camera_apply_level(const stream_ctrl_t *ctrl, camera_broker_sub_t sub,
+                               jpg_rate_ctrl_t *sensor_rc, jpg_rate_ctrl_t *encoder_rc) {
+  const stream_ctrl_level_t *level = stream_ctrl_level(ctrl);
+  ESP_LOGI(TAG, "Stream level %u: framesize %d, %u fps, %lu bytes per frame, delay %lu ms, link %lu B/s",
+           ctrl->level, level->framesize, level->fps, level->frame_budget, ctrl->delay_us / 1000, ctrl->rate);
+  esp_camera_broker_set_fps(sub, level->fps);
+  sensor_rc->target_size = level->frame_budget;
+  encoder_rc->target_size = level->frame_budget;
+
+  sensor_t *s = esp_camera_sensor_get();
+  if (framesizes_prepared && s && s->status.framesize != level->framesize) {
+    esp_err_t err = esp_camera_set_framesize(level->framesize);
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "Frame size switch failed: %s", esp_err_to_name(err));
+    }
+  }
+}
+
 void camera_flash(uint32_t turnOn) {
     gpio_set_level(CAM_FLASH_PIN, turnOn);
 }
@@ -79,23 +194,53 @@ static void camera_stream_task(void *pvParameters) {
   snprintf(topic, sizeof(topic), "iot/%s/%s/camera/frames",
            settings.datacenter_id, settings.device_id);
 
-  char* payload_buf = malloc(1024*100);
-  time_t* ts = (time_t*)payload_buf;
+  mqtt_publish_stats_t stats = { 0 };
+  uint32_t frames = 0;
+  int64_t last_sent_us = 0;
+  uint8_t *chunk_buf = NULL;
+  if (CAMERA_MQTT_CHUNK_SIZE) {
+    chunk_buf = malloc(FRAME_CHUNK_HEADER_SIZE + CAMERA_MQTT_CHUNK_SIZE);
+    if (!chunk_buf) {
+      ESP_LOGE(TAG, "No memory for the frame chunk buffer");
+      vTaskDelete(NULL);
+    }
+  }
+
+  // Sensor JPEG quality and software encoder quality are steered separately
+  jpg_rate_ctrl_t sensor_rc;
+  jpg_rate_ctrl_t encoder_rc;
+  stream_ctrl_t ctrl;
+  stream_ctrl_config_t ctrl_config = STREAM_CTRL_CONFIG_DEFAULT(camera_levels, CAMERA_LEVEL_COUNT);
+  stream_ctrl_init(&ctrl, &ctrl_config);
+  jpg_rate_ctrl_init(&sensor_rc, JPG_RATE_CTRL_SENSOR, camera_levels[0].frame_budget, camera_config.jpeg_quality);
+  jpg_rate_ctrl_init(&encoder_rc, JPG_RATE_CTRL_ENCODER, camera_levels[0].frame_budget, 80);
+
+  camera_broker_sub_t sub = NULL;
+  camera_broker_sub_config_t sub_config = CAMERA_BROKER_SUB_CONFIG_DEFAULT();
 
   while (1) {
     if (is_mqtt_subscribed() && is_time_synced()) {
-      fb = esp_camera_fb_get();
-      time(ts);
+      if (!sub) {
+        sub_config.fps = stream_ctrl_level(&ctrl)->fps;
+        sub = esp_camera_broker_subscribe(&sub_config);
+      }
+      fb = esp_camera_broker_take(sub, CAMERA_TAKE_TIMEOUT);
       if (!fb) {
         ESP_LOGE(TAG, "Camera capture failed");
         vTaskDelay(1000 / portTICK_PERIOD_MS);
         continue;
       }
+      // Static scenes only go out as keepalive frames
+      if (!camera_motion_pass(fb, &last_sent_us)) {
+        esp_camera_broker_release(fb);
+        continue;
+      }
+      int64_t capture_us = camera_capture_time_us(fb);
       if(fb->format != PIXFORMAT_JPEG){
-        bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
+        bool jpeg_converted = frame2jpg_rate_ctrl(fb, &encoder_rc, &_jpg_buf, &_jpg_buf_len);
         if(!jpeg_converted){
           ESP_LOGE(TAG, "JPEG compression failed");
-          esp_camera_fb_return(fb);
+          esp_camera_broker_release(fb);
           vTaskDelay(1000 / portTICK_PERIOD_MS);
           continue;
         }
@@ -103,16 +248,47 @@ static void camera_stream_task(void *pvParameters) {
       } else {
         _jpg_buf_len = fb->len;
         _jpg_buf = fb->buf;
+
+        // Frames queued before the last quality change don't count, they still have the old one
+        sensor_t *s = esp_camera_sensor_get();
+        int quality = jpg_rate_ctrl_update_frame(&sensor_rc, fb->len, camera_vsync_us(fb), esp_timer_get_time());
+        if (s && quality != s->status.quality) {
+          s->set_quality(s, quality);
+        }
       }
-      memcpy(payload_buf+sizeof(time_t), _jpg_buf, fb->len);
 
-      esp_mqtt_client_publish(get_mqtt_client(), topic, payload_buf, _jpg_buf_len+sizeof(time_t), 0, 0);
+      uint64_t busy_us = stats.total_publish_us + stats.total_copy_us;
+      camera_publish_frame(topic, fb, _jpg_buf, _jpg_buf_len, capture_us, chunk_buf, &stats);
+      stream_ctrl_sample_t sample = {
+        .now_us = esp_timer_get_time(),
+        .publish_us = stats.total_publish_us + stats.total_copy_us - busy_us,
+        .frame_bytes = _jpg_buf_len,
+        .sent_bytes = stats.bytes,
+        .rssi = camera_wifi_rssi(),
+      };
+      if (stream_ctrl_update(&ctrl, &sample)) {
+        camera_apply_level(&ctrl, sub, &sensor_rc, &encoder_rc);
+      }
+      if (++frames % CAMERA_STATS_INTERVAL == 0 && stats.messages + stats.failed) {
+        uint32_t attempts = stats.messages + stats.failed;
+        ESP_LOGI(TAG, "MQTT messages: %lu sent, %lu copied, %lu oversize, %lu failed, avg copy %llu us, avg publish %llu us",
+                 stats.messages, stats.copied, stats.oversize, stats.failed,
+                 stats.total_copy_us / attempts, stats.total_publish_us / attempts);
+        ESP_LOGI(TAG, "Stream level %u, delay %lu ms, %lu down, %lu up, %lu failed probes",
+                 ctrl.level, ctrl.delay_us / 1000, ctrl.stats.steps_down, ctrl.stats.steps_up,
+                 ctrl.stats.failed_probes);
+      }
 
       if(fb->format != PIXFORMAT_JPEG){
         free(_jpg_buf);
       }
-      esp_camera_fb_return(fb);
+      esp_camera_broker_release(fb);
     } else {
+      // Don't hold frames back from the other subscribers while not streaming
+      if (sub) {
+        esp_camera_broker_unsubscribe(sub);
+        sub = NULL;
+      }
       vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
   }
@@ -134,6 +310,26 @@ void init_camera(int mqtt_stream) {
     esp_err_t err = esp_camera_init(&camera_config);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Camera Init Failed");
+        return;
+    }
+
+    // Frames are shared between the MQTT and the HTTP stream
+    err = esp_camera_broker_init(6, 1);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Camera frame broker init failed");
+        return;
+    }
+
+    // Without it every frame is streamed
+    if (camera_motion_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Motion gating not available");
+    }
+
+    // The MQTT stream lowers the frame size on a slow link
+    err = esp_camera_prepare_framesizes(camera_framesizes, sizeof(camera_framesizes) / sizeof(camera_framesizes[0]));
+    framesizes_prepared = err == ESP_OK;
+    if (!framesizes_prepared) {
+        ESP_LOGW(TAG, "Frame size switching not available: %s", esp_err_to_name(err));
     }
 
   if (mqtt_stream) {
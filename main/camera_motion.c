@@ -0,0 +1,252 @@
+#include <string.h>
+#include <time.h>
+
+#include "camera_motion.h"
+#include "motion.h"
+#include "img_converters.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "settings.h"
+#include "status.h"
+#include "mqtt.h"
+#include "SensorReadingMessage.h"
+#include "MotionConfigMessage.h"
+
+static const char *TAG = "CAMERA_MOTION";
+static const char *CAMERA_MOTION_SENSOR_TYPE = "camera_motion";
+
+// Frames between two detector timing log lines
+#define CAMERA_MOTION_STATS_INTERVAL 100
+
+typedef struct {
+  uint16_t factor;        // source pixels per thumbnail pixel, in each direction
+  uint16_t width;
+  uint16_t height;
+  uint32_t sums[MOTION_MAX_WIDTH * MOTION_MAX_HEIGHT];  // factor is over 16 on raw frames above SXGA
+} camera_thumb_t;
+
+static SemaphoreHandle_t motion_lock;
+static jpg_decoder_t *decoder;
+static motion_detector_t detector;
+static motion_config_t config = MOTION_CONFIG_DEFAULT();
+static bool enabled = true;
+static camera_thumb_t thumb;
+static uint8_t luma[MOTION_MAX_WIDTH * MOTION_MAX_HEIGHT];
+
+// Result for the frame last looked at, the streams see the same frames
+static struct timeval result_timestamp;
+static motion_result_t result;
+static bool result_valid;
+
+static uint32_t detections;
+static uint64_t detect_us;
+
+static void thumb_start(camera_thumb_t *t, uint16_t src_width, uint16_t src_height) {
+  t->factor = (src_width + MOTION_MAX_WIDTH - 1) / MOTION_MAX_WIDTH;
+  uint16_t factor_h = (src_height + MOTION_MAX_HEIGHT - 1) / MOTION_MAX_HEIGHT;
+  if (factor_h > t->factor) {
+    t->factor = factor_h;
+  }
+  if (!t->factor) {
+    t->factor = 1;
+  }
+  t->width = src_width / t->factor;
+  t->height = src_height / t->factor;
+  memset(t->sums, 0, sizeof(t->sums));
+}
+
+static inline void thumb_add(camera_thumb_t *t, uint16_t x, uint16_t y, uint8_t y_value) {
+  uint16_t tx = x / t->factor, ty = y / t->factor;
+  if (tx < t->width && ty < t->height) {
+    t->sums[ty * t->width + tx] += y_value;
+  }
+}
+
+static void thumb_finish(const camera_thumb_t *t, uint8_t *out) {
+  uint32_t area = t->factor * t->factor;
+  for (size_t i = 0; i < (size_t)t->width * t->height; i++) {
+    out[i] = t->sums[i] / area;
+  }
+}
+
+static inline uint8_t bgr_luma(uint8_t b, uint8_t g, uint8_t r) {
+  return (77 * r + 150 * g + 29 * b) >> 8;
+}
+
+static bool thumb_rows(void *arg, uint16_t y, uint16_t h, const uint8_t *data, size_t stride) {
+  camera_thumb_t *t = arg;
+  for (uint16_t row = 0; row < h; row++, data += stride) {
+    for (uint16_t x = 0; x < t->width * t->factor; x++) {
+      const uint8_t *p = data + x * 3;
+      thumb_add(t, x, y + row, bgr_luma(p[0], p[1], p[2]));
+    }
+  }
+  return true;
+}
+
+// Luma thumbnail of at most MOTION_MAX_WIDTH x MOTION_MAX_HEIGHT, JPEG frames are decoded at 1/8 scale
+static bool camera_luma_thumb(const camera_fb_t *fb) {
+  if (fb->format == PIXFORMAT_JPEG) {
+    uint16_t w, h;
+    if (jpg_decoder_get_size(decoder, fb->buf, fb->len, JPG_SCALE_8X, &w, &h) != ESP_OK) {
+      return false;
+    }
+    thumb_start(&thumb, w, h);
+    jpg_rect_t roi = { 0, 0, thumb.width * thumb.factor, thumb.height * thumb.factor };
+    if (jpg_decoder_rows(decoder, fb->buf, fb->len, JPG_SCALE_8X, &roi, thumb_rows, &thumb) != ESP_OK) {
+      return false;
+    }
+  } else {
+    if (fb->format != PIXFORMAT_GRAYSCALE && fb->format != PIXFORMAT_YUV422 && fb->format != PIXFORMAT_RGB565) {
+      return false;
+    }
+    thumb_start(&thumb, fb->width, fb->height);
+    for (uint16_t y = 0; y < thumb.height * thumb.factor; y++) {
+      const uint8_t *row = fb->buf + (size_t)y * fb->width * (fb->format == PIXFORMAT_GRAYSCALE ? 1 : 2);
+      for (uint16_t x = 0; x < thumb.width * thumb.factor; x++) {
+        uint8_t v;
+        if (fb->format == PIXFORMAT_GRAYSCALE) {
+          v = row[x];
+        } else if (fb->format == PIXFORMAT_YUV422) {
+          v = row[x * 2];
+        } else {
+          uint8_t hb = row[x * 2], lb = row[x * 2 + 1];
+          v = bgr_luma((lb & 0x1F) << 3, (hb & 0x07) << 5 | (lb & 0xE0) >> 3, hb & 0xF8);
+        }
+        thumb_add(&thumb, x, y, v);
+      }
+    }
+  }
+  thumb_finish(&thumb, luma);
+  return true;
+}
+
+static void camera_motion_publish_event(const motion_result_t *r) {
+  time_t ts;
+  time(&ts);
+  struct SensorReading sensorReading = {
+          .unit = "boolean",
+          .value2 = r->changed_permille / 10.0,
+          .sensor_type = CAMERA_MOTION_SENSOR_TYPE,
+          .value = r->event == MOTION_EVENT_START,
+          .timestamp = ts
+  };
+
+  publish_SensorReadingMessage(
+          get_mqtt_client(), CAMERA_MOTION_SENSOR_TYPE, settings.datacenter_id, settings.device_id, &sensorReading);
+}
+
+void camera_motion_publish_config(void) {
+  char mask[MOTION_MASK_HEX_LEN + 1];
+  xSemaphoreTake(motion_lock, portMAX_DELAY);
+  motion_mask_to_hex(config.mask, mask);
+  struct MotionConfig motionConfig = {
+          .enabled = enabled,
+          .pixel_threshold = config.pixel_threshold,
+          .area_percent = config.area_permille / 10.0,
+          .keepalive_s = config.keepalive_ms / 1000,
+          .mask = mask
+  };
+  xSemaphoreGive(motion_lock);
+
+  publish_MotionConfigMessage(get_mqtt_client(), settings.datacenter_id, settings.device_id, &motionConfig);
+}
+
+bool camera_motion_pass(const camera_fb_t *fb, int64_t *last_sent_us) {
+  if (!motion_lock) {
+    return true;
+  }
+  // Both streams wait on the lock, the event goes out after it is released
+  motion_result_t event;
+  bool publish = false;
+  xSemaphoreTake(motion_lock, portMAX_DELAY);
+  if (!enabled) {
+    xSemaphoreGive(motion_lock);
+    return true;
+  }
+
+  if (!result_valid || fb->timestamp.tv_sec != result_timestamp.tv_sec
+      || fb->timestamp.tv_usec != result_timestamp.tv_usec) {
+    int64_t start = esp_timer_get_time();
+    if (camera_luma_thumb(fb)) {
+      motion_detector_update(&detector, luma, thumb.width, thumb.height, &result);
+    } else {
+      // Nothing to compare, the frame goes out
+      memset(&result, 0, sizeof(result));
+      result.motion = true;
+    }
+    result_timestamp = fb->timestamp;
+    result_valid = true;
+    detect_us += esp_timer_get_time() - start;
+    if (++detections % CAMERA_MOTION_STATS_INTERVAL == 0) {
+      ESP_LOGI(TAG, "Motion detection: %lu frames, avg %llu us, %u.%u%% changed",
+               detections, detect_us / detections, result.changed_permille / 10, result.changed_permille % 10);
+    }
+    if (result.event != MOTION_EVENT_NONE) {
+      ESP_LOGI(TAG, "Motion %s, %u.%u%% changed", result.event == MOTION_EVENT_START ? "started" : "ended",
+               result.changed_permille / 10, result.changed_permille % 10);
+      event = result;
+      publish = true;
+    }
+  }
+  bool send = motion_should_send(&config, &result, esp_timer_get_time(), last_sent_us);
+  xSemaphoreGive(motion_lock);
+
+  if (publish && is_mqtt_subscribed() && is_time_synced()) {
+    camera_motion_publish_event(&event);
+  }
+  return send;
+}
+
+bool camera_motion_command(const char *name, const char *param1, double param2, int param3, bool param4) {
+  if (strncmp(name, "motion", strlen("motion")) != 0 || !motion_lock) {
+    return false;
+  }
+
+  bool handled = true;
+  xSemaphoreTake(motion_lock, portMAX_DELAY);
+  if (strcmp(name, "motion") == 0) {
+    // Gating on or off, the detector starts over from the next frame
+    enabled = param4;
+    motion_detector_reset(&detector);
+    result_valid = false;
+  } else if (strcmp(name, "motion_threshold") == 0) {
+    // Changed area in percent of the unmasked frame, and the pixel difference if given
+    if (param2 > 0 && param2 <= 100) {
+      config.area_permille = param2 * 10;
+    }
+    if (param3 > 0 && param3 < 256) {
+      config.pixel_threshold = param3;
+    }
+  } else if (strcmp(name, "motion_keepalive") == 0) {
+    config.keepalive_ms = param3 > 0 ? param3 * 1000 : 0;
+  } else if (strcmp(name, "motion_mask") == 0) {
+    if (!param1 || !motion_mask_from_hex(param1, config.mask)) {
+      ESP_LOGW(TAG, "Motion mask needs %d hex digits, or none to clear it", MOTION_MASK_HEX_LEN);
+    }
+  } else if (strcmp(name, "motion_config") != 0) {
+    handled = false;
+  }
+  motion_detector_set_config(&detector, &config);
+  xSemaphoreGive(motion_lock);
+
+  if (handled) {
+    camera_motion_publish_config();
+  }
+  return handled;
+}
+
+esp_err_t camera_motion_init(void) {
+  decoder = jpg_decoder_create();
+  motion_lock = xSemaphoreCreateMutex();
+  if (!decoder || !motion_lock) {
+    ESP_LOGE(TAG, "No memory for motion detection");
+    return ESP_ERR_NO_MEM;
+  }
+  motion_detector_init(&detector, &config);
+  return ESP_OK;
+}
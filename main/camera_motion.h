@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_camera.h"
+
+// Motion gate shared by the MQTT and the HTTP stream, see motion.h.
+//
+// The first stream to look at a frame runs the detector on a 1/8 scale luma thumbnail of it,
+// the others reuse the result. Detection start and end go out as camera_motion readings,
+// thresholds, keepalive and mask are changed with the motion* commands and reported on
+// iot/<dc>/<dev>/camera/motion/config.
+
+esp_err_t camera_motion_init(void);
+
+// Whether a stream sends the frame, always true while gating is off. last_sent_us is the
+// stream's own keepalive clock, start it at 0.
+bool camera_motion_pass(const camera_fb_t *fb, int64_t *last_sent_us);
+
+// Handles the motion commands, false when name is not one of them
+bool camera_motion_command(const char *name, const char *param1, double param2, int param3, bool param4);
+
+void camera_motion_publish_config(void);
@@ -2,6 +2,7 @@
 #include "SensorCommandSchema.h"
 #include "motors.h"
 #include "servo.h"
+#include "camera_motion.h"
 #include <string.h>
 
 static const char *TAG = "COMMANDS";
@@ -28,6 +29,10 @@ void handleCommand(const char* jsonTextData) {
     } else if (strcmp(sensorCommand->commandName, "servo")==0) {
       double angle = sensorCommand->commandParam2;
       set_servo_angle(angle);
+    } else if (camera_motion_command(sensorCommand->commandName, sensorCommand->commandParam1,
+                                     sensorCommand->commandParam2, sensorCommand->commandParam3,
+                                     sensorCommand->commandParam4)) {
+      ESP_LOGI(TAG, "Motion detection settings updated");
     }
 
     free_SensorCommandSchema(sensorCommand);
@@ -0,0 +1,255 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_chunk.h"
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    put_u16(p, v >> 16);
+    put_u16(p + 2, v);
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return ((uint32_t)get_u16(p) << 16) | get_u16(p + 2);
+}
+
+size_t frame_chunk_count(size_t frame_len, size_t chunk_size) {
+    if (!frame_len) {
+        return 1;
+    }
+    return (frame_len + chunk_size - 1) / chunk_size;
+}
+
+void frame_chunk_header_write(const frame_chunk_header_t *header, uint8_t *out) {
+    out[0] = FRAME_CHUNK_MAGIC;
+    out[1] = FRAME_CHUNK_VERSION;
+    out[2] = 0;
+    out[3] = FRAME_CHUNK_HEADER_SIZE;
+    put_u32(out + 4, header->frame_id);
+    put_u16(out + 8, header->index);
+    put_u16(out + 10, header->count);
+    put_u32(out + 12, header->offset);
+    put_u32(out + 16, header->frame_len);
+    put_u32(out + 20, (uint64_t)header->timestamp_us >> 32);
+    put_u32(out + 24, header->timestamp_us);
+}
+
+bool frame_chunk_header_read(const uint8_t *msg, size_t len, frame_chunk_header_t *header) {
+    if (len < FRAME_CHUNK_HEADER_SIZE || msg[0] != FRAME_CHUNK_MAGIC || msg[1] != FRAME_CHUNK_VERSION) {
+        return false;
+    }
+    // Later versions may append fields, the data starts after all of them
+    size_t header_len = msg[3];
+    if (header_len < FRAME_CHUNK_HEADER_SIZE || header_len > len) {
+        return false;
+    }
+    header->frame_id = get_u32(msg + 4);
+    header->index = get_u16(msg + 8);
+    header->count = get_u16(msg + 10);
+    header->offset = get_u32(msg + 12);
+    header->frame_len = get_u32(msg + 16);
+    header->timestamp_us = (int64_t)(((uint64_t)get_u32(msg + 20) << 32) | get_u32(msg + 24));
+    header->data = msg + header_len;
+    header->data_len = len - header_len;
+    return header->count && header->index < header->count
+        && header->offset <= header->frame_len && header->data_len <= header->frame_len - header->offset;
+}
+
+int frame_chunk_send(const uint8_t *frame, size_t len, uint32_t frame_id, int64_t timestamp_us,
+                     size_t chunk_size, uint8_t *chunk_buf, frame_chunk_publish_t publish, void *ctx) {
+    size_t count = frame_chunk_count(len, chunk_size);
+    if (count > FRAME_CHUNK_MAX_COUNT) {
+        return -1;
+    }
+    frame_chunk_header_t header = {
+        .frame_id = frame_id,
+        .count = count,
+        .frame_len = len,
+        .timestamp_us = timestamp_us,
+    };
+    for (size_t i = 0; i < count; i++) {
+        size_t n = len - header.offset < chunk_size ? len - header.offset : chunk_size;
+        header.index = i;
+        frame_chunk_header_write(&header, chunk_buf);
+        memcpy(chunk_buf + FRAME_CHUNK_HEADER_SIZE, frame + header.offset, n);
+        if (publish(chunk_buf, FRAME_CHUNK_HEADER_SIZE + n, ctx) < 0) {
+            return -1;
+        }
+        header.offset += n;
+    }
+    return count;
+}
+
+bool frame_chunk_reassembler_init(frame_chunk_reassembler_t *r, size_t slot_count, size_t max_frame_len,
+                                  frame_chunk_frame_cb_t on_frame, void *ctx) {
+    memset(r, 0, sizeof(*r));
+    r->slots = calloc(slot_count, sizeof(frame_chunk_slot_t));
+    if (!r->slots) {
+        return false;
+    }
+    r->slot_count = slot_count;
+    r->max_frame_len = max_frame_len;
+    r->on_frame = on_frame;
+    r->ctx = ctx;
+    for (size_t i = 0; i < slot_count; i++) {
+        r->slots[i].buf = malloc(max_frame_len ? max_frame_len : 1);
+        r->slots[i].seen = malloc((FRAME_CHUNK_MAX_COUNT + 7) / 8);
+        if (!r->slots[i].buf || !r->slots[i].seen) {
+            frame_chunk_reassembler_deinit(r);
+            return false;
+        }
+    }
+    return true;
+}
+
+void frame_chunk_reassembler_deinit(frame_chunk_reassembler_t *r) {
+    if (!r->slots) {
+        return;
+    }
+    for (size_t i = 0; i < r->slot_count; i++) {
+        free(r->slots[i].buf);
+        free(r->slots[i].seen);
+    }
+    free(r->slots);
+    r->slots = NULL;
+}
+
+// Frame ids wrap, a is older than b if it is less than half the range behind
+static bool frame_id_older(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+static frame_chunk_slot_t *find_slot(frame_chunk_reassembler_t *r, const frame_chunk_header_t *h) {
+    frame_chunk_slot_t *free_slot = NULL, *oldest = NULL;
+    for (size_t i = 0; i < r->slot_count; i++) {
+        frame_chunk_slot_t *s = &r->slots[i];
+        if (!s->used) {
+            free_slot = free_slot ? free_slot : s;
+        } else if (s->frame_id == h->frame_id) {
+            return s;
+        } else if (!oldest || frame_id_older(s->frame_id, oldest->frame_id)) {
+            oldest = s;
+        }
+    }
+    frame_chunk_slot_t *s = free_slot;
+    if (!s) {
+        // More frames in flight than slots, the oldest one will not complete in time
+        if (frame_id_older(h->frame_id, oldest->frame_id)) {
+            return NULL;
+        }
+        s = oldest;
+        r->stats.dropped++;
+    }
+    s->used = true;
+    s->frame_id = h->frame_id;
+    s->frame_len = h->frame_len;
+    s->count = h->count;
+    s->received = 0;
+    s->chunk_size = 0;
+    s->bytes = 0;
+    s->timestamp_us = h->timestamp_us;
+    memset(s->seen, 0, (h->count + 7) / 8);
+    return s;
+}
+
+// Whether the chunk is where frame_chunk_send() puts it: chunk i starts at i * chunk_size, all but
+// the last one are chunk_size long and the last one ends the frame. The chunk size is not in the
+// header, it is taken from the first chunk that shows it and all others have to agree.
+static bool chunk_in_place(frame_chunk_slot_t *s, const frame_chunk_header_t *h) {
+    bool last = h->index == h->count - 1;
+    if (last && h->offset + h->data_len != h->frame_len) {
+        return false;
+    }
+    uint32_t chunk_size;
+    if (h->index) {
+        if (h->offset % h->index) {
+            return false;
+        }
+        chunk_size = h->offset / h->index;
+    } else if (h->offset) {
+        return false;
+    } else if (last) {
+        return true;
+    } else {
+        chunk_size = h->data_len;
+    }
+    if (!chunk_size || (s->chunk_size && s->chunk_size != chunk_size)) {
+        return false;
+    }
+    if (last ? !h->data_len || h->data_len > chunk_size : h->data_len != chunk_size) {
+        return false;
+    }
+    s->chunk_size = chunk_size;
+    return true;
+}
+
+void frame_chunk_reassembler_push(frame_chunk_reassembler_t *r, const uint8_t *msg, size_t len) {
+    frame_chunk_header_t h;
+    if (!frame_chunk_header_read(msg, len, &h)) {
+        r->stats.malformed++;
+        return;
+    }
+    if (r->delivered_any && !frame_id_older(r->last_delivered, h.frame_id)) {
+        r->stats.late++;
+        return;
+    }
+    if (h.frame_len > r->max_frame_len) {
+        // Counted once per frame, on its first chunk
+        if (h.index == 0) {
+            r->stats.too_large++;
+        }
+        return;
+    }
+
+    frame_chunk_slot_t *s = find_slot(r, &h);
+    if (!s) {
+        r->stats.late++;
+        return;
+    }
+    if (s->frame_len != h.frame_len || s->count != h.count || s->timestamp_us != h.timestamp_us
+        || !chunk_in_place(s, &h)) {
+        r->stats.malformed++;
+        return;
+    }
+    if (s->seen[h.index / 8] & (1 << (h.index % 8))) {
+        r->stats.duplicates++;
+        return;
+    }
+    s->seen[h.index / 8] |= 1 << (h.index % 8);
+    s->received++;
+    s->bytes += h.data_len;
+    r->stats.chunks++;
+    memcpy(s->buf + h.offset, h.data, h.data_len);
+    if (s->received < s->count) {
+        return;
+    }
+    if (s->bytes != s->frame_len) {
+        // Not covered exactly, part of the buffer would be left from an older frame
+        s->used = false;
+        r->stats.malformed++;
+        r->stats.dropped++;
+        return;
+    }
+
+    // Older frames still missing chunks are given up, a viewer wants the newest frame
+    for (size_t i = 0; i < r->slot_count; i++) {
+        frame_chunk_slot_t *o = &r->slots[i];
+        if (o->used && o != s && frame_id_older(o->frame_id, s->frame_id)) {
+            o->used = false;
+            r->stats.dropped++;
+        }
+    }
+    s->used = false;
+    r->delivered_any = true;
+    r->last_delivered = s->frame_id;
+    r->stats.frames++;
+    r->on_frame(s->buf, s->frame_len, s->frame_id, s->timestamp_us, r->ctx);
+}
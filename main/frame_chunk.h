@@ -0,0 +1,115 @@
+#pragma once
+
+// Chunked camera frame transport for iot/<dc>/<dev>/camera/frames.
+//
+// Each frame is split into chunks of at most chunk_size bytes, every chunk is one MQTT
+// message made of a fixed binary header followed by the chunk data. The header carries
+// everything needed to put the frame back together, so chunks can be sent as separate
+// small publishes between other messages and reassembled in any order.
+//
+// Header, all fields big-endian:
+//   0  uint8   magic FRAME_CHUNK_MAGIC
+//   1  uint8   version FRAME_CHUNK_VERSION
+//   2  uint8   flags, 0
+//   3  uint8   header length, the chunk data starts here
+//   4  uint32  frame id, incremented per frame
+//   8  uint16  chunk index
+//  10  uint16  chunk count
+//  12  uint32  offset of the chunk data in the frame
+//  16  uint32  frame length
+//  20  int64   capture time, microseconds since the epoch
+//
+// This file has no ESP-IDF dependencies, receivers build it on the host.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAME_CHUNK_MAGIC 0xC7
+#define FRAME_CHUNK_VERSION 1
+#define FRAME_CHUNK_HEADER_SIZE 28
+#define FRAME_CHUNK_MAX_COUNT 0xFFFF
+
+typedef struct {
+    uint32_t frame_id;
+    uint16_t index;
+    uint16_t count;
+    uint32_t offset;
+    uint32_t frame_len;
+    int64_t timestamp_us;
+    const uint8_t *data;        // chunk data, set by frame_chunk_header_read()
+    size_t data_len;
+} frame_chunk_header_t;
+
+// Chunks needed for a frame, an empty frame still takes one
+size_t frame_chunk_count(size_t frame_len, size_t chunk_size);
+
+void frame_chunk_header_write(const frame_chunk_header_t *header, uint8_t *out);
+
+// Parses and checks a chunk message, false if it is not a valid chunk
+bool frame_chunk_header_read(const uint8_t *msg, size_t len, frame_chunk_header_t *header);
+
+// Sends one chunk message, returns a negative value on failure
+typedef int (*frame_chunk_publish_t)(const uint8_t *msg, size_t len, void *ctx);
+
+// Splits a frame into chunks and publishes them one by one. chunk_buf holds one message,
+// FRAME_CHUNK_HEADER_SIZE + chunk_size bytes, so memory does not grow with the frame.
+// Returns the number of chunks sent, or -1 when publish failed and the rest was not sent.
+int frame_chunk_send(const uint8_t *frame, size_t len, uint32_t frame_id, int64_t timestamp_us,
+                     size_t chunk_size, uint8_t *chunk_buf, frame_chunk_publish_t publish, void *ctx);
+
+typedef struct {
+    uint32_t frames;            // delivered
+    uint32_t chunks;            // accepted
+    uint32_t duplicates;        // chunks received twice, ignored
+    uint32_t malformed;         // not a chunk, or not matching the frame it claims to be part of or its place in it
+    uint32_t late;              // chunks of frames already delivered or dropped
+    uint32_t dropped;           // incomplete frames given up, a newer frame completed first
+    uint32_t too_large;         // frames over the reassembler's max_frame_len
+} frame_chunk_stats_t;
+
+// A complete frame, the buffer is only valid during the call
+typedef void (*frame_chunk_frame_cb_t)(const uint8_t *frame, size_t len, uint32_t frame_id,
+                                       int64_t timestamp_us, void *ctx);
+
+typedef struct {
+    bool used;
+    uint32_t frame_id;
+    uint32_t frame_len;
+    uint16_t count;
+    uint16_t received;
+    uint32_t chunk_size;        // sender's chunk size, 0 until a chunk shows it
+    uint32_t bytes;             // chunk data received
+    int64_t timestamp_us;
+    uint8_t *buf;
+    uint8_t *seen;              // one bit per chunk index
+} frame_chunk_slot_t;
+
+typedef struct {
+    frame_chunk_slot_t *slots;  // frames being reassembled at the same time
+    size_t slot_count;
+    size_t max_frame_len;
+    bool delivered_any;
+    uint32_t last_delivered;    // frame id, chunks of this frame and older ones are late
+    frame_chunk_frame_cb_t on_frame;
+    void *ctx;
+    frame_chunk_stats_t stats;
+} frame_chunk_reassembler_t;
+
+bool frame_chunk_reassembler_init(frame_chunk_reassembler_t *r, size_t slot_count, size_t max_frame_len,
+                                  frame_chunk_frame_cb_t on_frame, void *ctx);
+
+void frame_chunk_reassembler_deinit(frame_chunk_reassembler_t *r);
+
+// Feeds one received chunk message, calls on_frame when it completes a frame.
+// Older frames that are still incomplete at that point are dropped. Chunks have to tile the
+// frame the way frame_chunk_send() cuts it, chunk i at i * chunk_size, others are malformed.
+void frame_chunk_reassembler_push(frame_chunk_reassembler_t *r, const uint8_t *msg, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "motion.h"
+
+void motion_detector_init(motion_detector_t *d, const motion_config_t *config) {
+    memset(d, 0, sizeof(*d));
+    d->config = *config;
+}
+
+void motion_detector_set_config(motion_detector_t *d, const motion_config_t *config) {
+    d->config = *config;
+}
+
+void motion_detector_reset(motion_detector_t *d) {
+    d->primed = false;
+    d->motion = false;
+    d->quiet = 0;
+}
+
+static bool masked(const motion_detector_t *d, uint16_t x, uint16_t y, uint16_t *col, uint16_t *row) {
+    *col = x * MOTION_GRID_COLS / d->width;
+    *row = y * MOTION_GRID_ROWS / d->height;
+    return d->config.mask[*row] & (1 << *col);
+}
+
+void motion_detector_update(motion_detector_t *d, const uint8_t *luma, uint16_t width, uint16_t height,
+                            motion_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    if (width > MOTION_MAX_WIDTH || height > MOTION_MAX_HEIGHT || !width || !height) {
+        return;
+    }
+    size_t pixels = (size_t)width * height;
+    if (!d->primed || width != d->width || height != d->height) {
+        for (size_t i = 0; i < pixels; i++) {
+            d->background[i] = luma[i] << 8;
+        }
+        d->width = width;
+        d->height = height;
+        d->primed = true;
+        d->motion = false;
+        d->quiet = 0;
+        return;
+    }
+
+    // Mean brightness change over the unmasked pixels, an exposure step moves all of them
+    int64_t diff_sum = 0;
+    uint32_t unmasked = 0;
+    uint16_t col, row;
+    for (uint16_t y = 0; y < height; y++) {
+        for (uint16_t x = 0; x < width; x++) {
+            if (!masked(d, x, y, &col, &row)) {
+                size_t i = (size_t)y * width + x;
+                diff_sum += (luma[i] << 8) - d->background[i];
+                unmasked++;
+            }
+        }
+    }
+    if (!unmasked) {
+        return;
+    }
+    int32_t shift = diff_sum / unmasked;
+    result->brightness_shift = shift >> 8;
+
+    // Cells count as changed from an eighth of their pixels on, single noisy pixels do not
+    uint16_t cell_changed[MOTION_GRID_ROWS][MOTION_GRID_COLS] = { 0 };
+    uint16_t cell_pixels[MOTION_GRID_ROWS][MOTION_GRID_COLS] = { 0 };
+    uint32_t changed = 0;
+    int32_t threshold = d->config.pixel_threshold << 8;
+    for (uint16_t y = 0; y < height; y++) {
+        for (uint16_t x = 0; x < width; x++) {
+            size_t i = (size_t)y * width + x;
+            int32_t diff = (luma[i] << 8) - d->background[i] - shift;
+            bool pixel_changed = abs(diff) > threshold;
+            if (!masked(d, x, y, &col, &row)) {
+                cell_pixels[row][col]++;
+                if (pixel_changed) {
+                    cell_changed[row][col]++;
+                    changed++;
+                }
+            }
+            // Changed pixels are learnt slower, so that a moving object does not become background at once
+            int learn = d->config.learn_shift + (pixel_changed ? 2 : 0);
+            d->background[i] += ((luma[i] << 8) - (int32_t)d->background[i]) >> learn;
+        }
+    }
+    for (row = 0; row < MOTION_GRID_ROWS; row++) {
+        for (col = 0; col < MOTION_GRID_COLS; col++) {
+            if (cell_pixels[row][col] && cell_changed[row][col] * 8 >= cell_pixels[row][col]) {
+                result->cells[row] |= 1 << col;
+            }
+        }
+    }
+    result->changed_permille = (uint64_t)changed * 1000 / unmasked;
+
+    if (result->changed_permille >= d->config.area_permille && d->config.area_permille) {
+        d->quiet = 0;
+        if (!d->motion) {
+            d->motion = true;
+            result->event = MOTION_EVENT_START;
+        }
+    } else if (d->motion && ++d->quiet > d->config.hold_frames) {
+        d->motion = false;
+        result->event = MOTION_EVENT_END;
+    }
+    result->motion = d->motion;
+}
+
+bool motion_should_send(const motion_config_t *config, const motion_result_t *result, int64_t now_us,
+                        int64_t *last_sent_us) {
+    // The frame that ends motion goes out too, it shows the scene settled
+    bool send = result->motion || result->event != MOTION_EVENT_NONE
+        || (config->keepalive_ms && now_us - *last_sent_us >= (int64_t)config->keepalive_ms * 1000);
+    if (send) {
+        *last_sent_us = now_us;
+    }
+    return send;
+}
+
+void motion_mask_to_hex(const uint16_t *cells, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    for (int row = 0; row < MOTION_GRID_ROWS; row++) {
+        for (int n = 0; n < 4; n++) {
+            *out++ = digits[(cells[row] >> (12 - 4 * n)) & 0xF];
+        }
+    }
+    *out = '\0';
+}
+
+bool motion_mask_from_hex(const char *hex, uint16_t *cells) {
+    size_t len = strlen(hex);
+    if (len != 0 && len != MOTION_MASK_HEX_LEN) {
+        return false;
+    }
+    uint16_t parsed[MOTION_GRID_ROWS] = { 0 };
+    for (size_t i = 0; i < len; i++) {
+        char c = hex[i];
+        int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+              : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (v < 0) {
+            return false;
+        }
+        parsed[i / 4] = (parsed[i / 4] << 4) | v;
+    }
+    memcpy(cells, parsed, sizeof(parsed));
+    return true;
+}
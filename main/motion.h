@@ -0,0 +1,97 @@
+#pragma once
+
+// Motion detection on small luma thumbnails of the camera frames.
+//
+// Each thumbnail is compared with a background model, a running average of the previous
+// thumbnails. A pixel has changed when it differs from the background by more than
+// pixel_threshold, after the mean brightness change of the whole frame is taken out so
+// that exposure steps do not count. There is motion when the changed share of the pixels
+// outside the mask reaches area_permille; it ends after hold_frames quiet frames.
+//
+// The mask and the changed cells of a result use the same grid of MOTION_GRID_COLS x
+// MOTION_GRID_ROWS cells over the frame, one bit per cell, bit 0 the left column.
+//
+// This file has no ESP-IDF dependencies, it is tested on the host.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOTION_MAX_WIDTH 80
+#define MOTION_MAX_HEIGHT 60
+#define MOTION_GRID_COLS 16
+#define MOTION_GRID_ROWS 12
+
+typedef struct {
+    uint8_t pixel_threshold;            // luma difference of a changed pixel
+    uint16_t area_permille;             // changed share of the unmasked pixels that is motion
+    uint8_t learn_shift;                // the background moves 1/2^learn_shift towards each frame
+    uint8_t hold_frames;                // quiet frames before motion ends
+    uint32_t keepalive_ms;              // without motion a frame still goes out this often, 0 never
+    uint16_t mask[MOTION_GRID_ROWS];    // cells left out of the detection
+} motion_config_t;
+
+#define MOTION_CONFIG_DEFAULT() { \
+    .pixel_threshold = 24, \
+    .area_permille = 15, \
+    .learn_shift = 4, \
+    .hold_frames = 5, \
+    .keepalive_ms = 30000, \
+    .mask = { 0 }, \
+}
+
+typedef enum {
+    MOTION_EVENT_NONE,
+    MOTION_EVENT_START,
+    MOTION_EVENT_END,
+} motion_event_t;
+
+typedef struct {
+    bool motion;                        // motion is going on, hold time included
+    motion_event_t event;               // motion started or ended with this frame
+    uint16_t changed_permille;          // changed share of the unmasked pixels
+    int16_t brightness_shift;           // mean luma change taken out before comparing
+    uint16_t cells[MOTION_GRID_ROWS];   // cells with changed pixels
+} motion_result_t;
+
+typedef struct {
+    motion_config_t config;
+    uint16_t width;
+    uint16_t height;
+    bool primed;                        // the background holds a frame of this size
+    bool motion;
+    uint8_t quiet;                      // frames without motion since it was last seen
+    uint16_t background[MOTION_MAX_WIDTH * MOTION_MAX_HEIGHT];  // luma << 8
+} motion_detector_t;
+
+void motion_detector_init(motion_detector_t *d, const motion_config_t *config);
+
+// Takes a new configuration, the background is kept
+void motion_detector_set_config(motion_detector_t *d, const motion_config_t *config);
+
+// Learns the background again from the next frame
+void motion_detector_reset(motion_detector_t *d);
+
+// Feeds the next thumbnail, width x height luma bytes, at most MOTION_MAX_WIDTH x MOTION_MAX_HEIGHT.
+// A thumbnail of another size than the previous one restarts the background.
+void motion_detector_update(motion_detector_t *d, const uint8_t *luma, uint16_t width, uint16_t height,
+                            motion_result_t *result);
+
+// Whether a stream sends the frame the result belongs to: while there is motion, and otherwise
+// every keepalive_ms. last_sent_us is the stream's own, updated when the frame is to be sent.
+bool motion_should_send(const motion_config_t *config, const motion_result_t *result, int64_t now_us,
+                        int64_t *last_sent_us);
+
+// Grid cells as hex, MOTION_GRID_ROWS groups of 4 digits from the top row, out holds
+// MOTION_MASK_HEX_LEN + 1 bytes. Parsing accepts an empty string for no cells.
+#define MOTION_MASK_HEX_LEN (MOTION_GRID_ROWS * 4)
+void motion_mask_to_hex(const uint16_t *cells, char *out);
+bool motion_mask_from_hex(const char *hex, uint16_t *cells);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,7 @@
+#include <stdlib.h>
+#include <string.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "settings.h"
 #include "status.h"
 #include "commands.h"
@@ -92,6 +95,64 @@ int mqtt_publish(char* topic, const char* payload) {
         payload, 0, 0, 0);
 }
 
+size_t mqtt_packet_size(const char* topic, size_t payload_len, int qos) {
+  // Topic with its length, the packet id from QoS 1 on, then the payload
+  size_t remaining = 2 + strlen(topic) + (qos ? 2 : 0) + payload_len;
+  size_t len_bytes = 1;
+  for (size_t n = remaining; n >= 128; n >>= 7) {
+    len_bytes++;
+  }
+  return 1 + len_bytes + remaining;
+}
+
+int mqtt_publish_segments(const char* topic, const mqtt_segment_t* segments, size_t count,
+                          int qos, mqtt_publish_stats_t* stats) {
+  size_t len = 0;
+  bool contiguous = true;
+  for (size_t i = 0; i < count; i++) {
+    if (i && (const uint8_t *)segments[i - 1].data + segments[i - 1].len != segments[i].data) {
+      contiguous = false;
+    }
+    len += segments[i].len;
+  }
+  if (mqtt_packet_size(topic, len, qos) > MQTT_MAX_PACKET_SIZE) {
+    stats->oversize++;
+    return -2;
+  }
+
+  const char *payload = count ? segments[0].data : "";
+  char *gathered = NULL;
+  int64_t start = esp_timer_get_time();
+  if (!contiguous) {
+    gathered = malloc(len);
+    if (!gathered) {
+      stats->failed++;
+      return -1;
+    }
+    for (size_t i = 0, pos = 0; i < count; pos += segments[i].len, i++) {
+      memcpy(gathered + pos, segments[i].data, segments[i].len);
+    }
+    payload = gathered;
+    stats->copied++;
+  }
+  int64_t copied = esp_timer_get_time();
+  int msg_id = esp_mqtt_client_publish(mqtt_client, topic, payload, len, qos, 0);
+  int64_t published = esp_timer_get_time();
+  free(gathered);
+
+  stats->last_copy_us = copied - start;
+  stats->last_publish_us = published - copied;
+  stats->total_copy_us += stats->last_copy_us;
+  stats->total_publish_us += stats->last_publish_us;
+  if (msg_id < 0) {
+    stats->failed++;
+    return -1;
+  }
+  stats->messages++;
+  stats->bytes += len;
+  return msg_id;
+}
+
 void mqtt_start(void) {
   const esp_mqtt_client_config_t mqtt_cfg = {
       .broker.address.uri = settings.mqtt_url,
@@ -1,12 +1,44 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
+#include <stdint.h>
 #include "mqtt_client.h"
 
+// Largest PUBLISH packet sent. AWS IoT disconnects on payloads over 128 KB, the stricter of the
+// brokers in use; raise it to the mosquitto message_size_limit on a broker of your own.
+#define MQTT_MAX_PACKET_SIZE (128*1024)
+
+// One part of a message payload
+typedef struct {
+    const void *data;
+    size_t len;
+} mqtt_segment_t;
+
+typedef struct {
+    uint32_t messages;          // published
+    uint32_t oversize;          // dropped, the packet would exceed MQTT_MAX_PACKET_SIZE
+    uint32_t failed;            // rejected by the client
+    uint32_t copied;            // segments were not contiguous and had to be copied
+    uint64_t bytes;             // payload bytes published
+    uint32_t last_copy_us;      // time spent copying the last message, 0 when sent in place
+    uint32_t last_publish_us;   // time spent in esp_mqtt_client_publish for the last message
+    uint64_t total_copy_us;
+    uint64_t total_publish_us;
+} mqtt_publish_stats_t;
+
 void mqtt_start(void);
 int mqtt_publish(char* topic, const char* payload);
 esp_mqtt_client_handle_t get_mqtt_client();
 
+// Size of the PUBLISH packet carrying payload_len bytes on topic
+size_t mqtt_packet_size(const char* topic, size_t payload_len, int qos);
+
+// Publishes the segments as one message. Segments that follow each other in memory are
+// sent in place, others are gathered into a temporary buffer. Returns the message id,
+// -1 on failure and -2 when the packet would exceed MQTT_MAX_PACKET_SIZE.
+int mqtt_publish_segments(const char* topic, const mqtt_segment_t* segments, size_t count,
+                          int qos, mqtt_publish_stats_t* stats);
+
 #ifdef __cplusplus
 }
 #endif
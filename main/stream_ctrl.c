@@ -0,0 +1,100 @@
+#include <string.h>
+
+#include "stream_ctrl.h"
+
+void stream_ctrl_init(stream_ctrl_t *c, const stream_ctrl_config_t *config) {
+    memset(c, 0, sizeof(*c));
+    c->config = *config;
+    c->probe_ms = config->probe_ms;
+}
+
+static uint32_t level_rate(const stream_ctrl_level_t *level) {
+    return level->fps * level->frame_budget;
+}
+
+// Updates the link rate and the delay, returns whether the link was the bottleneck
+static bool measure(stream_ctrl_t *c, const stream_ctrl_sample_t *s) {
+    bool first = !c->last_us;
+    bool saturated = false;
+    int64_t elapsed = s->now_us - c->last_us;
+    // The link rate is only seen while it is the bottleneck: the publish blocked most of the time
+    if (!first && elapsed > 0 && s->publish_us > elapsed / 2) {
+        uint32_t measured = (s->sent_bytes - c->last_sent) * 1000000 / elapsed;
+        // Nothing moved at all is a stall, not a rate
+        if (measured) {
+            c->rate = c->rate ? ((uint64_t)c->rate * 3 + measured) / 4 : measured;
+            saturated = true;
+        }
+    }
+    c->last_us = s->now_us;
+    c->last_sent = s->sent_bytes;
+
+    uint32_t delay = s->publish_us;
+    c->delay_us = first ? delay : ((uint64_t)c->delay_us * 3 + delay) / 4;
+    return saturated;
+}
+
+// Level to step down to: the best one the link carries with room to drain the queue
+static size_t step_down(const stream_ctrl_t *c) {
+    size_t last = c->config.level_count - 1;
+    uint32_t target_us = c->config.target_delay_ms * 1000;
+    if (!c->rate) {
+        size_t steps = c->delay_us > 4 * target_us ? 2 : 1;
+        return c->level + steps < last ? c->level + steps : last;
+    }
+    size_t level = c->level + 1;
+    while (level < last && level_rate(&c->config.levels[level]) > c->rate / 4 * 3) {
+        level++;
+    }
+    return level;
+}
+
+bool stream_ctrl_update(stream_ctrl_t *c, const stream_ctrl_sample_t *s) {
+    bool saturated = measure(c, s);
+
+    size_t level = c->level;
+    uint32_t target_us = c->config.target_delay_ms * 1000;
+    bool cooled = s->now_us - c->changed_us >= (int64_t)c->config.cooldown_ms * 1000;
+
+    if (c->probing && s->now_us - c->changed_us >= (int64_t)c->config.probe_ms * 1000) {
+        // The better level held up, probe again at the normal pace
+        c->probing = false;
+        c->probe_ms = c->config.probe_ms;
+    }
+
+    // A saturated link that carries clearly less than the level produces is overloaded before
+    // the delay reaches the target
+    bool overloaded = saturated && c->delay_us > target_us / 2
+                      && c->rate < level_rate(stream_ctrl_level(c)) / 4 * 3;
+
+    if (c->delay_us > target_us || overloaded) {
+        c->good_since_us = 0;
+        if (cooled && c->level + 1 < c->config.level_count) {
+            if (c->probing) {
+                c->stats.failed_probes++;
+                c->probe_ms = c->probe_ms * 2 < c->config.max_probe_ms ? c->probe_ms * 2 : c->config.max_probe_ms;
+                c->probing = false;
+            }
+            c->level = step_down(c);
+            c->stats.steps_down++;
+        }
+    } else if (c->delay_us < target_us / 2) {
+        if (!c->good_since_us) {
+            c->good_since_us = s->now_us;
+        } else if (c->level && cooled && s->now_us - c->good_since_us >= (int64_t)c->probe_ms * 1000
+                   && !(s->rssi && s->rssi < c->config.weak_rssi)) {
+            c->level--;
+            c->stats.steps_up++;
+            c->probing = true;
+            c->good_since_us = 0;
+        }
+    } else {
+        c->good_since_us = 0;
+    }
+
+    if (level != c->level) {
+        c->changed_us = s->now_us;
+        return true;
+    }
+    return false;
+}
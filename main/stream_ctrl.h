@@ -0,0 +1,93 @@
+#pragma once
+
+// Adaptive camera stream controller: keeps the queueing delay of the MQTT stream under a
+// target by moving along a ladder of stream levels, each a frame size, a frame rate and a
+// JPEG byte budget per frame that the quality is steered towards.
+//
+// After every published frame the caller reports how long the publish took and the total sent
+// so far. QoS 0 publishes write to the socket before they return and nothing waits in the client
+// outbox, so a slow link shows up as publish time: the queueing delay is the time the publish
+// held the stream task up, newer frames are skipped by the broker meanwhile. Over the target, or
+// on a saturated link that carries clearly less than the level produces, the stream steps down
+// to the best level that fits the link rate (one or two levels while the rate is not known
+// yet), then waits cooldown_ms before the next step. With the delay under half the target for
+// probe_ms it tries the next better level; a probe that has to step down again doubles probe_ms,
+// up to max_probe_ms. Below weak_rssi the stream does not step up, the link is expected to get
+// worse.
+//
+// This file has no ESP-IDF dependencies, the host simulator runs it against a throttled socket.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int framesize;              // framesize_t on the device
+    uint8_t fps;
+    uint32_t frame_budget;      // JPEG bytes per frame
+} stream_ctrl_level_t;
+
+typedef struct {
+    const stream_ctrl_level_t *levels;  // best first
+    size_t level_count;
+    uint32_t target_delay_ms;
+    uint32_t cooldown_ms;
+    uint32_t probe_ms;
+    uint32_t max_probe_ms;
+    int8_t weak_rssi;                   // dBm
+} stream_ctrl_config_t;
+
+#define STREAM_CTRL_CONFIG_DEFAULT(lv, count) { \
+    .levels = (lv), \
+    .level_count = (count), \
+    .target_delay_ms = 1000, \
+    .cooldown_ms = 2000, \
+    .probe_ms = 10000, \
+    .max_probe_ms = 80000, \
+    .weak_rssi = -80, \
+}
+
+typedef struct {
+    int64_t now_us;
+    uint32_t publish_us;        // time the frame took to be written to the link
+    uint32_t frame_bytes;
+    uint64_t sent_bytes;        // total written to the link so far
+    int8_t rssi;                // dBm, 0 when unknown
+} stream_ctrl_sample_t;
+
+typedef struct {
+    uint32_t steps_down;
+    uint32_t steps_up;
+    uint32_t failed_probes;
+} stream_ctrl_stats_t;
+
+typedef struct {
+    stream_ctrl_config_t config;
+    size_t level;
+    uint32_t delay_us;          // smoothed queueing delay
+    uint32_t rate;              // link bytes per second, measured while the publish blocked
+    uint32_t probe_ms;
+    int64_t changed_us;         // last level change
+    int64_t good_since_us;      // delay under half the target since, 0 when it is not
+    bool probing;               // the last change was a step up, not yet confirmed
+    int64_t last_us;
+    uint64_t last_sent;
+    stream_ctrl_stats_t stats;
+} stream_ctrl_t;
+
+void stream_ctrl_init(stream_ctrl_t *c, const stream_ctrl_config_t *config);
+
+// Feeds the sample of a published frame, returns true when the level changed
+bool stream_ctrl_update(stream_ctrl_t *c, const stream_ctrl_sample_t *sample);
+
+static inline const stream_ctrl_level_t *stream_ctrl_level(const stream_ctrl_t *c) {
+    return &c->config.levels[c->level];
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "broker_stub.h"
+
+typedef struct {
+    char filter[128];
+    broker_stub_cb_t cb;
+    void *ctx;
+} sub_t;
+
+typedef struct {
+    char topic[128];
+    uint8_t *data;
+    size_t len;
+} held_t;
+
+broker_stub_stats_t broker_stub_stats;
+static sub_t subs[BROKER_STUB_MAX_SUBS];
+static size_t sub_count;
+static broker_stub_fault_cb_t fault_cb;
+static void *fault_ctx;
+static held_t held;
+
+void broker_stub_reset(void) {
+    free(held.data);
+    memset(&held, 0, sizeof(held));
+    memset(&broker_stub_stats, 0, sizeof(broker_stub_stats));
+    sub_count = 0;
+    fault_cb = NULL;
+}
+
+bool broker_stub_subscribe(const char *filter, broker_stub_cb_t cb, void *ctx) {
+    if (sub_count == BROKER_STUB_MAX_SUBS || strlen(filter) >= sizeof(subs[0].filter)) {
+        return false;
+    }
+    strcpy(subs[sub_count].filter, filter);
+    subs[sub_count].cb = cb;
+    subs[sub_count].ctx = ctx;
+    sub_count++;
+    return true;
+}
+
+void broker_stub_set_fault(broker_stub_fault_cb_t fault, void *ctx) {
+    fault_cb = fault;
+    fault_ctx = ctx;
+}
+
+bool broker_stub_topic_matches(const char *filter, const char *topic) {
+    while (*filter) {
+        if (filter[0] == '#') {
+            return true;
+        }
+        if (filter[0] == '+') {
+            while (*topic && *topic != '/') {
+                topic++;
+            }
+            filter++;
+            continue;
+        }
+        if (*filter != *topic) {
+            return false;
+        }
+        filter++;
+        topic++;
+    }
+    return !*topic;
+}
+
+static void deliver(const char *topic, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < sub_count; i++) {
+        if (broker_stub_topic_matches(subs[i].filter, topic)) {
+            subs[i].cb(topic, data, len, subs[i].ctx);
+            broker_stub_stats.delivered++;
+        }
+    }
+}
+
+void broker_stub_publish(const char *topic, const uint8_t *data, size_t len) {
+    broker_stub_fault_t fault = fault_cb ? fault_cb(broker_stub_stats.published, topic, fault_ctx) : BROKER_STUB_DELIVER;
+    broker_stub_stats.published++;
+    if (len > broker_stub_stats.max_len) {
+        broker_stub_stats.max_len = len;
+    }
+    // The broker keeps its own copy, publishers may reuse their buffer right away
+    held_t prev = held;
+    memset(&held, 0, sizeof(held));
+    switch (fault) {
+        case BROKER_STUB_DROP:
+            break;
+        case BROKER_STUB_DUPLICATE:
+            deliver(topic, data, len);
+            deliver(topic, data, len);
+            break;
+        case BROKER_STUB_DELAY:
+            strncpy(held.topic, topic, sizeof(held.topic) - 1);
+            held.data = malloc(len ? len : 1);
+            memcpy(held.data, data, len);
+            held.len = len;
+            break;
+        default:
+            deliver(topic, data, len);
+            break;
+    }
+    if (prev.data) {
+        deliver(prev.topic, prev.data, prev.len);
+        free(prev.data);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// In-process stand-in for an MQTT broker, for host tests of the message formats.
+//
+// Messages are delivered synchronously to every subscription whose filter matches the
+// topic, '+' and '#' wildcards included. Faults a lossy path can introduce are injected
+// per message: drop, duplicate, or hold back and deliver after the next message.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BROKER_STUB_MAX_SUBS 8
+
+typedef void (*broker_stub_cb_t)(const char *topic, const uint8_t *data, size_t len, void *ctx);
+
+typedef enum {
+    BROKER_STUB_DELIVER = 0,
+    BROKER_STUB_DROP,
+    BROKER_STUB_DUPLICATE,
+    BROKER_STUB_DELAY,          // delivered after the next message
+} broker_stub_fault_t;
+
+// Decides the fate of the n-th published message, NULL delivers everything
+typedef broker_stub_fault_t (*broker_stub_fault_cb_t)(uint32_t n, const char *topic, void *ctx);
+
+typedef struct {
+    uint32_t published;
+    uint32_t delivered;
+    size_t max_len;             // largest message published
+} broker_stub_stats_t;
+
+extern broker_stub_stats_t broker_stub_stats;
+
+void broker_stub_reset(void);
+bool broker_stub_subscribe(const char *filter, broker_stub_cb_t cb, void *ctx);
+void broker_stub_set_fault(broker_stub_fault_cb_t fault, void *ctx);
+void broker_stub_publish(const char *topic, const uint8_t *data, size_t len);
+bool broker_stub_topic_matches(const char *filter, const char *topic);
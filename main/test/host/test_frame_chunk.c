@@ -0,0 +1,288 @@
+// Chunked frame transport: frames are split with frame_chunk_send(), go through the broker
+// stand-in together with telemetry and are put back together by the reassembler.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_chunk.h"
+#include "broker_stub.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); return 1; } } while (0)
+
+#define FRAMES_TOPIC "iot/dc1/dev1/camera/frames"
+#define TELEMETRY_TOPIC "iot/dc1/dev1/readings"
+#define CHUNK_SIZE 4096
+#define MAX_FRAME (200 * 1024)
+#define FRAME_COUNT 24
+
+typedef struct {
+    uint8_t *data[FRAME_COUNT];
+    size_t len[FRAME_COUNT];
+    int64_t timestamp_us[FRAME_COUNT];
+} frames_t;
+
+typedef struct {
+    const frames_t *sent;
+    uint32_t received;
+    uint32_t bad;
+    uint32_t last_id;
+    uint32_t telemetry;
+    uint32_t telemetry_inside_frame;    // telemetry delivered while a frame was partly received
+    uint32_t chunks_since_frame;
+} receiver_t;
+
+static frame_chunk_reassembler_t reassembler;
+
+static void on_frame(const uint8_t *frame, size_t len, uint32_t frame_id, int64_t timestamp_us, void *ctx) {
+    receiver_t *rx = ctx;
+    const frames_t *sent = rx->sent;
+    if (frame_id >= FRAME_COUNT || len != sent->len[frame_id] || timestamp_us != sent->timestamp_us[frame_id]
+        || memcmp(frame, sent->data[frame_id], len) != 0) {
+        rx->bad++;
+    }
+    rx->received++;
+    rx->last_id = frame_id;
+    rx->chunks_since_frame = 0;
+}
+
+static void on_message(const char *topic, const uint8_t *data, size_t len, void *ctx) {
+    receiver_t *rx = ctx;
+    if (strcmp(topic, FRAMES_TOPIC) == 0) {
+        rx->chunks_since_frame++;
+        frame_chunk_reassembler_push(&reassembler, data, len);
+    } else {
+        rx->telemetry++;
+        if (rx->chunks_since_frame) {
+            rx->telemetry_inside_frame++;
+        }
+    }
+}
+
+// The streaming task publishes one chunk at a time, a sensor task gets its readings out in between
+static int publish_chunk(const uint8_t *msg, size_t len, void *ctx) {
+    uint32_t *chunks = ctx;
+    broker_stub_publish(FRAMES_TOPIC, msg, len);
+    if (++*chunks % 3 == 0) {
+        const char reading[] = "{\"sensor_type\":\"temp\",\"value\":21.5}";
+        broker_stub_publish(TELEMETRY_TOPIC, (const uint8_t *)reading, sizeof(reading) - 1);
+    }
+    return 0;
+}
+
+static void make_frames(frames_t *f) {
+    srand(1);
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        // Sizes around and on chunk boundaries, an empty frame and one over the receiver's limit
+        size_t len = 1000 + rand() % (60 * 1024);
+        if (i == 3) {
+            len = 4 * CHUNK_SIZE;
+        } else if (i == 4) {
+            len = CHUNK_SIZE + 1;
+        } else if (i == 5) {
+            len = 0;
+        } else if (i == 6) {
+            len = MAX_FRAME + 1;
+        }
+        f->len[i] = len;
+        f->data[i] = malloc(len ? len : 1);
+        for (size_t n = 0; n < len; n++) {
+            f->data[i][n] = rand();
+        }
+        f->timestamp_us[i] = 1700000000000000LL + i * 200000;
+    }
+}
+
+static int send_frames(const frames_t *f, receiver_t *rx, broker_stub_fault_cb_t fault) {
+    uint8_t chunk_buf[FRAME_CHUNK_HEADER_SIZE + CHUNK_SIZE];
+    uint32_t chunks = 0;
+    memset(rx, 0, sizeof(*rx));
+    rx->sent = f;
+    broker_stub_reset();
+    broker_stub_set_fault(fault, NULL);
+    CHECK(broker_stub_subscribe("iot/dc1/+/camera/frames", on_message, rx));
+    CHECK(broker_stub_subscribe("iot/dc1/dev1/readings", on_message, rx));
+    frame_chunk_reassembler_deinit(&reassembler);
+    CHECK(frame_chunk_reassembler_init(&reassembler, 2, MAX_FRAME, on_frame, rx));
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        int n = frame_chunk_send(f->data[i], f->len[i], i, f->timestamp_us[i], CHUNK_SIZE, chunk_buf, publish_chunk, &chunks);
+        CHECK(n == (int)frame_chunk_count(f->len[i], CHUNK_SIZE));
+    }
+    return 0;
+}
+
+static int test_header(void) {
+    uint8_t msg[FRAME_CHUNK_HEADER_SIZE + 4] = { 0 };
+    frame_chunk_header_t in = {
+        .frame_id = 0x01020304, .index = 2, .count = 3, .offset = 8, .frame_len = 12, .timestamp_us = -5,
+    };
+    frame_chunk_header_t out;
+    frame_chunk_header_write(&in, msg);
+    CHECK(msg[0] == FRAME_CHUNK_MAGIC && msg[4] == 0x01 && msg[7] == 0x04);
+    CHECK(frame_chunk_header_read(msg, sizeof(msg), &out));
+    CHECK(out.frame_id == in.frame_id && out.index == 2 && out.count == 3 && out.offset == 8);
+    CHECK(out.frame_len == 12 && out.timestamp_us == -5 && out.data_len == 4);
+
+    // Data past the end of the frame, index past the count, truncated, unknown version
+    in.offset = 9;
+    frame_chunk_header_write(&in, msg);
+    CHECK(!frame_chunk_header_read(msg, sizeof(msg), &out));
+    in.offset = 8;
+    in.index = 3;
+    frame_chunk_header_write(&in, msg);
+    CHECK(!frame_chunk_header_read(msg, sizeof(msg), &out));
+    in.index = 2;
+    frame_chunk_header_write(&in, msg);
+    CHECK(!frame_chunk_header_read(msg, FRAME_CHUNK_HEADER_SIZE - 1, &out));
+    msg[1] = FRAME_CHUNK_VERSION + 1;
+    CHECK(!frame_chunk_header_read(msg, sizeof(msg), &out));
+
+    CHECK(frame_chunk_count(0, CHUNK_SIZE) == 1);
+    CHECK(frame_chunk_count(CHUNK_SIZE, CHUNK_SIZE) == 1);
+    CHECK(frame_chunk_count(CHUNK_SIZE + 1, CHUNK_SIZE) == 2);
+    printf("header                  OK\n");
+    return 0;
+}
+
+static int test_clean(const frames_t *f) {
+    receiver_t rx;
+    if (send_frames(f, &rx, NULL)) {
+        return 1;
+    }
+    CHECK(rx.bad == 0);
+    CHECK(rx.received == FRAME_COUNT - 1);
+    CHECK(reassembler.stats.too_large == 1);
+    CHECK(reassembler.stats.dropped == 0 && reassembler.stats.malformed == 0);
+    CHECK(rx.telemetry_inside_frame > 0);
+    // Messages never grow with the frame
+    CHECK(broker_stub_stats.max_len <= FRAME_CHUNK_HEADER_SIZE + CHUNK_SIZE);
+    printf("clean                   %u frames, %u chunks, %u readings in between, largest message %zu bytes\n",
+           rx.received, reassembler.stats.chunks, rx.telemetry_inside_frame, broker_stub_stats.max_len);
+    return 0;
+}
+
+static broker_stub_fault_t reorder_and_duplicate(uint32_t n, const char *topic, void *ctx) {
+    if (strcmp(topic, FRAMES_TOPIC) != 0) {
+        return BROKER_STUB_DELIVER;
+    }
+    return n % 5 == 1 ? BROKER_STUB_DELAY : n % 7 == 2 ? BROKER_STUB_DUPLICATE : BROKER_STUB_DELIVER;
+}
+
+static int test_reorder(const frames_t *f) {
+    receiver_t rx;
+    if (send_frames(f, &rx, reorder_and_duplicate)) {
+        return 1;
+    }
+    CHECK(rx.bad == 0);
+    CHECK(rx.received + reassembler.stats.dropped == FRAME_COUNT - 1);
+    CHECK(reassembler.stats.duplicates > 0);
+    printf("reordered, duplicated   %u frames, %u dropped, %u duplicates, %u late\n",
+           rx.received, reassembler.stats.dropped, reassembler.stats.duplicates, reassembler.stats.late);
+    return 0;
+}
+
+static uint32_t drop_at;
+
+static broker_stub_fault_t drop_one(uint32_t n, const char *topic, void *ctx) {
+    return n == drop_at ? BROKER_STUB_DROP : BROKER_STUB_DELIVER;
+}
+
+static int test_loss(const frames_t *f) {
+    receiver_t rx;
+    // One chunk goes missing, only its frame is lost
+    drop_at = 2;
+    if (send_frames(f, &rx, drop_one)) {
+        return 1;
+    }
+    CHECK(rx.bad == 0);
+    CHECK(reassembler.stats.dropped == 1);
+    CHECK(rx.received == FRAME_COUNT - 2);
+    printf("one chunk lost          %u frames, %u dropped\n", rx.received, reassembler.stats.dropped);
+    return 0;
+}
+
+static int test_malformed(void) {
+    receiver_t rx = { 0 };
+    frames_t none = { 0 };
+    rx.sent = &none;
+    frame_chunk_reassembler_deinit(&reassembler);
+    CHECK(frame_chunk_reassembler_init(&reassembler, 2, MAX_FRAME, on_frame, &rx));
+
+    const uint8_t jpeg[] = { 0xFF, 0xD8, 0xFF, 0xE0 };
+    frame_chunk_reassembler_push(&reassembler, jpeg, sizeof(jpeg));
+    uint8_t msg[FRAME_CHUNK_HEADER_SIZE + 8] = { 0 };
+    frame_chunk_header_t h = { .frame_id = 1, .index = 0, .count = 2, .offset = 0, .frame_len = 16, .timestamp_us = 1 };
+    frame_chunk_header_write(&h, msg);
+    frame_chunk_reassembler_push(&reassembler, msg, sizeof(msg));
+    // Second chunk claims another frame length for the same frame id
+    h.index = 1;
+    h.offset = 8;
+    h.frame_len = 17;
+    frame_chunk_header_write(&h, msg);
+    frame_chunk_reassembler_push(&reassembler, msg, sizeof(msg));
+    CHECK(reassembler.stats.malformed == 2);
+    CHECK(rx.received == 0);
+    printf("malformed               OK\n");
+    return 0;
+}
+
+static void push_chunk(uint32_t frame_id, uint16_t index, uint16_t count, uint32_t offset, uint32_t frame_len,
+                       size_t data_len) {
+    uint8_t msg[FRAME_CHUNK_HEADER_SIZE + 16] = { 0 };
+    frame_chunk_header_t h = {
+        .frame_id = frame_id, .index = index, .count = count, .offset = offset, .frame_len = frame_len, .timestamp_us = 1,
+    };
+    frame_chunk_header_write(&h, msg);
+    frame_chunk_reassembler_push(&reassembler, msg, FRAME_CHUNK_HEADER_SIZE + data_len);
+}
+
+static int test_coverage(void) {
+    receiver_t rx = { 0 };
+    frames_t none = { 0 };
+    rx.sent = &none;
+    frame_chunk_reassembler_deinit(&reassembler);
+    CHECK(frame_chunk_reassembler_init(&reassembler, 2, MAX_FRAME, on_frame, &rx));
+
+    // Every chunk passes the header checks, but they overlap and leave 12..16 uncovered
+    push_chunk(1, 0, 2, 0, 16, 8);
+    push_chunk(1, 1, 2, 4, 16, 8);
+    CHECK(reassembler.stats.malformed == 1);
+    // Chunk sizes that do not agree, the first chunk arriving last
+    push_chunk(2, 1, 2, 8, 16, 8);
+    push_chunk(2, 0, 2, 0, 16, 4);
+    CHECK(reassembler.stats.malformed == 2);
+    // A chunk not at index * chunk_size and a last chunk that does not end the frame
+    push_chunk(3, 0, 3, 0, 20, 8);
+    push_chunk(3, 1, 3, 7, 20, 8);
+    push_chunk(3, 2, 3, 14, 20, 4);
+    CHECK(reassembler.stats.malformed == 4);
+    CHECK(rx.received == 0);
+
+    // Tiled the way frame_chunk_send() cuts it, in any order
+    push_chunk(4, 2, 3, 16, 20, 4);
+    push_chunk(4, 0, 3, 0, 20, 8);
+    push_chunk(4, 1, 3, 8, 20, 8);
+    CHECK(rx.received == 1 && rx.last_id == 4);
+    CHECK(reassembler.stats.malformed == 4);
+    printf("coverage                OK\n");
+    return 0;
+}
+
+int main(void) {
+    static frames_t frames;
+    int fail = 0;
+    make_frames(&frames);
+    fail |= test_header();
+    fail |= test_clean(&frames);
+    fail |= test_reorder(&frames);
+    fail |= test_loss(&frames);
+    fail |= test_malformed();
+    fail |= test_coverage();
+    frame_chunk_reassembler_deinit(&reassembler);
+    broker_stub_reset();
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        free(frames.data[i]);
+    }
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
@@ -0,0 +1,332 @@
+// Motion detector on frame sequences. Without arguments it runs scenes with the disturbances
+// a fixed camera sees: sensor noise, exposure steps, slow light changes, a flickering screen
+// that is masked out and objects walking through. The thumbnails are what camera_motion.c
+// feeds the detector: 80x60 luma, a VGA frame decoded at 1/8 scale.
+//
+// With arguments it replays a recorded sequence of binary PGM (P5) files, one per frame,
+// and prints the decision for each:
+//     ./test_motion frames/*.pgm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "motion.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); return 1; } } while (0)
+
+#define W MOTION_MAX_WIDTH
+#define H MOTION_MAX_HEIGHT
+#define FRAME_US 200000     // 5 fps, the MQTT stream rate
+
+typedef struct {
+    uint32_t frames;
+    uint32_t sent;
+    uint32_t starts;
+    uint32_t ends;
+    int first_start;        // frame index, -1 when there was none
+    int last_end;
+    uint16_t max_changed;
+} scene_stats_t;
+
+static uint32_t rng = 1;
+
+static int noise(int amplitude) {
+    rng = rng * 1103515245 + 12345;
+    return (int)((rng >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+static uint8_t clamp(int v) {
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+// Textured background: a gradient with some edges, like a room
+static void scene_background(uint8_t *out) {
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            int v = 60 + x + y / 2;
+            if ((x / 10 + y / 15) % 3 == 0) {
+                v += 40;
+            }
+            out[y * W + x] = clamp(v);
+        }
+    }
+}
+
+static void draw_box(uint8_t *frame, int x0, int y0, int w, int h, int value) {
+    for (int y = y0; y < y0 + h; y++) {
+        for (int x = x0; x < x0 + w; x++) {
+            if (x >= 0 && x < W && y >= 0 && y < H) {
+                frame[y * W + x] = clamp(value + noise(4));
+            }
+        }
+    }
+}
+
+typedef void (*scene_frame_t)(int i, uint8_t *frame, const uint8_t *background);
+
+static void run_scene(const motion_config_t *config, int count, scene_frame_t make, scene_stats_t *stats) {
+    static motion_detector_t d;
+    uint8_t background[W * H], frame[W * H];
+    motion_result_t r;
+    int64_t last_sent_us = 0;
+
+    rng = 1;
+    scene_background(background);
+    motion_detector_init(&d, config);
+    memset(stats, 0, sizeof(*stats));
+    stats->first_start = stats->last_end = -1;
+    for (int i = 0; i < count; i++) {
+        make(i, frame, background);
+        motion_detector_update(&d, frame, W, H, &r);
+        stats->frames++;
+        // Camera time starts late enough for the first frame to be a keepalive
+        if (motion_should_send(config, &r, (int64_t)config->keepalive_ms * 1000 + (int64_t)i * FRAME_US, &last_sent_us)) {
+            stats->sent++;
+        }
+        if (r.event == MOTION_EVENT_START) {
+            stats->starts++;
+            if (stats->first_start < 0) {
+                stats->first_start = i;
+            }
+        } else if (r.event == MOTION_EVENT_END) {
+            stats->ends++;
+            stats->last_end = i;
+        }
+        if (r.changed_permille > stats->max_changed) {
+            stats->max_changed = r.changed_permille;
+        }
+    }
+}
+
+static void print_scene(const char *name, const scene_stats_t *s) {
+    printf("%-26s %4u frames %4u sent %2u starts  first %4d  last end %4d  max changed %5.1f%%\n", name,
+           s->frames, s->sent, s->starts, s->first_start, s->last_end, s->max_changed / 10.0);
+}
+
+static void static_scene(int i, uint8_t *frame, const uint8_t *background) {
+    for (int p = 0; p < W * H; p++) {
+        frame[p] = clamp(background[p] + noise(6));
+    }
+}
+
+// Auto exposure settles a step brighter, then darker
+static void exposure_steps(int i, uint8_t *frame, const uint8_t *background) {
+    int gain = i < 100 ? 0 : i < 200 ? 35 : -25;
+    for (int p = 0; p < W * H; p++) {
+        frame[p] = clamp(background[p] + gain + noise(6));
+    }
+}
+
+// Daylight fading over a minute
+static void light_drift(int i, uint8_t *frame, const uint8_t *background) {
+    for (int p = 0; p < W * H; p++) {
+        frame[p] = clamp(background[p] - i / 4 + noise(6));
+    }
+}
+
+// A person crosses the room from frame 100 to 160, then another one from 300 on
+static void walkers(int i, uint8_t *frame, const uint8_t *background) {
+    static_scene(i, frame, background);
+    if (i >= 100 && i < 160) {
+        draw_box(frame, -12 + (i - 100) * 92 / 60, 15, 12, 30, 20);
+    }
+    if (i >= 300 && i < 340) {
+        draw_box(frame, W - (i - 300) * 2, 20, 8, 24, 230);
+    }
+}
+
+// A monitor in the top right corner flickers all the time
+static void flicker(int i, uint8_t *frame, const uint8_t *background) {
+    static_scene(i, frame, background);
+    draw_box(frame, 60, 0, 20, 15, i % 3 ? 40 : 220);
+}
+
+// The person walks through the flickering scene
+static void flicker_walker(int i, uint8_t *frame, const uint8_t *background) {
+    flicker(i, frame, background);
+    if (i >= 100 && i < 160) {
+        draw_box(frame, -12 + (i - 100) * 92 / 60, 15, 12, 30, 20);
+    }
+}
+
+static int test_scenes(void) {
+    motion_config_t config = MOTION_CONFIG_DEFAULT();
+    scene_stats_t s;
+    const int count = 500;      // 100 s
+    // Keepalives at 5 fps over 100 s with a 30 s interval
+    const uint32_t keepalives = 4;
+
+    printf("keepalive %lu s, pixel threshold %u, area %u.%u%%\n", (unsigned long)config.keepalive_ms / 1000,
+           config.pixel_threshold, config.area_permille / 10, config.area_permille % 10);
+
+    run_scene(&config, count, static_scene, &s);
+    print_scene("static", &s);
+    CHECK(s.starts == 0 && s.sent == keepalives);
+
+    run_scene(&config, count, exposure_steps, &s);
+    print_scene("exposure steps", &s);
+    CHECK(s.starts == 0 && s.sent == keepalives);
+
+    run_scene(&config, count, light_drift, &s);
+    print_scene("light drift", &s);
+    CHECK(s.starts == 0 && s.sent == keepalives);
+
+    run_scene(&config, count, walkers, &s);
+    print_scene("two walkers", &s);
+    CHECK(s.starts == 2 && s.ends == 2);
+    CHECK(s.first_start >= 100 && s.first_start <= 102);
+    CHECK(s.last_end >= 340 && s.last_end <= 340 + config.hold_frames + 2);
+    // Both walks and the hold time after them, plus the keepalives before and in between
+    CHECK(s.sent >= 60 + 40 && s.sent <= 60 + 40 + 2 * (config.hold_frames + 2) + keepalives + 2);
+
+    run_scene(&config, count, flicker, &s);
+    print_scene("flicker, no mask", &s);
+    CHECK(s.starts >= 1 && s.sent > count / 2);
+
+    // Cells covering x 60..79, y 0..14: columns 12..15 of rows 0..2
+    CHECK(motion_mask_from_hex("f000f000f000000000000000000000000000000000000000", config.mask));
+    run_scene(&config, count, flicker, &s);
+    print_scene("flicker, masked", &s);
+    CHECK(s.starts == 0 && s.sent == keepalives);
+
+    run_scene(&config, count, flicker_walker, &s);
+    print_scene("flicker masked, walker", &s);
+    CHECK(s.starts == 1 && s.first_start >= 100 && s.first_start <= 102);
+
+    // Without keepalive a static scene sends nothing
+    config = (motion_config_t)MOTION_CONFIG_DEFAULT();
+    config.keepalive_ms = 0;
+    run_scene(&config, count, static_scene, &s);
+    CHECK(s.sent == 0);
+    return 0;
+}
+
+static int test_detector(void) {
+    static motion_detector_t d;
+    motion_config_t config = MOTION_CONFIG_DEFAULT();
+    static uint8_t frame[W * H];
+    motion_result_t r;
+    char hex[MOTION_MASK_HEX_LEN + 1];
+    uint16_t cells[MOTION_GRID_ROWS];
+
+    // A new size learns the background again instead of reporting everything as changed
+    motion_detector_init(&d, &config);
+    memset(frame, 100, sizeof(frame));
+    motion_detector_update(&d, frame, 40, 30, &r);
+    CHECK(!r.motion && r.event == MOTION_EVENT_NONE);
+    memset(frame, 200, sizeof(frame));
+    motion_detector_update(&d, frame, 80, 60, &r);
+    CHECK(!r.motion && r.event == MOTION_EVENT_NONE);
+    // Over the maximum size, ignored
+    motion_detector_update(&d, frame, 81, 60, &r);
+    CHECK(!r.motion && r.changed_permille == 0);
+
+    // Changed cells of a box in the top left
+    draw_box(frame, 0, 0, 10, 10, 20);
+    motion_detector_update(&d, frame, 80, 60, &r);
+    CHECK(r.event == MOTION_EVENT_START);
+    CHECK(r.cells[0] == 0x0003 && r.cells[1] == 0x0003 && r.cells[2] == 0);
+
+    // All masked, nothing to see
+    memset(config.mask, 0xFF, sizeof(config.mask));
+    motion_detector_set_config(&d, &config);
+    draw_box(frame, 40, 30, 20, 20, 20);
+    motion_detector_update(&d, frame, 80, 60, &r);
+    CHECK(r.changed_permille == 0);
+
+    for (int i = 0; i < MOTION_GRID_ROWS; i++) {
+        cells[i] = i * 0x1111;
+    }
+    motion_mask_to_hex(cells, hex);
+    CHECK(strncmp(hex, "00001111", 8) == 0 && strlen(hex) == MOTION_MASK_HEX_LEN);
+    memset(config.mask, 0, sizeof(config.mask));
+    CHECK(motion_mask_from_hex(hex, config.mask) && memcmp(config.mask, cells, sizeof(cells)) == 0);
+    CHECK(motion_mask_from_hex("", config.mask) && config.mask[5] == 0);
+    CHECK(!motion_mask_from_hex("123", config.mask));
+    hex[3] = 'x';
+    CHECK(!motion_mask_from_hex(hex, config.mask));
+    printf("detector                  OK\n");
+    return 0;
+}
+
+static uint8_t *read_pgm(const char *path, int *width, int *height) {
+    FILE *f = fopen(path, "rb");
+    int maxval;
+    uint8_t *data = NULL;
+    if (!f) {
+        return NULL;
+    }
+    if (fscanf(f, "P5 %d %d %d", width, height, &maxval) == 3 && maxval == 255 && fgetc(f) != EOF) {
+        data = malloc((size_t)*width * *height);
+        if (data && fread(data, 1, (size_t)*width * *height, f) != (size_t)*width * *height) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+// Box filters a frame down to thumbnail size, the way camera_motion.c does
+static void downscale(const uint8_t *src, int width, int height, uint8_t *out, uint16_t *tw, uint16_t *th) {
+    int factor = (width + W - 1) / W;
+    int factor_h = (height + H - 1) / H;
+    factor = factor_h > factor ? factor_h : factor;
+    *tw = width / factor;
+    *th = height / factor;
+    for (int y = 0; y < *th; y++) {
+        for (int x = 0; x < *tw; x++) {
+            uint32_t sum = 0;
+            for (int dy = 0; dy < factor; dy++) {
+                for (int dx = 0; dx < factor; dx++) {
+                    sum += src[(y * factor + dy) * width + x * factor + dx];
+                }
+            }
+            out[y * *tw + x] = sum / (factor * factor);
+        }
+    }
+}
+
+static int replay(int count, char **paths) {
+    static motion_detector_t d;
+    motion_config_t config = MOTION_CONFIG_DEFAULT();
+    uint8_t thumb[W * H];
+    motion_result_t r;
+    int64_t last_sent_us = 0;
+    uint32_t sent = 0;
+
+    motion_detector_init(&d, &config);
+    for (int i = 0; i < count; i++) {
+        int width, height;
+        uint16_t tw, th;
+        uint8_t *frame = read_pgm(paths[i], &width, &height);
+        if (!frame) {
+            printf("%s: not a binary PGM\n", paths[i]);
+            return 1;
+        }
+        downscale(frame, width, height, thumb, &tw, &th);
+        free(frame);
+        motion_detector_update(&d, thumb, tw, th, &r);
+        bool send = motion_should_send(&config, &r, (int64_t)config.keepalive_ms * 1000 + (int64_t)i * FRAME_US,
+                                       &last_sent_us);
+        sent += send;
+        printf("%5d %-40s changed %5.1f%% shift %4d %s%s%s\n", i, paths[i], r.changed_permille / 10.0,
+               r.brightness_shift, r.motion ? "motion" : "      ",
+               r.event == MOTION_EVENT_START ? " start" : r.event == MOTION_EVENT_END ? " end" : "",
+               send ? " sent" : "");
+    }
+    printf("%u of %d frames sent\n", sent, count);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        return replay(argc - 1, argv + 1);
+    }
+    int fail = 0;
+    fail |= test_detector();
+    fail |= test_scenes();
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
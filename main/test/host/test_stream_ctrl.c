@@ -0,0 +1,355 @@
+// Adaptive stream controller against a throttled local socket.
+//
+// A receiver thread reads a TCP loopback connection through a token bucket whose rate follows
+// a Wi-Fi scenario: good link, weak link, bad link, good again. The sender produces frames at
+// the rate and byte budget of the controller's current level and publishes them like the
+// MQTT client does at QoS 0, with blocking writes that hold the stream task up. The receiver
+// measures the delay of every frame from capture to arrival, the figure the controller has to
+// keep under its target.
+//
+// The simulated clock runs SPEED times faster than the real one, rates are scaled to match.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stream_ctrl.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); return 1; } } while (0)
+
+#define SPEED 40
+#define HEADER_SIZE 12          // frame length, capture time
+#define MAX_SAMPLES 8192
+
+// Same ladder as camera.c, frame sizes only label the levels here
+static const stream_ctrl_level_t levels[] = {
+    { 640, 5, 32 * 1024 },
+    { 640, 5, 20 * 1024 },
+    { 640, 3, 16 * 1024 },
+    { 400, 3, 10 * 1024 },
+    { 320, 2, 6 * 1024 },
+    { 320, 1, 4 * 1024 },
+    { 160, 1, 2 * 1024 },
+};
+#define LEVEL_COUNT (sizeof(levels) / sizeof(levels[0]))
+
+typedef struct {
+    int64_t until_us;           // simulated time the phase ends
+    uint32_t rate;              // link bytes per second
+    int8_t rssi;
+    const char *name;
+} phase_t;
+
+static const phase_t scenario[] = {
+    { 20000000, 250000, -55, "good 2 Mbit/s" },
+    { 80000000, 31000, -76, "weak 250 kbit/s" },
+    { 130000000, 12500, -84, "bad 100 kbit/s" },
+    { 260000000, 250000, -55, "good again" },
+};
+#define PHASE_COUNT (sizeof(scenario) / sizeof(scenario[0]))
+
+typedef struct {
+    int64_t at_us;
+    uint32_t delay_us;
+} arrival_t;
+
+typedef struct {
+    int fd;
+    arrival_t arrivals[MAX_SAMPLES];
+    volatile size_t arrival_count;
+} receiver_t;
+
+static struct timespec start_time;
+
+static int64_t sim_now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t real_us = (now.tv_sec - start_time.tv_sec) * 1000000LL + (now.tv_nsec - start_time.tv_nsec) / 1000;
+    return real_us * SPEED;
+}
+
+static const phase_t *phase_at(int64_t us) {
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+        if (us < scenario[i].until_us) {
+            return &scenario[i];
+        }
+    }
+    return &scenario[PHASE_COUNT - 1];
+}
+
+static void sleep_real_us(long us) {
+    struct timespec ts = { 0, us * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    memcpy(p, &v, 4);
+}
+
+static void *receiver_task(void *arg) {
+    receiver_t *rx = arg;
+    static uint8_t buf[64 * 1024];
+    uint8_t header[HEADER_SIZE];
+    size_t header_len = 0;
+    uint32_t remaining = 0;
+    int64_t capture_us = 0;
+    double tokens = 0;
+    int64_t last_us = sim_now_us();
+
+    while (1) {
+        int64_t now = sim_now_us();
+        uint32_t rate = phase_at(now)->rate;
+        tokens += (double)rate * (now - last_us) / 1000000;
+        last_us = now;
+        // Bursts of 100 ms at most, like the radio's own buffering
+        if (tokens > rate / 10) {
+            tokens = rate / 10;
+        }
+        if (tokens < 512) {
+            sleep_real_us((512 - tokens) * 1000000 / rate / SPEED + 1);
+            continue;
+        }
+        size_t want = tokens < sizeof(buf) ? (size_t)tokens : sizeof(buf);
+        ssize_t n = recv(rx->fd, buf, want, 0);
+        if (n <= 0) {
+            break;
+        }
+        now = sim_now_us();
+        tokens -= n;
+        for (ssize_t i = 0; i < n;) {
+            if (header_len < HEADER_SIZE) {
+                header[header_len++] = buf[i++];
+                if (header_len == HEADER_SIZE) {
+                    memcpy(&remaining, header, 4);
+                    memcpy(&capture_us, header + 4, 8);
+                }
+                continue;
+            }
+            uint32_t take = (uint32_t)(n - i) < remaining ? (uint32_t)(n - i) : remaining;
+            remaining -= take;
+            i += take;
+            if (!remaining) {
+                if (rx->arrival_count < MAX_SAMPLES) {
+                    rx->arrivals[rx->arrival_count].at_us = now;
+                    rx->arrivals[rx->arrival_count].delay_us = now - capture_us;
+                    rx->arrival_count++;
+                }
+                header_len = 0;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int connect_pair(int *tx, int *rx) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    int small = 1;
+    // As little kernel buffering as Linux allows, lwIP on the device buffers a few KB too
+    setsockopt(listener, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) || listen(listener, 1)
+        || getsockname(listener, (struct sockaddr *)&addr, &len)) {
+        return -1;
+    }
+    *tx = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(*tx, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+    setsockopt(*tx, IPPROTO_TCP, TCP_NODELAY, &small, sizeof(small));
+    if (connect(*tx, (struct sockaddr *)&addr, sizeof(addr))) {
+        return -1;
+    }
+    *rx = accept(listener, NULL, NULL);
+    close(listener);
+    return *rx < 0 ? -1 : 0;
+}
+
+typedef struct {
+    const char *name;
+    bool adaptive;
+    int64_t duration_us;
+    // Results per phase
+    uint32_t p95_delay_ms[PHASE_COUNT];
+    uint32_t max_delay_ms[PHASE_COUNT];
+    size_t best_level[PHASE_COUNT];     // while settled
+    size_t worst_level[PHASE_COUNT];
+    size_t final_level;
+    uint32_t frames;
+    stream_ctrl_stats_t stats;
+} run_t;
+
+static uint32_t rng = 1;
+
+static uint32_t frame_size(uint32_t budget) {
+    // The JPEG rate controller keeps frames within about 15% of the budget
+    rng = rng * 1103515245 + 12345;
+    return budget * (85 + (rng >> 16) % 31) / 100;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void phase_results(run_t *run, const receiver_t *rx) {
+    static uint32_t delays[MAX_SAMPLES];
+    int64_t from = 0;
+    for (size_t p = 0; p < PHASE_COUNT; p++) {
+        // The controller gets 15 s to settle after a change of the link
+        int64_t settled = from + 15000000;
+        size_t n = 0;
+        for (size_t i = 0; i < rx->arrival_count; i++) {
+            if (rx->arrivals[i].at_us >= settled && rx->arrivals[i].at_us < scenario[p].until_us) {
+                delays[n++] = rx->arrivals[i].delay_us;
+            }
+        }
+        if (n) {
+            qsort(delays, n, sizeof(delays[0]), cmp_u32);
+            run->p95_delay_ms[p] = delays[n * 95 / 100] / 1000;
+            run->max_delay_ms[p] = delays[n - 1] / 1000;
+        }
+        from = scenario[p].until_us;
+    }
+}
+
+static int run_stream(run_t *run) {
+    static uint8_t payload[64 * 1024];
+    static receiver_t rx;
+    uint64_t sent = 0;
+    pthread_t rx_thread;
+    int tx_fd;
+
+    stream_ctrl_t ctrl;
+    stream_ctrl_config_t config = STREAM_CTRL_CONFIG_DEFAULT(levels, LEVEL_COUNT);
+    stream_ctrl_init(&ctrl, &config);
+
+    memset(&rx, 0, sizeof(rx));
+    CHECK(connect_pair(&tx_fd, &rx.fd) == 0);
+    rng = 1;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    pthread_create(&rx_thread, NULL, receiver_task, &rx);
+
+    for (size_t p = 0; p < PHASE_COUNT; p++) {
+        run->best_level[p] = LEVEL_COUNT;
+        run->worst_level[p] = 0;
+    }
+    int64_t next_frame_us = 0;
+    while (1) {
+        int64_t now = sim_now_us();
+        if (now >= run->duration_us) {
+            break;
+        }
+        const stream_ctrl_level_t *level = stream_ctrl_level(&ctrl);
+        const phase_t *phase = phase_at(now);
+        size_t p = phase - scenario;
+        if (now >= (p ? scenario[p - 1].until_us : 0) + 15000000) {
+            run->best_level[p] = ctrl.level < run->best_level[p] ? ctrl.level : run->best_level[p];
+            run->worst_level[p] = ctrl.level > run->worst_level[p] ? ctrl.level : run->worst_level[p];
+        }
+        if (now < next_frame_us) {
+            sleep_real_us((next_frame_us - now) / SPEED + 1);
+            continue;
+        }
+
+        // Like the broker: a late stream task gets the newest frame, not a backlog
+        next_frame_us += 1000000 / level->fps;
+        if (next_frame_us < now) {
+            next_frame_us = now + 1000000 / level->fps;
+        }
+        uint32_t bytes = frame_size(level->frame_budget);
+        uint8_t header[HEADER_SIZE];
+        put_u32(header, bytes);
+        memcpy(header + 4, &now, 8);
+        stream_ctrl_sample_t sample = { .frame_bytes = bytes, .rssi = phase->rssi };
+
+        // The stream task is held up until the socket took the whole frame
+        int64_t start = sim_now_us();
+        size_t off = 0;
+        while (off < HEADER_SIZE + bytes) {
+            const uint8_t *src = off < HEADER_SIZE ? header + off : payload + off - HEADER_SIZE;
+            size_t len = off < HEADER_SIZE ? HEADER_SIZE - off : HEADER_SIZE + bytes - off;
+            ssize_t n = send(tx_fd, src, len, 0);
+            if (n < 0) {
+                break;
+            }
+            off += n;
+        }
+        sent += off;
+        run->frames++;
+        sample.publish_us = sim_now_us() - start;
+        sample.now_us = sim_now_us();
+        sample.sent_bytes = sent;
+        if (run->adaptive) {
+            stream_ctrl_update(&ctrl, &sample);
+        }
+    }
+
+    // Unblocks the receiver
+    shutdown(tx_fd, SHUT_RDWR);
+    shutdown(rx.fd, SHUT_RDWR);
+    pthread_join(rx_thread, NULL);
+    close(tx_fd);
+    close(rx.fd);
+    run->final_level = ctrl.level;
+    run->stats = ctrl.stats;
+    phase_results(run, &rx);
+    return 0;
+}
+
+static void print_run(const run_t *run) {
+    printf("%s: %u frames, %u down, %u up, %u failed probes\n", run->name,
+           run->frames, run->stats.steps_down, run->stats.steps_up, run->stats.failed_probes);
+    for (size_t p = 0; p < PHASE_COUNT; p++) {
+        if ((p ? scenario[p - 1].until_us : 0) >= run->duration_us) {
+            break;
+        }
+        printf("  %-16s levels %zu-%zu  delay p95 %6u ms  max %6u ms\n", scenario[p].name,
+               run->best_level[p], run->worst_level[p], run->p95_delay_ms[p], run->max_delay_ms[p]);
+    }
+}
+
+static int check_adaptive(const run_t *run) {
+    const uint32_t target_ms = 1000;
+    for (size_t p = 0; p < PHASE_COUNT; p++) {
+        // Loopback and radio buffering come on top of what the controller sees
+        CHECK(run->p95_delay_ms[p] < 2 * target_ms);
+    }
+    // Full quality on the good link, and back to it after the bad one
+    CHECK(run->best_level[0] == 0 && run->worst_level[0] == 0);
+    CHECK(run->final_level == 0);
+    // The bad link can not carry more than level 4, and the weak signal keeps probes off
+    CHECK(run->best_level[2] >= 4);
+    CHECK(run->stats.steps_down >= 3);
+    return 0;
+}
+
+int main(void) {
+    int fail = 0;
+    int64_t full = scenario[PHASE_COUNT - 1].until_us;
+
+    run_t fixed = { .name = "fixed level 0", .adaptive = false, .duration_us = scenario[1].until_us };
+    run_t adaptive = { .name = "adaptive", .adaptive = true, .duration_us = full };
+
+    printf("simulated %u s at %ux, target delay 1000 ms\n", (unsigned)(full / 1000000), SPEED);
+    fail |= run_stream(&fixed);
+    print_run(&fixed);
+    // Without the controller every frame on the weak link takes longer than the target to get out
+    if (!fail && fixed.p95_delay_ms[1] < 1000) {
+        printf("%s:%d: fixed level kept up with the weak link\n", __FILE__, __LINE__);
+        fail = 1;
+    }
+
+    fail |= run_stream(&adaptive);
+    print_run(&adaptive);
+    fail |= check_adaptive(&adaptive);
+
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
@@ -5,14 +5,12 @@
 
 #include "esp_http_server.h"
 #include "settings.h"
-#include "camera.h"
 #include "status.h"
 #include "wifi.h"
 #include "esp_spiffs.h"
 #include "esp_log.h"
-#include "esp_camera.h"
-#include "esp_timer.h"
 #include "motors.h"
+#include "web_stream.h"
 
 static const char *TAG = "WEB_SERVER";
 
@@ -243,81 +241,6 @@ esp_err_t init_fs(void) {
   return ESP_OK;
 }
 
-#define PART_BOUNDARY "123456789000000000000987654321"
-static const char* _STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
-static const char* _STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
-static const char* _STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
-
-esp_err_t streaming_camera_handler(httpd_req_t *req){
-    camera_fb_t * fb = NULL;
-    esp_err_t res = ESP_OK;
-    size_t _jpg_buf_len;
-    uint8_t * _jpg_buf;
-    char * part_buf[64];
-    static int64_t last_frame = 0;
-    if(!last_frame) {
-        last_frame = esp_timer_get_time();
-    }
-
-    res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
-    if(res != ESP_OK){
-        return res;
-    }
-
-    camera_flash(0);
-
-    while(true){
-        fb = esp_camera_fb_get();
-        if (!fb) {
-            ESP_LOGE(TAG, "Camera capture failed");
-            res = ESP_FAIL;
-            break;
-        }
-        if(fb->format != PIXFORMAT_JPEG){
-            bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-            if(!jpeg_converted){
-                ESP_LOGE(TAG, "JPEG compression failed");
-                esp_camera_fb_return(fb);
-                res = ESP_FAIL;
-            }
-            ESP_LOGI(TAG, "MJPG: jpeg_converted");
-        } else {
-            _jpg_buf_len = fb->len;
-            _jpg_buf = fb->buf;
-        }
-
-        if(res == ESP_OK){
-            res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
-        }
-        if(res == ESP_OK){
-            size_t hlen = snprintf((char *)part_buf, 64, _STREAM_PART, _jpg_buf_len);
-
-            res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
-        }
-        if(res == ESP_OK){
-            res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
-        }
-        if(fb->format != PIXFORMAT_JPEG){
-            free(_jpg_buf);
-        }
-        esp_camera_fb_return(fb);
-        if(res != ESP_OK){
-            break;
-        }
-        int64_t fr_end = esp_timer_get_time();
-        int64_t frame_time = fr_end - last_frame;
-        last_frame = fr_end;
-        frame_time /= 1000;
-        ESP_LOGI(TAG, "MJPG: %luKB %lums (%.1ffps)",
-                 (uint32_t)(_jpg_buf_len/1024),
-                 (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time);
-    }
-
-    last_frame = 0;
-    return res;
-}
-
-
 esp_err_t init_web() {
   esp_err_t err = init_fs();
   if (err != ESP_OK) {
@@ -332,6 +255,13 @@ esp_err_t init_web() {
   ESP_LOGI(TAG, "Starting HTTP Server");
   httpd_start(&server, &config);
 
+  // Camera viewers are served by a task of their own, not by the httpd worker
+  err = web_stream_init(server);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Camera stream task start failed");
+    return err;
+  }
+
   httpd_uri_t wifi_list_get_uri = {
       .uri = "/wifi/networks",
       .method = HTTP_GET,
@@ -363,7 +293,7 @@ esp_err_t init_web() {
   httpd_uri_t camera_uri = {
         .uri = "/camera",
         .method = HTTP_GET,
-        .handler = streaming_camera_handler,
+        .handler = web_stream_handler,
         .user_ctx = NULL };
   httpd_register_uri_handler(server, &camera_uri);
 
@@ -0,0 +1,385 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lwip/sockets.h"
+
+#include "web_stream.h"
+#include "camera.h"
+#include "camera_motion.h"
+#include "esp_camera.h"
+#include "esp_camera_broker.h"
+#include "img_converters.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+static const char *TAG = "WEB_STREAM";
+
+#define PART_BOUNDARY "123456789000000000000987654321"
+// The stream has no length and no chunked encoding, it ends when the connection closes
+static const char *STREAM_RESPONSE = "HTTP/1.1 200 OK\r\n"
+                                     "Content-Type: multipart/x-mixed-replace;boundary=" PART_BOUNDARY "\r\n"
+                                     "Cache-Control: no-cache\r\n"
+                                     "\r\n";
+static const char *STREAM_PART = "\r\n--" PART_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
+
+// Viewers streamed to at the same time, each keeps an httpd socket open
+#define WEB_STREAM_MAX_CLIENTS 4
+// Frames held for the viewers: the newest one and the one slow viewers are still sending.
+// They are not available to the driver meanwhile, see esp_camera_broker.h
+#define WEB_STREAM_SLOTS 2
+// A viewer that takes no bytes for this long is disconnected
+#define WEB_STREAM_STALL_US (10 * 1000000)
+// How long the task waits for a writable socket before it looks for a new frame
+#define WEB_STREAM_POLL_MS 10
+// How long the task waits for a frame while no viewer has anything to send
+#define WEB_STREAM_TAKE_TIMEOUT (100 / portTICK_PERIOD_MS)
+// Without a frame for this long the camera is considered failed and the viewers are dropped
+#define WEB_STREAM_CAPTURE_TIMEOUT_US (4 * 1000000)
+// Frames between two statistics log lines
+#define WEB_STREAM_STATS_INTERVAL 100
+
+typedef struct {
+  camera_fb_t *fb;                // NULL when the slot is free
+  jpg_chunked_t *jpg;             // converted frame, NULL when the camera sends JPEG
+  jpg_chunk_t fb_chunk;
+  const jpg_chunk_t *chunks;
+  size_t chunk_count;
+  size_t len;                     // JPEG bytes
+  char part[128];                 // boundary and part header in front of the frame
+  size_t part_len;
+  uint32_t seq;
+  uint8_t refs;                   // viewers in the middle of the frame
+} web_stream_slot_t;
+
+typedef struct {
+  bool used;
+  bool closing;                   // not served: the socket failed and httpd closes the session,
+                                  // or the handler is still sending the response head
+  int fd;
+  web_stream_slot_t *slot;        // frame being sent, NULL when waiting for the next one
+  size_t segment;                 // 0 the part header, then the JPEG chunks
+  size_t offset;                  // bytes of the segment sent
+  uint32_t last_seq;              // last frame started
+  int64_t progress_us;            // last time the socket took bytes
+  uint32_t frames;
+  uint32_t skipped;
+} web_stream_client_t;
+
+static httpd_handle_t httpd;
+static TaskHandle_t stream_task;
+// Guards the clients and the slot references, httpd adds and removes clients from its task
+static SemaphoreHandle_t stream_lock;
+static web_stream_client_t clients[WEB_STREAM_MAX_CLIENTS];
+static web_stream_slot_t slots[WEB_STREAM_SLOTS];
+static web_stream_slot_t *newest;
+static uint32_t frame_seq;
+
+static void web_stream_slot_release(web_stream_slot_t *s) {
+  if (s->jpg) {
+    jpg_chunked_free(s->jpg);
+  }
+  if (s->fb) {
+    esp_camera_broker_release(s->fb);
+  }
+  if (newest == s) {
+    newest = NULL;
+  }
+  memset(s, 0, sizeof(*s));
+}
+
+// The slot the next frame goes to, one no viewer is on. It is released once that frame is
+// there: replacing the newest frame before a slow viewer started it is how the viewer skips
+// frames. Called with the lock held.
+static web_stream_slot_t *web_stream_free_slot(void) {
+  for (size_t i = 0; i < WEB_STREAM_SLOTS; i++) {
+    if (!slots[i].fb) {
+      return &slots[i];
+    }
+  }
+  for (size_t i = 0; i < WEB_STREAM_SLOTS; i++) {
+    if (!slots[i].refs && &slots[i] != newest) {
+      return &slots[i];
+    }
+  }
+  return newest && !newest->refs ? newest : NULL;
+}
+
+static bool web_stream_slot_fill(web_stream_slot_t *s, camera_fb_t *fb) {
+  s->fb = fb;
+  if (fb->format != PIXFORMAT_JPEG) {
+    // Chunks are sent as they are, no need to flatten the JPEG
+    if (!frame2jpg_chunked(fb, 80, &s->jpg)) {
+      ESP_LOGE(TAG, "JPEG compression failed");
+      web_stream_slot_release(s);
+      return false;
+    }
+    s->chunks = jpg_chunked_view(s->jpg, &s->chunk_count);
+    s->len = jpg_chunked_len(s->jpg);
+  } else {
+    s->fb_chunk.buf = fb->buf;
+    s->fb_chunk.len = fb->len;
+    s->chunks = &s->fb_chunk;
+    s->chunk_count = 1;
+    s->len = fb->len;
+  }
+  s->part_len = snprintf(s->part, sizeof(s->part), STREAM_PART, s->len);
+  s->seq = ++frame_seq;
+  return true;
+}
+
+// Starts the newest frame if the viewer has not had it. Called with the lock held.
+static void web_stream_client_start(web_stream_client_t *c) {
+  if (!newest || newest->seq == c->last_seq) {
+    return;
+  }
+  if (c->last_seq) {
+    c->skipped += newest->seq - c->last_seq - 1;
+  }
+  c->slot = newest;
+  c->slot->refs++;
+  c->last_seq = newest->seq;
+  c->segment = 0;
+  c->offset = 0;
+  // Frames can be minutes apart while the motion gate holds them back
+  c->progress_us = esp_timer_get_time();
+}
+
+// Gives up on the viewer, httpd closes the session and calls web_stream_client_closed().
+// Called with the lock held.
+static void web_stream_client_drop(web_stream_client_t *c) {
+  if (c->slot) {
+    c->slot->refs--;
+    c->slot = NULL;
+  }
+  c->closing = true;
+  httpd_sess_trigger_close(httpd, c->fd);
+}
+
+// Writes as much as the socket takes without blocking. Called with the lock held.
+static void web_stream_client_send(web_stream_client_t *c, int64_t now) {
+  while (c->slot) {
+    const web_stream_slot_t *s = c->slot;
+    const uint8_t *data;
+    size_t len;
+    if (c->segment == 0) {
+      data = (const uint8_t *)s->part;
+      len = s->part_len;
+    } else {
+      data = s->chunks[c->segment - 1].buf;
+      len = s->chunks[c->segment - 1].len;
+    }
+
+    ssize_t n = send(c->fd, data + c->offset, len - c->offset, MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        ESP_LOGI(TAG, "Viewer %d: send failed, errno %d", c->fd, errno);
+        web_stream_client_drop(c);
+      }
+      return;
+    }
+    c->progress_us = now;
+    c->offset += n;
+    if (c->offset < len) {
+      continue;
+    }
+    c->offset = 0;
+    if (++c->segment > s->chunk_count) {
+      c->slot->refs--;
+      c->slot = NULL;
+      c->frames++;
+      web_stream_client_start(c);
+    }
+  }
+}
+
+static void web_stream_client_closed(void *ctx) {
+  web_stream_client_t *c = ctx;
+  xSemaphoreTake(stream_lock, portMAX_DELAY);
+  ESP_LOGI(TAG, "Viewer %d left: %lu frames sent, %lu skipped", c->fd, c->frames, c->skipped);
+  if (c->slot) {
+    c->slot->refs--;
+  }
+  memset(c, 0, sizeof(*c));
+  xSemaphoreGive(stream_lock);
+}
+
+// Drops every viewer and frame, when the camera failed or nobody watches
+static void web_stream_stop(camera_broker_sub_t *sub) {
+  xSemaphoreTake(stream_lock, portMAX_DELAY);
+  for (size_t i = 0; i < WEB_STREAM_MAX_CLIENTS; i++) {
+    if (clients[i].used && !clients[i].closing) {
+      web_stream_client_drop(&clients[i]);
+    }
+  }
+  for (size_t i = 0; i < WEB_STREAM_SLOTS; i++) {
+    web_stream_slot_release(&slots[i]);
+  }
+  xSemaphoreGive(stream_lock);
+  if (*sub) {
+    esp_camera_broker_unsubscribe(*sub);
+    *sub = NULL;
+  }
+}
+
+static void web_stream_task(void *pvParameters) {
+  camera_broker_sub_t sub = NULL;
+  int64_t last_sent_us = 0;
+  int64_t last_frame_us = 0;
+  int64_t stats_start_us = 0;
+  bool busy = false;
+
+  while (1) {
+    xSemaphoreTake(stream_lock, portMAX_DELAY);
+    size_t viewers = 0;
+    for (size_t i = 0; i < WEB_STREAM_MAX_CLIENTS; i++) {
+      viewers += clients[i].used && !clients[i].closing;
+    }
+    web_stream_slot_t *slot = viewers ? web_stream_free_slot() : NULL;
+    xSemaphoreGive(stream_lock);
+
+    if (!viewers) {
+      if (sub) {
+        // Don't hold frames back from the other subscribers while nobody watches
+        web_stream_stop(&sub);
+      }
+      busy = false;
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    if (!sub) {
+      sub = esp_camera_broker_subscribe(NULL);
+      if (!sub) {
+        ESP_LOGE(TAG, "Camera stream subscription failed");
+        web_stream_stop(&sub);
+        continue;
+      }
+      last_sent_us = 0;
+      last_frame_us = stats_start_us = esp_timer_get_time();
+    }
+
+    // With bytes waiting to go out only look whether a frame is there, the sockets come first
+    if (slot) {
+      camera_fb_t *fb = esp_camera_broker_take(sub, busy ? 0 : WEB_STREAM_TAKE_TIMEOUT);
+      int64_t now = esp_timer_get_time();
+      if (!fb) {
+        if (now - last_frame_us > WEB_STREAM_CAPTURE_TIMEOUT_US) {
+          ESP_LOGE(TAG, "Camera capture failed");
+          web_stream_stop(&sub);
+          continue;
+        }
+      } else if (!camera_motion_pass(fb, &last_sent_us)) {
+        last_frame_us = now;
+        esp_camera_broker_release(fb);
+      } else {
+        last_frame_us = now;
+        // Only this task starts viewers on a frame, nobody got on the slot meanwhile
+        xSemaphoreTake(stream_lock, portMAX_DELAY);
+        web_stream_slot_release(slot);
+        xSemaphoreGive(stream_lock);
+        if (web_stream_slot_fill(slot, fb)) {
+          xSemaphoreTake(stream_lock, portMAX_DELAY);
+          newest = slot;
+          xSemaphoreGive(stream_lock);
+          if (slot->seq % WEB_STREAM_STATS_INTERVAL == 0) {
+            ESP_LOGI(TAG, "MJPG: %u viewers, %luKB frames, %.1ffps", viewers, (uint32_t)(slot->len / 1024),
+                     WEB_STREAM_STATS_INTERVAL * 1000000.0 / (now - stats_start_us));
+            stats_start_us = now;
+          }
+        }
+      }
+    }
+
+    fd_set writable;
+    FD_ZERO(&writable);
+    int max_fd = -1;
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(stream_lock, portMAX_DELAY);
+    for (size_t i = 0; i < WEB_STREAM_MAX_CLIENTS; i++) {
+      web_stream_client_t *c = &clients[i];
+      if (!c->used || c->closing) {
+        continue;
+      }
+      // Viewers between frames get on the newest one, one that joined gets the last frame right away
+      if (!c->slot) {
+        web_stream_client_start(c);
+      }
+      web_stream_client_send(c, now);
+      if (c->slot && now - c->progress_us > WEB_STREAM_STALL_US) {
+        ESP_LOGW(TAG, "Viewer %d stalled, disconnecting", c->fd);
+        web_stream_client_drop(c);
+      }
+      if (c->slot) {
+        FD_SET(c->fd, &writable);
+        max_fd = c->fd > max_fd ? c->fd : max_fd;
+      }
+    }
+    xSemaphoreGive(stream_lock);
+
+    busy = max_fd >= 0;
+    if (busy) {
+      struct timeval timeout = { .tv_sec = 0, .tv_usec = WEB_STREAM_POLL_MS * 1000 };
+      select(max_fd + 1, NULL, &writable, NULL, &timeout);
+    }
+  }
+}
+
+esp_err_t web_stream_handler(httpd_req_t *req) {
+  int fd = httpd_req_to_sockfd(req);
+  web_stream_client_t *c = NULL;
+
+  // Only the claim of a client is under the lock, the task keeps sending to the other viewers
+  xSemaphoreTake(stream_lock, portMAX_DELAY);
+  for (size_t i = 0; i < WEB_STREAM_MAX_CLIENTS && !c; i++) {
+    if (!clients[i].used) {
+      c = &clients[i];
+      memset(c, 0, sizeof(*c));
+      c->used = true;
+      c->closing = true;
+    }
+  }
+  xSemaphoreGive(stream_lock);
+  if (!c) {
+    ESP_LOGW(TAG, "Viewer %d turned away, %d already watching", fd, WEB_STREAM_MAX_CLIENTS);
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "10");
+    return httpd_resp_sendstr(req, "Too many viewers");
+  }
+  // The response head goes out before the task can see the viewer
+  int sent = httpd_send(req, STREAM_RESPONSE, strlen(STREAM_RESPONSE));
+  xSemaphoreTake(stream_lock, portMAX_DELAY);
+  if (sent < 0) {
+    memset(c, 0, sizeof(*c));
+    xSemaphoreGive(stream_lock);
+    return ESP_FAIL;
+  }
+  c->fd = fd;
+  c->progress_us = esp_timer_get_time();
+  c->closing = false;
+  xSemaphoreGive(stream_lock);
+
+  // The session stays open after the handler returns, httpd frees the context when it closes
+  req->sess_ctx = c;
+  req->free_ctx = web_stream_client_closed;
+  ESP_LOGI(TAG, "Viewer %d joined", fd);
+
+  camera_flash(0);
+  xTaskNotifyGive(stream_task);
+  return ESP_OK;
+}
+
+esp_err_t web_stream_init(httpd_handle_t server) {
+  httpd = server;
+  stream_lock = xSemaphoreCreateMutex();
+  if (!stream_lock) {
+    return ESP_ERR_NO_MEM;
+  }
+  if (xTaskCreatePinnedToCore(&web_stream_task, "web_stream_task", 4096, NULL, 5, &stream_task, 1) != pdPASS) {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// MJPEG stream of the camera for several HTTP viewers at once.
+//
+// One task takes the frames from the broker, runs the motion gate and the JPEG conversion once
+// per frame and writes every frame to all viewers with non-blocking sends. A viewer whose socket
+// can not keep up finishes the frame it is on and then skips to the newest one, the others are
+// not held up. The httpd handler only answers the request and hands the socket to the task, no
+// httpd worker stays busy while a viewer watches.
+
+esp_err_t web_stream_init(httpd_handle_t server);
+
+// GET handler of the stream URI
+esp_err_t web_stream_handler(httpd_req_t *req);